@@ -0,0 +1,19 @@
+#!/bin/bash
+# kernels.sh <Compiler> <primes.src> [n]
+# Sums the primes up to n (the one in primes.src by default) by trial division
+# with the filter kernels and element at a time (--no-kernels), and prints how
+# long each took. Element at a time runs out of evaluation steps past 50000 or so.
+compiler=$1
+program=$2
+if [ -n "$3" ]; then
+    program=$(mktemp --suffix .src)
+    trap 'rm -f "$program"' EXIT
+    sed "s/primeSum([0-9]*)/primeSum($3)/" "$2" > "$program"
+fi
+
+for flags in "" --no-kernels; do
+    start=$(date +%s%N)
+    output=$("$compiler" --eval $flags "$program" 2>&1 | grep -v '^end$')
+    ms=$((($(date +%s%N) - start) / 1000000))
+    printf '%-14s %-26s %d.%03d s\n' "${flags:-kernels}" "$output" $((ms / 1000)) $((ms % 1000))
+done
@@ -0,0 +1,79 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+namespace Compiler {
+
+// Bump-pointer allocator, everything in it is freed at once by release().
+// Destructors are never run, so only put objects in it whose members are
+// trivial or live in the same arena (see ArenaAllocator).
+class Arena
+{
+    public:
+        Arena(size_t blockSize = 64 * 1024);
+        ~Arena() = default;
+
+        Arena(const Arena&) = delete;
+        Arena& operator=(const Arena&) = delete;
+
+        void* allocate(size_t size ,size_t align);
+
+        template <typename T ,typename... Args>
+        T* make(Args&&... args)
+        {
+            return new (allocate(sizeof(T) ,alignof(T))) T(std::forward<Args>(args)...);
+        }
+
+        // rewinds to the first block, blocks are kept for reuse
+        void release();
+
+        size_t allocationCount() const { return allocationCount_; }
+        size_t bytesReserved() const;
+        size_t bytesUsed() const; // since the last release()
+
+    private:
+        struct Block
+        {
+            std::unique_ptr<char[]> data;
+            size_t size;
+        };
+
+        const size_t kBlockSize_;
+
+        std::vector<Block> blocks_ {};
+        size_t currentBlock_ = 0;
+        size_t used_ = 0; // in the current block
+
+        size_t allocationCount_ = 0;
+};
+
+// For containers owned by arena allocated objects.
+template <typename T>
+struct ArenaAllocator
+{
+    using value_type = T;
+
+    Arena* arena;
+
+    ArenaAllocator(Arena& arena) : arena(&arena) {}
+
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) {}
+
+    T* allocate(size_t n) { return static_cast<T*>(arena->allocate(n * sizeof(T) ,alignof(T))); }
+    void deallocate(T*, size_t) {} // freed with the arena
+
+    template <typename U>
+    bool operator==(const ArenaAllocator<U>& other) const { return arena == other.arena; }
+    template <typename U>
+    bool operator!=(const ArenaAllocator<U>& other) const { return arena != other.arena; }
+};
+
+}; // Compiler
+
+#endif
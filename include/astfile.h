@@ -0,0 +1,135 @@
+#ifndef ASTFILE_H
+#define ASTFILE_H
+
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "flatast.h"
+#include "source.h"
+
+namespace Compiler {
+namespace AST {
+
+// What compiling one source file produced. Its statements are the roots of
+// ast, the first completeStatements of them ended with a ';' and the rest is
+// the unfinished statement that is printed after "end".
+struct CompiledAST
+{
+    FlatAST ast {};
+    uint32_t completeStatements = 0;
+};
+
+// Binary AST file (--emit-ast=bin).
+// A fixed header followed by the FlatAST arrays, each one a section at an
+// offset from the start of the file. Nothing in it is a pointer, so a mapped
+// file is read in place without fix-ups. Symbols are replaced by indices into
+// a string table in the file, so it doesnt depend on the process that wrote it.
+// Numbers are in the byte order of the writer, readers reject the other one.
+inline constexpr char kASTFileMagic[8] = {'A' ,'S' ,'T' ,'F' ,'I' ,'L' ,'E' ,'\0'};
+inline constexpr uint32_t kASTFileVersion = 3; // bump when the layout changes
+inline constexpr uint32_t kByteOrderMark = 0x01020304;
+
+enum class ASTSection : uint32_t
+{
+    Kinds,          // uint8_t NodeType per node
+    Flags,          // uint8_t FlatAST::Flags per node
+    Payloads,       // uint32_t per node, string index if FlatAST::hasSymbol(), else as in FlatAST
+    FirstChild,     // uint32_t per node, into Children, or Literal* for a Set or Literal
+    ChildCounts,    // uint32_t per node
+    Children,       // uint32_t node index
+    LiteralTags,    // uint8_t Literal_t::index()
+    LiteralValues,  // uint64_t bits of the value, string index for strings
+    Roots,          // uint32_t node index per statement
+    StringOffsets,  // uint32_t per string plus one for the end, into StringChars
+    StringChars,
+    Count
+};
+
+struct ASTFileHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder; // kByteOrderMark
+    uint64_t fileSize;
+
+    uint32_t nodeCount;
+    uint32_t childEntryCount; // size of Children
+    uint32_t literalCount;
+    uint32_t rootCount;
+    uint32_t stringCount;
+    uint32_t completeStatements;
+
+    uint64_t sections[static_cast<size_t>(ASTSection::Count)]; // offsets, 8 byte aligned
+};
+
+std::string encodeASTFile(const CompiledAST& compiled);
+void writeASTFile(const std::string& path ,std::string_view bytes); // throws std::runtime_error
+
+// Read-only view of an AST file in memory, the bytes have to outlive it.
+// open() checks every size and index once, the accessors dont check anything.
+class ASTFileView
+{
+    public:
+        static std::optional<ASTFileView> open(std::string_view bytes); // nullopt if bytes is malformed
+
+        uint32_t size() const { return header_.nodeCount; }
+        uint32_t rootCount() const { return header_.rootCount; }
+        NodeIndex root(uint32_t i) const { return load<uint32_t>(ASTSection::Roots ,i); }
+        uint32_t completeStatements() const { return header_.completeStatements; }
+        std::string_view bytes() const { return bytes_; } // the whole file
+
+        NodeType nodeKind(NodeIndex node) const { return static_cast<NodeType>(load<uint8_t>(ASTSection::Kinds ,node)); }
+        bool hasFlag(NodeIndex node ,FlatAST::Flags flag) const { return load<uint8_t>(ASTSection::Flags ,node) & flag; }
+        std::string_view nodeName(NodeIndex node) const { return string(load<uint32_t>(ASTSection::Payloads ,node)); } // if FlatAST::hasSymbol()
+        uint32_t payload(NodeIndex node) const { return load<uint32_t>(ASTSection::Payloads ,node); }
+        uint32_t nodeChildCount(NodeIndex node) const { return load<uint32_t>(ASTSection::ChildCounts ,node); }
+        NodeIndex nodeChild(NodeIndex node ,uint32_t i) const;
+
+        // elements of a Set or the value of a Literal, strings are interned when asked for
+        Literal_t literal(NodeIndex node ,uint32_t i) const;
+
+        uint32_t stringCount() const { return header_.stringCount; }
+        std::string_view string(uint32_t index) const;
+
+    private:
+        std::string_view bytes_ {};
+        ASTFileHeader header_ {};
+
+        ASTFileView(std::string_view bytes ,const ASTFileHeader& header);
+        bool isValid() const;
+
+        // memcpy instead of a cast, the section may sit at any address
+        template <typename T>
+        T load(ASTSection section ,size_t i) const
+        {
+            T value;
+            std::memcpy(&value ,bytes_.data() + header_.sections[static_cast<size_t>(section)] + i * sizeof(T) ,sizeof(T));
+            return value;
+        }
+};
+
+// An AST file mapped into memory, bytes before offset belong to whoever wrote the file.
+class ASTFile
+{
+    public:
+        ASTFile(const std::string& path ,size_t offset = 0); // throws std::runtime_error if its unreadable or malformed
+
+        const ASTFileView& view() const { return *view_; }
+        std::string_view bytes() const { return buffer_.view(); } // the whole file
+
+    private:
+        SourceBuffer buffer_;
+        std::optional<ASTFileView> view_ {};
+};
+
+} // AST
+
+// Prints the statements of an AST file with "end" where compiling printed it.
+void printASTFile(const AST::ASTFileView& file);
+
+}; // Compiler
+
+#endif
@@ -1,35 +1,63 @@
 #ifndef ASTNODE_H
 #define ASTNODE_H
 
-#include <memory>
-#include <string>
 #include <vector>
 #include <variant>
 
+#include "arena.h"
+#include "symbols.h"
+#include "token.h"
+
 namespace Compiler {
 namespace AST {
 
+// Nodes are allocated in the parser's Arena and never destroyed one by one,
+// child pointers and lists point into the same arena.
+template <typename T>
+using List = std::vector<T ,ArenaAllocator<T>>;
+
 enum class NodeType {
     Unknown,
     Empty,
     Block,
+    Set,
     VarDeclaration,
     VarDefinition,
     VarAllocation,
     VarReference,
     Expression,
+    FunctionDefinition,
+    Parameter,
+    Return,
+    Literal,
+    Lvalue,
+    Unary,
+    Binary,
+    Conditional,
+    Call,
+    Member,
+    Index,
+    Comprehension,
+    Domain,
     // ...
 };
 
+// Nodes that are an Expression, they can stand alone as a statement.
+// Operands are Rvalues, so sets and blocks can be used in expressions too.
+inline bool isExpression(NodeType type)
+{
+    return type >= NodeType::Literal && type <= NodeType::Index;
+}
+
 struct ASTNode
 {
     virtual ~ASTNode() = default;
-    virtual NodeType getType() { return NodeType::Unknown; };
+    virtual NodeType getType() const { return NodeType::Unknown; };
 };
 
 struct Empty : ASTNode
 {
-    NodeType getType() override { return NodeType::Empty; };
+    NodeType getType() const override { return NodeType::Empty; };
 };
 
 
@@ -40,26 +68,141 @@ struct Expression : Rvalue {};
 using Int_t = long long;
 using Double_t = double;
 using Char_t = char;
-using String_t = std::string;
-using Identifier_t = String_t;
+using String_t = SymbolId; // interned
+using Identifier_t = SymbolId;
 
 using Literal_t = std::variant<std::monostate,Int_t,Double_t,Char_t,String_t>;
 
-struct Value : ASTNode {};
+struct Value : Expression {};
 
 struct Literal : Value 
 {
     Literal_t value;
+
+    Literal(Literal_t value)
+        : value(value) {}
+
+    NodeType getType() const override { return NodeType::Literal; };
 };
 
 struct Lvalue : Value
 {
     Identifier_t identifier;
+
+    Lvalue(Identifier_t identifier)
+        : identifier(identifier) {}
+
+    NodeType getType() const override { return NodeType::Lvalue; };
+};
+
+// -x not x ++x --x, and x++ x-- with isPostfix
+struct Unary : Expression
+{
+    TokenType op;
+    bool isPostfix;
+    Rvalue* operand;
+
+    Unary(TokenType op ,bool isPostfix ,Rvalue* operand)
+        : op(op), isPostfix(isPostfix), operand(operand) {}
+
+    NodeType getType() const override { return NodeType::Unary; };
+};
+
+// Arithmetic, comparisons, and or xor, the assignments (= += ...) and name@Domain.
+struct Binary : Expression
+{
+    TokenType op;
+    Rvalue* lhs;
+    Rvalue* rhs;
+
+    Binary(TokenType op ,Rvalue* lhs ,Rvalue* rhs)
+        : op(op), lhs(lhs), rhs(rhs) {}
+
+    NodeType getType() const override { return NodeType::Binary; };
 };
+
+// value | condition ,otherwise    is value if condition holds, else otherwise
+// condition | action              runs action if condition holds (otherwise is nullptr)
+struct Conditional : Expression
+{
+    Rvalue* lhs;
+    Rvalue* rhs;
+    Rvalue* otherwise;
+
+    Conditional(Rvalue* lhs ,Rvalue* rhs ,Rvalue* otherwise)
+        : lhs(lhs), rhs(rhs), otherwise(otherwise) {}
+
+    NodeType getType() const override { return NodeType::Conditional; };
+};
+
+struct Call : Expression
+{
+    Rvalue* callee;
+    List<Rvalue*> arguments;
+
+    Call(Arena& arena ,Rvalue* callee)
+        : callee(callee), arguments(ArenaAllocator<Rvalue*>(arena)) {}
+
+    NodeType getType() const override { return NodeType::Call; };
+};
+// Set.x, x takes the value of every element of Set in turn
+struct Member : Expression
+{
+    Rvalue* set;
+    Identifier_t variable;
+
+    Member(Rvalue* set ,Identifier_t variable)
+        : set(set), variable(variable) {}
+
+    NodeType getType() const override { return NodeType::Member; };
+};
+
+// Set.[n] is the nth element counting from 1, Set.[a..b] the elements a to b
+struct Index : Expression
+{
+    Rvalue* set;
+    Rvalue* index;
+
+    Index(Rvalue* set ,Rvalue* index)
+        : set(set), index(index) {}
+
+    NodeType getType() const override { return NodeType::Index; };
+};
+
 struct Set : Rvalue
 {
-    std::vector<Literal_t> elements;
+    List<Literal_t> elements;
     bool isSetValue;
+
+    Set(Arena& arena)
+        : elements(ArenaAllocator<Literal_t>(arena)) {}
+
+    NodeType getType() const override { return NodeType::Set; };
+};
+
+// {} as a statement or as the action of a conditional does nothing
+inline bool isEmptySet(const ASTNode* node)
+{
+    return node && node->getType() == NodeType::Set && !static_cast<const Set*>(node)->isSetValue
+        && static_cast<const Set*>(node)->elements.empty();
+}
+
+// { Set.x | predicate } mode   the elements x of Set the predicate holds for
+// { Set.x } mode
+// { expression } mode          expression for every value of a name bound by := Set.x
+// mode is Continuous, Discrete or Unknown if there is none. Its elements
+// are computed by the evaluator, Set::elements stays empty.
+struct Comprehension : Set
+{
+    Member* source; // nullptr for { expression }
+    Rvalue* predicate; // nullptr if there is none
+    Rvalue* element; // nullptr if the elements are the values of source
+    TokenType mode;
+
+    Comprehension(Arena& arena ,Member* source ,Rvalue* predicate ,Rvalue* element ,TokenType mode)
+        : Set(arena), source(source), predicate(predicate), element(element), mode(mode) {}
+
+    NodeType getType() const override { return NodeType::Comprehension; };
 };
 
 // Expression
@@ -68,58 +211,116 @@ struct Set : Rvalue
 
 struct VariableBase : ASTNode
 {
-    const std::string name;
+    const Identifier_t name;
     bool isRuntime;
     bool isDecleration;
-    std::unique_ptr<Rvalue> value; // nullptr for declaration
+    Rvalue* value; // nullptr for declaration
+    bool hasDomain = false; // new x@domain, otherwise it is on the domain of its block
+    Identifier_t domain {}; // if hasDomain, the empty name for the global domain (new x@)
 
-    VariableBase(const std::string& name, bool isRuntime, bool isDecleration, std::unique_ptr<Rvalue> value = nullptr)
-        : name(std::move(name)), isRuntime(isRuntime), isDecleration(isDecleration), value(std::move(value)) {}
+    VariableBase(Identifier_t name, bool isRuntime, bool isDecleration, Rvalue* value = nullptr)
+        : name(name), isRuntime(isRuntime), isDecleration(isDecleration), value(value) {}
 
 
-    NodeType getType() override { return NodeType::Unknown; };
+    NodeType getType() const override { return NodeType::Unknown; };
 };
 
 struct VarDeclaration : VariableBase
 {
-    VarDeclaration(const std::string& name, bool isRuntime)
-        : VariableBase(std::move(name), isRuntime, true) {}
+    VarDeclaration(Identifier_t name, bool isRuntime)
+        : VariableBase(name, isRuntime, true) {}
 
-    NodeType getType() override { return NodeType::VarDeclaration; };
+    NodeType getType() const override { return NodeType::VarDeclaration; };
 };
 
 struct VarDefinition : VariableBase
 {
-    VarDefinition (const std::string& name, bool isRuntime ,bool isDecleration ,std::unique_ptr<Rvalue> value)
-        : VariableBase(std::move(name), isRuntime, isDecleration ,std::move(value)) {}
+    VarDefinition (Identifier_t name, bool isRuntime ,bool isDecleration ,Rvalue* value)
+        : VariableBase(name, isRuntime, isDecleration  ,value) {}
 
-    NodeType getType() override { return NodeType::VarDefinition; };
+    NodeType getType() const override { return NodeType::VarDefinition; };
 };
 
 struct VarAllocation : VariableBase
 {
-    VarAllocation (const std::string& name, bool isRuntime ,bool isDecleration ,std::unique_ptr<Rvalue> value)
-        : VariableBase(std::move(name), isRuntime, isDecleration ,std::move(value)) {}
+    VarAllocation (Identifier_t name, bool isRuntime ,bool isDecleration ,Rvalue* value)
+        : VariableBase(name, isRuntime, isDecleration  ,value) {}
 
-    NodeType getType() override { return NodeType::VarAllocation; };
+    NodeType getType() const override { return NodeType::VarAllocation; };
 };
 
 struct VarReference : VariableBase
 {
-    VarReference (const std::string& name, bool isRuntime ,bool isDecleration ,std::unique_ptr<Rvalue> value)
-        : VariableBase(std::move(name), isRuntime, isDecleration ,std::move(value)) {}
+    VarReference (Identifier_t name, bool isRuntime ,bool isDecleration ,Rvalue* value)
+        : VariableBase(name, isRuntime, isDecleration  ,value) {}
 
-    NodeType getType() override { return NodeType::VarReference; };
+    NodeType getType() const override { return NodeType::VarReference; };
+};
+
+
+// Functions
+
+// name : type, the type is optional
+struct Parameter : ASTNode
+{
+    Identifier_t name;
+    Identifier_t type;
+    bool hasType;
+
+    Parameter(Identifier_t name ,Identifier_t type ,bool hasType)
+        : name(name), type(type), hasType(hasType) {}
+
+    NodeType getType() const override { return NodeType::Parameter; };
+};
+
+// name(parameters) = value, relation is Assign, Allocate or Reference like for variables
+struct FunctionDefinition : VariableBase
+{
+    TokenType relation;
+    List<Parameter*> parameters;
+
+    FunctionDefinition(Arena& arena ,Identifier_t name ,bool isRuntime ,TokenType relation ,Rvalue* value)
+        : VariableBase(name, isRuntime, true ,value), relation(relation), parameters(ArenaAllocator<Parameter*>(arena)) {}
+
+    NodeType getType() const override { return NodeType::FunctionDefinition; };
+};
+
+struct Return : ASTNode
+{
+    Rvalue* value;
+
+    Return(Rvalue* value)
+        : value(value) {}
+
+    NodeType getType() const override { return NodeType::Return; };
+};
+
+
+// Domains
+
+// create name; or delete name;, op is Create or Delete
+struct Domain : ASTNode
+{
+    TokenType op;
+    Identifier_t name;
+
+    Domain(TokenType op ,Identifier_t name)
+        : op(op), name(name) {}
+
+    NodeType getType() const override { return NodeType::Domain; };
 };
 
 
 // Block
 
-struct Block : ASTNode
+struct Block : Rvalue // blocks can be assigned like sets
 {
-    std::vector<std::unique_ptr<ASTNode>> ASTList {};
+    List<ASTNode*> ASTList;
+
+    Block(Arena& arena)
+        : ASTList(ArenaAllocator<ASTNode*>(arena)) {}
 
-    NodeType getType() override { return NodeType::Block; };
+    NodeType getType() const override { return NodeType::Block; };
 };
 
 } // AST
@@ -0,0 +1,241 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "astnode.h"
+#include "symbols.h"
+#include "value.h"
+
+struct Domain; // runtime/domain.h
+
+namespace Compiler {
+
+// A value of runtime code, small and trivially copyable so it fits a register.
+// Cells and domains are only held by the registers and globals of their variables.
+struct RuntimeValue
+{
+    enum class Type : uint8_t
+    {
+        Undefined,
+        Int,
+        Double,
+        Char,
+        String,
+        Cell, // a new x@domain, its value is on the domain
+        Domain,
+    };
+
+    Type type = Type::Undefined;
+    union
+    {
+        Int_t i;
+        Double_t d;
+        Char_t c;
+        SymbolId s;
+        RuntimeValue* cell;
+        ::Domain* domain;
+    };
+
+    RuntimeValue() : i (0) {}
+    static RuntimeValue ofInt(Int_t value) { RuntimeValue v; v.type = Type::Int; v.i = value; return v; }
+};
+
+Value toValue(const RuntimeValue& value); // Cells and domains are undefined
+RuntimeValue toRuntimeValue(const Value& value); // fails for sets
+
+// The folded runtime code of a program (see evaluator.h) lowered to
+// instructions on registers, for the VM (see vm.h).
+// Every function has a frame of registers, its parameters first and then its
+// locals and temporaries, a call puts the arguments in consecutive registers
+// of the caller that become the start of the callee's frame and its first one
+// the result. The top level code is the first function, its names are globals
+// so functions can read them.
+// Variables on a named domain are cells allocated on it, the register or
+// global of the variable holds the cell. Blocks dont allocate anything, their
+// variables are registers.
+// Common patterns get instructions of their own: a comparison that decides a
+// branch jumps directly (x == 10 | x++ is a JumpUnlessEqualConst and an
+// Increment), and so does adding or subtracting a constant.
+// A function that calls itself as Recursion::isLoop() allows is a loop in its
+// own frame instead of a call per level.
+// optimize() (see passmanager.h) rewrites it in SSA form before it runs.
+struct Bytecode
+{
+    enum class Op : uint8_t
+    {
+        Move, // a = b
+        LoadConst, // a = constants[target]
+        LoadGlobal, // a = globals[target]
+        StoreGlobal, // globals[target] = a
+        DefineGlobal, // StoreGlobal that also marks the global declared, for the results
+        LoadCell, // a = *b
+        StoreCell, // *a = b
+        Add, // a = b + c
+        Subtract,
+        Multiply,
+        Divide,
+        Modulo,
+        AddConst, // a = b + constants[c]
+        SubtractConst,
+        Equal, // a = b == c
+        NotEqual,
+        Less,
+        LessEqual,
+        Greater,
+        GreaterEqual,
+        Negate, // a = -b
+        Not, // a = not b
+        Truth, // a = 1 if b is truthy, 0 otherwise
+        Increment, // a += 1
+        Decrement,
+        Jump, // to target
+        JumpIfFalse, // if a isnt truthy
+        JumpIfTrue,
+        JumpUnlessEqual, // unless a == b
+        JumpUnlessNotEqual,
+        JumpUnlessLess,
+        JumpUnlessLessEqual,
+        JumpUnlessGreater,
+        JumpUnlessGreaterEqual,
+        JumpUnlessEqualConst, // unless a == constants[b]
+        JumpUnlessNotEqualConst,
+        JumpUnlessLessConst,
+        JumpUnlessLessEqualConst,
+        JumpUnlessGreaterConst,
+        JumpUnlessGreaterEqualConst,
+        Call, // functions[target] with the b arguments from a on, the result goes to a
+        CallBuiltin, // the same for a Builtin
+        Convert, // parameter c of functions[target] in a to an int (b 0) or a double (b 1)
+        Return, // a
+        CreateDomain, // a = a new domain
+        DeleteDomain, // a, then a is undefined
+        NewCell, // a = an undefined cell on the domain b
+        Fail, // with messages[target]
+        Halt,
+    };
+
+    enum class Builtin : uint32_t
+    {
+        Pow,
+        Abs,
+    };
+
+    struct Instruction
+    {
+        Op op;
+        uint16_t a = 0;
+        uint16_t b = 0;
+        uint16_t c = 0;
+        uint32_t target = 0; // a jump's instruction, or a constant, global, function or message
+    };
+
+    struct Function
+    {
+        SymbolId name;
+        uint16_t parameterCount;
+        uint16_t registerCount;
+        uint32_t entry;
+    };
+
+    // a variable the top level code declares, printed after the run
+    struct Result
+    {
+        SymbolId name;
+        uint32_t global;
+        bool isCell;
+    };
+
+    static constexpr uint16_t kNoRegister = 0xFFFF;
+
+    static bool isJump(Op op) { return op >= Op::Jump && op <= Op::JumpUnlessGreaterEqualConst; }
+    static uint16_t written(const Instruction& instruction); // the register it writes, kNoRegister for none
+    template <typename F>
+    static void forEachRead(const Instruction& instruction ,F&& visit); // with each register it reads, a call's arguments too
+
+    std::vector<Instruction> code {};
+    std::vector<RuntimeValue> constants {};
+    std::vector<Function> functions {}; // the top level code first
+    std::vector<std::string> messages {};
+    uint32_t globalCount = 0;
+    std::vector<Result> results {}; // in the order they are declared, the ones whose domain is deleted left out
+
+    // Lowers the statements of a program in order. Code the VM cant run, like
+    // sets, becomes a Fail with the message, so it fails when the run gets there.
+    static Bytecode compile(const std::vector<const AST::ASTNode*>& statements);
+
+    private:
+        struct Builder; // compile()'s state
+};
+
+template <typename F>
+void Bytecode::forEachRead(const Instruction& instruction ,F&& visit)
+{
+    switch (instruction.op)
+    {
+        case Op::Move:
+        case Op::LoadCell:
+        case Op::AddConst:
+        case Op::SubtractConst:
+        case Op::Negate:
+        case Op::Not:
+        case Op::Truth:
+        case Op::NewCell:
+            visit(instruction.b);
+            return;
+        case Op::StoreGlobal:
+        case Op::DefineGlobal:
+        case Op::Increment:
+        case Op::Decrement:
+        case Op::JumpIfFalse:
+        case Op::JumpIfTrue:
+        case Op::JumpUnlessEqualConst:
+        case Op::JumpUnlessNotEqualConst:
+        case Op::JumpUnlessLessConst:
+        case Op::JumpUnlessLessEqualConst:
+        case Op::JumpUnlessGreaterConst:
+        case Op::JumpUnlessGreaterEqualConst:
+        case Op::Convert:
+        case Op::Return:
+        case Op::DeleteDomain:
+            visit(instruction.a);
+            return;
+        case Op::StoreCell:
+        case Op::JumpUnlessEqual:
+        case Op::JumpUnlessNotEqual:
+        case Op::JumpUnlessLess:
+        case Op::JumpUnlessLessEqual:
+        case Op::JumpUnlessGreater:
+        case Op::JumpUnlessGreaterEqual:
+            visit(instruction.a);
+            visit(instruction.b);
+            return;
+        case Op::Add:
+        case Op::Subtract:
+        case Op::Multiply:
+        case Op::Divide:
+        case Op::Modulo:
+        case Op::Equal:
+        case Op::NotEqual:
+        case Op::Less:
+        case Op::LessEqual:
+        case Op::Greater:
+        case Op::GreaterEqual:
+            visit(instruction.b);
+            visit(instruction.c);
+            return;
+        case Op::Call:
+        case Op::CallBuiltin:
+            for (uint16_t i = 0; i < instruction.b; i++)
+                visit(static_cast<uint16_t>(instruction.a + i));
+            return;
+        default:
+            return;
+    }
+}
+
+}; // Compiler
+
+#endif
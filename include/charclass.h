@@ -0,0 +1,57 @@
+#ifndef CHARCLASS_H
+#define CHARCLASS_H
+
+#include <cstdint>
+#include <string_view>
+
+namespace Compiler {
+
+// ASCII character classes used by the lexer, same as the C locale
+// but without going through <cctype>.
+namespace CharClass {
+
+enum : uint8_t
+{
+    Whitespace = 1 << 0, // ' ' \t \n \v \f \r
+    Digit      = 1 << 1,
+    Alpha      = 1 << 2,
+    Underscore = 1 << 3,
+};
+
+struct Table
+{
+    uint8_t classes[256] {};
+
+    constexpr Table()
+    {
+        for (char c : {' ' ,'\t' ,'\n' ,'\v' ,'\f' ,'\r'})
+            classes[static_cast<uint8_t>(c)] |= Whitespace;
+        for (int c = '0'; c <= '9'; c++)
+            classes[c] |= Digit;
+        for (int c = 'a'; c <= 'z'; c++)
+            classes[c] |= Alpha;
+        for (int c = 'A'; c <= 'Z'; c++)
+            classes[c] |= Alpha;
+        classes[static_cast<uint8_t>('_')] |= Underscore;
+    }
+};
+inline constexpr Table kTable {};
+
+inline bool is(char c ,uint8_t mask) { return kTable.classes[static_cast<uint8_t>(c)] & mask; }
+
+} // CharClass
+
+inline bool isWhitespace(char c) { return CharClass::is(c ,CharClass::Whitespace); }
+inline bool isDigit(char c) { return CharClass::is(c ,CharClass::Digit); }
+inline bool isIdentifierStart(char c) { return CharClass::is(c ,CharClass::Alpha | CharClass::Underscore); }
+inline bool isIdentifierChar(char c) { return CharClass::is(c ,CharClass::Alpha | CharClass::Digit | CharClass::Underscore); }
+
+// Length of the run of matching characters at the start of view.
+// Scans 16 (SSE2) or 32 (AVX2) bytes at a time when the cpu supports it.
+size_t countWhitespace(std::string_view view);
+size_t countIdentifierChars(std::string_view view);
+size_t countDigits(std::string_view view);
+
+}; // Compiler
+
+#endif
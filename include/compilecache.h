@@ -0,0 +1,76 @@
+#ifndef COMPILECACHE_H
+#define COMPILECACHE_H
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string_view>
+
+#include "astfile.h"
+#include "compiler.h"
+#include "hash.h"
+
+namespace Compiler {
+
+// Results of earlier compiles kept on disk, like ccache does for C.
+// An entry is named by a hash of everything that decides the output: the
+// source bytes, the CompileContext fields the parser reads, the entry format
+// and the compiler binary itself. Once the directory grows past its size
+// limit the least recently used entries (by mtime, bumped on every hit) are
+// removed. Several compiler processes may share one directory.
+class CompileCache
+{
+    public:
+        struct Stats
+        {
+            uint64_t hits = 0;
+            uint64_t misses = 0;
+            uint64_t evictions = 0;
+            uint64_t bytes = 0; // size of all entries
+            uint64_t maxSize = kDefaultMaxSize;
+        };
+
+        static constexpr uint64_t kDefaultMaxSize = uint64_t(1) << 30;
+
+        // A maxSize of 0 keeps the limit stored in the directory, anything else replaces it.
+        // Throws std::runtime_error if the directory cant be created.
+        CompileCache(const std::filesystem::path& directory ,uint64_t maxSize = 0);
+        ~CompileCache(); // adds this run's statistics to the directory's, evicts if its too big
+
+        CompileCache(const CompileCache&) = delete;
+        CompileCache& operator=(const CompileCache&) = delete;
+
+        Hash128 key(const CompileContext& context ,std::string_view source) const;
+        std::unique_ptr<AST::ASTFile> load(Hash128 key); // counts a hit or a miss, nullptr on a miss
+        void store(Hash128 key ,const AST::CompiledAST& compiled);
+
+        Stats stats(); // of the directory, including this run
+        const std::filesystem::path& directory() const { return directory_; }
+
+        // $COMPILER_CACHE_DIR, else $XDG_CACHE_HOME/compiler, else ~/.cache/compiler
+        static std::filesystem::path defaultDirectory();
+
+    private:
+        static constexpr uint32_t kVersion_ = 4; // bump when the entry format changes
+
+        const std::filesystem::path directory_;
+        const uint64_t maxSize_; // 0 to keep the stored one
+        Hash128 compilerId_ = kHash128Seed;
+
+        std::mutex mutex_ {};
+        Stats pending_ {}; // not written to the stats file yet
+
+        std::filesystem::path entryPath(Hash128 key) const;
+
+        // runs update on the stats file's contents while holding the directory lock
+        template <typename F>
+        Stats updateStats(F update);
+        void evict(Stats& stats);
+};
+
+void printCacheStats(CompileCache& cache);
+
+}; // Compiler
+
+#endif
@@ -1,7 +1,9 @@
 #ifndef COMPILER_H
 #define COMPILER_H
 
+#include <cstdint>
 #include <memory>
+#include <ostream>
 #include <vector>
 #include <string>
 
@@ -12,11 +14,51 @@ namespace Compiler {
 
 void log(std::string_view msg);
 
+// Where log() and the AST printers write to, std::cout unless redirected.
+// Redirection is per thread so files compiled in parallel dont interleave.
+std::ostream& output();
+
+class OutputRedirect
+{
+    public:
+        OutputRedirect(std::ostream& os);
+        ~OutputRedirect();
+
+    private:
+        std::ostream* previous_;
+};
+
+// what --run runs the runtime code with
+enum class RunMode
+{
+    None,
+    VM, // --run or --run=vm, see vm.h
+    Tree, // --run=tree, see treewalker.h
+    Bench, // --run=bench, both, and how long each took
+};
+
 struct CompileContext
 {
     std::vector<std::string> sourceFiles {};
-    std::string outputName {"out"};
+    std::string outputName {"out"}; // -o NAME, --emit-obj writes NAME.o
     unsigned maxNestRange = 500;
+    bool useFlatAST = false; // --flat-ast
+    unsigned jobs = 0; // -j N, 0 for one per hardware thread
+    bool usePipeline = false; // --pipeline, lex on a separate thread from parsing
+    bool checkLexer = false; // --check-lex, compare the parallel lexer to the sequential one
+    bool isWatching = false; // --watch, recompile the source files whenever they change
+    bool useCache = false; // --cache, reuse results of earlier compiles from disk
+    std::string cacheDirectory {}; // --cache-dir=DIR, empty for CompileCache::defaultDirectory()
+    uint64_t cacheMaxSize = 0; // --cache-size=MB, 0 keeps the size the cache directory has
+    bool showCacheStats = false; // --cache-stats
+    bool emitAST = false; // --emit-ast=bin, also write each file's AST to <source>.ast
+    bool loadAST = false; // --load-ast, the inputs are AST files to print instead of sources
+    bool evaluate = false; // --eval, run the defines at compile time and print the folded runtime code
+    RunMode run = RunMode::None; // --run, also evaluates
+    bool emitObject = false; // --emit-obj, also evaluates, compiles the runtime code to native code, see x86backend.h
+    bool optimize = true; // -O0 runs and compiles the runtime code without the SSA passes, see passmanager.h
+    bool timePasses = false; // --time-passes, log how long each SSA pass took
+    bool useKernels = true; // --no-kernels, test comprehension filters one candidate at a time instead of with vector instructions
     // ...
 };
 
@@ -27,7 +69,10 @@ std::string getTokenKey(TokenType type);
 std::string getTokenPos(Token token);
 
 
-void printASTNode(const std::unique_ptr<AST::ASTNode>& node);
+void printASTNode(const AST::ASTNode* node);
+
+// The statement or expression as source, with parentheses around nested operations.
+std::string formatNode(const AST::ASTNode* node);
 
 }; // Compiler
 
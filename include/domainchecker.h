@@ -0,0 +1,102 @@
+#ifndef DOMAINCHECKER_H
+#define DOMAINCHECKER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "astnode.h"
+#include "symbols.h"
+
+namespace Compiler {
+
+// Checks the lifetimes of domains in runtime code while it is folded, so the
+// code generated for it can allocate every new variable on its domain with a
+// pointer bump and free a whole domain at once (see runtime/domain.h) without
+// counting or tracking objects.
+// Every block is an anonymous domain freed when it ends, together with the
+// domains created in it. A named domain lives from create to delete, and can
+// only be deleted in the block that created it, so when each domain is freed
+// is known from the code alone. A variable is on the domain of its block unless
+// it is put on another one (new x@domain, new x@ for the global domain), then
+// its name stays visible where that domain was created.
+// Names can only be used while the domain they are on is alive, and so can
+// references (:=) and runtime functions, while the domains of every name they
+// read are alive too.
+// Errors are thrown as std::runtime_error.
+class DomainChecker
+{
+    public:
+        DomainChecker();
+
+        void enterBlock();
+        void exitBlock(); // frees the block and the domains created in it
+        void reset(); // back to the top level, after an error
+
+        // Checks code as if it was at the top level until exitTopLevel(), for
+        // a function cloned where it is called (see Evaluator). Names declared
+        // at the top level in between stay.
+        void enterTopLevel();
+        void exitTopLevel(); // leaves the blocks entered since, the ones it was in are back
+
+        void create(SymbolId name);
+        void remove(SymbolId name); // delete name;
+
+        // The names used between beginCapture() and endCapture() that were
+        // declared outside of it, for a reference or a runtime function.
+        void beginCapture();
+        std::vector<uint32_t> endCapture(); // the domains they are on
+
+        // variable in the current block, with the domains a reference or function depends on
+        void declare(const AST::VariableBase* variable ,std::vector<uint32_t> captured = {});
+        void declareParameter(SymbolId name); // on the caller's domain, alive as long as the call
+        void use(SymbolId name); // fails if name is on a freed domain or depends on one
+
+    private:
+        static constexpr uint32_t kGlobalDomain_ = 0;
+
+        struct Domain
+        {
+            SymbolId name; // empty for a block and the global domain
+            size_t depth; // of the block that created it
+            bool isAlive;
+        };
+
+        struct Variable
+        {
+            SymbolId name;
+            size_t depth;
+            std::vector<uint32_t> domains; // its own first, then the ones it depends on
+        };
+
+        struct Capture
+        {
+            size_t depth; // names declared at this depth or deeper are inside
+            std::vector<uint32_t> domains;
+        };
+
+        std::vector<Domain> domains_ {}; // never shrinks, freed ones stay to name them in errors
+        std::vector<std::vector<Variable>> scopes_ {}; // one per block, the top level first
+        std::vector<uint32_t> alive_ {}; // ordered by depth, the global domain first
+        std::vector<uint32_t> blockDomains_ {}; // of each block but the top level
+        std::vector<Capture> captures_ {};
+
+        // what enterTopLevel() put aside
+        struct Hidden
+        {
+            std::vector<std::vector<Variable>> scopes;
+            std::vector<uint32_t> alive;
+            std::vector<uint32_t> blockDomains;
+            std::vector<Capture> captures;
+        };
+        std::vector<Hidden> hidden_ {};
+
+        size_t depth() const { return scopes_.size() - 1; }
+        uint32_t findDomain(SymbolId name) const; // the alive one, fails if there is none
+        std::string describe(uint32_t domain) const;
+};
+
+}; // Compiler
+
+#endif
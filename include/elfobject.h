@@ -0,0 +1,70 @@
+#ifndef ELFOBJECT_H
+#define ELFOBJECT_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Compiler {
+
+// A relocatable x86-64 ELF object file (.o), what a linker takes next to the
+// objects of a C or C++ compiler.
+// Code goes to .text, strings to .rodata and variables to .bss, symbols name
+// places in them or, undefined, functions of other objects the code calls.
+// Relocations only patch .text.
+// Errors are thrown as std::runtime_error.
+class ElfObject
+{
+    public:
+        enum class Section : uint8_t
+        {
+            Undefined, // defined by another object
+            Text,
+            ReadOnly,
+            Bss,
+        };
+
+        // x86-64 relocation types (R_X86_64_*)
+        static constexpr uint32_t kPC32 = 2; // data, S + A - P
+        static constexpr uint32_t kPLT32 = 4; // calls, through the PLT if the linker makes one
+
+        std::vector<uint8_t> text {};
+        std::vector<uint8_t> readOnly {};
+        uint64_t bssSize = 0;
+
+        // returns the symbol, for addRelocation()
+        uint32_t addSymbol(const std::string& name ,Section section ,uint64_t offset ,uint64_t size ,bool isFunction ,bool isGlobal);
+        uint32_t addExternal(const std::string& name); // a function of another object
+        uint32_t sectionSymbol(Section section) const; // the start of a section, for relocations to unnamed data
+
+        // the 4 bytes at offset in .text
+        void addRelocation(uint64_t offset ,uint32_t symbol ,uint32_t type ,int64_t addend);
+
+        void write(const std::string& path) const;
+
+    private:
+        struct Symbol
+        {
+            std::string name;
+            Section section;
+            uint64_t offset;
+            uint64_t size;
+            bool isFunction;
+            bool isGlobal;
+        };
+
+        struct Relocation
+        {
+            uint64_t offset;
+            uint32_t symbol;
+            uint32_t type;
+            int64_t addend;
+        };
+
+        std::vector<Symbol> symbols_ {};
+        std::vector<Relocation> relocations_ {};
+};
+
+}; // Compiler
+
+#endif
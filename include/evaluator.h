@@ -0,0 +1,214 @@
+#ifndef EVALUATOR_H
+#define EVALUATOR_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "arena.h"
+#include "lazyset.h"
+#include "rangesolver.h"
+#include "recursion.h"
+#include "astnode.h"
+#include "compiler.h"
+#include "domainchecker.h"
+#include "taskscheduler.h"
+#include "value.h"
+
+namespace Compiler {
+
+// Runs the compile-time side of a program (--eval).
+// Top level statements are given to run() in order: define bindings are
+// evaluated to constants, calls of define functions are memoized on their
+// argument values since they cant have side effects, and runtime (new) code is
+// folded so that code generation never sees a define.
+// Statements given to run() have to stay alive as long as the Evaluator.
+class Evaluator
+{
+    public:
+        struct Stats
+        {
+            uint64_t calls = 0; // of define functions, memoized ones included
+            uint64_t memoHits = 0;
+            uint64_t steps = 0; // expressions evaluated
+        };
+
+        Evaluator(const CompileContext& context ,unsigned threads = 1);
+
+        // Evaluates or folds one top level statement and logs the result,
+        // statement may be replaced by its folded form. Returns false on errors.
+        bool run(AST::ASTNode*& statement);
+
+        // The clones made while folding the statements given to run() since the
+        // last call, runtime functions the statements call.
+        std::vector<AST::ASTNode*> takeSpecializations();
+
+        size_t errorCount() const { return errorCount_; }
+        const Stats& stats() const { return stats_; }
+
+    private:
+        static constexpr uint64_t kMaxSteps_ = 100'000'000;
+        static constexpr size_t kMaxCallDepth_ = 1000;
+        static constexpr size_t kMaxPendingSteps_ = 1 << 20; // levels of a loop waiting for the ones below
+        static constexpr size_t kMinKernelWindow_ = 256; // candidates a FilterKernel checks at once
+        static constexpr size_t kMaxKernelWindow_ = 1 << 16;
+        static constexpr size_t kParallelChunk_ = 1024; // candidates per task of a parallel comprehension
+        static constexpr size_t kParallelSumChunk_ = 1 << 16; // elements per task of a parallel sum
+        static constexpr uint64_t kStepCheck_ = 1 << 20; // steps a worker takes between looks at the others
+        static constexpr size_t kMaxSpecializedNodes_ = 20'000; // all clones of functions together
+        static constexpr size_t kMaxSpecializationDepth_ = 64; // clones folded while folding another
+
+        // a top level name
+        struct Binding
+        {
+            bool isRuntime = false;
+            Value value {};
+            const AST::FunctionDefinition* function = nullptr;
+        };
+
+        // a name inside a function or block, runtime ones only shadow when folding
+        struct Local
+        {
+            SymbolId name;
+            Value value;
+            bool isRuntime;
+            bool isIterator = false; // define x := Set.x, value is the set x ranges over
+        };
+
+        // a define function and its arguments, or a comprehension and the locals it reads
+        struct MemoKey
+        {
+            const AST::ASTNode* node;
+            std::vector<Value> arguments;
+
+            bool operator==(const MemoKey& other) const;
+        };
+
+        struct MemoKeyHash
+        {
+            size_t operator()(const MemoKey& key) const;
+        };
+
+        // a function and the arguments of a call of it, nullopt for the ones left for runtime
+        struct SpecializationKey
+        {
+            const AST::FunctionDefinition* function;
+            std::vector<std::optional<Value>> arguments;
+
+            bool operator==(const SpecializationKey& other) const;
+        };
+
+        struct SpecializationKeyHash
+        {
+            size_t operator()(const SpecializationKey& key) const;
+        };
+
+        Arena arena_ {}; // folded nodes
+        std::unordered_map<SymbolId ,Binding> globals_ {};
+        std::vector<std::vector<Local>> frames_ {}; // one per call, the innermost last
+        std::unordered_map<MemoKey ,Value ,MemoKeyHash> memo_ {};
+        std::unordered_map<MemoKey ,LazyRef ,MemoKeyHash> lazySets_ {}; // so calls share what they found
+        std::unordered_map<const AST::Comprehension* ,RangePlan> rangePlans_ {};
+        std::unordered_map<const AST::FunctionDefinition* ,Recursion> recursions_ {};
+        std::unordered_map<SpecializationKey ,AST::FunctionDefinition* ,SpecializationKeyHash> specializations_ {}; // nullptr if it cant be folded
+        std::vector<AST::ASTNode*> newSpecializations_ {};
+        size_t specializedNodes_ = 0;
+        std::vector<const AST::FunctionDefinition*> specializing_ {}; // the functions whose clones are being folded, innermost last
+        const AST::FunctionDefinition* foldingFunction_ = nullptr; // its body is being folded, it cant be cloned yet
+
+        // the steps of the tasks of a parallel comprehension so far
+        struct TaskSteps
+        {
+            std::vector<std::atomic<uint64_t>> steps;
+            uint64_t budget; // what the Evaluator that started them had left
+        };
+
+        Stats stats_ {};
+        uint64_t maxSteps_ = kMaxSteps_; // a worker looks at the other tasks once it has more
+        size_t errorCount_ = 0;
+        bool useKernels_;
+        Value returnValue_ {};
+        DomainChecker domainChecker_ {}; // the lifetimes of the domains of runtime code
+
+        const Evaluator* parent_ = nullptr; // a worker of a parallel task reads the defines, memo and range plans of its parent
+        TaskSteps* taskSteps_ = nullptr;
+        size_t task_ = 0;
+        std::vector<std::pair<const AST::Comprehension* ,std::string>> warnings_ {}; // a worker's, its parent logs them
+        unsigned threads_ = 1;
+        std::unique_ptr<TaskScheduler> scheduler_ {}; // started by the first parallel task
+
+        Evaluator(const Evaluator* parent ,TaskSteps* taskSteps ,size_t task); // a worker, doesnt start tasks of its own
+        TaskScheduler& scheduler();
+
+        [[noreturn]] static void fail(const std::string& msg);
+        void countSteps(uint64_t count); // fails once there were too many, for a worker where evaluating the tasks in order would
+
+        void define(SymbolId name ,Binding binding);
+        Local* findLocal(SymbolId name);
+        const Binding* findGlobal(SymbolId name) const;
+        const Value* memoized(const MemoKey& key) const; // nullptr if it wasnt evaluated yet
+        Value read(SymbolId name);
+        std::optional<Int_t> intConstant(SymbolId name ,const std::vector<Local>& locals) const; // if name is an int, for a FilterKernel
+        void write(const AST::Rvalue* target ,const Value& value);
+
+        Value evaluate(const AST::Rvalue* node);
+        Value evaluateUnary(const AST::Unary* unary);
+        Value evaluateBinary(const AST::Binary* binary);
+        Value evaluateCall(const AST::Call* call);
+        Value evaluateBlock(const AST::Block* block);
+        Value evaluateIndex(const AST::Index* index);
+        // A SetValue, or a LazySet if it is declared continuous or discrete. Over ints only
+        // the range the predicate allows is tried (see rangesolver.h), with vector
+        // instructions where they can test it (see filterkernel.h).
+        Value evaluateComprehension(const AST::Comprehension* comprehension);
+        const RangePlan& rangePlan(const AST::Comprehension* comprehension ,const LazySet& source); // planned once per node
+        const RangePlan* knownPlan(const AST::Comprehension* comprehension) const; // nullptr if it wasnt planned yet
+        void warn(const AST::Comprehension* comprehension ,const std::string& msg);
+        void collectLocals(const AST::ASTNode* node ,std::vector<Local>& locals); // the ones node reads
+        Value materialize(const Value& value); // finite LazySets become SetValues
+        // Comprehensions and sums with many elements run as tasks of a fixed size on several
+        // threads, merged in order, so neither results nor errors depend on the thread count.
+        bool isParallel(const AST::ASTNode* node ,const std::vector<Local>& locals
+            ,std::vector<const AST::FunctionDefinition*>& functions) const; // if a worker can evaluate node
+        std::optional<Value> sumInParallel(const Value& set); // nullopt if it has to be added up in order
+        Value convertArgument(const AST::FunctionDefinition* function ,size_t i ,Value argument) const; // to the type of parameter i
+        Value call(const AST::FunctionDefinition* function ,std::vector<Value> arguments);
+        const Recursion& recursionOf(const AST::FunctionDefinition* function); // found once per function
+        // The body of a call of a function that only calls itself as a tail call or a step (see
+        // recursion.h), in the frame of the first call, so it can go deeper than other calls.
+        Value loop(const AST::FunctionDefinition* function ,const Recursion& recursion);
+        bool execute(const AST::ASTNode* statement); // true if it returned
+
+        // runtime code
+        AST::Rvalue* fold(AST::Rvalue* node);
+        void checkRuntimeTarget(const AST::Rvalue* target); // fails if target is a define
+        void foldVariable(AST::VariableBase* variable); // and declares it on its domain
+        AST::ASTNode* foldStatement(AST::ASTNode* statement); // nullptr if it was only compile-time
+        bool isConstant(const AST::Rvalue* node) const;
+        AST::Rvalue* makeConstant(const Value& value); // nullptr if value cant be written as a literal
+        // A call folding leaves for runtime calls a clone of the function with the constant
+        // arguments folded in, one per function and arguments. Runtime functions are only
+        // cloned if an argument is known and they dont run as loops, the calls a clone makes
+        // of its own function keep their arguments, and all clones only add so much code.
+        AST::Rvalue* specialize(AST::Call* call ,const Binding& binding); // a call of a clone, or call
+        AST::FunctionDefinition* specialize(const AST::FunctionDefinition* function
+            ,const std::vector<std::optional<Value>>& arguments); // nullptr if it cant be folded
+};
+
+// Evaluates op on two values, fails with a message for operand types it doesnt take.
+// Assignments and and/or arent handled here.
+Value applyBinary(TokenType op ,const Value& lhs ,const Value& rhs);
+
+// The name@Functions builtins: pow, sum and abs.
+bool isBuiltinFunction(std::string_view name ,std::string_view domain);
+Value callBuiltin(std::string_view name ,const std::vector<Value>& arguments); // fails for wrong arguments
+
+}; // Compiler
+
+#endif
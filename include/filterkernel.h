@@ -0,0 +1,79 @@
+#ifndef FILTERKERNEL_H
+#define FILTERKERNEL_H
+
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "astnode.h"
+#include "rangesolver.h"
+#include "symbols.h"
+#include "value.h"
+
+namespace Compiler {
+
+// The filters of a comprehension over a range of ints, compiled to test blocks
+// of candidates 4 at a time with AVX2, or 2 at a time with SSE2 otherwise.
+// Filters can use ints, names of ints, + - * / %, comparisons and not/and/or/xor.
+// Candidates are computed in doubles, so a filter is only compiled if none of
+// its values can leave the ints a double holds exactly or divide by 0, then
+// it gives the same result as evaluating it candidate by candidate.
+class FilterKernel
+{
+    public:
+        using Resolve = std::function<std::optional<Int_t>(SymbolId)>; // the value of a name that isnt the variable, nullopt if it isnt an int
+
+        // nullopt if a filter cant run as a kernel for the candidates in range
+        static std::optional<FilterKernel> compile(const std::vector<const AST::Rvalue*>& filters ,SymbolId variable
+            ,IntRange range ,const Resolve& resolve);
+
+        // Appends the candidates of first..last for which every filter holds, in order.
+        // first..last has to be inside the range it was compiled for.
+        void run(Int_t first ,Int_t last ,std::vector<Int_t>& survivors) const;
+
+        // The compiled form, instructions on registers that each hold the values
+        // for a block of candidates. Register 0 is the candidates themselves.
+        enum class Op : uint8_t
+        {
+            Add,
+            Subtract,
+            Multiply,
+            Divide,
+            Modulo,
+            Negate,
+            Not,
+            Equal,
+            NotEqual,
+            Less,
+            LessEqual,
+            Greater,
+            GreaterEqual,
+            And,
+            Or,
+            Xor,
+        };
+
+        struct Instruction
+        {
+            Op op;
+            uint16_t target;
+            uint16_t lhs;
+            uint16_t rhs; // unused by Negate and Not
+        };
+
+    private:
+        std::vector<std::pair<uint16_t ,double>> constants_ {}; // register and value
+        std::vector<Instruction> code_ {};
+        uint16_t registerCount_ = 1;
+        uint16_t result_ = 0; // nonzero for the candidates that pass
+
+        struct Builder; // compile()'s state
+
+        FilterKernel() = default;
+};
+
+}; // Compiler
+
+#endif
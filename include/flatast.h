@@ -0,0 +1,153 @@
+#ifndef FLATAST_H
+#define FLATAST_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "astnode.h"
+#include "compiler.h"
+
+namespace Compiler {
+namespace AST {
+
+using NodeIndex = uint32_t;
+
+// The AST of a whole compilation unit as parallel arrays.
+// Nodes are stored in preorder and refer to each other by index, the
+// children of a node are one contiguous range of `children` (or of
+// `literals` for a Set or Literal), so traversals walk flat memory instead of pointers.
+//
+// Children per kind:
+//   variables          value, if there is one, then a Domain if it is put on one
+//   FunctionDefinition Parameters, then the value
+//   Parameter          an Lvalue of its type, if it has one
+//   Return             value, if there is one
+//   Unary              operand
+//   Binary             lhs ,rhs
+//   Conditional        lhs ,rhs ,otherwise if there is one
+//   Call               callee ,arguments
+//   Member             set
+//   Index              set ,index
+//   Comprehension      source if Source ,predicate if Predicate ,element if there is one
+struct FlatAST
+{
+    enum Flags : uint8_t
+    {
+        Runtime     = 1 << 0,
+        Declaration = 1 << 1, // variables, and a Domain that is created
+        SetValue    = 1 << 2,
+        Allocate    = 1 << 3, // FunctionDefinition with ':', neither flag means '='
+        Reference   = 1 << 4, // FunctionDefinition with ':='
+        Postfix     = 1 << 5, // Unary
+        Source      = 1 << 6, // Comprehension
+        Predicate   = 1 << 7, // Comprehension
+    };
+
+    // per node
+    std::vector<NodeType> kinds {};
+    std::vector<uint8_t> flags {};
+    std::vector<uint32_t> payloads {}; // SymbolId if hasSymbol(), TokenType of the operator for Unary and Binary, of the mode for Comprehension
+    std::vector<uint32_t> firstChild {}; // into children, or literals for a Set or Literal
+    std::vector<uint32_t> childCount {};
+
+    std::vector<NodeIndex> children {};
+    std::vector<Literal_t> literals {};
+    std::vector<NodeIndex> roots {}; // top level statements in order
+
+    size_t size() const { return kinds.size(); }
+    bool hasFlag(NodeIndex node ,Flags flag) const { return flags[node] & flag; }
+
+    // the accessors printFlatTree() needs, ASTFileView has the same ones
+    NodeType nodeKind(NodeIndex node) const { return kinds[node]; }
+    std::string_view nodeName(NodeIndex node) const { return symbols().lookup(static_cast<SymbolId>(payloads[node])); } // if hasSymbol()
+    uint32_t nodeChildCount(NodeIndex node) const { return childCount[node]; }
+    NodeIndex nodeChild(NodeIndex node ,uint32_t i) const { return children[firstChild[node] + i]; }
+
+    NodeIndex add(const ASTNode* node); // copies a tree, returns its root, nullptr becomes NodeType::Unknown
+    void clear();
+
+    static bool hasSymbol(NodeType type); // if the payload is a SymbolId
+    static bool hasLiterals(NodeType type) { return type == NodeType::Set || type == NodeType::Literal; }
+
+    private:
+        NodeIndex convert(const ASTNode* node);
+};
+
+} // AST
+
+void printFlatAST(const AST::FlatAST& ast ,AST::NodeIndex node); // same output as printASTNode
+
+// printFlatAST() for anything with FlatAST's node accessors.
+template <typename FlatTree>
+void printFlatTree(const FlatTree& tree ,AST::NodeIndex node)
+{
+    using AST::NodeType;
+
+    const NodeType kind = tree.nodeKind(node);
+    if (kind == NodeType::Unknown) // failed parse
+    {
+        log("fail");
+        return;
+    }
+
+    const bool isRuntime = tree.hasFlag(node ,AST::FlatAST::Runtime);
+    auto valueCount = [&]() -> uint32_t // children of a variable that arent its Domain
+    {
+        const uint32_t count = tree.nodeChildCount(node);
+        return count && tree.nodeKind(tree.nodeChild(node ,count - 1)) == NodeType::Domain ? count - 1 : count;
+    };
+
+    switch (kind) {
+        case NodeType::VarDeclaration:
+            output() << "VarDeclaration: name = " << tree.nodeName(node)
+                      << ", runtime = " << isRuntime << "\n";
+            break;
+        case NodeType::VarDefinition:
+            output() << "VarDefinition: name = " << tree.nodeName(node)
+                      << ", runtime = " << isRuntime
+                      << ", has value = " << (valueCount() != 0) << "\n";
+            break;
+        case NodeType::VarAllocation:
+            output() << "VarAllocation: name = " << tree.nodeName(node)
+                      << ", runtime = " << isRuntime << "\n";
+            break;
+        case NodeType::VarReference:
+            output() << "VarReference: name = " << tree.nodeName(node)
+                      << ", runtime = " << isRuntime << "\n";
+            break;
+        case NodeType::FunctionDefinition: {
+            uint32_t parameters = 0;
+            while (parameters < tree.nodeChildCount(node) && tree.nodeKind(tree.nodeChild(node ,parameters)) == NodeType::Parameter)
+                parameters++;
+            output() << "FunctionDefinition: name = " << tree.nodeName(node)
+                      << ", runtime = " << isRuntime
+                      << ", parameters = " << parameters << "\n";
+            break;
+        }
+        case NodeType::Block: {
+            const uint32_t count = tree.nodeChildCount(node);
+            output() << "Block with " << count << " children\n";
+            for (uint32_t i = 0; i < count; i++)
+                printFlatTree(tree ,tree.nodeChild(node ,i));
+            break;
+        }
+        case NodeType::Return:
+            output() << "Return\n";
+            break;
+        case NodeType::Domain:
+            output() << "Domain: name = " << tree.nodeName(node)
+                      << ", create = " << tree.hasFlag(node ,AST::FlatAST::Declaration) << "\n";
+            break;
+        default:
+            if (AST::isExpression(kind))
+                output() << "Expression\n";
+            else
+                output() << "Unknown node\n";
+    }
+}
+
+} // Compiler
+
+#endif
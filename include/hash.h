@@ -0,0 +1,67 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+
+namespace Compiler {
+
+// 64 bit FNV-1a, chain calls by passing the previous hash as seed.
+inline constexpr uint64_t kHashSeed = 14695981039346656037ull;
+
+inline uint64_t hashBytes(const void* data ,size_t size ,uint64_t hash = kHashSeed)
+{
+    const auto* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+template <typename T>
+inline uint64_t hashValue(const T& value ,uint64_t hash = kHashSeed)
+{
+    static_assert(std::is_trivially_copyable_v<T>);
+    return hashBytes(&value ,sizeof(T) ,hash);
+}
+
+// 128 bit FNV-1a, for keys that name content (like cache entries) where a
+// collision would silently give the wrong result.
+__extension__ typedef unsigned __int128 Hash128;
+
+inline constexpr Hash128 kHash128Seed = (Hash128(0x6c62272e07bb0142ull) << 64) | 0x62b821756295c58dull;
+
+inline Hash128 hashBytes128(const void* data ,size_t size ,Hash128 hash = kHash128Seed)
+{
+    const auto* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= bytes[i];
+        hash = (hash << 88) + hash * 0x13b; // * (2^88 + 0x13b)
+    }
+    return hash;
+}
+
+template <typename T>
+inline Hash128 hashValue128(const T& value ,Hash128 hash = kHash128Seed)
+{
+    static_assert(std::is_trivially_copyable_v<T>);
+    return hashBytes128(&value ,sizeof(T) ,hash);
+}
+
+inline std::string toHex(Hash128 hash)
+{
+    constexpr char kDigits[] = "0123456789abcdef";
+    std::string hex(32 ,'0');
+    for (size_t i = 32; i-- > 0; hash >>= 4)
+        hex[i] = kDigits[static_cast<unsigned>(hash & 15)];
+    return hex;
+}
+
+}; // Compiler
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef LAZYSET_H
+#define LAZYSET_H
+
+#include <cstddef>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include "rangesolver.h"
+#include "value.h"
+
+namespace Compiler {
+
+// A set whose elements are only computed when they are asked for, in the
+// order of the set it is built from. Natural@Sets, ranges and comprehensions
+// declared continuous or discrete are LazySets, so they can be infinite.
+//
+// A generated set produces its elements one after another with next() and
+// remembers them, so at(n) after at(n - 1) costs one more call of next()
+// instead of n. An indexed set computes element i from i alone and remembers
+// nothing, so slices and ranges stream without storing any prefix.
+class LazySet
+{
+    public:
+        static constexpr size_t kInfinite = std::numeric_limits<size_t>::max();
+
+        using Next = std::function<std::optional<Value>()>; // the next element, nullopt after the last one
+        using Nth = std::function<std::optional<Value>(size_t)>; // element i, nullopt past the end
+
+        LazySet(Next next ,size_t maxSize = kInfinite);
+        LazySet(Nth nth ,size_t maxSize);
+
+        // Element i counting from 0, nullopt if the set has fewer elements.
+        // Errors thrown by next() or nth() leave the set as it was.
+        std::optional<Value> at(size_t i);
+
+        bool isInfinite() const { return maxSize_ == kInfinite; }
+        size_t maxSize() const { return maxSize_; } // the set may end before
+        bool isIndexed() const { return static_cast<bool>(nth_); }
+        const std::vector<Value>& known() const { return memo_; } // generated so far
+        bool isComplete() const { return isExhausted_ || memo_.size() == maxSize_; } // if known() is all of it
+
+        // the ints first..last in order if this is a range or Natural@Sets, last is the
+        // largest Int_t for an infinite one
+        const std::optional<IntRange>& intRange() const { return intRange_; }
+
+    private:
+        Next next_ {};
+        Nth nth_ {};
+        size_t maxSize_;
+
+        std::vector<Value> memo_ {};
+        bool isExhausted_ = false;
+        std::optional<IntRange> intRange_ {};
+
+        friend LazyRef makeRange(Int_t first ,Int_t last);
+        friend LazyRef countFrom(Int_t first);
+};
+
+// Element i counting from 0 of a SetValue or LazySet, nullopt past the end.
+std::optional<Value> elementAt(const Value& set ,size_t i);
+
+// first, first + 1, ... last, empty if last < first
+LazyRef makeRange(Int_t first ,Int_t last);
+
+// first, first + 1, ... without an end
+LazyRef countFrom(Int_t first);
+
+// 1, 2, 3, ...
+LazyRef naturalNumbers();
+
+// Elements first to last of set counting from 0, streamed from set.
+LazyRef makeSlice(const Value& set ,size_t first ,size_t last);
+
+}; // Compiler
+
+#endif
@@ -1,32 +1,51 @@
 #ifndef LEXER_H
 #define LEXER_H
 
-#include <fstream>
+#include <array>
+#include <exception>
+#include <memory>
 #include <string>
 #include <optional>
 #include <string_view>
 
 #include "compiler.h"
+#include "source.h"
 #include "token.h"
 
 namespace Compiler {
 class Lexer
 {
     public:
-        Lexer(const CompileContext& context);
+        Lexer(const CompileContext& context); // lexes the first source file
+        Lexer(const CompileContext& context ,const std::string& sourceFile);
+        // lexes a part of a buffer owned by the caller, text must start at a line start
+        Lexer(std::string_view text ,size_t linesBefore);
         ~Lexer() = default;
 
+        static constexpr size_t kLookahead = 64; // max k for peek(k) + 1, power of 2
+
         std::optional<Token> getNextToken();
-        std::optional<Token> peekNextToken();
+        std::optional<Token> peekNextToken(); // same as peek(0)
+        std::optional<Token> peek(size_t k); // k tokens after the next one, nullopt past EOF
 
     private:
-        std::ifstream ifs {};
-        std::string line {};
-        std::optional<Token> nextToken;
+        std::unique_ptr<SourceBuffer> source {}; // mapped for the whole compile, null when lexing a view
+        std::string_view text {};
+        std::string_view line {};
+        size_t nextLineOffset = 0;
+
+        // tokens lexed ahead of the consumer, lexed in batches of up to kLookahead
+        std::array<Token ,kLookahead> lookahead {};
+        size_t lookaheadHead = 0;
+        size_t lookaheadCount = 0;
+        bool isEOF = false;
+        std::exception_ptr lexError {}; // thrown once the tokens before it are consumed
 
         size_t atLine = 0;
         size_t atColumn = 0;
 
+        Token makeToken(TokenType type ,uint32_t payload = 0) const; // at the current position
+
         Token lexIdentifierOrToken(const std::string_view view);
 
         Token lexNumber(const std::string_view view);
@@ -37,7 +56,9 @@ class Lexer
 
         Token lexOperator(const std::string_view view);
 
+        bool readLine(); // moves line to the next line of source, false on EOF
         std::optional<Token> tokenizeAtPosition();
+        bool fillLookahead(size_t count); // false if less than count tokens are left
         void advancePosition(const std::optional<Token> token);
 };
 
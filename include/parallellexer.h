@@ -0,0 +1,69 @@
+#ifndef PARALLELLEXER_H
+#define PARALLELLEXER_H
+
+#include <deque>
+#include <exception>
+#include <future>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "compiler.h"
+#include "source.h"
+#include "threadpool.h"
+#include "token.h"
+
+namespace Compiler {
+
+// Lexes one big file with several threads, same tokens as Lexer.
+//
+// The file is cut into chunks at newlines. The lexer keeps no state
+// across lines (a string or char literal left open at the end of a line
+// is an error), so a line start is always a safe place to resume and a
+// chunk never has to be lexed again.
+// First the newlines of every chunk are counted in parallel to get each
+// chunk's first line number, then the chunks are lexed as independent
+// Lexers, a few ahead of the consumer, and handed out in order.
+class ParallelLexer
+{
+    public:
+        static constexpr size_t kChunkSize = 4 << 20;
+        static constexpr size_t kMinFileSize = 2 * kChunkSize; // smaller files arent worth it
+
+        ParallelLexer(const CompileContext& context ,const std::string& sourceFile ,unsigned threads);
+        ~ParallelLexer() = default;
+
+        std::optional<Token> getNextToken();
+
+    private:
+        struct Chunk
+        {
+            std::vector<Token> tokens {};
+            std::exception_ptr error {}; // thrown after the tokens before it
+        };
+
+        SourceBuffer source_;
+        std::vector<std::string_view> chunkTexts_ {};
+        std::vector<size_t> linesBefore_ {};
+
+        ThreadPool pool_; // declared after the data the jobs read
+        std::deque<std::future<Chunk>> pending_ {};
+        size_t nextChunk_ = 0; // next one to submit
+
+        Chunk current_ {};
+        size_t currentIndex_ = 0;
+        bool isDone_ = false;
+
+        void splitChunks();
+        void submitChunks();
+        static Chunk lexChunk(std::string_view text ,size_t linesBefore);
+};
+
+// Lexes sourceFile with Lexer and ParallelLexer and logs the first
+// token that differs, returns true if both streams are the same.
+bool checkParallelLexer(const CompileContext& context ,const std::string& sourceFile ,unsigned threads);
+
+}; // Compiler
+
+#endif
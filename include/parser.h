@@ -1,33 +1,53 @@
 #ifndef PARSER_H
 #define PARSER_H
 
-#include <memory>
+#include <cstdint>
+#include <string>
 #include <vector>
 
+#include "arena.h"
 #include "compiler.h"
 #include "token.h"
 #include "astnode.h"
+#include "statementcache.h"
 
 namespace Compiler {
 
 class Parser
 {
     public:
-        Parser(const CompileContext& context);
+        // With a cache, statements seen before are taken from it instead of
+        // being parsed again, and parsed statements are added to it.
+        Parser(const CompileContext& context ,StatementCache* cache = nullptr);
         ~Parser() = default;
 
         void consume(Token token);
         bool statementReady();
         bool statementNotEmpty();
-        std::unique_ptr<AST::ASTNode> parse();
+        AST::ASTNode* parse(); // the node lives until releaseAST(), or in the cache
+        void releaseAST(); // frees every node returned by parse() so far, if there is no cache
+        bool wasCached() const { return wasCached_; } // if the last parse() came from the cache
+        uint64_t statementHash() const { return hash_; } // of the last parse(), 0 without a cache
+        size_t errorCount() const { return errorCount_; } // errors logged so far
+        bool hasErrors() const { return hasErrors_; } // if the last parse() logged errors
 
     private:
         const int kMaxNestRange_;
 
+        Arena arena_ {};
+        StatementCache* cache_;
+        Arena& nodeArena_; // arena_ or the cache's arena
+
+        bool hasErrors_ = false; // statements with errors arent cached
+        size_t errorCount_ = 0;
+        bool wasCached_ = false;
+        uint64_t hash_ = 0;
+
         std::vector<Token> tokenStream_ {};
         size_t currentIndex_ = 0;
         bool isStatementReady_ = false;
         int nestLevel_ = 0;
+        bool isInList_ = false; // parsing call arguments, a ',' ends the argument instead of starting an otherwise
 
         unsigned consumeNestLevel_ = 0;
 
@@ -39,17 +59,34 @@ class Parser
         std::string strCurrentTokenPos(); // returns "line:column"
         std::string strCurrentTokenType(); // returns current token type
         bool expect(TokenType type); // logs error if not matching
+        void error(const std::string& msg); // logs msg and marks the statement as failed
+        uint64_t hashStatement() const; // ignores token positions
         
-        std::unique_ptr<AST::ASTNode> getAST();
+        AST::ASTNode* getAST();
+
+        AST::ASTNode* parseEmpty();
 
-        std::unique_ptr<AST::ASTNode> parseEmpty();
+        AST::ASTNode* parseVariable();
 
-        std::unique_ptr<AST::ASTNode> parseVariable();
+        AST::Rvalue* parseRvalue();
+        size_t elementLength(size_t i) const; // tokens of the set element at tokenStream_[i], a literal or - and a number, 0 for none
+        bool isBlockAhead(); // if the '{' at the current token opens a block rather than a set
+        bool isSetValueAhead(); // if the '(' at the current token opens a set value rather than an expression
+        bool isComprehensionAhead(); // if the '{' at the current token opens a set comprehension
+        AST::Rvalue* parseSet();
 
-        std::unique_ptr<AST::Rvalue> parseRvalue();
-        std::unique_ptr<AST::Rvalue> parseSet();
+        // Pratt parser, minPower is the binding power an operator needs to be taken in
+        AST::Rvalue* parseExpression(int minPower = 0);
+        AST::Rvalue* parsePrefix();
+        AST::Rvalue* parseCall(AST::Rvalue* callee);
+        AST::Rvalue* parseMember(AST::Rvalue* set);
+        AST::Rvalue* parseComprehension();
+        AST::ASTNode* parseExpressionStatement();
+        AST::ASTNode* parseReturn();
+        bool parseParameters(AST::FunctionDefinition* function);
+        AST::ASTNode* parseDomain();
 
-        std::unique_ptr<AST::Block> parseBlock();
+        AST::Block* parseBlock();
         
 };
 
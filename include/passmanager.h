@@ -0,0 +1,62 @@
+#ifndef PASSMANAGER_H
+#define PASSMANAGER_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "bytecode.h"
+#include "ssa.h"
+
+namespace Compiler {
+
+// Runs optimization passes over the functions of a program in SSA form (see
+// ssa.h), one pass over all of them after the other, and times each.
+// A pass returns how many changes it made. Functions that arent in SSA form
+// are skipped.
+class PassManager
+{
+    public:
+        using Pass = size_t (*)(SSA::Module& module ,SSA::Function& function);
+
+        struct Timing
+        {
+            std::string name;
+            double milliseconds;
+            size_t changes;
+        };
+
+        void add(std::string name ,Pass pass);
+        void run(SSA::Module& module);
+        const std::vector<Timing>& timings() const { return timings_; }
+
+    private:
+        std::vector<std::pair<std::string ,Pass>> passes_ {};
+        std::vector<Timing> timings_ {};
+};
+
+// The passes. Their folding is the VM's (see vm.h), an operation that could
+// fail or whose result is undefined is left for the run, so the native
+// backend, where undefined is 0, computes the same as without them.
+
+// Sparse conditional constant propagation: values that are the same constant
+// on every path that can run become LoadConsts, branches whose condition is
+// known become jumps, and the blocks no path reaches are dead.
+size_t propagateConstants(SSA::Module& module ,SSA::Function& function);
+
+// Global value numbering: an operation that computes what one that dominates
+// it did, on the same values, becomes a Move of that result if its register
+// still holds it.
+size_t numberValues(SSA::Module& module ,SSA::Function& function);
+
+// Dead code elimination: instructions that cant fail and write values nothing
+// reads are removed.
+size_t eliminateDeadCode(SSA::Module& module ,SSA::Function& function);
+
+// Builds the SSA form of program, runs the passes above in order and lowers it
+// back. With isTimed it logs how long building, each pass and lowering took.
+Bytecode optimize(const Bytecode& program ,bool isTimed);
+
+}; // Compiler
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef RANGESOLVER_H
+#define RANGESOLVER_H
+
+#include <limits>
+#include <vector>
+
+#include "astnode.h"
+#include "token.h"
+#include "value.h"
+
+namespace Compiler {
+
+// How a comprehension over integers can skip most of its domain.
+// In { Natrual@Sets.an | an > 1 and an <= x/2 and x%an == 0 } the comparisons
+// between an and values that dont depend on an bound it to 2..x/2, so only
+// those candidates are tried and only x%an == 0 is left to check for them.
+struct RangePlan
+{
+    // variable op value, with the operands swapped if the variable was on the right
+    struct Bound
+    {
+        TokenType op; // == > >= < <=
+        const AST::Rvalue* value;
+    };
+
+    std::vector<Bound> bounds {};
+    std::vector<const AST::Rvalue*> filters {}; // the other conjuncts, in order
+
+    bool hasLowerBound() const;
+    bool hasUpperBound() const;
+};
+
+// Splits the and-connected conjuncts of predicate, nullptr gives an empty plan.
+RangePlan planRange(const AST::Rvalue* predicate ,SymbolId variable);
+
+// Inclusive interval of ints, empty once first > last.
+struct IntRange
+{
+    Int_t first = std::numeric_limits<Int_t>::min();
+    Int_t last = std::numeric_limits<Int_t>::max();
+
+    bool isEmpty() const { return first > last; }
+
+    // Keeps the ints i of the range for which i op value holds, value is a
+    // number or undefined (which no int compares to). Returns false for other values.
+    bool narrow(TokenType op ,const Value& value);
+};
+
+}; // Compiler
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef RECURSION_H
+#define RECURSION_H
+
+#include <vector>
+
+#include "astnode.h"
+#include "symbols.h"
+
+namespace Compiler {
+
+// How a function calls itself, when it can run as a loop instead of a call per
+// level (see Evaluator, TreeWalker and Bytecode).
+// Its value, or the one of a { return value; } body, has to be a tree of
+// conditionals (value | condition ,otherwise) with leaves that are
+//   a call of the function, a tail call: the loop goes on with its arguments,
+//   call op operand or operand op call with an arithmetic op, a step: the loop
+//   goes on with the arguments, op is applied once the levels below are done,
+//   or anything that doesnt call the function, where the loop stops.
+// The recursive leaves are all tail calls, or there is one step, like in
+//   factorial(x : int) = { return (factorial(x - 1) * x | x > 1 ,1); }
+// at least one leaf stops, and the function calls itself nowhere else.
+struct Recursion
+{
+    enum class Kind
+    {
+        None,
+        Tail,
+        Linear, // one step
+    };
+
+    Kind kind = Kind::None;
+    SymbolId name {};
+    const AST::Rvalue* value = nullptr;
+    std::vector<const AST::Conditional*> branches {}; // the conditionals with recursive leaves
+    const AST::Binary* step = nullptr;
+    bool isCallFirst = false; // the step is call op operand
+
+    // The parameters of a level can be computed back from the ones of the
+    // level below, so the levels of a step need no memory: every argument of
+    // the step is its parameter, or an int parameter plus or minus an int
+    // literal, nothing assigns a parameter, and an operand evaluated before
+    // the call is a literal or a parameter.
+    bool isReversible = false;
+
+    bool isLoop() const { return kind == Kind::Tail || (kind == Kind::Linear && isReversible); } // for runtime code
+    bool isBranch(const AST::Rvalue* node) const;
+    const AST::Call* callOf(const AST::Rvalue* node) const; // nullptr if node isnt a call of the function
+    const AST::Call* stepCall() const { return callOf(isCallFirst ? step->lhs : step->rhs); }
+    const AST::Rvalue* stepOperand() const { return isCallFirst ? step->rhs : step->lhs; }
+};
+
+Recursion findRecursion(const AST::FunctionDefinition* function);
+
+}; // Compiler
+
+#endif
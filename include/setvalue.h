@@ -0,0 +1,150 @@
+#ifndef SETVALUE_H
+#define SETVALUE_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "value.h"
+
+namespace Compiler {
+
+// Finite set of values, immutable once built. Its representation is picked
+// from its contents, so equal sets always have the same one:
+//   Bits   ints that are dense enough, one bit for every int from the smallest to the largest
+//   Ints   other ints, sorted
+//   Mixed  anything else, sorted by valueLess with a hash index for lookups
+// Whatever the representation, elements are visited and indexed in valueLess order.
+class SetValue
+{
+    public:
+        enum class Kind : uint8_t
+        {
+            Bits,
+            Ints,
+            Mixed,
+        };
+
+        static SetRef make(std::vector<Value> elements); // any order, duplicates allowed
+        static SetRef fromInts(std::vector<Int_t> ints); // any order, duplicates allowed
+        static const SetRef& empty();
+
+        Kind kind() const { return kind_; }
+        size_t size() const { return size_; }
+        Value at(size_t i) const; // i < size()
+        bool contains(const Value& value) const;
+
+        template <typename F>
+        void forEach(F&& f) const
+        {
+            switch (kind_)
+            {
+                case Kind::Bits:
+                    for (size_t w = 0; w < words_.size(); w++)
+                        for (uint64_t word = words_[w]; word; word &= word - 1)
+                            f(Value(static_cast<Int_t>(base_ + static_cast<Int_t>(w * 64 + __builtin_ctzll(word)))));
+                    break;
+                case Kind::Ints:
+                    for (Int_t i : ints_)
+                        f(Value(i));
+                    break;
+                case Kind::Mixed:
+                    for (const auto& value : values_)
+                        f(value);
+                    break;
+            }
+        }
+
+        // forEach for elements first..first + count - 1 only, first + count <= size()
+        template <typename F>
+        void forEach(size_t first ,size_t count ,F&& f) const
+        {
+            if (count == 0)
+                return;
+            switch (kind_)
+            {
+                case Kind::Bits: {
+                    size_t w = std::upper_bound(ranks_.begin() ,ranks_.end() ,first) - ranks_.begin() - 1;
+                    uint64_t word = words_[w];
+                    for (size_t skip = first - ranks_[w]; skip; skip--)
+                        word &= word - 1;
+                    while (true)
+                    {
+                        for (; word; word &= word - 1)
+                        {
+                            f(Value(static_cast<Int_t>(base_ + static_cast<Int_t>(w * 64 + __builtin_ctzll(word)))));
+                            if (--count == 0)
+                                return;
+                        }
+                        word = words_[++w];
+                    }
+                }
+                case Kind::Ints:
+                    for (size_t i = first; i < first + count; i++)
+                        f(Value(ints_[i]));
+                    break;
+                case Kind::Mixed:
+                    for (size_t i = first; i < first + count; i++)
+                        f(values_[i]);
+                    break;
+            }
+        }
+
+    private:
+        Kind kind_ = Kind::Ints;
+        size_t size_ = 0;
+
+        // Bits: bit i of the words is base_ + i, bit 0 is set
+        Int_t base_ = 0;
+        std::vector<uint64_t> words_ {};
+        std::vector<uint32_t> ranks_ {}; // set bits in the words before each word
+
+        // Ints
+        std::vector<Int_t> ints_ {};
+
+        // Mixed: open addressing, a slot holds the position of an element in values_ plus 1
+        std::vector<Value> values_ {};
+        std::vector<uint32_t> slots_ {};
+
+        SetValue() = default;
+
+        static SetRef fromSortedInts(std::vector<Int_t> ints); // sorted, no duplicates
+        static SetRef fromBits(Int_t base ,std::vector<uint64_t> words); // bit i is base + i
+        static SetRef fromSortedValues(std::vector<Value> values); // sorted by valueLess, no duplicates
+
+        Int_t last() const; // of a non empty Bits set
+        std::vector<Int_t> ints() const; // of a Bits or Ints set
+        size_t find(const Value& value) const; // Mixed, the slot that holds value or the empty one where it would go
+
+        friend SetRef setUnion(const SetRef& a ,const SetRef& b);
+        friend SetRef setIntersection(const SetRef& a ,const SetRef& b);
+        friend SetRef setDifference(const SetRef& a ,const SetRef& b);
+        friend bool setsEqual(const SetValue& a ,const SetValue& b);
+};
+
+// Each one has a word-wise version for two Bits sets, a merge of sorted
+// ints for two sets of ints, and lookups in the other set for the rest.
+SetRef setUnion(const SetRef& a ,const SetRef& b);
+SetRef setIntersection(const SetRef& a ,const SetRef& b);
+SetRef setDifference(const SetRef& a ,const SetRef& b); // the elements of a that arent in b
+bool setsEqual(const SetValue& a ,const SetValue& b);
+
+// Collects the elements of a set, while they are all ints without a Value per element.
+class SetBuilder
+{
+    public:
+        void add(const Value& value);
+        void merge(SetBuilder&& other); // adds what other was given
+        SetRef build();
+
+    private:
+        std::vector<Int_t> ints_ {};
+        std::vector<Value> values_ {}; // once there is something else than an int
+        bool isMixed_ = false;
+};
+
+}; // Compiler
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef SOURCE_H
+#define SOURCE_H
+
+#include <string>
+#include <string_view>
+
+namespace Compiler {
+
+// Read-only contents of a whole source file.
+// Regular files are memory-mapped so tokens can be views into the buffer,
+// anything that cant be mapped (pipes, empty files) is read into memory instead.
+// Views returned by view() stay valid for the lifetime of the buffer.
+class SourceBuffer
+{
+    public:
+        SourceBuffer(const std::string& path);
+        ~SourceBuffer();
+
+        SourceBuffer(const SourceBuffer&) = delete;
+        SourceBuffer& operator=(const SourceBuffer&) = delete;
+
+        std::string_view view() const;
+
+    private:
+        const char* data_ = nullptr;
+        size_t size_ = 0;
+        bool isMapped_ = false;
+
+        std::string contents_ {}; // only used when mapping fails
+};
+
+}; //Compiler
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef SPSCQUEUE_H
+#define SPSCQUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+namespace Compiler {
+
+// Bounded lock-free queue for exactly one producer and one consumer thread.
+// Each side caches the other side's index and only rereads it when the
+// queue looks full (producer) or empty (consumer).
+template <typename T ,size_t kCapacity>
+class SpscQueue
+{
+    static_assert((kCapacity & (kCapacity - 1)) == 0 ,"capacity must be a power of 2");
+
+    public:
+        SpscQueue() : slots_(kCapacity) {}
+
+        // producer side, false if full
+        bool tryPush(T&& value)
+        {
+            const size_t tail = tail_.load(std::memory_order_relaxed);
+            if (tail - cachedHead_ == kCapacity)
+            {
+                cachedHead_ = head_.load(std::memory_order_acquire);
+                if (tail - cachedHead_ == kCapacity)
+                    return false;
+            }
+
+            slots_[tail & (kCapacity - 1)] = std::move(value);
+            tail_.store(tail + 1 ,std::memory_order_release);
+            return true;
+        }
+
+        // consumer side, false if empty
+        bool tryPop(T& value)
+        {
+            const size_t head = head_.load(std::memory_order_relaxed);
+            if (head == cachedTail_)
+            {
+                cachedTail_ = tail_.load(std::memory_order_acquire);
+                if (head == cachedTail_)
+                    return false;
+            }
+
+            value = std::move(slots_[head & (kCapacity - 1)]);
+            head_.store(head + 1 ,std::memory_order_release);
+            return true;
+        }
+
+    private:
+        std::vector<T> slots_;
+
+        // consumer owned
+        alignas(64) std::atomic<size_t> head_ {0};
+        size_t cachedTail_ = 0;
+
+        // producer owned
+        alignas(64) std::atomic<size_t> tail_ {0};
+        size_t cachedHead_ = 0;
+};
+
+}; // Compiler
+
+#endif
@@ -0,0 +1,94 @@
+#ifndef SSA_H
+#define SSA_H
+
+#include <cstdint>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "bytecode.h"
+
+namespace Compiler {
+namespace SSA {
+
+constexpr uint32_t kNone = UINT32_MAX; // no value, block or instruction
+
+// The Bytecode of a program in static single assignment form, for the
+// optimization passes (see passmanager.h).
+// Every write of a register is a value of its own and every read knows the
+// value it gets, a Phi joins the values a register has when control flow
+// meets. Values stay in the register they are written to, so the IR is a
+// view of the bytecode: lower() writes the instructions back as they are,
+// there are no copies to place for the phis.
+// A function whose jumps go backwards isnt in SSA form, the passes leave it
+// alone. Compiled code only jumps backwards in the loops of recursive
+// functions (see recursion.h).
+
+struct Instruction
+{
+    Bytecode::Instruction code; // a jump's target is a block
+    uint32_t def = kNone; // the value it writes
+    std::vector<uint32_t> uses {}; // the values it reads, in Bytecode::forEachRead() order, kNone for none
+    bool isDead = false;
+};
+
+struct Phi
+{
+    uint16_t reg;
+    uint32_t def;
+    std::vector<uint32_t> incoming {}; // one for each predecessor
+};
+
+struct Block
+{
+    std::vector<Phi> phis {};
+    std::vector<Instruction> instructions {};
+    uint32_t next = kNone; // the block it falls through to
+    uint32_t target = kNone; // the block its last instruction jumps to
+    std::vector<uint32_t> predecessors {};
+    uint32_t dominator = kNone; // the immediate one, none for the entry
+    bool isDead = false; // unreachable
+};
+
+// where a value is written, parameters are written by the caller
+struct Definition
+{
+    uint32_t block;
+    uint32_t index; // of the instruction or the phi, kNone for a parameter
+    bool isPhi;
+    uint16_t reg;
+};
+
+struct Function
+{
+    uint32_t index; // in Bytecode::functions
+    std::vector<Block> blocks {}; // in the order of the code, the entry first
+    std::vector<Definition> values {}; // the parameters first
+    bool isSSA = true;
+
+    const Instruction* definition(uint32_t value) const; // nullptr for phis and parameters
+};
+
+struct Module
+{
+    Bytecode program; // the code is written back by lower()
+    std::vector<Function> functions {};
+
+    uint32_t constant(const RuntimeValue& value); // its index in program.constants, added if it isnt there
+
+    private:
+        std::map<std::pair<RuntimeValue::Type ,uint64_t> ,uint32_t> constants_ {}; // by type and bits
+        size_t indexed_ = 0; // the constants in constants_
+};
+
+Module build(const Bytecode& program);
+Bytecode lower(Module module);
+
+// after blocks were found dead or lost edges, recomputes the predecessors,
+// the phis incoming values and the dominators
+void update(Function& function);
+
+}; // SSA
+}; // Compiler
+
+#endif
@@ -0,0 +1,90 @@
+#ifndef STATEMENTCACHE_H
+#define STATEMENTCACHE_H
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "arena.h"
+#include "astnode.h"
+#include "compiler.h"
+
+namespace Compiler {
+
+// A top level statement of the last compile. The statements of a file cover
+// its whole text, each one ends just after its ';' (the last one may end at
+// the end of the text instead).
+struct CachedStatement
+{
+    size_t end; // offset in the source text
+    uint32_t line; // position of the ';' token
+    uint32_t column;
+    uint64_t hash; // see Parser::hashStatement
+    AST::ASTNode* node; // as returned by Parser::parse()
+    bool isComplete; // if it ends with a ';'
+};
+
+// ASTs of the top level statements of one file from earlier compiles, keyed
+// by a hash of the statement's tokens. Cached nodes are never modified, so a
+// statement that appears twice shares one node. Entries are counted by the
+// statements that use them and dropped when the last one goes away.
+// Also keeps the last text of the file, so the next compile only has to lex
+// and parse what lies between the unchanged prefix and suffix.
+class StatementCache
+{
+    public:
+        StatementCache() = default;
+
+        StatementCache(const StatementCache&) = delete;
+        StatementCache& operator=(const StatementCache&) = delete;
+
+        Arena& arena() { return arena_; } // cached nodes live here
+
+        AST::ASTNode* find(uint64_t hash) const; // nullptr on a miss
+        void insert(uint64_t hash ,AST::ASTNode* node ,size_t bytes);
+        void addUse(uint64_t hash);
+        void removeUse(uint64_t hash);
+
+        void beginCompile();
+        void endCompile(std::string text ,std::vector<CachedStatement> statements);
+        void clear(); // the next compile starts from scratch
+
+        bool isWarm() const { return compileCount_ > 1; } // if an earlier compile filled it
+        const std::string& text() const { return text_; }
+        const std::vector<CachedStatement>& statements() const { return statements_; }
+
+        // the next compile edits these and hands them back to endCompile()
+        std::vector<CachedStatement> takeStatements() { return std::exchange(statements_ ,{}); }
+        std::string takeSpareText() { return std::exchange(spareText_ ,{}); } // memory to read the next text into
+
+    private:
+        // once this much of the arena is garbage it is thrown away with every entry
+        static constexpr size_t kMaxDeadBytes_ = 16 * 1024 * 1024;
+
+        struct Entry
+        {
+            AST::ASTNode* node;
+            size_t bytes; // arena bytes used by the statement
+            size_t uses;
+        };
+
+        Arena arena_ {};
+        std::unordered_map<uint64_t ,Entry> entries_ {};
+        unsigned compileCount_ = 0;
+        size_t liveBytes_ = 0;
+
+        std::string text_ {};
+        std::string spareText_ {}; // the text before text_
+        std::vector<CachedStatement> statements_ {};
+};
+
+// Compiles sourceFile like the normal path does, but reuses everything cache
+// has for it and only prints the statements that had to be parsed again.
+// Returns false if the file couldnt be compiled.
+bool compileIncremental(const CompileContext& context ,const std::string& sourceFile ,StatementCache& cache);
+
+}; // Compiler
+
+#endif
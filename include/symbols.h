@@ -0,0 +1,73 @@
+#ifndef SYMBOLS_H
+#define SYMBOLS_H
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace Compiler {
+
+using Int_t = long long;
+using Double_t = double;
+using Char_t = char;
+using String_t = std::string;
+
+// Interned string, equal strings always get the same id.
+enum class SymbolId : uint32_t {};
+
+// Global table of identifiers, string literals and numeric literals.
+// Tokens and AST nodes only hold 32 bit indices into it.
+// Safe to use from several threads, the table is split into shards with a
+// lock each so lexers running in parallel rarely wait on each other.
+// The low bits of an id/index select the shard.
+class SymbolTable
+{
+    public:
+        SymbolId intern(std::string_view str);
+        std::string_view lookup(SymbolId id) const;
+
+        uint32_t addInt(Int_t value);
+        Int_t getInt(uint32_t index) const;
+
+        uint32_t addDouble(Double_t value);
+        Double_t getDouble(uint32_t index) const;
+
+    private:
+        static constexpr uint32_t kShardBits_ = 4;
+        static constexpr uint32_t kShardCount_ = 1 << kShardBits_;
+        static constexpr size_t kBlockSize_ = 64 * 1024;
+
+        struct Shard
+        {
+            mutable std::mutex mutex {};
+
+            std::vector<std::unique_ptr<char[]>> blocks {}; // backing storage of strings
+            size_t blockUsed = kBlockSize_;
+
+            std::vector<std::string_view> strings {};
+            std::unordered_map<std::string_view ,SymbolId> ids {};
+
+            std::vector<Int_t> ints {};
+            std::vector<Double_t> doubles {};
+
+            std::string_view store(std::string_view str);
+        };
+
+        Shard shards_[kShardCount_] {};
+
+        static uint32_t makeIndex(uint32_t shard ,size_t local);
+        const Shard& shardOf(uint32_t index) const { return shards_[index & (kShardCount_ - 1)]; }
+        static size_t localOf(uint32_t index) { return index >> kShardBits_; }
+
+        Shard& threadShard(); // literal pools are sharded by thread
+};
+
+SymbolTable& symbols();
+
+}; // Compiler
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef TASKSCHEDULER_H
+#define TASKSCHEDULER_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Compiler {
+
+// Runs the tasks of a loop on a fixed set of threads, the calling one included.
+// Every thread starts on its own share of the tasks, one that runs out steals
+// the back half of what another has left, so tasks that take very different
+// times still keep every thread busy. Which thread runs a task depends on
+// timing, so a task should only write results of its own.
+class TaskScheduler
+{
+    public:
+        TaskScheduler(unsigned threads); // starts threads - 1, the caller of run() is the last one
+        ~TaskScheduler();
+
+        TaskScheduler(const TaskScheduler&) = delete;
+        TaskScheduler& operator=(const TaskScheduler&) = delete;
+
+        // Runs task(0) .. task(count - 1) and returns once all of them have.
+        // task must not throw or call run() itself.
+        void run(size_t count ,const std::function<void(size_t)>& task);
+
+        size_t size() const { return shares_.size(); }
+
+    private:
+        // the tasks next..end - 1 a thread has left
+        struct alignas(64) Share
+        {
+            std::mutex mutex {};
+            size_t next = 0;
+            size_t end = 0;
+        };
+
+        std::vector<std::unique_ptr<Share>> shares_ {}; // the last one is the caller's
+        std::vector<std::thread> workers_ {};
+        std::mutex mutex_ {};
+        std::condition_variable wakeup_ {};
+        std::condition_variable finished_ {};
+        const std::function<void(size_t)>* task_ = nullptr;
+        uint64_t round_ = 0; // run() calls so far
+        size_t busy_ = 0; // workers still running tasks of this round
+        bool isStopping_ = false;
+
+        void work(size_t self);
+        void drain(size_t self ,const std::function<void(size_t)>& task); // until no share has tasks left
+        bool take(size_t self ,size_t& task);
+        bool steal(size_t self);
+};
+
+}; // Compiler
+
+#endif
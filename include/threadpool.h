@@ -0,0 +1,54 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+namespace Compiler {
+
+// Fixed set of worker threads running submitted jobs in FIFO order.
+class ThreadPool
+{
+    public:
+        ThreadPool(unsigned threads);
+        ~ThreadPool(); // finishes queued jobs, then joins
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        // exceptions thrown by job are rethrown by the future's get()
+        template <typename F>
+        auto submit(F job) -> std::future<decltype(job())>
+        {
+            auto task = std::make_shared<std::packaged_task<decltype(job())()>>(std::move(job));
+            auto future = task->get_future();
+            {
+                std::lock_guard lock(mutex_);
+                jobs_.emplace([task]() { (*task)(); });
+            }
+            wakeup_.notify_one();
+            return future;
+        }
+
+        size_t size() const { return workers_.size(); }
+
+    private:
+        std::vector<std::thread> workers_ {};
+        std::queue<std::function<void()>> jobs_ {};
+        std::mutex mutex_ {};
+        std::condition_variable wakeup_ {};
+        bool isStopping_ = false;
+
+        void work();
+};
+
+unsigned defaultJobCount(); // one per hardware thread the process may run on
+
+}; // Compiler
+
+#endif
@@ -1,13 +1,15 @@
 #ifndef TOKEN_H
 #define TOKEN_H
 
-#include <variant>
-#include <string>
-#include <unordered_map>
+#include <array>
+#include <cstdint>
+#include <string_view>
+
+#include "symbols.h"
 
 namespace Compiler {
 
-enum class TokenType
+enum class TokenType : uint8_t
 {
     Unknown = 0,
     Identifier,
@@ -25,6 +27,8 @@ enum class TokenType
     Create,
     Delete,
     Return,
+    Continuous, // set comprehensions: generated on demand
+    Discrete,
 
     Undefined, // Values
     Nan,
@@ -70,35 +74,51 @@ enum class TokenType
     GreaterEquals,
     LessEquals,
 
-};
+    Pipe, // conditions: value | condition ,otherwise
+    At, // name@Domain
+    Dot, // Set.x Set.[n]
+    DoubleDot, // ranges: 1..n
 
-using Int_t = long long;
-using Double_t = double;
-using Char_t = char;
-using String_t = std::string;
-using Identifier_t = String_t;
+};
 
+// 16 bytes, copied by value everywhere.
+// payload depends on type:
+//   Identifier, String -> SymbolId
+//   Integer            -> the value itself, or kPooledInt | index into the
+//                         SymbolTable int pool if it doesnt fit in 31 bits
+//   Double             -> index into the SymbolTable double pool
+//   Char               -> the char itself
 struct Token
 {
+    static constexpr uint32_t kPooledInt = 1u << 31;
+
     TokenType type {TokenType::Unknown};
-    std::variant<
-        std::monostate,
-        Int_t,
-        Double_t,
-        Char_t,
-        String_t
-            > value {};
-    size_t line {};
-    size_t column {};
+    uint32_t payload {};
+    uint32_t line {};
+    uint32_t column {};
 
+    SymbolId symbol() const { return static_cast<SymbolId>(payload); }
+    Int_t intValue() const { return payload & kPooledInt ? symbols().getInt(payload & ~kPooledInt) : payload; }
+    Double_t doubleValue() const { return symbols().getDouble(payload); }
+    Char_t charValue() const { return static_cast<Char_t>(payload); }
 };
-const std::unordered_map<std::string_view ,TokenType> kKeywords =
+static_assert(sizeof(Token) == 16);
+
+struct TokenSpelling
+{
+    std::string_view key {};
+    TokenType type {TokenType::Unknown};
+};
+
+inline constexpr TokenSpelling kKeywords[] =
 {
     {"define" ,TokenType::Define},
     {"new" ,TokenType::New},
     {"create" ,TokenType::Create},
     {"delete" ,TokenType::Delete},
     {"return" ,TokenType::Return},
+    {"continuous" ,TokenType::Continuous},
+    {"discrete" ,TokenType::Discrete},
 
     {"undefined" ,TokenType::Undefined},
     {"nan" ,TokenType::Nan},
@@ -109,7 +129,7 @@ const std::unordered_map<std::string_view ,TokenType> kKeywords =
     {"xor" ,TokenType::Xor},
 };
 
-const std::unordered_map<std::string_view ,TokenType> kOperators =
+inline constexpr TokenSpelling kOperators[] =
 {
     {"=" ,TokenType::Assign},
     {":" ,TokenType::Allocate},
@@ -145,8 +165,121 @@ const std::unordered_map<std::string_view ,TokenType> kOperators =
     {">=" ,TokenType::GreaterEquals},
     {"<=" ,TokenType::LessEquals},
     {"," ,TokenType::Comma},
+
+    {"|" ,TokenType::Pipe},
+    {"@" ,TokenType::At},
+    {"." ,TokenType::Dot},
+    {".." ,TokenType::DoubleDot},
+};
+
+
+// Everything below is built from kKeywords and kOperators at compile time.
+
+inline constexpr size_t kTokenTypeCount = static_cast<size_t>(TokenType::DoubleDot) + 1; // keep in sync
+
+// Perfect hash over kKeywords, retune the constants if the static_assert fires.
+constexpr size_t keywordHash(std::string_view key)
+{
+    return (key.size() + key[0] * 2 + key[key.size() - 2] * 12) & 31;
+}
+
+struct KeywordTable
+{
+    TokenSpelling slots[32] {};
+    bool isPerfect = true;
+
+    constexpr KeywordTable()
+    {
+        for (const auto& keyword : kKeywords)
+        {
+            auto& slot = slots[keywordHash(keyword.key)];
+            if (!slot.key.empty())
+                isPerfect = false;
+            slot = keyword;
+        }
+    }
 };
+inline constexpr KeywordTable kKeywordTable {};
+static_assert(kKeywordTable.isPerfect ,"keywordHash has collisions");
+
+// returns TokenType::Unknown if str isnt a keyword
+inline TokenType findKeyword(std::string_view str)
+{
+    if (str.size() < 2)
+        return TokenType::Unknown;
+
+    const auto& slot = kKeywordTable.slots[keywordHash(str)];
+    return slot.key == str ? slot.type : TokenType::Unknown;
+}
+
+// Trie over kOperators, walked with maximal munch.
+// State 0 is the root, a transition to 0 means no operator continues with that char.
+constexpr size_t operatorTrieSize()
+{
+    size_t size = 1;
+    for (const auto& op : kOperators)
+        size += op.key.size();
+    return size;
+}
+
+struct OperatorTrie
+{
+    uint8_t next[operatorTrieSize()][128] {};
+    TokenType accept[operatorTrieSize()] {};
 
+    constexpr OperatorTrie()
+    {
+        size_t states = 1;
+        for (const auto& op : kOperators)
+        {
+            size_t state = 0;
+            for (char c : op.key)
+            {
+                auto& target = next[state][static_cast<uint8_t>(c)];
+                if (target == 0)
+                    target = static_cast<uint8_t>(states++);
+                state = target;
+            }
+            accept[state] = op.type;
+        }
+    }
+};
+inline constexpr OperatorTrie kOperatorTrie {};
+static_assert(operatorTrieSize() < 256);
+
+// Longest operator at the start of view, length is 0 if there is none.
+inline TokenSpelling matchOperator(std::string_view view)
+{
+    TokenSpelling longest {};
+    size_t state = 0;
+
+    for (size_t i = 0; i < view.size(); i++)
+    {
+        const auto c = static_cast<uint8_t>(view[i]);
+        if (c >= 128)
+            break;
+
+        state = kOperatorTrie.next[state][c];
+        if (state == 0)
+            break;
+
+        if (kOperatorTrie.accept[state] != TokenType::Unknown)
+            longest = {view.substr(0 ,i + 1) ,kOperatorTrie.accept[state]};
+    }
+    return longest;
+}
+
+// TokenType -> spelling, empty for types without a fixed spelling.
+constexpr std::array<std::string_view ,kTokenTypeCount> makeTokenSpellings()
+{
+    std::array<std::string_view ,kTokenTypeCount> spellings {};
+    for (const auto& op : kOperators)
+        spellings[static_cast<size_t>(op.type)] = op.key;
+    for (const auto& keyword : kKeywords)
+        spellings[static_cast<size_t>(keyword.type)] = keyword.key;
+    return spellings;
+}
+inline constexpr auto kTokenSpellings = makeTokenSpellings();
 
 }; // Compiler
 
@@ -0,0 +1,119 @@
+#ifndef TOKENPIPELINE_H
+#define TOKENPIPELINE_H
+
+#include <array>
+#include <atomic>
+#include <exception>
+#include <optional>
+#include <thread>
+#include <utility>
+
+#include "spscqueue.h"
+#include "token.h"
+
+namespace Compiler {
+
+// Runs LexerT on its own thread, ahead of the thread calling getNextToken().
+// Tokens go through a lock-free SPSC queue in batches; when the queue is
+// full the lexer thread waits, so it can be at most kQueueSize batches ahead.
+template <typename LexerT>
+class TokenPipeline
+{
+    public:
+        static constexpr size_t kBatchSize = 256;
+        static constexpr size_t kQueueSize = 64;
+
+        template <typename... Args>
+        TokenPipeline(Args&&... args)
+            : lexer_(std::forward<Args>(args)...)
+            ,thread_(&TokenPipeline::produce ,this)
+        {}
+
+        ~TokenPipeline()
+        {
+            isStopping_.store(true ,std::memory_order_relaxed);
+            thread_.join();
+        }
+
+        TokenPipeline(const TokenPipeline&) = delete;
+        TokenPipeline& operator=(const TokenPipeline&) = delete;
+
+        std::optional<Token> getNextToken()
+        {
+            while (currentIndex_ == current_.count)
+            {
+                if (current_.error)
+                {
+                    current_.isLast = true;
+                    std::rethrow_exception(std::exchange(current_.error ,nullptr));
+                }
+                if (current_.isLast)
+                    return std::nullopt; // EOF
+
+                while (!queue_.tryPop(current_))
+                    std::this_thread::yield(); // lexer is behind
+                currentIndex_ = 0;
+            }
+            return current_.tokens[currentIndex_++];
+        }
+
+    private:
+        struct Batch
+        {
+            std::array<Token ,kBatchSize> tokens {};
+            size_t count = 0;
+            bool isLast = false;
+            std::exception_ptr error {}; // after the tokens of this batch
+        };
+
+        LexerT lexer_;
+        SpscQueue<Batch ,kQueueSize> queue_ {};
+        std::atomic<bool> isStopping_ {false};
+
+        // consumer side
+        Batch current_ {};
+        size_t currentIndex_ = 0;
+
+        std::thread thread_; // last, starts once everything above exists
+
+        void produce()
+        {
+            while (true)
+            {
+                Batch batch;
+                try
+                {
+                    while (batch.count < kBatchSize)
+                    {
+                        auto token = lexer_.getNextToken();
+                        if (!token)
+                        {
+                            batch.isLast = true;
+                            break;
+                        }
+                        batch.tokens[batch.count++] = *token;
+                    }
+                }
+                catch (...)
+                {
+                    batch.error = std::current_exception();
+                    batch.isLast = true;
+                }
+
+                const bool isLast = batch.isLast;
+                while (!queue_.tryPush(std::move(batch)))
+                {
+                    if (isStopping_.load(std::memory_order_relaxed))
+                        return; // consumer is gone
+                    std::this_thread::yield(); // parser is behind
+                }
+
+                if (isLast || isStopping_.load(std::memory_order_relaxed))
+                    return;
+            }
+        }
+};
+
+}; // Compiler
+
+#endif
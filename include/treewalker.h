@@ -0,0 +1,91 @@
+#ifndef TREEWALKER_H
+#define TREEWALKER_H
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "astnode.h"
+#include "recursion.h"
+#include "symbols.h"
+#include "value.h"
+
+namespace Compiler {
+
+// Runs the folded runtime code of a program directly on its AST, each name a
+// Value looked up when it is used, the simplest way to run it. The VM (see
+// vm.h) is checked and measured against it with --run=bench.
+// Functions that call themselves as a tail call, or as a step whose levels can
+// be computed back (see recursion.h), run as loops like the VM runs them.
+// Errors are thrown as std::runtime_error.
+class TreeWalker
+{
+    public:
+        void run(const std::vector<const AST::ASTNode*>& statements);
+
+        // the values of the top level variables the run declared, like VM::results()
+        std::vector<std::pair<SymbolId ,Value>> results() const;
+
+    private:
+        static constexpr size_t kMaxCallDepth_ = 1000;
+        static constexpr size_t kNoDomain_ = static_cast<size_t>(-1);
+
+        using Slot = std::shared_ptr<Value>; // shared by a name and its references
+
+        struct Local
+        {
+            SymbolId name;
+            Slot slot;
+            size_t domain; // of the named domain it is on, kNoDomain_ for others
+            size_t depth; // of the block it is visible in
+        };
+
+        struct Domain
+        {
+            SymbolId name;
+            size_t depth;
+            size_t id;
+        };
+
+        // a function's names and domains, the top level code is one too
+        struct Frame
+        {
+            std::vector<Local> locals {};
+            std::vector<Domain> domains {}; // the alive ones
+            size_t depth = 0;
+        };
+
+        std::unordered_map<SymbolId ,Local> globals_ {};
+        std::unordered_map<SymbolId ,const AST::FunctionDefinition*> functions_ {};
+        std::unordered_map<const AST::FunctionDefinition* ,Recursion> recursions_ {}; // found once per function
+        std::vector<Frame> frames_ {};
+        std::vector<bool> isDomainAlive_ {};
+        std::vector<Local> results_ {}; // top level variables in the order they were declared
+        Value returnValue_ {};
+
+        [[noreturn]] static void fail(const std::string& msg);
+
+        Local* find(SymbolId name);
+        Local& named(const AST::Rvalue* node); // the variable node names, fails if it isnt a name
+        const Domain& findDomain(SymbolId name) const;
+
+        Value evaluate(const AST::Rvalue* node);
+        Value evaluateUnary(const AST::Unary* unary);
+        Value evaluateBinary(const AST::Binary* binary);
+        Value evaluateCall(const AST::Call* call);
+        Value evaluateBlock(const AST::Block* block);
+        static void convertArguments(const AST::FunctionDefinition* function ,std::vector<Value>& arguments); // to the parameter types
+        Value call(const AST::FunctionDefinition* function ,std::vector<Value> arguments);
+        Value loop(const AST::FunctionDefinition* function ,const Recursion& recursion); // the body of a call of a recursive function
+        bool execute(const AST::ASTNode* statement); // true if it returned
+        void declare(const AST::VariableBase* variable);
+        void enterBlock();
+        void exitBlock();
+};
+
+}; // Compiler
+
+#endif
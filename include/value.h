@@ -0,0 +1,39 @@
+#ifndef VALUE_H
+#define VALUE_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <variant>
+#include <vector>
+
+#include "astnode.h"
+#include "symbols.h"
+
+namespace Compiler {
+
+class SetValue;
+using SetRef = std::shared_ptr<const SetValue>; // see setvalue.h
+class LazySet;
+using LazyRef = std::shared_ptr<LazySet>; // see lazyset.h
+
+// A value computed at compile time.
+// monostate is undefined, truth values are the Int_t 1 and 0 like in C.
+// Sets are immutable and shared between the values that hold them, LazySets
+// only grow the part of them that is known.
+using Value = std::variant<std::monostate ,Int_t ,Double_t ,Char_t ,SymbolId ,SetRef ,LazyRef>;
+
+Value toValue(const AST::Literal_t& literal);
+bool isNumber(const Value& value); // Int_t, Double_t or Char_t
+bool isTruthy(const Value& value); // nonzero numbers, non empty strings and sets, may compute a LazySet's first element
+
+bool valuesEqual(const Value& a ,const Value& b); // the language's ==, numbers compare by value
+bool isSame(const Value& a ,const Value& b); // same type and bits, NaN is the same as NaN, LazySets by identity
+bool valueLess(const Value& a ,const Value& b); // a total order, for sorting sets
+uint64_t hashOf(const Value& value ,uint64_t hash); // consistent with isSame()
+
+std::string formatValue(const Value& value); // like a literal in source
+
+}; // Compiler
+
+#endif
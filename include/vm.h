@@ -0,0 +1,64 @@
+#ifndef VM_H
+#define VM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "astnode.h"
+#include "bytecode.h"
+#include "compiler.h"
+#include "symbols.h"
+#include "value.h"
+
+namespace Compiler {
+
+// Runs Bytecode (see bytecode.h) with an interpreter loop that jumps from the
+// end of one instruction straight to the next one's code (computed goto, with
+// GCC and Clang) instead of going back to a switch.
+// Ints are added, compared and so on inline, everything else goes through
+// applyBinary() so runtime code computes the same as the Evaluator.
+// The registers of all frames are one stack, a call only moves where its frame starts.
+// Errors are thrown as std::runtime_error, the domains a run leaves alive are
+// deleted with the VM.
+class VM
+{
+    public:
+        explicit VM(const Bytecode& program);
+        ~VM();
+
+        VM(const VM&) = delete;
+        VM& operator=(const VM&) = delete;
+
+        void run();
+
+        // the values of the top level variables the run declared
+        std::vector<std::pair<SymbolId ,Value>> results() const;
+
+    private:
+        static constexpr size_t kMaxCallDepth_ = 1000;
+
+        struct Frame
+        {
+            const Bytecode::Instruction* returnTo;
+            size_t base; // of the caller's registers
+        };
+
+        const Bytecode& program_;
+        std::vector<RuntimeValue> registers_ {};
+        std::vector<RuntimeValue> globals_ {};
+        std::vector<uint8_t> isDeclared_ {}; // per global
+        std::vector<Frame> frames_ {};
+        std::vector<::Domain*> domains_ {}; // the alive ones
+};
+
+// Runs the runtime code of a program as --run asks, with the VM or the
+// TreeWalker (see treewalker.h), and logs the results. statements are the
+// top level runtime ones after the Evaluator folded them.
+// Returns false on errors.
+bool runProgram(const CompileContext& context ,const std::vector<const AST::ASTNode*>& statements);
+
+}; // Compiler
+
+#endif
@@ -0,0 +1,129 @@
+#ifndef X86ASSEMBLER_H
+#define X86ASSEMBLER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <vector>
+
+#include "elfobject.h"
+
+namespace Compiler {
+
+// Encodes the x86-64 instructions the native backend (see x86backend.h) uses
+// into the .text of an ElfObject, all of them on 64 bit values.
+// An Operand is a register, memory at a register plus an offset, or memory at
+// a symbol of the object plus an offset, addressed relative to the
+// instruction (RIP) and patched by a relocation.
+// Jumps and calls go to Labels, which are bound anywhere in the code and
+// patched by finish().
+class X86Assembler
+{
+    public:
+        enum Reg : uint8_t
+        {
+            rax, rcx, rdx, rbx, rsp, rbp, rsi, rdi,
+            r8, r9, r10, r11, r12, r13, r14, r15,
+        };
+
+        // the low 4 bits of jcc and setcc
+        enum class Condition : uint8_t
+        {
+            Overflow = 0x0,
+            Equal = 0x4,
+            NotEqual = 0x5,
+            Sign = 0x8,
+            NotSign = 0x9,
+            Less = 0xC,
+            GreaterEqual = 0xD,
+            LessEqual = 0xE,
+            Greater = 0xF,
+        };
+
+        // the two operand instructions with the same encoding pattern, the value
+        // is the opcode of op r/m, r and the digit of op r/m, imm
+        enum class Alu : uint8_t
+        {
+            Add = 0,
+            Or = 1,
+            And = 4,
+            Sub = 5,
+            Xor = 6,
+            Cmp = 7,
+        };
+
+        struct Operand
+        {
+            enum class Kind : uint8_t { Register, Memory, Symbol };
+
+            Kind kind = Kind::Register;
+            Reg reg = rax; // the register, or the base of Memory
+            int32_t offset = 0;
+            uint32_t symbol = 0; // of the ElfObject, for Symbol
+
+            static Operand of(Reg reg) { return Operand{Kind::Register ,reg ,0 ,0}; }
+            static Operand memory(Reg base ,int32_t offset) { return Operand{Kind::Memory ,base ,offset ,0}; }
+            static Operand at(uint32_t symbol ,int32_t offset) { return Operand{Kind::Symbol ,rax ,offset ,symbol}; }
+
+            bool isRegister() const { return kind == Kind::Register; }
+            bool operator==(const Operand& other) const;
+            bool operator!=(const Operand& other) const { return !(*this == other); }
+        };
+
+        using Label = uint32_t;
+
+        explicit X86Assembler(ElfObject& object) : object_ (object) {}
+
+        Label newLabel();
+        void bind(Label label);
+        size_t size() const { return object_.text.size(); }
+
+        void mov(Reg dst ,const Operand& src);
+        void mov(const Operand& dst ,Reg src);
+        void mov(const Operand& dst ,int64_t value); // through r11 if it doesnt fit 32 bits and dst is memory
+        void lea(Reg dst ,const Operand& src);
+        void alu(Alu op ,Reg dst ,const Operand& src); // dst = dst op src
+        void alu(Alu op ,const Operand& dst ,int32_t value);
+        void imul(Reg dst ,const Operand& src);
+        void test(Reg a ,Reg b);
+        void neg(const Operand& operand);
+        void cqo();
+        void idiv(const Operand& divisor); // rdx:rax / divisor, the quotient in rax and the remainder in rdx
+        void set(Condition condition ,Reg dst); // dst = 1 if condition, else 0
+        void push(const Operand& operand);
+        void pop(const Operand& operand);
+
+        void jump(Label label);
+        void jump(Condition condition ,Label label);
+        void call(Label label);
+        void callExternal(uint32_t symbol); // a function of another object
+        void ret();
+
+        void finish(); // patches the jumps and calls to Labels
+
+    private:
+        static constexpr uint32_t kUnbound = UINT32_MAX;
+
+        struct Fixup
+        {
+            size_t at; // of the rel32
+            Label label;
+        };
+
+        ElfObject& object_;
+        std::vector<uint32_t> labels_ {}; // offsets in .text
+        std::vector<Fixup> fixups_ {};
+
+        void byte(uint8_t value) { object_.text.push_back(value); }
+        void int32(int32_t value);
+        void int64(int64_t value);
+        void rel32(Label label);
+
+        // an instruction with a ModRM byte for rm, reg its reg field (a register or an opcode digit)
+        // and trailing the size of the immediate after it, which RIP relative addresses count from
+        void emit(bool isWide ,std::initializer_list<uint8_t> opcode ,uint8_t reg ,const Operand& rm ,size_t trailing = 0 ,bool hasByteRegister = false);
+};
+
+}; // Compiler
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef X86BACKEND_H
+#define X86BACKEND_H
+
+#include <string>
+#include <vector>
+
+#include "astnode.h"
+#include "bytecode.h"
+#include "compiler.h"
+#include "elfobject.h"
+
+namespace Compiler {
+
+// Compiles runtime code to x86-64 machine code for the System V ABI, from the
+// Bytecode the VM runs (see bytecode.h), into an ElfObject.
+// Native values are int64_t, so functions are int64_t f(int64_t ,...) that C
+// and C++ code declares extern "C" and calls directly. The top level code is
+// the function void <name>_init(), the top level variables are int64_t
+// globals, the ones on a named domain int64_t* to their cell.
+// Native code has no undefined, what the VM gets as undefined (x / 0 too) is
+// 0, which only computes the same while nothing but a truth test reads it. So
+// programs where something else could read undefined, like a variable without
+// a value, the result of dividing by what may be 0, or a variable a function
+// reads before the top level code gives it a value, are errors. A function
+// that returns undefined gives C code 0.
+// Overflows fail like in the VM, by calling nativeFail() of the runtime
+// library (see native.h).
+// Doubles, chars and strings cant be compiled yet.
+// The registers of each function are given x86 registers by linear scan, a
+// value that lives across a call gets a callee saved one, the rest go to
+// the stack.
+// Errors are thrown as std::runtime_error.
+ElfObject compileNative(const Bytecode& program ,const std::string& name);
+
+// Compiles the runtime code of a program as --emit-obj asks, into <outputName>.o.
+// statements are the top level runtime ones after the Evaluator folded them.
+// Returns false on errors.
+bool emitObject(const CompileContext& context ,const std::vector<const AST::ASTNode*>& statements);
+
+}; // Compiler
+
+#endif
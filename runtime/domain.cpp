@@ -0,0 +1,131 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <utility>
+
+#include "domain.h"
+
+struct DomainChunk
+{
+    DomainChunk* next;
+    size_t size; // header included
+};
+
+namespace {
+
+constexpr size_t kHeaderSize = (sizeof(DomainChunk) + alignof(std::max_align_t) - 1) & ~(alignof(std::max_align_t) - 1);
+constexpr size_t kChunkSize = 64 * 1024;
+constexpr size_t kBigSize = kChunkSize / 4; // allocations that get a chunk of their own
+constexpr size_t kMaxFreeBytes = 16 * 1024 * 1024; // what a thread keeps for later domains, besides the last one deleted
+constexpr size_t kMaxAlign = 4096;
+
+// chunks of deleted domains, the newest first
+struct FreeList
+{
+    DomainChunk* chunks = nullptr;
+    size_t bytes = 0;
+
+    ~FreeList() { clear(); }
+
+    void clear()
+    {
+        while (chunks)
+            ::operator delete(std::exchange(chunks ,chunks->next));
+        bytes = 0;
+    }
+};
+
+thread_local FreeList freeList;
+
+char* begin(DomainChunk* chunk) { return reinterpret_cast<char*>(chunk) + kHeaderSize; }
+char* end(DomainChunk* chunk) { return reinterpret_cast<char*>(chunk) + chunk->size; }
+
+// a chunk with at least size bytes after its header, from the free list if
+// its newest one is big enough, new ones for big allocations have just that size
+DomainChunk* takeChunk(size_t size)
+{
+    FreeList& list = freeList;
+    if (list.chunks && list.chunks->size - kHeaderSize >= size)
+    {
+        DomainChunk* chunk = list.chunks;
+        list.chunks = chunk->next;
+        list.bytes -= chunk->size;
+        chunk->next = nullptr;
+        return chunk;
+    }
+
+    const size_t bytes = size > kBigSize ? kHeaderSize + size : kChunkSize;
+    auto* chunk = static_cast<DomainChunk*>(::operator new(bytes));
+    chunk->next = nullptr;
+    chunk->size = bytes;
+    return chunk;
+}
+
+char* alignUp(char* pointer ,size_t align)
+{
+    return reinterpret_cast<char*>((reinterpret_cast<uintptr_t>(pointer) + align - 1) & ~uintptr_t(align - 1));
+}
+
+} // namespace
+
+Domain* domainCreate()
+{
+    DomainChunk* chunk = takeChunk(sizeof(Domain));
+    auto* domain = new (begin(chunk)) Domain;
+    domain->cursor = begin(chunk) + sizeof(Domain);
+    domain->limit = end(chunk);
+    domain->chunks = chunk;
+    domain->last = chunk;
+    domain->chunkBytes = chunk->size;
+    return domain;
+}
+
+void domainDelete(Domain* domain)
+{
+    // the Domain is in one of the chunks, so read it before they are reused
+    DomainChunk* chunks = domain->chunks;
+    DomainChunk* last = domain->last;
+    const size_t bytes = domain->chunkBytes;
+
+    // the chunks of the last domain are kept even if there are many, a loop
+    // that creates and deletes a big one then allocates nothing new
+    FreeList& list = freeList;
+    if (list.bytes + bytes > kMaxFreeBytes)
+        list.clear();
+    last->next = list.chunks;
+    list.chunks = chunks;
+    list.bytes += bytes;
+}
+
+Domain* domainGlobal()
+{
+    static Domain* global = domainCreate();
+    return global;
+}
+
+void* domainAllocateSlow(Domain* domain ,size_t size ,size_t align)
+{
+    align = std::min(std::max(align ,size_t(1)) ,kMaxAlign);
+    const size_t needed = size + align - 1;
+
+    DomainChunk* chunk = takeChunk(needed);
+    domain->chunkBytes += chunk->size;
+
+    // a big allocation gets a chunk of its own behind the newest one, which keeps filling up
+    if (needed > kBigSize)
+    {
+        chunk->next = domain->chunks->next;
+        domain->chunks->next = chunk;
+        if (domain->last == domain->chunks)
+            domain->last = chunk;
+        return alignUp(begin(chunk) ,align);
+    }
+
+    chunk->next = domain->chunks;
+    domain->chunks = chunk;
+    char* start = alignUp(begin(chunk) ,align);
+    domain->cursor = start + size;
+    domain->limit = end(chunk);
+    return start;
+}
@@ -0,0 +1,52 @@
+#ifndef RUNTIME_DOMAIN_H
+#define RUNTIME_DOMAIN_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Runtime library of compiled programs: the memory of their new variables.
+// A domain is a region of chunks, allocating on it bumps a pointer and
+// deleting it gives all of its chunks back at once, in O(1), to a free list
+// the next domains take their chunks from. Nothing is freed one by one, the
+// compiler checks that nothing is used after its domain is freed (see
+// domainchecker.h), so objects dont carry any header either.
+// Blocks are anonymous domains, created when they start and deleted when they
+// end, with the free list that is a few pointer writes each.
+// A domain is used by one thread at a time, every thread has its own free list.
+// The functions have C names so generated code can call them.
+extern "C" {
+
+struct DomainChunk;
+
+struct Domain
+{
+    char* cursor; // next free byte of the newest chunk
+    char* limit; // end of the newest chunk
+    DomainChunk* chunks; // newest first, the Domain itself is at the start of one of them
+    DomainChunk* last; // of chunks, to give them all back at once
+    size_t chunkBytes; // of all chunks, to bound what the free list keeps
+};
+
+Domain* domainCreate();
+void domainDelete(Domain* domain);
+Domain* domainGlobal(); // never deleted
+
+// size bytes aligned to align (a power of 2 up to 4096) in a new chunk,
+// domainAllocate() calls it when the newest one is full
+void* domainAllocateSlow(Domain* domain ,size_t size ,size_t align);
+
+}
+
+// The fast path, inlined into the caller.
+inline void* domainAllocate(Domain* domain ,size_t size ,size_t align)
+{
+    const uintptr_t start = (reinterpret_cast<uintptr_t>(domain->cursor) + align - 1) & ~uintptr_t(align - 1);
+    if (start <= reinterpret_cast<uintptr_t>(domain->limit) && size <= reinterpret_cast<uintptr_t>(domain->limit) - start)
+    {
+        domain->cursor = reinterpret_cast<char*>(start + size);
+        return reinterpret_cast<void*>(start);
+    }
+    return domainAllocateSlow(domain ,size ,align);
+}
+
+#endif
@@ -0,0 +1,37 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+
+#include "native.h"
+
+void nativeFail(const char* msg)
+{
+    std::fprintf(stderr ,"ERROR: %s.\n" ,msg);
+    std::abort();
+}
+
+// by squaring, like pow@Functions
+int64_t nativePow(int64_t base ,int64_t exponent)
+{
+    if (exponent < 0)
+        nativeFail("pow@Functions with a negative exponent is a double, native code only has ints");
+
+    int64_t result = 1;
+    for (int64_t e = exponent; e > 0; e >>= 1)
+    {
+        if ((e & 1) && __builtin_mul_overflow(result ,base ,&result))
+            nativeFail("integer overflow in pow@Functions");
+        if (e > 1 && __builtin_mul_overflow(base ,base ,&base))
+            nativeFail("integer overflow in pow@Functions");
+    }
+    return result;
+}
+
+int64_t* nativeNewCell(Domain* domain)
+{
+    if (!domain)
+        nativeFail("a variable is put on a domain that was deleted");
+    auto* cell = static_cast<int64_t*>(domainAllocate(domain ,sizeof(int64_t) ,alignof(int64_t)));
+    *cell = 0;
+    return cell;
+}
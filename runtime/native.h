@@ -0,0 +1,25 @@
+#ifndef RUNTIME_NATIVE_H
+#define RUNTIME_NATIVE_H
+
+#include <cstdint>
+
+#include "domain.h"
+
+// Runtime library of compiled programs: what their native code (see
+// x86backend.h) calls besides the domain functions, the parts that are too
+// long or too rare to be inlined. Values are int64_t, a cell is an int64_t on
+// a domain.
+extern "C" {
+
+// writes "ERROR: msg." to stderr and aborts, for what runtime code reports as an error
+[[noreturn]] void nativeFail(const char* msg);
+
+// base to the power of exponent, fails if it overflows or if exponent is negative
+int64_t nativePow(int64_t base ,int64_t exponent);
+
+// a new cell on domain holding 0, fails if the domain was deleted (null)
+int64_t* nativeNewCell(Domain* domain);
+
+}
+
+#endif
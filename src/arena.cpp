@@ -0,0 +1,61 @@
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+
+#include "arena.h"
+
+using namespace Compiler;
+
+Arena::Arena(size_t blockSize)
+    : kBlockSize_ (blockSize)
+{}
+
+void* Arena::allocate(size_t size ,size_t align)
+{
+    allocationCount_++;
+
+    while (true)
+    {
+        if (currentBlock_ == blocks_.size())
+        {
+            const size_t blockSize = std::max(kBlockSize_ ,size + align);
+            blocks_.push_back(Block{std::unique_ptr<char[]>(new char[blockSize]) ,blockSize});
+        }
+
+        Block& block = blocks_[currentBlock_];
+        const auto base = reinterpret_cast<uintptr_t>(block.data.get());
+        const uintptr_t aligned = (base + used_ + align - 1) & ~(uintptr_t(align) - 1);
+
+        if (aligned + size <= base + block.size)
+        {
+            used_ = aligned + size - base;
+            return reinterpret_cast<void*>(aligned);
+        }
+
+        // doesnt fit, go to the next block (kept from before a release()) or a new one
+        currentBlock_++;
+        used_ = 0;
+    }
+}
+
+void Arena::release()
+{
+    currentBlock_ = 0;
+    used_ = 0;
+}
+
+size_t Arena::bytesReserved() const
+{
+    size_t total = 0;
+    for (const auto& block : blocks_)
+        total += block.size;
+    return total;
+}
+
+size_t Arena::bytesUsed() const
+{
+    size_t total = used_;
+    for (size_t i = 0; i < currentBlock_ && i < blocks_.size(); i++)
+        total += blocks_[i].size;
+    return total;
+}
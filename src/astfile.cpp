@@ -0,0 +1,272 @@
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <variant>
+#include <vector>
+
+#include "astfile.h"
+#include "compiler.h"
+#include "flatast.h"
+
+using namespace Compiler;
+using namespace Compiler::AST;
+
+static_assert(std::is_trivially_copyable_v<ASTFileHeader>);
+static_assert(sizeof(ASTFileHeader) % 8 == 0);
+
+static constexpr size_t sectionIndex(ASTSection section)
+{
+    return static_cast<size_t>(section);
+}
+
+// appends a section at the next 8 byte boundary and records where it starts
+template <typename T>
+static void writeSection(std::string& out ,ASTFileHeader& header ,ASTSection section ,const T* data ,size_t count)
+{
+    static_assert(std::is_trivially_copyable_v<T>);
+    out.resize((out.size() + 7) & ~size_t(7) ,'\0');
+    header.sections[sectionIndex(section)] = out.size();
+    out.append(reinterpret_cast<const char*>(data) ,count * sizeof(T));
+}
+
+std::string AST::encodeASTFile(const CompiledAST& compiled)
+{
+    const FlatAST& ast = compiled.ast;
+
+    std::vector<SymbolId> strings;
+    std::unordered_map<uint32_t ,uint32_t> stringIndex;
+    auto indexOf = [&](SymbolId id)
+    {
+        auto [it ,isNew] = stringIndex.try_emplace(static_cast<uint32_t>(id) ,static_cast<uint32_t>(strings.size()));
+        if (isNew)
+            strings.push_back(id);
+        return it->second;
+    };
+
+    std::vector<uint8_t> kinds(ast.size());
+    std::vector<uint32_t> payloads(ast.payloads);
+    for (size_t i = 0; i < ast.size(); i++)
+    {
+        kinds[i] = static_cast<uint8_t>(ast.kinds[i]);
+        if (FlatAST::hasSymbol(ast.kinds[i]))
+            payloads[i] = indexOf(static_cast<SymbolId>(ast.payloads[i]));
+    }
+
+    std::vector<uint8_t> literalTags(ast.literals.size());
+    std::vector<uint64_t> literalValues(ast.literals.size());
+    for (size_t i = 0; i < ast.literals.size(); i++)
+    {
+        const auto& literal = ast.literals[i];
+        literalTags[i] = static_cast<uint8_t>(literal.index());
+        if (auto* value = std::get_if<Int_t>(&literal))
+            std::memcpy(&literalValues[i] ,value ,sizeof(*value));
+        else if (auto* value = std::get_if<Double_t>(&literal))
+            std::memcpy(&literalValues[i] ,value ,sizeof(*value));
+        else if (auto* value = std::get_if<Char_t>(&literal))
+            literalValues[i] = static_cast<unsigned char>(*value);
+        else if (auto* value = std::get_if<String_t>(&literal))
+            literalValues[i] = indexOf(*value);
+    }
+
+    std::vector<uint32_t> stringOffsets;
+    std::string characters;
+    stringOffsets.reserve(strings.size() + 1);
+    for (SymbolId id : strings)
+    {
+        stringOffsets.push_back(static_cast<uint32_t>(characters.size()));
+        characters.append(symbols().lookup(id));
+    }
+    stringOffsets.push_back(static_cast<uint32_t>(characters.size()));
+
+    ASTFileHeader header;
+    std::memset(&header ,0 ,sizeof(header));
+    std::memcpy(header.magic ,kASTFileMagic ,sizeof(kASTFileMagic));
+    header.version = kASTFileVersion;
+    header.byteOrder = kByteOrderMark;
+    header.nodeCount = static_cast<uint32_t>(ast.size());
+    header.childEntryCount = static_cast<uint32_t>(ast.children.size());
+    header.literalCount = static_cast<uint32_t>(ast.literals.size());
+    header.rootCount = static_cast<uint32_t>(ast.roots.size());
+    header.stringCount = static_cast<uint32_t>(strings.size());
+    header.completeStatements = compiled.completeStatements;
+
+    std::string out(sizeof(header) ,'\0'); // filled in once the offsets are known
+    writeSection(out ,header ,ASTSection::Kinds ,kinds.data() ,kinds.size());
+    writeSection(out ,header ,ASTSection::Flags ,ast.flags.data() ,ast.flags.size());
+    writeSection(out ,header ,ASTSection::Payloads ,payloads.data() ,payloads.size());
+    writeSection(out ,header ,ASTSection::FirstChild ,ast.firstChild.data() ,ast.firstChild.size());
+    writeSection(out ,header ,ASTSection::ChildCounts ,ast.childCount.data() ,ast.childCount.size());
+    writeSection(out ,header ,ASTSection::Children ,ast.children.data() ,ast.children.size());
+    writeSection(out ,header ,ASTSection::LiteralTags ,literalTags.data() ,literalTags.size());
+    writeSection(out ,header ,ASTSection::LiteralValues ,literalValues.data() ,literalValues.size());
+    writeSection(out ,header ,ASTSection::Roots ,ast.roots.data() ,ast.roots.size());
+    writeSection(out ,header ,ASTSection::StringOffsets ,stringOffsets.data() ,stringOffsets.size());
+    writeSection(out ,header ,ASTSection::StringChars ,characters.data() ,characters.size());
+
+    header.fileSize = out.size();
+    std::memcpy(out.data() ,&header ,sizeof(header));
+    return out;
+}
+
+void AST::writeASTFile(const std::string& path ,std::string_view bytes)
+{
+    std::ofstream file(path ,std::ios::binary | std::ios::trunc);
+    file.write(bytes.data() ,bytes.size());
+    if (!file)
+        throw std::runtime_error("ERROR: Failed to write AST file " + path + ".");
+}
+
+ASTFileView::ASTFileView(std::string_view bytes ,const ASTFileHeader& header)
+    : bytes_ (bytes)
+    ,header_ (header)
+{}
+
+std::optional<ASTFileView> ASTFileView::open(std::string_view bytes)
+{
+    ASTFileHeader header;
+    if (bytes.size() < sizeof(header))
+        return std::nullopt;
+    std::memcpy(&header ,bytes.data() ,sizeof(header));
+
+    if (std::memcmp(header.magic ,kASTFileMagic ,sizeof(kASTFileMagic)) != 0
+        || header.version != kASTFileVersion
+        || header.byteOrder != kByteOrderMark
+        || header.fileSize != bytes.size())
+        return std::nullopt;
+
+    ASTFileView view(bytes ,header);
+    if (!view.isValid())
+        return std::nullopt;
+    return view;
+}
+
+// Everything the accessors and printFlatTree() rely on: sections inside the
+// file, indices inside their arrays and children after their parent, so a
+// damaged file cant make a traversal read out of bounds or loop forever.
+bool ASTFileView::isValid() const
+{
+    const uint64_t nodes = header_.nodeCount;
+    const uint64_t sizes[] =
+    {
+        nodes ,nodes ,nodes * 4 ,nodes * 4 ,nodes * 4
+        ,uint64_t(header_.childEntryCount) * 4
+        ,header_.literalCount ,uint64_t(header_.literalCount) * 8
+        ,uint64_t(header_.rootCount) * 4
+        ,(uint64_t(header_.stringCount) + 1) * 4
+        ,0 // StringChars, checked with the last string offset
+    };
+    static_assert(std::size(sizes) == sectionIndex(ASTSection::Count));
+
+    for (size_t i = 0; i < std::size(sizes); i++)
+    {
+        const uint64_t offset = header_.sections[i];
+        if (offset < sizeof(ASTFileHeader) || offset > bytes_.size() || bytes_.size() - offset < sizes[i])
+            return false;
+    }
+
+    const uint64_t charsSize = bytes_.size() - header_.sections[sectionIndex(ASTSection::StringChars)];
+    uint32_t previous = 0;
+    for (uint64_t i = 0; i <= header_.stringCount; i++)
+    {
+        const uint32_t offset = load<uint32_t>(ASTSection::StringOffsets ,i);
+        if (offset < previous || offset > charsSize)
+            return false;
+        previous = offset;
+    }
+
+    for (uint32_t node = 0; node < nodes; node++)
+    {
+        const uint8_t kind = load<uint8_t>(ASTSection::Kinds ,node);
+        if (kind > static_cast<uint8_t>(NodeType::Domain))
+            return false;
+        if (FlatAST::hasSymbol(static_cast<NodeType>(kind)) && load<uint32_t>(ASTSection::Payloads ,node) >= header_.stringCount)
+            return false;
+
+        const uint64_t first = load<uint32_t>(ASTSection::FirstChild ,node);
+        const uint64_t end = first + load<uint32_t>(ASTSection::ChildCounts ,node);
+        if (FlatAST::hasLiterals(static_cast<NodeType>(kind)))
+        {
+            if (end > header_.literalCount)
+                return false;
+            continue;
+        }
+
+        if (end > header_.childEntryCount)
+            return false;
+        for (uint64_t i = first; i < end; i++)
+        {
+            const uint32_t child = load<uint32_t>(ASTSection::Children ,i);
+            if (child <= node || child >= nodes)
+                return false;
+        }
+    }
+
+    for (uint32_t i = 0; i < header_.literalCount; i++)
+    {
+        const uint8_t tag = load<uint8_t>(ASTSection::LiteralTags ,i);
+        if (tag >= std::variant_size_v<Literal_t>)
+            return false;
+        if (tag == 4 /* String_t */ && load<uint64_t>(ASTSection::LiteralValues ,i) >= header_.stringCount)
+            return false;
+    }
+
+    for (uint32_t i = 0; i < header_.rootCount; i++)
+        if (root(i) >= nodes)
+            return false;
+
+    return header_.completeStatements <= header_.rootCount;
+}
+
+NodeIndex ASTFileView::nodeChild(NodeIndex node ,uint32_t i) const
+{
+    return load<uint32_t>(ASTSection::Children ,load<uint32_t>(ASTSection::FirstChild ,node) + i);
+}
+
+Literal_t ASTFileView::literal(NodeIndex node ,uint32_t i) const
+{
+    const size_t index = load<uint32_t>(ASTSection::FirstChild ,node) + i;
+    const uint64_t bits = load<uint64_t>(ASTSection::LiteralValues ,index);
+
+    switch (load<uint8_t>(ASTSection::LiteralTags ,index))
+    {
+        case 1: { Int_t value; std::memcpy(&value ,&bits ,sizeof(value)); return value; }
+        case 2: { Double_t value; std::memcpy(&value ,&bits ,sizeof(value)); return value; }
+        case 3: return static_cast<Char_t>(bits);
+        case 4: return symbols().intern(string(static_cast<uint32_t>(bits)));
+        default: return {};
+    }
+}
+
+std::string_view ASTFileView::string(uint32_t index) const
+{
+    const uint32_t begin = load<uint32_t>(ASTSection::StringOffsets ,index);
+    const uint32_t end = load<uint32_t>(ASTSection::StringOffsets ,index + 1);
+    return bytes_.substr(header_.sections[sectionIndex(ASTSection::StringChars)] + begin ,end - begin);
+}
+
+ASTFile::ASTFile(const std::string& path ,size_t offset)
+    : buffer_ (path)
+{
+    if (offset <= buffer_.view().size())
+        view_ = ASTFileView::open(buffer_.view().substr(offset));
+    if (!view_)
+        throw std::runtime_error("ERROR: " + path + " isnt a valid AST file.");
+}
+
+void Compiler::printASTFile(const ASTFileView& file)
+{
+    for (uint32_t i = 0; i < file.rootCount(); i++)
+    {
+        if (i == file.completeStatements())
+            log("end");
+        printFlatTree(file ,file.root(i));
+    }
+    if (file.completeStatements() == file.rootCount())
+        log("end");
+}
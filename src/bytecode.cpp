@@ -0,0 +1,1349 @@
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "bytecode.h"
+#include "compiler.h"
+#include "recursion.h"
+
+using namespace Compiler;
+
+static std::string nameOf(SymbolId id)
+{
+    return std::string(symbols().lookup(id));
+}
+
+Value Compiler::toValue(const RuntimeValue& value)
+{
+    switch (value.type)
+    {
+        case RuntimeValue::Type::Int: return value.i;
+        case RuntimeValue::Type::Double: return value.d;
+        case RuntimeValue::Type::Char: return value.c;
+        case RuntimeValue::Type::String: return value.s;
+        default: return Value();
+    }
+}
+
+RuntimeValue Compiler::toRuntimeValue(const Value& value)
+{
+    RuntimeValue result;
+    if (auto* i = std::get_if<Int_t>(&value))
+    {
+        result.type = RuntimeValue::Type::Int;
+        result.i = *i;
+    }
+    else if (auto* d = std::get_if<Double_t>(&value))
+    {
+        result.type = RuntimeValue::Type::Double;
+        result.d = *d;
+    }
+    else if (auto* c = std::get_if<Char_t>(&value))
+    {
+        result.type = RuntimeValue::Type::Char;
+        result.c = *c;
+    }
+    else if (auto* s = std::get_if<SymbolId>(&value))
+    {
+        result.type = RuntimeValue::Type::String;
+        result.s = *s;
+    }
+    else if (!std::holds_alternative<std::monostate>(value))
+        throw std::runtime_error("runtime code cant use sets yet");
+    return result;
+}
+
+namespace {
+
+using Op = Bytecode::Op;
+
+constexpr uint16_t kNone = std::numeric_limits<uint16_t>::max(); // no register, the value isnt used
+
+// where a name's value is
+struct Location
+{
+    enum class Kind : uint8_t
+    {
+        Register,
+        Global,
+        RegisterCell, // the register holds the cell
+        GlobalCell,
+    };
+
+    Kind kind;
+    uint32_t index;
+};
+
+bool isComparison(TokenType op)
+{
+    return op == TokenType::Equals || op == TokenType::NotEquals || op == TokenType::LessThan
+        || op == TokenType::LessEquals || op == TokenType::GreaterThan || op == TokenType::GreaterEquals;
+}
+
+// the instruction for op, an arithmetic operator or a comparison
+Op binaryOp(TokenType op)
+{
+    switch (op)
+    {
+        case TokenType::Plus: return Op::Add;
+        case TokenType::Minus: return Op::Subtract;
+        case TokenType::Multiplication: return Op::Multiply;
+        case TokenType::Division: return Op::Divide;
+        case TokenType::Modulo: return Op::Modulo;
+        case TokenType::Equals: return Op::Equal;
+        case TokenType::NotEquals: return Op::NotEqual;
+        case TokenType::LessThan: return Op::Less;
+        case TokenType::LessEquals: return Op::LessEqual;
+        case TokenType::GreaterThan: return Op::Greater;
+        case TokenType::GreaterEquals: return Op::GreaterEqual;
+        default: throw std::runtime_error("operator '" + getTokenKey(op) + "' cant be run");
+    }
+}
+
+// the jump taken unless a comparison holds, Op::JumpUnlessEqual for ==
+Op branchOp(TokenType op ,bool isConstant)
+{
+    const auto offset = static_cast<uint8_t>(binaryOp(op)) - static_cast<uint8_t>(Op::Equal);
+    const Op first = isConstant ? Op::JumpUnlessEqualConst : Op::JumpUnlessEqual;
+    return static_cast<Op>(static_cast<uint8_t>(first) + offset);
+}
+
+// x += y is x = x + y
+TokenType baseOperator(TokenType op)
+{
+    switch (op)
+    {
+        case TokenType::PlusEquals: return TokenType::Plus;
+        case TokenType::MinusEquals: return TokenType::Minus;
+        case TokenType::MultiplicationEquals: return TokenType::Multiplication;
+        case TokenType::DivisionEquals: return TokenType::Division;
+        case TokenType::ModuloEquals: return TokenType::Modulo;
+        default: return TokenType::Unknown;
+    }
+}
+
+bool isAssignment(TokenType op)
+{
+    return op == TokenType::Assign || baseOperator(op) != TokenType::Unknown;
+}
+
+// if evaluating node can change a variable
+bool hasEffects(const AST::ASTNode* node)
+{
+    if (!node)
+        return false;
+
+    using AST::NodeType;
+    switch (node->getType())
+    {
+        case NodeType::Unary: {
+            auto* unary = static_cast<const AST::Unary*>(node);
+            return unary->op == TokenType::DoublePlus || unary->op == TokenType::DoubleMinus || hasEffects(unary->operand);
+        }
+        case NodeType::Binary: {
+            auto* binary = static_cast<const AST::Binary*>(node);
+            return isAssignment(binary->op) || hasEffects(binary->lhs) || hasEffects(binary->rhs);
+        }
+        case NodeType::Conditional: {
+            auto* conditional = static_cast<const AST::Conditional*>(node);
+            return hasEffects(conditional->lhs) || hasEffects(conditional->rhs) || hasEffects(conditional->otherwise);
+        }
+        case NodeType::Call: {
+            auto* call = static_cast<const AST::Call*>(node);
+            return std::any_of(call->arguments.begin() ,call->arguments.end() ,[](const AST::Rvalue* argument) { return hasEffects(argument); });
+        }
+        case NodeType::Block:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// if node is one instruction that reads all its operands before it writes,
+// so it can write to a variable it reads
+bool isSingleStep(const AST::Rvalue* node)
+{
+    auto isLeaf = [](const AST::Rvalue* operand)
+    {
+        return operand->getType() == AST::NodeType::Literal || operand->getType() == AST::NodeType::Lvalue;
+    };
+
+    switch (node->getType())
+    {
+        case AST::NodeType::Literal:
+        case AST::NodeType::Lvalue:
+        case AST::NodeType::Call: // the result is moved once the arguments are done
+            return true;
+        case AST::NodeType::Unary: {
+            auto* unary = static_cast<const AST::Unary*>(node);
+            return (unary->op == TokenType::Not || unary->op == TokenType::Minus) && isLeaf(unary->operand);
+        }
+        case AST::NodeType::Binary: {
+            auto* binary = static_cast<const AST::Binary*>(node);
+            const bool isArithmetic = binary->op == TokenType::Plus || binary->op == TokenType::Minus
+                || binary->op == TokenType::Multiplication || binary->op == TokenType::Division || binary->op == TokenType::Modulo;
+            return (isArithmetic || isComparison(binary->op)) && isLeaf(binary->lhs) && isLeaf(binary->rhs);
+        }
+        default:
+            return false;
+    }
+}
+
+// the names of name@Domain, or empty ones if node isnt of that form
+std::pair<std::string_view ,std::string_view> domainNames(const AST::Rvalue* node)
+{
+    if (node->getType() != AST::NodeType::Binary)
+        return {};
+    auto* binary = static_cast<const AST::Binary*>(node);
+    if (binary->op != TokenType::At || binary->lhs->getType() != AST::NodeType::Lvalue || binary->rhs->getType() != AST::NodeType::Lvalue)
+        return {};
+    return {symbols().lookup(static_cast<const AST::Lvalue*>(binary->lhs)->identifier)
+        ,symbols().lookup(static_cast<const AST::Lvalue*>(binary->rhs)->identifier)};
+}
+
+} // namespace
+
+struct Bytecode::Builder
+{
+    struct Name
+    {
+        SymbolId name;
+        Location location;
+        size_t depth; // of the block it is visible in
+    };
+
+    struct DomainName
+    {
+        SymbolId name;
+        Location location; // Register or Global
+        size_t depth;
+        uint32_t id; // in isDomainAlive
+    };
+
+    // where return goes: out of a function, or to the end of a block used as a value
+    struct ReturnTarget
+    {
+        uint16_t result; // for a block
+        size_t depth; // domains created deeper are deleted
+        bool isFunction;
+        std::vector<size_t> jumps {};
+    };
+
+    // the function being lowered, the top level code is one too
+    struct Frame
+    {
+        uint32_t function;
+        std::vector<Instruction> code {};
+        std::vector<Name> names {}; // innermost last
+        std::vector<DomainName> domains {}; // the alive ones
+        std::vector<uint16_t> scopes {}; // the first free register outside of each block
+        std::vector<std::pair<size_t ,uint16_t>> pinned {}; // registers of names on an outer block's domain, and its depth
+        std::vector<ReturnTarget> returns {};
+        uint16_t nextRegister = 0;
+        uint16_t registerCount = 0;
+
+        size_t depth() const { return scopes.size(); }
+    };
+
+    Bytecode& program;
+    std::unordered_map<SymbolId ,Location> globals {}; // top level names, and names on the global domain or a top level one
+    std::unordered_map<SymbolId ,uint32_t> functions {};
+    std::map<std::pair<RuntimeValue::Type ,uint64_t> ,uint32_t> constantIndex {};
+    std::vector<bool> isDomainAlive {};
+    std::unordered_map<uint32_t ,uint32_t> cellDomains {}; // global of a cell and the domain it is on
+    std::vector<std::vector<Instruction>> bodies {}; // of each function
+    Frame main {0};
+    Frame* frame = &main;
+    bool isMainFailing = false; // a statement couldnt be lowered, the ones after it never run
+
+    explicit Builder(Bytecode& program) : program (program) {}
+
+    [[noreturn]] static void fail(const std::string& msg) { throw std::runtime_error(msg); }
+
+    bool isTopLevel() const { return frame == &main && frame->depth() == 0; }
+
+    size_t emit(Op op ,uint16_t a = 0 ,uint16_t b = 0 ,uint16_t c = 0 ,uint32_t target = 0)
+    {
+        frame->code.push_back(Instruction{op ,a ,b ,c ,target});
+        return frame->code.size() - 1;
+    }
+
+    void patch(const std::vector<size_t>& jumps)
+    {
+        for (size_t jump : jumps)
+            frame->code[jump].target = static_cast<uint32_t>(frame->code.size());
+    }
+
+    uint32_t constant(const RuntimeValue& value)
+    {
+        uint64_t bits = 0;
+        switch (value.type)
+        {
+            case RuntimeValue::Type::Int: bits = static_cast<uint64_t>(value.i); break;
+            case RuntimeValue::Type::Double: std::memcpy(&bits ,&value.d ,sizeof(bits)); break;
+            case RuntimeValue::Type::Char: bits = static_cast<unsigned char>(value.c); break;
+            case RuntimeValue::Type::String: bits = static_cast<uint32_t>(value.s); break;
+            default: break;
+        }
+
+        auto [it ,isNew] = constantIndex.try_emplace({value.type ,bits} ,static_cast<uint32_t>(program.constants.size()));
+        if (isNew)
+            program.constants.push_back(value);
+        return it->second;
+    }
+
+    uint32_t undefined() { return constant(RuntimeValue()); }
+
+    uint32_t message(std::string msg)
+    {
+        program.messages.push_back(std::move(msg));
+        return static_cast<uint32_t>(program.messages.size() - 1);
+    }
+
+    uint32_t newGlobal() { return program.globalCount++; }
+
+    uint16_t allocate()
+    {
+        if (frame->nextRegister == kNone)
+            fail("a function needs more than " + std::to_string(kNone) + " registers");
+        const uint16_t reg = frame->nextRegister++;
+        frame->registerCount = std::max(frame->registerCount ,frame->nextRegister);
+        return reg;
+    }
+
+    // frees the registers from mark on, but not the ones of names still visible
+    void release(uint16_t mark)
+    {
+        for (const auto& [depth ,reg] : frame->pinned)
+            mark = std::max<uint16_t>(mark ,reg + 1);
+        frame->nextRegister = mark;
+    }
+
+    std::optional<Location> resolve(SymbolId name) const
+    {
+        for (auto it = frame->names.rbegin(); it != frame->names.rend(); ++it)
+            if (it->name == name)
+                return it->location;
+        if (auto it = globals.find(name); it != globals.end())
+            return it->second;
+        return std::nullopt;
+    }
+
+    Location resolveVariable(const AST::Rvalue* node)
+    {
+        if (node->getType() != AST::NodeType::Lvalue)
+            fail("only variables can be assigned");
+
+        const SymbolId name = static_cast<const AST::Lvalue*>(node)->identifier;
+        if (auto location = resolve(name))
+            return *location;
+        if (functions.count(name))
+            fail(nameOf(name) + " is a function, it has to be called");
+        fail(nameOf(name) + " isnt defined");
+    }
+
+    const DomainName& findDomain(SymbolId name) const
+    {
+        for (auto it = frame->domains.rbegin(); it != frame->domains.rend(); ++it)
+            if (it->name == name)
+                return *it;
+        for (const auto& domain : main.domains) // functions see the top level ones
+            if (domain.depth == 0 && domain.name == name)
+                return domain;
+        fail("there is no domain " + nameOf(name)); // the DomainChecker reported it already
+    }
+
+    void read(Location location ,uint16_t target)
+    {
+        switch (location.kind)
+        {
+            case Location::Kind::Register:
+                if (location.index != target)
+                    emit(Op::Move ,target ,static_cast<uint16_t>(location.index));
+                break;
+            case Location::Kind::Global:
+                emit(Op::LoadGlobal ,target ,0 ,0 ,location.index);
+                break;
+            case Location::Kind::RegisterCell:
+                emit(Op::LoadCell ,target ,static_cast<uint16_t>(location.index));
+                break;
+            case Location::Kind::GlobalCell:
+                emit(Op::LoadGlobal ,target ,0 ,0 ,location.index);
+                emit(Op::LoadCell ,target ,target);
+                break;
+        }
+    }
+
+    void write(Location location ,uint16_t source)
+    {
+        switch (location.kind)
+        {
+            case Location::Kind::Register:
+                if (location.index != source)
+                    emit(Op::Move ,static_cast<uint16_t>(location.index) ,source);
+                break;
+            case Location::Kind::Global:
+                emit(Op::StoreGlobal ,source ,0 ,0 ,location.index);
+                break;
+            case Location::Kind::RegisterCell:
+                emit(Op::StoreCell ,static_cast<uint16_t>(location.index) ,source);
+                break;
+            case Location::Kind::GlobalCell: {
+                const uint16_t cell = allocate();
+                emit(Op::LoadGlobal ,cell ,0 ,0 ,location.index);
+                emit(Op::StoreCell ,cell ,source);
+                release(cell);
+                break;
+            }
+        }
+    }
+
+    // a register holding node's value, the variable's own if node is a local
+    uint16_t operand(const AST::Rvalue* node)
+    {
+        if (node->getType() == AST::NodeType::Lvalue)
+        {
+            const Location location = resolveVariable(node);
+            if (location.kind == Location::Kind::Register)
+                return static_cast<uint16_t>(location.index);
+        }
+        const uint16_t reg = allocate();
+        lower(node ,reg);
+        return reg;
+    }
+
+    // operand() for the left side of a binary operation, copied if the right side can change it
+    uint16_t leftOperand(const AST::Rvalue* lhs ,const AST::Rvalue* rhs)
+    {
+        const uint16_t mark = frame->nextRegister;
+        const uint16_t reg = operand(lhs);
+        if (reg >= mark || !hasEffects(rhs))
+            return reg;
+        const uint16_t copy = allocate();
+        emit(Op::Move ,copy ,reg);
+        return copy;
+    }
+
+    // the index of a numeric literal's constant if it fits an instruction's operand
+    std::optional<uint16_t> smallConstant(const AST::Rvalue* node)
+    {
+        if (node->getType() != AST::NodeType::Literal)
+            return std::nullopt;
+        const RuntimeValue value = toRuntimeValue(toValue(static_cast<const AST::Literal*>(node)->value));
+        if (value.type != RuntimeValue::Type::Int && value.type != RuntimeValue::Type::Double)
+            return std::nullopt;
+        const uint32_t index = constant(value);
+        if (index >= kNone)
+            return std::nullopt;
+        return static_cast<uint16_t>(index);
+    }
+
+    // node's value into target, the temporaries it needs are freed after
+    void lower(const AST::Rvalue* node ,uint16_t target)
+    {
+        const uint16_t mark = frame->nextRegister;
+        lowerExpression(node ,target);
+        release(mark);
+    }
+
+    void lowerExpression(const AST::Rvalue* node ,uint16_t target)
+    {
+        if (!node)
+            fail("expression has errors");
+
+        using AST::NodeType;
+        switch (node->getType())
+        {
+            case NodeType::Literal:
+                emit(Op::LoadConst ,target ,0 ,0 ,constant(toRuntimeValue(toValue(static_cast<const AST::Literal*>(node)->value))));
+                return;
+            case NodeType::Lvalue:
+                read(resolveVariable(node) ,target);
+                return;
+            case NodeType::Block:
+                valueBlock(static_cast<const AST::Block*>(node) ,target);
+                return;
+            case NodeType::Unary:
+                lowerUnary(static_cast<const AST::Unary*>(node) ,target);
+                return;
+            case NodeType::Binary:
+                lowerBinary(static_cast<const AST::Binary*>(node) ,target);
+                return;
+            case NodeType::Conditional: {
+                auto* conditional = static_cast<const AST::Conditional*>(node);
+                if (conditional->otherwise) // value | condition ,otherwise
+                {
+                    const auto otherwise = branchUnless(conditional->rhs);
+                    lower(conditional->lhs ,target);
+                    const size_t end = emit(Op::Jump);
+                    patch(otherwise);
+                    lower(conditional->otherwise ,target);
+                    patch({end});
+                    return;
+                }
+                // condition | action
+                const auto skip = branchUnless(conditional->lhs);
+                if (AST::isEmptySet(conditional->rhs))
+                {
+                    patch(skip);
+                    emit(Op::LoadConst ,target ,0 ,0 ,undefined());
+                    return;
+                }
+                lower(conditional->rhs ,target);
+                const size_t end = emit(Op::Jump);
+                patch(skip);
+                emit(Op::LoadConst ,target ,0 ,0 ,undefined());
+                patch({end});
+                return;
+            }
+            case NodeType::Call:
+                lowerCall(static_cast<const AST::Call*>(node) ,target);
+                return;
+            case NodeType::Set:
+            case NodeType::Comprehension:
+            case NodeType::Member:
+            case NodeType::Index:
+                fail(formatNode(node) + " uses sets, runtime code cant use sets yet");
+            default:
+                fail(formatNode(node) + " cant be run");
+        }
+    }
+
+    void lowerUnary(const AST::Unary* unary ,uint16_t target)
+    {
+        switch (unary->op)
+        {
+            case TokenType::Not:
+                emit(Op::Not ,target ,operand(unary->operand));
+                return;
+            case TokenType::Minus:
+                emit(Op::Negate ,target ,operand(unary->operand));
+                return;
+            case TokenType::DoublePlus:
+            case TokenType::DoubleMinus:
+                increment(unary ,target);
+                return;
+            default:
+                fail("operator '" + getTokenKey(unary->op) + "' cant be run");
+        }
+    }
+
+    // x++, ++x, x-- and --x, target is kNone if the value isnt used
+    void increment(const AST::Unary* unary ,uint16_t target)
+    {
+        const Op op = unary->op == TokenType::DoublePlus ? Op::Increment : Op::Decrement;
+        const Location location = resolveVariable(unary->operand);
+        const bool isLocal = location.kind == Location::Kind::Register;
+        const uint16_t reg = isLocal ? static_cast<uint16_t>(location.index) : allocate();
+        if (!isLocal)
+            read(location ,reg);
+
+        if (target != kNone && unary->isPostfix)
+            emit(Op::Move ,target ,reg);
+        emit(op ,reg);
+        if (!isLocal)
+            write(location ,reg);
+        if (target != kNone && !unary->isPostfix)
+            emit(Op::Move ,target ,reg);
+    }
+
+    void lowerBinary(const AST::Binary* binary ,uint16_t target)
+    {
+        switch (binary->op)
+        {
+            case TokenType::At: {
+                auto [name ,domain] = domainNames(binary);
+                if (domain == "Functions")
+                    fail(std::string(name) + "@" + std::string(domain) + " is a function, it has to be called");
+                fail(formatNode(binary) + " cant be used by runtime code yet");
+            }
+            case TokenType::And:
+            case TokenType::Or: {
+                lower(binary->lhs ,target);
+                emit(Op::Truth ,target ,target);
+                const size_t skip = emit(binary->op == TokenType::And ? Op::JumpIfFalse : Op::JumpIfTrue ,target);
+                lower(binary->rhs ,target);
+                emit(Op::Truth ,target ,target);
+                patch({skip});
+                return;
+            }
+            case TokenType::Xor: {
+                const uint16_t lhs = allocate();
+                emit(Op::Truth ,lhs ,operand(binary->lhs));
+                const uint16_t rhs = allocate();
+                emit(Op::Truth ,rhs ,operand(binary->rhs));
+                emit(Op::NotEqual ,target ,lhs ,rhs);
+                return;
+            }
+            case TokenType::DoubleDot:
+                fail(formatNode(binary) + " is a set, runtime code cant use sets yet");
+            default:
+                break;
+        }
+
+        if (isAssignment(binary->op))
+        {
+            assign(binary ,target);
+            return;
+        }
+
+        const Op op = binaryOp(binary->op);
+        if (op == Op::Add || op == Op::Subtract)
+        {
+            if (auto k = smallConstant(binary->rhs)) // x + 1
+            {
+                emit(op == Op::Add ? Op::AddConst : Op::SubtractConst ,target ,operand(binary->lhs) ,*k);
+                return;
+            }
+        }
+        const uint16_t lhs = leftOperand(binary->lhs ,binary->rhs);
+        emit(op ,target ,lhs ,operand(binary->rhs));
+    }
+
+    // x = y and x += y, target is kNone if the value isnt used
+    void assign(const AST::Binary* binary ,uint16_t target)
+    {
+        const Location location = resolveVariable(binary->lhs);
+        const bool isLocal = location.kind == Location::Kind::Register;
+
+        if (binary->op == TokenType::Assign)
+        {
+            uint16_t value;
+            if (isLocal && isSingleStep(binary->rhs))
+            {
+                value = static_cast<uint16_t>(location.index);
+                lower(binary->rhs ,value);
+            }
+            else
+            {
+                value = operand(binary->rhs);
+                write(location ,value);
+            }
+            if (target != kNone && target != value)
+                emit(Op::Move ,target ,value);
+            return;
+        }
+
+        // x op= y, x is read before y is evaluated
+        const Op op = binaryOp(baseOperator(binary->op));
+        uint16_t current = isLocal ? static_cast<uint16_t>(location.index) : allocate();
+        if (!isLocal)
+            read(location ,current);
+        else if (hasEffects(binary->rhs))
+        {
+            current = allocate();
+            emit(Op::Move ,current ,static_cast<uint16_t>(location.index));
+        }
+
+        const uint16_t result = isLocal ? static_cast<uint16_t>(location.index) : current;
+        auto k = (op == Op::Add || op == Op::Subtract) ? smallConstant(binary->rhs) : std::nullopt;
+        if (k)
+            emit(op == Op::Add ? Op::AddConst : Op::SubtractConst ,result ,current ,*k);
+        else
+            emit(op ,result ,current ,operand(binary->rhs));
+        if (!isLocal)
+            write(location ,result);
+        if (target != kNone)
+            emit(Op::Move ,target ,result);
+    }
+
+    // jumps to patch to where the code goes if condition doesnt hold
+    std::vector<size_t> branchUnless(const AST::Rvalue* condition)
+    {
+        const uint16_t mark = frame->nextRegister;
+        std::vector<size_t> jumps;
+
+        if (condition->getType() == AST::NodeType::Binary)
+        {
+            auto* binary = static_cast<const AST::Binary*>(condition);
+            if (binary->op == TokenType::And)
+            {
+                jumps = branchUnless(binary->lhs);
+                auto more = branchUnless(binary->rhs);
+                jumps.insert(jumps.end() ,more.begin() ,more.end());
+                return jumps;
+            }
+            if (isComparison(binary->op)) // x == 10 | ... compares and jumps at once
+            {
+                const uint16_t lhs = leftOperand(binary->lhs ,binary->rhs);
+                if (auto k = smallConstant(binary->rhs))
+                    jumps.push_back(emit(branchOp(binary->op ,true) ,lhs ,*k));
+                else
+                    jumps.push_back(emit(branchOp(binary->op ,false) ,lhs ,operand(binary->rhs)));
+                release(mark);
+                return jumps;
+            }
+        }
+
+        jumps.push_back(emit(Op::JumpIfFalse ,operand(condition)));
+        release(mark);
+        return jumps;
+    }
+
+    void lowerCall(const AST::Call* call ,uint16_t target)
+    {
+        // the arguments go to consecutive registers, the first one gets the result
+        auto lowerArguments = [&]
+        {
+            const uint16_t first = frame->nextRegister;
+            for (const auto* argument : call->arguments)
+            {
+                const uint16_t reg = allocate();
+                lower(argument ,reg);
+            }
+            if (call->arguments.empty())
+                allocate();
+            return first;
+        };
+        const auto count = static_cast<uint16_t>(call->arguments.size());
+
+        if (call->callee->getType() == AST::NodeType::Lvalue)
+        {
+            const SymbolId name = static_cast<const AST::Lvalue*>(call->callee)->identifier;
+            auto it = functions.find(name);
+            if (it == functions.end())
+                fail(nameOf(name) + (resolve(name) ? " isnt a function" : " isnt defined"));
+
+            const Function& function = program.functions[it->second];
+            const uint16_t first = lowerArguments();
+            if (count != function.parameterCount)
+                emit(Op::Fail ,0 ,0 ,0 ,message(nameOf(name) + " takes " + std::to_string(function.parameterCount)
+                    + " arguments but got " + std::to_string(count)));
+            else
+                emit(Op::Call ,first ,count ,0 ,it->second);
+            if (target != first)
+                emit(Op::Move ,target ,first);
+            return;
+        }
+
+        auto [name ,domain] = domainNames(call->callee);
+        if (domain != "Functions" || (name != "pow" && name != "abs"))
+        {
+            if (domain == "Functions" && name == "sum")
+                fail("sum@Functions adds up a set, runtime code cant use sets yet");
+            fail("only functions can be called");
+        }
+
+        const uint16_t first = lowerArguments();
+        emit(Op::CallBuiltin ,first ,count ,0 ,static_cast<uint32_t>(name == "pow" ? Builtin::Pow : Builtin::Abs));
+        if (target != first)
+            emit(Op::Move ,target ,first);
+    }
+
+    // node for what it does, its value isnt used
+    void effect(const AST::Rvalue* node)
+    {
+        const uint16_t mark = frame->nextRegister;
+
+        using AST::NodeType;
+        switch (node->getType())
+        {
+            case NodeType::Literal:
+                break;
+            case NodeType::Set:
+                if (!AST::isEmptySet(node))
+                    lower(node ,allocate());
+                break;
+            case NodeType::Lvalue:
+                resolveVariable(node);
+                break;
+            case NodeType::Unary: {
+                auto* unary = static_cast<const AST::Unary*>(node);
+                if (unary->op == TokenType::DoublePlus || unary->op == TokenType::DoubleMinus)
+                    increment(unary ,kNone);
+                else
+                    lower(node ,allocate());
+                break;
+            }
+            case NodeType::Binary: {
+                auto* binary = static_cast<const AST::Binary*>(node);
+                if (isAssignment(binary->op))
+                    assign(binary ,kNone);
+                else
+                    lower(node ,allocate());
+                break;
+            }
+            case NodeType::Conditional: {
+                auto* conditional = static_cast<const AST::Conditional*>(node);
+                if (conditional->otherwise)
+                {
+                    const auto otherwise = branchUnless(conditional->rhs);
+                    effect(conditional->lhs);
+                    const size_t end = emit(Op::Jump);
+                    patch(otherwise);
+                    effect(conditional->otherwise);
+                    patch({end});
+                    break;
+                }
+                const auto skip = branchUnless(conditional->lhs);
+                effect(conditional->rhs);
+                patch(skip);
+                break;
+            }
+            default:
+                lower(node ,allocate());
+        }
+        release(mark);
+    }
+
+    void enterBlock()
+    {
+        frame->scopes.push_back(frame->nextRegister);
+    }
+
+    // deletes the domains created deeper than depth, for return or the end of a block
+    void deleteDomains(size_t depth)
+    {
+        for (auto it = frame->domains.rbegin(); it != frame->domains.rend() && it->depth > depth; ++it)
+            deleteDomain(*it);
+    }
+
+    void deleteDomain(const DomainName& domain)
+    {
+        if (domain.location.kind == Location::Kind::Register)
+        {
+            emit(Op::DeleteDomain ,static_cast<uint16_t>(domain.location.index));
+            return;
+        }
+        const uint16_t reg = allocate();
+        emit(Op::LoadGlobal ,reg ,0 ,0 ,domain.location.index);
+        emit(Op::DeleteDomain ,reg);
+        emit(Op::StoreGlobal ,reg ,0 ,0 ,domain.location.index);
+        release(reg);
+    }
+
+    void exitBlock()
+    {
+        const size_t depth = frame->depth();
+        deleteDomains(depth - 1);
+        while (!frame->domains.empty() && frame->domains.back().depth == depth)
+        {
+            isDomainAlive[frame->domains.back().id] = false;
+            frame->domains.pop_back();
+        }
+
+        auto isInside = [&](size_t nameDepth) { return nameDepth >= depth; };
+        frame->names.erase(std::remove_if(frame->names.begin() ,frame->names.end() ,[&](const Name& name) { return isInside(name.depth); })
+            ,frame->names.end());
+        frame->pinned.erase(std::remove_if(frame->pinned.begin() ,frame->pinned.end() ,[&](const auto& pin) { return isInside(pin.first); })
+            ,frame->pinned.end());
+        const uint16_t start = frame->scopes.back();
+        frame->scopes.pop_back();
+        release(start);
+    }
+
+    // a block as a statement, return leaves whatever encloses it
+    void block(const AST::Block* block)
+    {
+        enterBlock();
+        for (const auto* statement : block->ASTList)
+            this->statement(statement);
+        exitBlock();
+    }
+
+    // a block as a value, return gives it
+    void valueBlock(const AST::Block* block ,uint16_t target)
+    {
+        emit(Op::LoadConst ,target ,0 ,0 ,undefined());
+        frame->returns.push_back(ReturnTarget{target ,frame->depth() ,false});
+        this->block(block);
+        patch(frame->returns.back().jumps);
+        frame->returns.pop_back();
+    }
+
+    void lowerReturn(const AST::Return* ret)
+    {
+        if (frame->returns.empty())
+            fail("return outside of a function");
+
+        const ReturnTarget target = frame->returns.back(); // lowering the value can add more
+        if (target.isFunction)
+        {
+            uint16_t value;
+            if (ret->value)
+                value = operand(ret->value);
+            else
+            {
+                value = allocate();
+                emit(Op::LoadConst ,value ,0 ,0 ,undefined());
+            }
+            deleteDomains(target.depth);
+            emit(Op::Return ,value);
+            return;
+        }
+
+        if (ret->value)
+            lower(ret->value ,target.result);
+        else
+            emit(Op::LoadConst ,target.result ,0 ,0 ,undefined());
+        deleteDomains(target.depth);
+        frame->returns.back().jumps.push_back(emit(Op::Jump));
+    }
+
+    void domain(const AST::Domain* domain)
+    {
+        if (domain->op == TokenType::Create)
+        {
+            const auto id = static_cast<uint32_t>(isDomainAlive.size());
+            isDomainAlive.push_back(true);
+            if (isTopLevel())
+            {
+                const uint32_t global = newGlobal();
+                const uint16_t reg = allocate();
+                emit(Op::CreateDomain ,reg);
+                emit(Op::StoreGlobal ,reg ,0 ,0 ,global);
+                release(reg);
+                main.domains.push_back(DomainName{domain->name ,Location{Location::Kind::Global ,global} ,0 ,id});
+                return;
+            }
+            const uint16_t reg = allocate();
+            emit(Op::CreateDomain ,reg);
+            frame->domains.push_back(DomainName{domain->name ,Location{Location::Kind::Register ,reg} ,frame->depth() ,id});
+            return;
+        }
+
+        // deleted in the block that created it, the DomainChecker made sure
+        auto it = std::find_if(frame->domains.rbegin() ,frame->domains.rend() ,[&](const DomainName& d) { return d.name == domain->name; });
+        if (it == frame->domains.rend())
+            fail("there is no domain " + nameOf(domain->name));
+        deleteDomain(*it);
+        isDomainAlive[it->id] = false;
+        frame->domains.erase(std::next(it).base());
+    }
+
+    void bind(SymbolId name ,Location location ,size_t depth ,bool isGlobalName)
+    {
+        if (isGlobalName)
+            globals[name] = location;
+        else
+            frame->names.push_back(Name{name ,location ,depth});
+    }
+
+    static bool isGlobal(Location location)
+    {
+        return location.kind == Location::Kind::Global || location.kind == Location::Kind::GlobalCell;
+    }
+
+    void declare(const AST::VariableBase* variable)
+    {
+        const bool hasValue = variable->getType() == AST::NodeType::VarDefinition || variable->getType() == AST::NodeType::VarReference;
+        const bool isMain = frame == &main;
+
+        // a reference to a name is another name for its value
+        if (variable->getType() == AST::NodeType::VarReference && variable->value && variable->value->getType() == AST::NodeType::Lvalue)
+        {
+            const Location location = resolveVariable(variable->value);
+            bind(variable->name ,location ,frame->depth() ,isTopLevel());
+            if (isTopLevel())
+                program.results.push_back(Result{variable->name ,location.index ,location.kind == Location::Kind::GlobalCell});
+            return;
+        }
+
+        auto lowerValue = [&](uint16_t target)
+        {
+            if (hasValue)
+                lower(variable->value ,target);
+            else
+                emit(Op::LoadConst ,target ,0 ,0 ,undefined());
+        };
+
+        // on the domain of its block
+        if (!variable->hasDomain && !isTopLevel())
+        {
+            const uint16_t reg = allocate();
+            lowerValue(reg);
+            bind(variable->name ,Location{Location::Kind::Register ,reg} ,frame->depth() ,false);
+            return;
+        }
+
+        const DomainName* domain = variable->hasDomain && !symbols().lookup(variable->domain).empty() ? &findDomain(variable->domain) : nullptr;
+
+        // on a block's domain, visible until that block ends
+        if (domain && domain->location.kind == Location::Kind::Register)
+        {
+            const uint16_t cell = allocate();
+            if (domain->depth < frame->depth())
+                frame->pinned.emplace_back(domain->depth ,cell);
+            const uint16_t value = allocate();
+            lowerValue(value);
+            emit(Op::NewCell ,cell ,static_cast<uint16_t>(domain->location.index));
+            emit(Op::StoreCell ,cell ,value);
+            release(static_cast<uint16_t>(cell + 1));
+            bind(variable->name ,Location{Location::Kind::RegisterCell ,cell} ,domain->depth ,false);
+            return;
+        }
+
+        // on the global domain, or a top level one
+        const uint16_t mark = frame->nextRegister;
+        const uint16_t value = allocate();
+        lowerValue(value);
+
+        const bool isCell = domain != nullptr;
+        const uint32_t global = isTopLevel() ? globals.at(variable->name).index : newGlobal();
+        if (isCell)
+        {
+            const uint16_t cell = allocate();
+            emit(Op::LoadGlobal ,cell ,0 ,0 ,domain->location.index);
+            emit(Op::NewCell ,cell ,cell);
+            emit(Op::StoreCell ,cell ,value);
+            emit(Op::DefineGlobal ,cell ,0 ,0 ,global);
+            cellDomains[global] = domain->id;
+        }
+        else
+            emit(Op::DefineGlobal ,value ,0 ,0 ,global);
+
+        const Location location {isCell ? Location::Kind::GlobalCell : Location::Kind::Global ,global};
+        bind(variable->name ,location ,0 ,true);
+        if (isMain)
+            program.results.push_back(Result{variable->name ,global ,isCell});
+        release(mark);
+    }
+
+    void statement(const AST::ASTNode* statement)
+    {
+        if (!statement)
+            fail("statement has errors");
+
+        using AST::NodeType;
+        switch (statement->getType())
+        {
+            case NodeType::Empty:
+                return;
+            case NodeType::VarDeclaration:
+            case NodeType::VarAllocation:
+            case NodeType::VarDefinition:
+            case NodeType::VarReference:
+                declare(static_cast<const AST::VariableBase*>(statement));
+                return;
+            case NodeType::FunctionDefinition:
+                fail("functions can only be defined at the top level");
+            case NodeType::Return:
+                lowerReturn(static_cast<const AST::Return*>(statement));
+                return;
+            case NodeType::Block:
+                block(static_cast<const AST::Block*>(statement));
+                return;
+            case NodeType::Domain:
+                domain(static_cast<const AST::Domain*>(statement));
+                return;
+            default:
+                if (!AST::isExpression(statement->getType()) && !AST::isEmptySet(statement))
+                    fail(formatNode(statement) + " cant be run");
+                effect(static_cast<const AST::Rvalue*>(statement));
+        }
+    }
+
+    // a function that calls itself as findRecursion() describes, lowered to a
+    // loop: a tail call jumps back to the start with its arguments as the
+    // parameters, so does a step, counting the levels, and once a leaf stops
+    // unwind() computes the parameters of each level back to apply its op
+    struct Loop
+    {
+        Recursion recursion;
+        uint32_t head = 0; // where the parameters are converted
+        uint16_t count = kNone; // the levels of a step still to apply
+        uint16_t result = kNone;
+        uint16_t one = kNone;
+    };
+
+    // a step without the parameters of each level cant be a loop, neither can
+    // one that needs more constants than an instruction can name
+    bool isLoop(Loop& loop)
+    {
+        const Recursion& recursion = loop.recursion;
+        if (!recursion.isLoop())
+            return false;
+        if (recursion.kind == Recursion::Kind::Tail)
+            return true;
+
+        const uint32_t one = constant(RuntimeValue::ofInt(1));
+        if (one >= kNone)
+            return false;
+        loop.one = static_cast<uint16_t>(one);
+        for (const auto* argument : recursion.stepCall()->arguments)
+            if (argument->getType() == AST::NodeType::Binary && !smallConstant(static_cast<const AST::Binary*>(argument)->rhs))
+                return false;
+        return true;
+    }
+
+    // node of the conditionals of the loop, the jumps of the leaves that stop it go to stops
+    void loopLeaf(const Loop& loop ,const AST::Rvalue* node ,std::vector<size_t>& stops)
+    {
+        const Recursion& recursion = loop.recursion;
+        if (recursion.isBranch(node))
+        {
+            auto* conditional = static_cast<const AST::Conditional*>(node);
+            const auto otherwise = branchUnless(conditional->rhs);
+            loopLeaf(loop ,conditional->lhs ,stops);
+            patch(otherwise);
+            loopLeaf(loop ,conditional->otherwise ,stops);
+            return;
+        }
+
+        const bool isStep = node == recursion.step;
+        const AST::Call* call = isStep ? recursion.stepCall() : recursion.callOf(node);
+        if (!call)
+        {
+            const uint16_t mark = frame->nextRegister;
+            if (loop.count == kNone)
+                emit(Op::Return ,operand(node));
+            else
+            {
+                lower(node ,loop.result);
+                stops.push_back(emit(Op::Jump));
+            }
+            release(mark);
+            return;
+        }
+
+        // all arguments are evaluated before a parameter changes, the ones
+        // that are their parameter stay
+        const uint16_t mark = frame->nextRegister;
+        std::vector<uint16_t> arguments(call->arguments.size() ,kNone);
+        for (size_t i = 0; i < arguments.size(); i++)
+        {
+            const AST::Rvalue* argument = call->arguments[i];
+            if (argument->getType() == AST::NodeType::Lvalue)
+            {
+                const Location location = resolveVariable(argument);
+                if (location.kind == Location::Kind::Register && location.index == i)
+                    continue;
+            }
+            arguments[i] = allocate();
+            lower(argument ,arguments[i]);
+        }
+        for (size_t i = 0; i < arguments.size(); i++)
+            if (arguments[i] != kNone)
+                emit(Op::Move ,static_cast<uint16_t>(i) ,arguments[i]);
+        release(mark);
+        if (isStep)
+            emit(Op::AddConst ,loop.count ,loop.count ,loop.one);
+        emit(Op::Jump ,0 ,0 ,0 ,loop.head);
+    }
+
+    // the levels of a step, deepest first: its parameters back from the ones
+    // of the level below, then result = result op operand
+    void unwind(const Loop& loop ,const std::vector<size_t>& stops)
+    {
+        const Recursion& recursion = loop.recursion;
+        patch(stops);
+        const size_t up = emit(Op::JumpIfFalse ,loop.count);
+        const auto& arguments = recursion.stepCall()->arguments;
+        for (size_t i = 0; i < arguments.size(); i++) // x - 1 back is x + 1
+        {
+            if (arguments[i]->getType() != AST::NodeType::Binary)
+                continue;
+            auto* binary = static_cast<const AST::Binary*>(arguments[i]);
+            const auto reg = static_cast<uint16_t>(i);
+            emit(binary->op == TokenType::Plus ? Op::SubtractConst : Op::AddConst ,reg ,reg ,*smallConstant(binary->rhs));
+        }
+
+        const uint16_t mark = frame->nextRegister;
+        const uint16_t value = operand(recursion.stepOperand());
+        const Op op = binaryOp(recursion.step->op);
+        if (recursion.isCallFirst)
+            emit(op ,loop.result ,loop.result ,value);
+        else
+            emit(op ,loop.result ,value ,loop.result);
+        release(mark);
+        emit(Op::SubtractConst ,loop.count ,loop.count ,loop.one);
+        emit(Op::Jump ,0 ,0 ,0 ,static_cast<uint32_t>(up));
+        patch({up});
+        emit(Op::Return ,loop.result);
+    }
+
+    void function(const AST::FunctionDefinition* definition)
+    {
+        const uint32_t index = functions.at(definition->name);
+        Frame state {index};
+        Frame* outer = std::exchange(frame ,&state);
+
+        for (const auto* parameter : definition->parameters)
+            frame->names.push_back(Name{parameter->name ,Location{Location::Kind::Register ,allocate()} ,0});
+
+        // a step counts its levels from before the loop starts
+        const Recursion recursion = findRecursion(definition);
+        Loop loop {recursion};
+        if (!isLoop(loop))
+            loop.recursion.kind = Recursion::Kind::None;
+        if (loop.recursion.kind == Recursion::Kind::Linear)
+        {
+            loop.count = allocate();
+            loop.result = allocate();
+            emit(Op::LoadConst ,loop.count ,0 ,0 ,constant(RuntimeValue::ofInt(0)));
+        }
+        loop.head = static_cast<uint32_t>(state.code.size());
+
+        for (size_t i = 0; i < definition->parameters.size(); i++) // x : int
+        {
+            const auto* parameter = definition->parameters[i];
+            if (!parameter->hasType)
+                continue;
+
+            const std::string_view type = symbols().lookup(parameter->type);
+            if (type == "int" || type == "double")
+                emit(Op::Convert ,static_cast<uint16_t>(i) ,type == "double" ,0 ,message(nameOf(definition->name) + " expects an int for "
+                    + nameOf(parameter->name) + " but got "));
+        }
+
+        const size_t start = state.code.size();
+        try
+        {
+            if (definition->relation != TokenType::Assign)
+                emit(Op::Fail ,0 ,0 ,0 ,message(nameOf(definition->name) + " isnt defined with '=', it cant be run"));
+            else if (loop.recursion.kind != Recursion::Kind::None)
+            {
+                frame->returns.push_back(ReturnTarget{0 ,0 ,true});
+                std::vector<size_t> stops;
+                loopLeaf(loop ,loop.recursion.value ,stops);
+                if (loop.recursion.kind == Recursion::Kind::Linear)
+                    unwind(loop ,stops);
+            }
+            else if (definition->value && definition->value->getType() == AST::NodeType::Block)
+            {
+                frame->returns.push_back(ReturnTarget{0 ,0 ,true});
+                block(static_cast<const AST::Block*>(definition->value));
+                const uint16_t reg = allocate();
+                emit(Op::LoadConst ,reg ,0 ,0 ,undefined());
+                emit(Op::Return ,reg);
+            }
+            else
+                emit(Op::Return ,operand(definition->value));
+        }
+        catch (const std::runtime_error& e) // reported when it is called, like the TreeWalker does
+        {
+            state.code.resize(start);
+            emit(Op::Fail ,0 ,0 ,0 ,message(e.what()));
+        }
+
+        program.functions[index].registerCount = std::max<uint16_t>(state.registerCount ,1);
+        bodies[index] = std::move(state.code);
+        frame = outer;
+    }
+
+    void topLevel(const AST::ASTNode* statement)
+    {
+        if (statement->getType() == AST::NodeType::FunctionDefinition)
+        {
+            function(static_cast<const AST::FunctionDefinition*>(statement));
+            return;
+        }
+        if (isMainFailing)
+            return;
+
+        // an error fails the run when it gets there, the statements before it still run
+        const size_t start = main.code.size();
+        const uint16_t mark = frame->nextRegister;
+        try
+        {
+            switch (statement->getType())
+            {
+                case AST::NodeType::Return:
+                    fail("return outside of a function");
+                case AST::NodeType::Block: // return leaves it
+                    valueBlock(static_cast<const AST::Block*>(statement) ,allocate());
+                    break;
+                default:
+                    this->statement(statement);
+            }
+        }
+        catch (const std::runtime_error& e)
+        {
+            main.code.resize(start);
+            emit(Op::Fail ,0 ,0 ,0 ,message(e.what()));
+            isMainFailing = true;
+        }
+        release(mark);
+    }
+
+    // functions and top level names first, functions can call and read the ones declared after them
+    void declareNames(const std::vector<const AST::ASTNode*>& statements)
+    {
+        program.functions.push_back(Function{symbols().intern("") ,0 ,0 ,0});
+        for (const auto* statement : statements)
+        {
+            if (statement->getType() == AST::NodeType::FunctionDefinition)
+            {
+                auto* definition = static_cast<const AST::FunctionDefinition*>(statement);
+                functions[definition->name] = static_cast<uint32_t>(program.functions.size());
+                program.functions.push_back(Function{definition->name ,static_cast<uint16_t>(definition->parameters.size()) ,0 ,0});
+                continue;
+            }
+
+            const bool isVariable = statement->getType() == AST::NodeType::VarDeclaration || statement->getType() == AST::NodeType::VarAllocation
+                || statement->getType() == AST::NodeType::VarDefinition || statement->getType() == AST::NodeType::VarReference;
+            if (!isVariable)
+                continue;
+            auto* variable = static_cast<const AST::VariableBase*>(statement);
+            const bool isAlias = statement->getType() == AST::NodeType::VarReference && variable->value
+                && variable->value->getType() == AST::NodeType::Lvalue;
+            if (!isAlias)
+            {
+                const bool isCell = variable->hasDomain && !symbols().lookup(variable->domain).empty();
+                globals[variable->name] = Location{isCell ? Location::Kind::GlobalCell : Location::Kind::Global ,newGlobal()};
+            }
+        }
+        bodies.resize(program.functions.size());
+    }
+
+    // the functions after the top level code, with their jumps moved along
+    void link()
+    {
+        emit(Op::Halt);
+        program.functions[0].registerCount = std::max<uint16_t>(main.registerCount ,1);
+        bodies[0] = std::move(main.code);
+
+        for (size_t i = 0; i < bodies.size(); i++)
+        {
+            const auto entry = static_cast<uint32_t>(program.code.size());
+            program.functions[i].entry = entry;
+            for (Instruction instruction : bodies[i])
+            {
+                if (Bytecode::isJump(instruction.op))
+                    instruction.target += entry;
+                program.code.push_back(instruction);
+            }
+        }
+
+        // the cells of deleted domains cant be read any more
+        auto isFreed = [&](const Result& result)
+        {
+            return result.isCell && !isDomainAlive[cellDomains.at(result.global)];
+        };
+        program.results.erase(std::remove_if(program.results.begin() ,program.results.end() ,isFreed) ,program.results.end());
+    }
+};
+
+uint16_t Bytecode::written(const Instruction& instruction)
+{
+    switch (instruction.op)
+    {
+        case Op::StoreGlobal:
+        case Op::DefineGlobal:
+        case Op::StoreCell:
+        case Op::Return:
+        case Op::Fail:
+        case Op::Halt:
+            return kNoRegister;
+        default:
+            return isJump(instruction.op) ? kNoRegister : instruction.a;
+    }
+}
+
+Bytecode Bytecode::compile(const std::vector<const AST::ASTNode*>& statements)
+{
+    Bytecode program;
+    Builder builder(program);
+    builder.declareNames(statements);
+    for (const auto* statement : statements)
+        builder.topLevel(statement);
+    builder.link();
+    return program;
+}
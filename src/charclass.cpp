@@ -0,0 +1,183 @@
+#include <cstddef>
+#include <string_view>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CHARCLASS_X86 1
+#endif
+
+#include "charclass.h"
+
+using namespace Compiler;
+
+namespace {
+
+enum class Run {Whitespace ,Identifier ,Digits};
+
+template <Run kRun>
+bool inRun(char c)
+{
+    switch (kRun)
+    {
+        case Run::Whitespace: return isWhitespace(c);
+        case Run::Identifier: return isIdentifierChar(c);
+        case Run::Digits: return isDigit(c);
+    }
+    return false;
+}
+
+template <Run kRun>
+size_t countScalar(const char* data ,size_t begin ,size_t size)
+{
+    size_t i = begin;
+    while (i < size && inRun<kRun>(data[i]))
+        i++;
+    return i;
+}
+
+#ifdef CHARCLASS_X86
+
+// unsigned (x - lo) <= (hi - lo) for every byte
+inline __m128i inRange128(__m128i x ,char lo ,char hi)
+{
+    __m128i t = _mm_sub_epi8(x ,_mm_set1_epi8(lo));
+    return _mm_cmpeq_epi8(_mm_min_epu8(t ,_mm_set1_epi8(static_cast<char>(hi - lo))) ,t);
+}
+
+template <Run kRun>
+__m128i match128(__m128i x)
+{
+    switch (kRun)
+    {
+        case Run::Whitespace:
+            return _mm_or_si128(_mm_cmpeq_epi8(x ,_mm_set1_epi8(' ')) ,inRange128(x ,'\t' ,'\r'));
+        case Run::Identifier:
+            return _mm_or_si128(
+                    _mm_or_si128(inRange128(x ,'0' ,'9') ,inRange128(_mm_or_si128(x ,_mm_set1_epi8(0x20)) ,'a' ,'z'))
+                    ,_mm_cmpeq_epi8(x ,_mm_set1_epi8('_')));
+        case Run::Digits:
+            return inRange128(x ,'0' ,'9');
+    }
+    return _mm_setzero_si128();
+}
+
+// Inlined into the AVX2 kernel too, so the tail stays VEX encoded there
+// instead of paying for an SSE/AVX transition.
+template <Run kRun>
+__attribute__((always_inline))
+inline size_t countBlocks128(const char* data ,size_t i ,size_t size)
+{
+    for (; i + 16 <= size; i += 16)
+    {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        unsigned miss = ~static_cast<unsigned>(_mm_movemask_epi8(match128<kRun>(x))) & 0xFFFF;
+        if (miss)
+            return i + __builtin_ctz(miss);
+    }
+    return countScalar<kRun>(data ,i ,size);
+}
+
+template <Run kRun>
+size_t countSSE2(std::string_view view)
+{
+    return countBlocks128<kRun>(view.data() ,0 ,view.size());
+}
+
+__attribute__((target("avx2")))
+inline __m256i inRange256(__m256i x ,char lo ,char hi)
+{
+    __m256i t = _mm256_sub_epi8(x ,_mm256_set1_epi8(lo));
+    return _mm256_cmpeq_epi8(_mm256_min_epu8(t ,_mm256_set1_epi8(static_cast<char>(hi - lo))) ,t);
+}
+
+template <Run kRun>
+__attribute__((target("avx2")))
+__m256i match256(__m256i x)
+{
+    switch (kRun)
+    {
+        case Run::Whitespace:
+            return _mm256_or_si256(_mm256_cmpeq_epi8(x ,_mm256_set1_epi8(' ')) ,inRange256(x ,'\t' ,'\r'));
+        case Run::Identifier:
+            return _mm256_or_si256(
+                    _mm256_or_si256(inRange256(x ,'0' ,'9') ,inRange256(_mm256_or_si256(x ,_mm256_set1_epi8(0x20)) ,'a' ,'z'))
+                    ,_mm256_cmpeq_epi8(x ,_mm256_set1_epi8('_')));
+        case Run::Digits:
+            return inRange256(x ,'0' ,'9');
+    }
+    return _mm256_setzero_si256();
+}
+
+template <Run kRun>
+__attribute__((target("avx2")))
+size_t countAVX2(std::string_view view)
+{
+    const char* data = view.data();
+    size_t i = 0;
+
+    for (; i + 32 <= view.size(); i += 32)
+    {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        unsigned miss = ~static_cast<unsigned>(_mm256_movemask_epi8(match256<kRun>(x)));
+        if (miss)
+            return i + __builtin_ctz(miss);
+    }
+    return countBlocks128<kRun>(data ,i ,view.size());
+}
+
+#endif
+
+template <Run kRun>
+size_t countScalarView(std::string_view view)
+{
+    return countScalar<kRun>(view.data() ,0 ,view.size());
+}
+
+using CountFn = size_t (*)(std::string_view);
+
+struct Kernels
+{
+    CountFn whitespace;
+    CountFn identifier;
+    CountFn digits;
+};
+
+Kernels selectKernels()
+{
+#ifdef CHARCLASS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return {countAVX2<Run::Whitespace> ,countAVX2<Run::Identifier> ,countAVX2<Run::Digits>};
+    return {countSSE2<Run::Whitespace> ,countSSE2<Run::Identifier> ,countSSE2<Run::Digits>};
+#else
+    return {countScalarView<Run::Whitespace> ,countScalarView<Run::Identifier> ,countScalarView<Run::Digits>};
+#endif
+}
+
+const Kernels kKernels = selectKernels();
+
+} // namespace
+
+// Most runs are a few characters long, so check the first one inline
+// before paying for the indirect call.
+
+size_t Compiler::countWhitespace(std::string_view view)
+{
+    if (view.empty() || !isWhitespace(view[0]))
+        return 0;
+    return kKernels.whitespace(view);
+}
+
+size_t Compiler::countIdentifierChars(std::string_view view)
+{
+    if (view.empty() || !isIdentifierChar(view[0]))
+        return 0;
+    return kKernels.identifier(view);
+}
+
+size_t Compiler::countDigits(std::string_view view)
+{
+    if (view.empty() || !isDigit(view[0]))
+        return 0;
+    return kKernels.digits(view);
+}
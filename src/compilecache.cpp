@@ -0,0 +1,293 @@
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+#include "astfile.h"
+#include "compilecache.h"
+#include "compiler.h"
+#include "hash.h"
+
+using namespace Compiler;
+namespace fs = std::filesystem;
+
+// entry file: header, then an AST file (astfile.h) that is mapped and printed in place
+struct EntryHeader
+{
+    char magic[4];
+    uint32_t version;
+    Hash128 key; // to catch truncated or misnamed files
+};
+
+static constexpr char kEntryMagic[4] = {'C' ,'C' ,'A' ,'E'};
+
+CompileCache::CompileCache(const fs::path& directory ,uint64_t maxSize)
+    : directory_ (directory)
+    ,maxSize_ (maxSize)
+{
+    std::error_code ec;
+    fs::create_directories(directory_ ,ec);
+    if (ec)
+        throw std::runtime_error("ERROR: cant create cache directory " + directory_.string() + ": " + ec.message() + ".");
+
+    // a rebuilt compiler may parse differently, so its binary is part of every key
+    compilerId_ = hashValue128(kVersion_ ,compilerId_);
+    const fs::path self = fs::read_symlink("/proc/self/exe" ,ec);
+    if (!ec)
+    {
+        const auto size = fs::file_size(self ,ec);
+        const auto modified = fs::last_write_time(self ,ec).time_since_epoch().count();
+        compilerId_ = hashValue128(size ,compilerId_);
+        compilerId_ = hashValue128(modified ,compilerId_);
+    }
+}
+
+CompileCache::~CompileCache()
+{
+    try
+    {
+        updateStats([this](Stats& stats)
+        {
+            if (stats.bytes > stats.maxSize)
+                evict(stats);
+        });
+    }
+    catch (const std::exception& e)
+    {
+        log(e.what());
+    }
+}
+
+fs::path CompileCache::defaultDirectory()
+{
+    if (const char* dir = std::getenv("COMPILER_CACHE_DIR"); dir && *dir)
+        return dir;
+    if (const char* dir = std::getenv("XDG_CACHE_HOME"); dir && *dir)
+        return fs::path(dir) / "compiler";
+    if (const char* home = std::getenv("HOME"); home && *home)
+        return fs::path(home) / ".cache" / "compiler";
+    return fs::temp_directory_path() / "compiler-cache";
+}
+
+Hash128 CompileCache::key(const CompileContext& context ,std::string_view source) const
+{
+    // the other fields only change how the work is split, not the result
+    Hash128 hash = hashValue128(context.maxNestRange ,compilerId_);
+    return hashBytes128(source.data() ,source.size() ,hash);
+}
+
+fs::path CompileCache::entryPath(Hash128 key) const
+{
+    const std::string hex = toHex(key);
+    return directory_ / hex.substr(0 ,2) / (hex.substr(2) + ".ast");
+}
+
+std::unique_ptr<AST::ASTFile> CompileCache::load(Hash128 key)
+{
+    const fs::path path = entryPath(key);
+    std::unique_ptr<AST::ASTFile> file;
+    uint64_t removedBytes = 0;
+
+    std::error_code ec;
+    if (fs::exists(path ,ec))
+    {
+        try
+        {
+            file = std::make_unique<AST::ASTFile>(path.string() ,sizeof(EntryHeader));
+
+            EntryHeader header;
+            std::memcpy(&header ,file->bytes().data() ,sizeof(header));
+            if (std::memcmp(header.magic ,kEntryMagic ,sizeof(kEntryMagic)) != 0
+                || header.version != kVersion_ || header.key != key)
+                file.reset();
+        }
+        catch (const std::exception&)
+        {
+            file.reset();
+        }
+
+        if (file)
+            fs::last_write_time(path ,fs::file_time_type::clock::now() ,ec); // most recently used
+        else // damaged, it will be stored again
+        {
+            const uint64_t size = fs::file_size(path ,ec);
+            if (!ec && fs::remove(path ,ec))
+                removedBytes = size;
+        }
+    }
+
+    std::lock_guard lock(mutex_);
+    (file ? pending_.hits : pending_.misses)++;
+    pending_.bytes -= removedBytes; // may wrap, adding it to the stored total wraps back
+    return file;
+}
+
+void CompileCache::store(Hash128 key ,const AST::CompiledAST& compiled)
+{
+    const std::string ast = AST::encodeASTFile(compiled);
+
+    EntryHeader header;
+    std::memset(&header ,0 ,sizeof(header)); // no garbage in the padding
+    std::memcpy(header.magic ,kEntryMagic ,sizeof(kEntryMagic));
+    header.version = kVersion_;
+    header.key = key;
+
+    const fs::path path = entryPath(key);
+    std::error_code ec;
+    fs::create_directories(path.parent_path() ,ec);
+
+    // written under a unique name and renamed, readers never see half an entry
+    std::ostringstream tmpName;
+    tmpName << path.string() << ".tmp." << getpid() << '.' << std::this_thread::get_id();
+    const fs::path tmp = tmpName.str();
+    {
+        std::ofstream file(tmp ,std::ios::binary);
+        file.write(reinterpret_cast<const char*>(&header) ,sizeof(header));
+        file.write(ast.data() ,ast.size());
+        if (!file)
+        {
+            fs::remove(tmp ,ec);
+            return;
+        }
+    }
+
+    const bool isNew = !fs::exists(path ,ec); // another process may have stored it meanwhile
+    fs::rename(tmp ,path ,ec);
+    if (ec)
+    {
+        fs::remove(tmp ,ec);
+        return;
+    }
+
+    std::lock_guard lock(mutex_);
+    if (isNew)
+        pending_.bytes += sizeof(header) + ast.size();
+}
+
+template <typename F>
+CompileCache::Stats CompileCache::updateStats(F update)
+{
+    std::lock_guard lock(mutex_);
+
+    const fs::path lockPath = directory_ / "lock";
+    const int lockFile = ::open(lockPath.c_str() ,O_RDWR | O_CREAT | O_CLOEXEC ,0644);
+    if (lockFile < 0 || ::flock(lockFile ,LOCK_EX) != 0)
+    {
+        if (lockFile >= 0)
+            ::close(lockFile);
+        throw std::runtime_error("ERROR: cant lock cache directory " + directory_.string() + ".");
+    }
+
+    Stats stats {};
+    const fs::path statsPath = directory_ / "stats";
+    {
+        std::ifstream file(statsPath);
+        std::string name;
+        uint64_t value = 0;
+        while (file >> name >> value)
+        {
+            if (name == "hits") stats.hits = value;
+            else if (name == "misses") stats.misses = value;
+            else if (name == "evictions") stats.evictions = value;
+            else if (name == "bytes") stats.bytes = value;
+            else if (name == "max_size" && value > 0) stats.maxSize = value;
+        }
+    }
+    if (maxSize_ > 0)
+        stats.maxSize = maxSize_;
+
+    stats.hits += pending_.hits;
+    stats.misses += pending_.misses;
+    stats.evictions += pending_.evictions;
+    stats.bytes += pending_.bytes;
+    pending_ = {};
+
+    update(stats);
+
+    {
+        std::ofstream file(statsPath ,std::ios::trunc);
+        file << "hits " << stats.hits << "\n"
+             << "misses " << stats.misses << "\n"
+             << "evictions " << stats.evictions << "\n"
+             << "bytes " << stats.bytes << "\n"
+             << "max_size " << stats.maxSize << "\n";
+    }
+
+    ::flock(lockFile ,LOCK_UN);
+    ::close(lockFile);
+    return stats;
+}
+
+void CompileCache::evict(Stats& stats)
+{
+    struct Entry
+    {
+        fs::file_time_type used;
+        uint64_t size;
+        fs::path path;
+    };
+    std::vector<Entry> entries;
+    uint64_t total = 0;
+
+    // the scan also corrects stats.bytes, which drifts when processes race on one entry
+    std::error_code ec;
+    for (auto it = fs::recursive_directory_iterator(directory_ ,ec); !ec && it != fs::recursive_directory_iterator(); it.increment(ec))
+    {
+        if (!it->is_regular_file(ec) || it->path().extension() != ".ast")
+            continue;
+
+        const uint64_t size = it->file_size(ec);
+        entries.push_back(Entry{it->last_write_time(ec) ,size ,it->path()});
+        total += size;
+    }
+
+    std::sort(entries.begin() ,entries.end() ,[](const Entry& a ,const Entry& b) { return a.used < b.used; });
+
+    // leave some room so the next runs dont evict again right away
+    const uint64_t target = stats.maxSize - stats.maxSize / 10;
+    for (const auto& entry : entries)
+    {
+        if (total <= target)
+            break;
+        if (fs::remove(entry.path ,ec))
+        {
+            total -= entry.size;
+            stats.evictions++;
+        }
+    }
+    stats.bytes = total;
+}
+
+CompileCache::Stats CompileCache::stats()
+{
+    return updateStats([](Stats&) {});
+}
+
+void Compiler::printCacheStats(CompileCache& cache)
+{
+    const auto stats = cache.stats();
+    const uint64_t lookups = stats.hits + stats.misses;
+
+    std::ostringstream os;
+    os << std::fixed << std::setprecision(1)
+       << "cache directory: " << cache.directory().string() << "\n"
+       << "hits: " << stats.hits << "\n"
+       << "misses: " << stats.misses << "\n"
+       << "hit rate: " << (lookups ? 100.0 * stats.hits / lookups : 0.0) << "%\n"
+       << "evictions: " << stats.evictions << "\n"
+       << "size: " << stats.bytes / (1024.0 * 1024.0) << " MB of " << stats.maxSize / (1024.0 * 1024.0) << " MB";
+    log(os.str());
+}
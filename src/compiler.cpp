@@ -1,16 +1,35 @@
+#include <charconv>
 #include <iostream>
 #include <string>
 #include <vector>
 #include <cassert>
-#include <algorithm>
 
 #include "compiler.h"
+#include "value.h"
 
 using namespace Compiler;
 
+static thread_local std::ostream* tOutput = nullptr;
+
+std::ostream& Compiler::output()
+{
+    return tOutput ? *tOutput : std::cout;
+}
+
+OutputRedirect::OutputRedirect(std::ostream& os)
+    : previous_ (tOutput)
+{
+    tOutput = &os;
+}
+
+OutputRedirect::~OutputRedirect()
+{
+    tOutput = previous_;
+}
+
 void Compiler::log(std::string_view msg)
 {
-    std::cout << msg << '\n';
+    output() << msg << '\n';
 }
 
 CompileContext Compiler::generateCompilerContext(int argc ,const char *argv[])
@@ -23,28 +42,128 @@ CompileContext Compiler::generateCompilerContext(int argc ,const char *argv[])
 
     CompileContext context {};
 
-    while (argc > 1)
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string_view arg = argv[i];
+
+        if (*argv[i] != '-')
+            context.sourceFiles.push_back(argv[i]);
+        else if (arg == "--flat-ast")
+            context.useFlatAST = true;
+        else if (arg == "--pipeline")
+            context.usePipeline = true;
+        else if (arg == "--check-lex")
+            context.checkLexer = true;
+        else if (arg == "--watch")
+            context.isWatching = true;
+        else if (arg == "--cache")
+            context.useCache = true;
+        else if (arg == "--cache-stats")
+            context.showCacheStats = true;
+        else if (arg == "--load-ast")
+            context.loadAST = true;
+        else if (arg == "--eval")
+            context.evaluate = true;
+        else if (arg == "--run")
+        {
+            context.run = RunMode::VM;
+            context.evaluate = true;
+        }
+        else if (arg.substr(0 ,6) == "--run=")
+        {
+            const std::string_view mode = arg.substr(6);
+            if (mode == "vm")
+                context.run = RunMode::VM;
+            else if (mode == "tree")
+                context.run = RunMode::Tree;
+            else if (mode == "bench")
+                context.run = RunMode::Bench;
+            else
+            {
+                log("ERROR: --run takes vm, tree or bench.");
+                exit(EXIT_FAILURE);
+            }
+            context.evaluate = true;
+        }
+        else if (arg == "--emit-obj")
+        {
+            context.emitObject = true;
+            context.evaluate = true;
+        }
+        else if (arg.substr(0 ,2) == "-o") // -o NAME or -oNAME
+        {
+            std::string_view name = arg.substr(2);
+            if (name.empty() && i + 1 < argc)
+                name = argv[++i];
+            if (name.empty())
+            {
+                log("ERROR: -o expects a name.");
+                exit(EXIT_FAILURE);
+            }
+            context.outputName = name;
+        }
+        else if (arg == "-O0")
+            context.optimize = false;
+        else if (arg == "--time-passes")
+            context.timePasses = true;
+        else if (arg == "--no-kernels")
+            context.useKernels = false;
+        else if (arg.substr(0 ,11) == "--emit-ast=")
+        {
+            if (arg.substr(11) != "bin")
+            {
+                log("ERROR: --emit-ast only supports the bin format.");
+                exit(EXIT_FAILURE);
+            }
+            context.emitAST = true;
+        }
+        else if (arg.substr(0 ,12) == "--cache-dir=")
+        {
+            context.useCache = true;
+            context.cacheDirectory = arg.substr(12);
+        }
+        else if (arg.substr(0 ,13) == "--cache-size=")
+        {
+            const std::string_view size = arg.substr(13);
+            uint64_t megabytes = 0;
+            auto result = std::from_chars(size.data() ,size.data() + size.size() ,megabytes);
+            if (result.ec != std::errc() || result.ptr != size.data() + size.size() || megabytes == 0)
+            {
+                log("ERROR: --cache-size expects a positive number of megabytes.");
+                exit(EXIT_FAILURE);
+            }
+            context.cacheMaxSize = megabytes << 20;
+        }
+        else if (arg.substr(0 ,2) == "-j") // -j N or -jN
+        {
+            std::string_view count = arg.substr(2);
+            if (count.empty() && i + 1 < argc)
+                count = argv[++i];
+
+            unsigned jobs = 0;
+            auto result = std::from_chars(count.data() ,count.data() + count.size() ,jobs);
+            if (result.ec != std::errc() || result.ptr != count.data() + count.size() || jobs == 0)
+            {
+                log("ERROR: -j expects a positive number of jobs.");
+                exit(EXIT_FAILURE);
+            }
+            context.jobs = jobs;
+        }
+    }
+
+    if (context.emitObject && context.sourceFiles.size() > 1)
     {
-        if (*argv[argc-1] != '-')
-            context.sourceFiles.push_back(argv[argc-1]);
-        argc--;
+        log("ERROR: --emit-obj compiles one source file.");
+        exit(EXIT_FAILURE);
     }
     return context;
 }
 
 std::string Compiler::getTokenKey(TokenType type)
 {
-    auto it = std::find_if(kOperators.begin(), kOperators.end(),
-        [type](const auto& pair) { return pair.second == type; });
-
-    if (it != kOperators.end())
-        return std::string(it->first);
-
-    it = std::find_if(kKeywords.begin(), kKeywords.end(),
-        [type](const auto& pair) { return pair.second == type; });
-
-    if (it != kKeywords.end())
-        return std::string(it->first);
+    const std::string_view spelling = kTokenSpellings[static_cast<size_t>(type)];
+    if (!spelling.empty())
+        return std::string(spelling);
 
     switch (type)
     {
@@ -69,7 +188,7 @@ std::string Compiler::getTokenPos(Token token)
     return std::to_string(token.line) + ":" + std::to_string(token.column);
 }
 
-void Compiler::printASTNode(const std::unique_ptr<AST::ASTNode>& node) {
+void Compiler::printASTNode(const AST::ASTNode* node) {
     if (node == nullptr)
     {
         log("fail");
@@ -79,39 +198,184 @@ void Compiler::printASTNode(const std::unique_ptr<AST::ASTNode>& node) {
 
     switch (node->getType()) {
         case NodeType::VarDeclaration: {
-            auto* decl = static_cast<const VarDeclaration*>(node.get());
-            std::cout << "VarDeclaration: name = " << decl->name
+            auto* decl = static_cast<const VarDeclaration*>(node);
+            output() << "VarDeclaration: name = " << symbols().lookup(decl->name)
                       << ", runtime = " << decl->isRuntime << "\n";
             break;
         }
         case NodeType::VarDefinition: {
-            auto* def = static_cast<const VarDefinition*>(node.get());
-            std::cout << "VarDefinition: name = " << def->name
+            auto* def = static_cast<const VarDefinition*>(node);
+            output() << "VarDefinition: name = " << symbols().lookup(def->name)
                       << ", runtime = " << def->isRuntime
                       << ", has value = " << (def->value != nullptr) << "\n";
             break;
         }
         case NodeType::VarAllocation: {
-            auto* alloc = static_cast<const VarAllocation*>(node.get());
-            std::cout << "VarAllocation: name = " << alloc->name
+            auto* alloc = static_cast<const VarAllocation*>(node);
+            output() << "VarAllocation: name = " << symbols().lookup(alloc->name)
                       << ", runtime = " << alloc->isRuntime << "\n";
             break;
         }
         case NodeType::VarReference: {
-            auto* ref = static_cast<const VarReference*>(node.get());
-            std::cout << "VarReference: name = " << ref->name
+            auto* ref = static_cast<const VarReference*>(node);
+            output() << "VarReference: name = " << symbols().lookup(ref->name)
                       << ", runtime = " << ref->isRuntime << "\n";
             break;
         }
+        case NodeType::FunctionDefinition: {
+            auto* function = static_cast<const FunctionDefinition*>(node);
+            output() << "FunctionDefinition: name = " << symbols().lookup(function->name)
+                      << ", runtime = " << function->isRuntime
+                      << ", parameters = " << function->parameters.size() << "\n";
+            break;
+        }
         case NodeType::Block: {
-            auto* block = static_cast<const Block*>(node.get());
-            std::cout << "Block with " << block->ASTList.size() << " children\n";
+            auto* block = static_cast<const Block*>(node);
+            output() << "Block with " << block->ASTList.size() << " children\n";
             for (const auto& stmt : block->ASTList)
                 printASTNode(stmt);
             break;
         }
+        case NodeType::Return:
+            output() << "Return\n";
+            break;
+        case NodeType::Domain: {
+            auto* domain = static_cast<const Domain*>(node);
+            output() << "Domain: name = " << symbols().lookup(domain->name)
+                      << ", create = " << (domain->op == TokenType::Create) << "\n";
+            break;
+        }
         default:
-            std::cout << "Unknown node\n";
+            if (isExpression(node->getType()))
+                output() << "Expression\n";
+            else
+                output() << "Unknown node\n";
     }
 }
 
+
+static std::string formatOperand(const AST::Rvalue* node)
+{
+    using AST::NodeType;
+    const bool isCompound = node && (node->getType() == NodeType::Conditional
+        || (node->getType() == NodeType::Binary && static_cast<const AST::Binary*>(node)->op != TokenType::At));
+    return isCompound ? "(" + formatNode(node) + ")" : formatNode(node);
+}
+
+std::string Compiler::formatNode(const AST::ASTNode* node)
+{
+    if (node == nullptr)
+        return "fail";
+    using namespace AST;
+
+    switch (node->getType()) {
+        case NodeType::Empty:
+            return "";
+        case NodeType::Literal:
+            return formatValue(toValue(static_cast<const Literal*>(node)->value));
+        case NodeType::Lvalue:
+            return std::string(symbols().lookup(static_cast<const Lvalue*>(node)->identifier));
+        case NodeType::Set: {
+            auto* set = static_cast<const Set*>(node);
+            std::string text = set->isSetValue ? "(" : "{";
+            for (size_t i = 0; i < set->elements.size(); i++)
+                text += (i ? ", " : "") + formatValue(toValue(set->elements[i]));
+            return text + (set->isSetValue ? ")" : "}");
+        }
+        case NodeType::Unary: {
+            auto* unary = static_cast<const Unary*>(node);
+            const std::string op = getTokenKey(unary->op);
+            if (unary->isPostfix)
+                return formatOperand(unary->operand) + op;
+            return op + (unary->op == TokenType::Not ? " " : "") + formatOperand(unary->operand);
+        }
+        case NodeType::Binary: {
+            auto* binary = static_cast<const Binary*>(node);
+            if (binary->op == TokenType::At || binary->op == TokenType::DoubleDot)
+                return formatOperand(binary->lhs) + getTokenKey(binary->op) + formatOperand(binary->rhs);
+            return formatOperand(binary->lhs) + " " + getTokenKey(binary->op) + " " + formatOperand(binary->rhs);
+        }
+        case NodeType::Conditional: {
+            auto* conditional = static_cast<const Conditional*>(node);
+            std::string text = formatOperand(conditional->lhs) + " | " + formatOperand(conditional->rhs);
+            if (conditional->otherwise)
+                text += ", " + formatOperand(conditional->otherwise);
+            return text;
+        }
+        case NodeType::Call: {
+            auto* call = static_cast<const Call*>(node);
+            std::string text = formatOperand(call->callee) + "(";
+            for (size_t i = 0; i < call->arguments.size(); i++)
+                text += (i ? ", " : "") + formatNode(call->arguments[i]);
+            return text + ")";
+        }
+        case NodeType::Member: {
+            auto* member = static_cast<const Member*>(node);
+            return formatOperand(member->set) + "." + std::string(symbols().lookup(member->variable));
+        }
+        case NodeType::Index: {
+            auto* index = static_cast<const Index*>(node);
+            return formatOperand(index->set) + ".[" + formatNode(index->index) + "]";
+        }
+        case NodeType::Comprehension: {
+            auto* comprehension = static_cast<const Comprehension*>(node);
+            std::string text = "{" + (comprehension->source ? formatNode(comprehension->source) : formatNode(comprehension->element));
+            if (comprehension->predicate)
+                text += " | " + formatNode(comprehension->predicate);
+            text += "}";
+            if (comprehension->mode != TokenType::Unknown)
+                text += " " + getTokenKey(comprehension->mode);
+            return text;
+        }
+        case NodeType::Block: {
+            std::string text = "{";
+            for (const auto* stmt : static_cast<const Block*>(node)->ASTList)
+                text += " " + formatNode(stmt) + ";";
+            return text + " }";
+        }
+        case NodeType::VarDeclaration:
+        case NodeType::VarDefinition:
+        case NodeType::VarAllocation:
+        case NodeType::VarReference:
+        case NodeType::FunctionDefinition: {
+            auto* var = static_cast<const VariableBase*>(node);
+            std::string text = std::string(var->isRuntime ? "new " : "define ") + std::string(symbols().lookup(var->name));
+            if (var->hasDomain)
+                text += "@" + std::string(symbols().lookup(var->domain));
+
+            TokenType relation = TokenType::Assign;
+            if (node->getType() == NodeType::FunctionDefinition)
+            {
+                auto* function = static_cast<const FunctionDefinition*>(node);
+                relation = function->relation;
+                text += "(";
+                for (size_t i = 0; i < function->parameters.size(); i++)
+                {
+                    const auto* parameter = function->parameters[i];
+                    text += (i ? ", " : "") + std::string(symbols().lookup(parameter->name));
+                    if (parameter->hasType)
+                        text += " : " + std::string(symbols().lookup(parameter->type));
+                }
+                text += ")";
+            }
+            else if (node->getType() == NodeType::VarAllocation)
+                relation = TokenType::Allocate;
+            else if (node->getType() == NodeType::VarReference)
+                relation = TokenType::Reference;
+
+            if (var->value)
+                text += " " + getTokenKey(relation) + " " + formatNode(var->value);
+            return text;
+        }
+        case NodeType::Return: {
+            auto* ret = static_cast<const Return*>(node);
+            return ret->value ? "return " + formatNode(ret->value) : "return";
+        }
+        case NodeType::Domain: {
+            auto* domain = static_cast<const Domain*>(node);
+            return getTokenKey(domain->op) + " " + std::string(symbols().lookup(domain->name));
+        }
+        default:
+            return "?";
+    }
+}
@@ -0,0 +1,85 @@
+#include <vector>
+
+#include "passmanager.h"
+
+using namespace Compiler;
+using namespace Compiler::SSA;
+
+namespace {
+
+using Op = Bytecode::Op;
+
+// instructions that do nothing but write their register and never fail,
+// arithmetic can overflow and comparisons of a string and a number fail
+bool isRemovable(Op op)
+{
+    switch (op)
+    {
+        case Op::Move:
+        case Op::LoadConst:
+        case Op::LoadGlobal:
+        case Op::LoadCell:
+        case Op::Equal:
+        case Op::NotEqual:
+        case Op::Not:
+        case Op::Truth:
+            return true;
+        default:
+            return false;
+    }
+}
+
+} // namespace
+
+size_t Compiler::eliminateDeadCode(Module& ,Function& function)
+{
+    auto& blocks = function.blocks;
+    std::vector<bool> isLive(function.values.size());
+    std::vector<uint32_t> work;
+    auto markLive = [&](uint32_t value)
+    {
+        if (value == kNone || isLive[value])
+            return;
+        isLive[value] = true;
+        work.push_back(value);
+    };
+
+    for (const Block& block : blocks)
+    {
+        if (block.isDead)
+            continue;
+        for (const Instruction& instruction : block.instructions)
+            if (!instruction.isDead && !isRemovable(instruction.code.op))
+                for (uint32_t value : instruction.uses)
+                    markLive(value);
+    }
+    while (!work.empty())
+    {
+        const Definition& definition = function.values[work.back()];
+        work.pop_back();
+        if (definition.index == kNone) // a parameter
+            continue;
+        const Block& block = blocks[definition.block];
+        if (definition.isPhi)
+            for (uint32_t value : block.phis[definition.index].incoming)
+                markLive(value);
+        else
+            for (uint32_t value : block.instructions[definition.index].uses)
+                markLive(value);
+    }
+
+    size_t changes = 0;
+    for (Block& block : blocks)
+    {
+        if (block.isDead)
+            continue;
+        for (Instruction& instruction : block.instructions)
+        {
+            if (instruction.isDead || !isRemovable(instruction.code.op) || isLive[instruction.def])
+                continue;
+            instruction.isDead = true;
+            changes++;
+        }
+    }
+    return changes;
+}
@@ -0,0 +1,161 @@
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "domainchecker.h"
+
+using namespace Compiler;
+
+DomainChecker::DomainChecker()
+    : domains_ {Domain{symbols().intern("") ,0 ,true}}
+    ,scopes_ (1)
+    ,alive_ {kGlobalDomain_}
+{}
+
+void DomainChecker::enterBlock()
+{
+    scopes_.emplace_back();
+    blockDomains_.push_back(static_cast<uint32_t>(domains_.size()));
+    alive_.push_back(static_cast<uint32_t>(domains_.size()));
+    domains_.push_back(Domain{symbols().intern("") ,depth() ,true});
+}
+
+void DomainChecker::exitBlock()
+{
+    // domains are created and freed like a stack, except for delete
+    while (domains_[alive_.back()].depth == depth())
+    {
+        domains_[alive_.back()].isAlive = false;
+        alive_.pop_back();
+    }
+    blockDomains_.pop_back();
+    scopes_.pop_back();
+}
+
+void DomainChecker::reset()
+{
+    while (depth() > 0)
+        exitBlock();
+    captures_.clear();
+}
+
+void DomainChecker::enterTopLevel()
+{
+    const auto inner = std::find_if(alive_.begin() ,alive_.end() ,[&](uint32_t domain) { return domains_[domain].depth > 0; });
+    hidden_.push_back(Hidden{
+        std::vector<std::vector<Variable>>(std::make_move_iterator(scopes_.begin() + 1) ,std::make_move_iterator(scopes_.end()))
+        ,std::vector<uint32_t>(inner ,alive_.end())
+        ,std::move(blockDomains_)
+        ,std::move(captures_)});
+    scopes_.resize(1);
+    alive_.erase(inner ,alive_.end());
+    blockDomains_.clear();
+    captures_.clear();
+}
+
+void DomainChecker::exitTopLevel()
+{
+    while (depth() > 0)
+        exitBlock();
+
+    Hidden& hidden = hidden_.back();
+    scopes_.insert(scopes_.end() ,std::make_move_iterator(hidden.scopes.begin()) ,std::make_move_iterator(hidden.scopes.end()));
+    alive_.insert(alive_.end() ,hidden.alive.begin() ,hidden.alive.end());
+    blockDomains_ = std::move(hidden.blockDomains);
+    captures_ = std::move(hidden.captures);
+    hidden_.pop_back();
+}
+
+uint32_t DomainChecker::findDomain(SymbolId name) const
+{
+    for (auto it = alive_.rbegin(); it != alive_.rend(); ++it)
+        if (domains_[*it].name == name)
+            return *it;
+
+    const bool wasFreed = std::any_of(domains_.begin() ,domains_.end() ,[&](const Domain& domain) { return domain.name == name; });
+    throw std::runtime_error(wasFreed ? "domain " + std::string(symbols().lookup(name)) + " is already freed"
+        : "there is no domain " + std::string(symbols().lookup(name)));
+}
+
+std::string DomainChecker::describe(uint32_t domain) const
+{
+    if (domains_[domain].name == domains_[kGlobalDomain_].name)
+        return "the block it was on has ended";
+    return "domain " + std::string(symbols().lookup(domains_[domain].name)) + " is freed";
+}
+
+void DomainChecker::create(SymbolId name)
+{
+    const bool exists = std::any_of(alive_.begin() ,alive_.end() ,[&](uint32_t domain) { return domains_[domain].name == name; });
+    if (exists)
+        throw std::runtime_error("domain " + std::string(symbols().lookup(name)) + " already exists");
+
+    alive_.push_back(static_cast<uint32_t>(domains_.size()));
+    domains_.push_back(Domain{name ,depth() ,true});
+}
+
+void DomainChecker::remove(SymbolId name)
+{
+    const uint32_t domain = findDomain(name);
+    if (domains_[domain].depth != depth())
+        throw std::runtime_error("domain " + std::string(symbols().lookup(name)) + " was created in an outer block, it can only be deleted there");
+
+    domains_[domain].isAlive = false;
+    alive_.erase(std::find(alive_.begin() ,alive_.end() ,domain));
+}
+
+void DomainChecker::beginCapture()
+{
+    captures_.push_back(Capture{depth() + 1 ,{}});
+}
+
+std::vector<uint32_t> DomainChecker::endCapture()
+{
+    std::vector<uint32_t> domains = std::move(captures_.back().domains);
+    captures_.pop_back();
+
+    std::sort(domains.begin() ,domains.end());
+    domains.erase(std::unique(domains.begin() ,domains.end()) ,domains.end());
+    return domains;
+}
+
+void DomainChecker::declare(const AST::VariableBase* variable ,std::vector<uint32_t> captured)
+{
+    uint32_t domain = depth() == 0 ? kGlobalDomain_ : blockDomains_.back();
+    if (variable->hasDomain)
+        domain = variable->domain == domains_[kGlobalDomain_].name ? kGlobalDomain_ : findDomain(variable->domain);
+
+    // a name on an outer domain stays visible where the domain was created
+    const size_t scope = domains_[domain].depth;
+    captured.insert(captured.begin() ,domain);
+    scopes_[scope].push_back(Variable{variable->name ,scope ,std::move(captured)});
+}
+
+void DomainChecker::declareParameter(SymbolId name)
+{
+    scopes_.back().push_back(Variable{name ,depth() ,{}});
+}
+
+void DomainChecker::use(SymbolId name)
+{
+    for (auto scope = scopes_.rbegin(); scope != scopes_.rend(); ++scope)
+    {
+        for (auto it = scope->rbegin(); it != scope->rend(); ++it)
+        {
+            if (it->name != name)
+                continue;
+
+            for (uint32_t domain : it->domains)
+                if (!domains_[domain].isAlive)
+                    throw std::runtime_error(std::string(symbols().lookup(name)) + " cant be used, " + describe(domain));
+
+            for (auto& capture : captures_)
+                if (it->depth < capture.depth)
+                    capture.domains.insert(capture.domains.end() ,it->domains.begin() ,it->domains.end());
+            return;
+        }
+    }
+}
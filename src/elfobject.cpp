@@ -0,0 +1,212 @@
+#include <elf.h>
+
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "elfobject.h"
+
+using namespace Compiler;
+
+namespace {
+
+constexpr uint32_t kSectionSymbol = 0x80000000; // sectionSymbol() | Section
+
+// the sections of the file, in this order
+enum SectionIndex : uint16_t
+{
+    kNull,
+    kText,
+    kRelaText,
+    kReadOnly,
+    kBss,
+    kNoteStack, // marks the stack not executable
+    kSymtab,
+    kStrtab,
+    kShstrtab,
+    kSectionCount,
+};
+
+uint16_t indexOf(ElfObject::Section section)
+{
+    switch (section)
+    {
+        case ElfObject::Section::Text: return kText;
+        case ElfObject::Section::ReadOnly: return kReadOnly;
+        case ElfObject::Section::Bss: return kBss;
+        default: return SHN_UNDEF;
+    }
+}
+
+// names, each ending with a 0, the first one empty
+struct StringTable
+{
+    std::string bytes {std::string(1 ,'\0')};
+
+    uint32_t add(const std::string& name)
+    {
+        if (name.empty())
+            return 0;
+        const auto offset = static_cast<uint32_t>(bytes.size());
+        bytes += name;
+        bytes += '\0';
+        return offset;
+    }
+};
+
+void align(std::string& out ,size_t alignment)
+{
+    out.resize((out.size() + alignment - 1) & ~(alignment - 1) ,'\0');
+}
+
+template <typename T>
+void append(std::string& out ,const T& value)
+{
+    out.append(reinterpret_cast<const char*>(&value) ,sizeof(value));
+}
+
+} // namespace
+
+uint32_t ElfObject::addSymbol(const std::string& name ,Section section ,uint64_t offset ,uint64_t size ,bool isFunction ,bool isGlobal)
+{
+    symbols_.push_back(Symbol{name ,section ,offset ,size ,isFunction ,isGlobal});
+    return static_cast<uint32_t>(symbols_.size() - 1);
+}
+
+uint32_t ElfObject::addExternal(const std::string& name)
+{
+    for (size_t i = 0; i < symbols_.size(); i++)
+        if (symbols_[i].section == Section::Undefined && symbols_[i].name == name)
+            return static_cast<uint32_t>(i);
+    return addSymbol(name ,Section::Undefined ,0 ,0 ,false ,true);
+}
+
+uint32_t ElfObject::sectionSymbol(Section section) const
+{
+    return kSectionSymbol | static_cast<uint32_t>(section);
+}
+
+void ElfObject::addRelocation(uint64_t offset ,uint32_t symbol ,uint32_t type ,int64_t addend)
+{
+    relocations_.push_back(Relocation{offset ,symbol ,type ,addend});
+}
+
+void ElfObject::write(const std::string& path) const
+{
+    // the null symbol and the sections first, then the local symbols, then the global ones
+    StringTable names;
+    std::vector<Elf64_Sym> table(1);
+    for (uint16_t section : {kText ,kReadOnly ,kBss})
+    {
+        Elf64_Sym symbol {};
+        symbol.st_info = ELF64_ST_INFO(STB_LOCAL ,STT_SECTION);
+        symbol.st_shndx = section;
+        table.push_back(symbol);
+    }
+
+    std::vector<uint32_t> indices(symbols_.size());
+    uint32_t firstGlobal = 0;
+    for (bool isGlobal : {false ,true})
+    {
+        if (isGlobal)
+            firstGlobal = static_cast<uint32_t>(table.size());
+        for (size_t i = 0; i < symbols_.size(); i++)
+        {
+            const Symbol& symbol = symbols_[i];
+            if (symbol.isGlobal != isGlobal)
+                continue;
+
+            Elf64_Sym entry {};
+            entry.st_name = names.add(symbol.name);
+            entry.st_info = ELF64_ST_INFO(isGlobal ? STB_GLOBAL : STB_LOCAL ,symbol.section == Section::Undefined ? STT_NOTYPE
+                : symbol.isFunction ? STT_FUNC : STT_OBJECT);
+            entry.st_shndx = indexOf(symbol.section);
+            entry.st_value = symbol.offset;
+            entry.st_size = symbol.size;
+            indices[i] = static_cast<uint32_t>(table.size());
+            table.push_back(entry);
+        }
+    }
+
+    std::vector<Elf64_Rela> relocations;
+    for (const Relocation& relocation : relocations_)
+    {
+        uint32_t symbol;
+        if (relocation.symbol & kSectionSymbol)
+        {
+            const auto section = static_cast<Section>(relocation.symbol & ~kSectionSymbol);
+            symbol = section == Section::Text ? 1 : section == Section::ReadOnly ? 2 : 3;
+        }
+        else
+            symbol = indices.at(relocation.symbol);
+
+        Elf64_Rela entry {};
+        entry.r_offset = relocation.offset;
+        entry.r_info = ELF64_R_INFO(symbol ,relocation.type);
+        entry.r_addend = relocation.addend;
+        relocations.push_back(entry);
+    }
+
+    static const char* const kSectionNames[kSectionCount] = {
+        "" ,".text" ,".rela.text" ,".rodata" ,".bss" ,".note.GNU-stack" ,".symtab" ,".strtab" ,".shstrtab",
+    };
+    StringTable sectionNames;
+    Elf64_Shdr headers[kSectionCount] {};
+    for (size_t i = 0; i < kSectionCount; i++)
+        headers[i].sh_name = sectionNames.add(kSectionNames[i]);
+    std::string out(sizeof(Elf64_Ehdr) ,'\0'); // filled in once the offsets are known
+
+    auto section = [&](SectionIndex index ,uint32_t type ,uint64_t flags ,const void* data ,size_t size ,size_t alignment)
+    {
+        align(out ,alignment);
+        Elf64_Shdr& header = headers[index];
+        header.sh_type = type;
+        header.sh_flags = flags;
+        header.sh_offset = out.size();
+        header.sh_size = size;
+        header.sh_addralign = alignment;
+        if (type != SHT_NOBITS)
+            out.append(static_cast<const char*>(data) ,size);
+    };
+
+    section(kText ,SHT_PROGBITS ,SHF_ALLOC | SHF_EXECINSTR ,text.data() ,text.size() ,16);
+    section(kRelaText ,SHT_RELA ,SHF_INFO_LINK ,relocations.data() ,relocations.size() * sizeof(Elf64_Rela) ,8);
+    headers[kRelaText].sh_link = kSymtab;
+    headers[kRelaText].sh_info = kText;
+    headers[kRelaText].sh_entsize = sizeof(Elf64_Rela);
+    section(kReadOnly ,SHT_PROGBITS ,SHF_ALLOC ,readOnly.data() ,readOnly.size() ,8);
+    section(kBss ,SHT_NOBITS ,SHF_ALLOC | SHF_WRITE ,nullptr ,bssSize ,8);
+    section(kNoteStack ,SHT_PROGBITS ,0 ,nullptr ,0 ,1);
+    section(kSymtab ,SHT_SYMTAB ,0 ,table.data() ,table.size() * sizeof(Elf64_Sym) ,8);
+    headers[kSymtab].sh_link = kStrtab;
+    headers[kSymtab].sh_info = firstGlobal;
+    headers[kSymtab].sh_entsize = sizeof(Elf64_Sym);
+    section(kStrtab ,SHT_STRTAB ,0 ,names.bytes.data() ,names.bytes.size() ,1);
+    section(kShstrtab ,SHT_STRTAB ,0 ,sectionNames.bytes.data() ,sectionNames.bytes.size() ,1);
+
+    align(out ,8);
+    Elf64_Ehdr header {};
+    std::memcpy(header.e_ident ,ELFMAG ,SELFMAG);
+    header.e_ident[EI_CLASS] = ELFCLASS64;
+    header.e_ident[EI_DATA] = ELFDATA2LSB;
+    header.e_ident[EI_VERSION] = EV_CURRENT;
+    header.e_ident[EI_OSABI] = ELFOSABI_SYSV;
+    header.e_type = ET_REL;
+    header.e_machine = EM_X86_64;
+    header.e_version = EV_CURRENT;
+    header.e_shoff = out.size();
+    header.e_ehsize = sizeof(Elf64_Ehdr);
+    header.e_shentsize = sizeof(Elf64_Shdr);
+    header.e_shnum = kSectionCount;
+    header.e_shstrndx = kShstrtab;
+    for (const Elf64_Shdr& sectionHeader : headers)
+        append(out ,sectionHeader);
+    std::memcpy(out.data() ,&header ,sizeof(header));
+
+    std::ofstream file(path ,std::ios::binary | std::ios::trunc);
+    file.write(out.data() ,out.size());
+    if (!file)
+        throw std::runtime_error("cant write the object file " + path);
+}
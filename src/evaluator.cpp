@@ -0,0 +1,2024 @@
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <exception>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "compiler.h"
+#include "evaluator.h"
+#include "filterkernel.h"
+#include "hash.h"
+#include "lazyset.h"
+#include "rangesolver.h"
+#include "setvalue.h"
+#include "taskscheduler.h"
+#include "value.h"
+
+using namespace Compiler;
+
+static std::string_view nameOf(SymbolId id)
+{
+    return symbols().lookup(id);
+}
+
+static const char* typeName(const Value& value)
+{
+    static const char* const kNames[] = {"undefined" ,"int" ,"double" ,"char" ,"string" ,"set" ,"set"};
+    return kNames[value.index()];
+}
+
+static Int_t toInt(const Value& value)
+{
+    if (auto* c = std::get_if<Char_t>(&value))
+        return static_cast<unsigned char>(*c);
+    return std::get<Int_t>(value);
+}
+
+static Double_t toDouble(const Value& value)
+{
+    if (auto* d = std::get_if<Double_t>(&value))
+        return *d;
+    return static_cast<Double_t>(toInt(value));
+}
+
+static bool compare(TokenType op ,int order) // order is <0, 0 or >0
+{
+    switch (op)
+    {
+        case TokenType::GreaterThan: return order > 0;
+        case TokenType::LessThan: return order < 0;
+        case TokenType::GreaterEquals: return order >= 0;
+        case TokenType::LessEquals: return order <= 0;
+        default: return false;
+    }
+}
+
+Value Compiler::applyBinary(TokenType op ,const Value& lhs ,const Value& rhs)
+{
+    switch (op)
+    {
+        case TokenType::Equals: return Int_t(valuesEqual(lhs ,rhs));
+        case TokenType::NotEquals: return Int_t(!valuesEqual(lhs ,rhs));
+        default: break;
+    }
+
+    if (std::holds_alternative<std::monostate>(lhs) || std::holds_alternative<std::monostate>(rhs))
+        return Value(); // undefined spreads
+
+    const bool isComparison = op == TokenType::GreaterThan || op == TokenType::LessThan
+        || op == TokenType::GreaterEquals || op == TokenType::LessEquals;
+
+    if (isComparison && std::holds_alternative<SymbolId>(lhs) && std::holds_alternative<SymbolId>(rhs))
+        return Int_t(compare(op ,nameOf(std::get<SymbolId>(lhs)).compare(nameOf(std::get<SymbolId>(rhs)))));
+
+    // + is the union of two sets, * their intersection and - their difference
+    if (std::holds_alternative<SetRef>(lhs) && std::holds_alternative<SetRef>(rhs))
+    {
+        const SetRef& a = std::get<SetRef>(lhs);
+        const SetRef& b = std::get<SetRef>(rhs);
+        switch (op)
+        {
+            case TokenType::Plus: return setUnion(a ,b);
+            case TokenType::Multiplication: return setIntersection(a ,b);
+            case TokenType::Minus: return setDifference(a ,b);
+            default: break;
+        }
+    }
+
+    if (!isNumber(lhs) || !isNumber(rhs))
+        throw std::runtime_error("operator '" + getTokenKey(op) + "' cant be used on " + typeName(lhs) + " and " + typeName(rhs));
+
+    if (std::holds_alternative<Double_t>(lhs) || std::holds_alternative<Double_t>(rhs))
+    {
+        const Double_t a = toDouble(lhs);
+        const Double_t b = toDouble(rhs);
+        switch (op)
+        {
+            case TokenType::Plus: return a + b;
+            case TokenType::Minus: return a - b;
+            case TokenType::Multiplication: return a * b;
+            case TokenType::Division: return a / b;
+            case TokenType::Modulo: return std::fmod(a ,b);
+            default:
+                if (isComparison)
+                    return Int_t(!std::isnan(a) && !std::isnan(b) && compare(op ,(a > b) - (a < b)));
+        }
+    }
+    else
+    {
+        const Int_t a = toInt(lhs);
+        const Int_t b = toInt(rhs);
+        Int_t result = 0;
+        bool isOverflow = false;
+        switch (op)
+        {
+            case TokenType::Plus: isOverflow = __builtin_add_overflow(a ,b ,&result); break;
+            case TokenType::Minus: isOverflow = __builtin_sub_overflow(a ,b ,&result); break;
+            case TokenType::Multiplication: isOverflow = __builtin_mul_overflow(a ,b ,&result); break;
+            case TokenType::Division:
+            case TokenType::Modulo:
+                if (b == 0)
+                    return Value(); // 10%0 == undefined
+                isOverflow = a == std::numeric_limits<Int_t>::min() && b == -1;
+                result = isOverflow ? 0 : (op == TokenType::Division ? a / b : a % b);
+                break;
+            default:
+                if (isComparison)
+                    return Int_t(compare(op ,(a > b) - (a < b)));
+                break;
+        }
+        if (isOverflow)
+            throw std::runtime_error("integer overflow in " + std::to_string(a) + " " + getTokenKey(op) + " " + std::to_string(b));
+        if (op != TokenType::Unknown && !isComparison)
+            return result;
+    }
+    throw std::runtime_error("operator '" + getTokenKey(op) + "' cant be evaluated");
+}
+
+// x += y is x = x + y
+static TokenType baseOperator(TokenType op)
+{
+    switch (op)
+    {
+        case TokenType::PlusEquals: return TokenType::Plus;
+        case TokenType::MinusEquals: return TokenType::Minus;
+        case TokenType::MultiplicationEquals: return TokenType::Multiplication;
+        case TokenType::DivisionEquals: return TokenType::Division;
+        case TokenType::ModuloEquals: return TokenType::Modulo;
+        default: return TokenType::Unknown;
+    }
+}
+
+static bool isAssignment(TokenType op)
+{
+    return op == TokenType::Assign || baseOperator(op) != TokenType::Unknown;
+}
+
+// name@Domain values, nullptr if there is none
+static const Value* builtinConstant(std::string_view name ,std::string_view domain)
+{
+    static const Value kPi = Double_t(3.14159265358979323846);
+    static const Value kTau = Double_t(6.28318530717958647692);
+    static const Value kE = Double_t(2.71828182845904523536);
+    static const Value kEmpty = SetValue::empty();
+
+    if (domain == "Constants")
+    {
+        if (name == "pi") return &kPi;
+        if (name == "tau") return &kTau;
+        if (name == "e") return &kE;
+    }
+    else if (domain == "Sets" && name == "Empty")
+        return &kEmpty;
+    else if (domain == "Sets" && (name == "Natural" || name == "Natrual")) // the docs spell it Natrual
+    {
+        static const Value kNatural = naturalNumbers();
+        return &kNatural;
+    }
+    return nullptr;
+}
+
+bool Compiler::isBuiltinFunction(std::string_view name ,std::string_view domain)
+{
+    return domain == "Functions" && (name == "pow" || name == "sum" || name == "abs");
+}
+
+Value Compiler::callBuiltin(std::string_view name ,const std::vector<Value>& arguments)
+{
+    auto expectArguments = [&](size_t count)
+    {
+        if (arguments.size() != count)
+            throw std::runtime_error(std::string(name) + "@Functions takes " + std::to_string(count) + " arguments but got " + std::to_string(arguments.size()));
+    };
+
+    if (name == "pow")
+    {
+        expectArguments(2);
+        const Value& base = arguments[0];
+        const Value& exponent = arguments[1];
+        if (!isNumber(base) || !isNumber(exponent))
+            throw std::runtime_error(std::string("pow@Functions cant be used on ") + typeName(base) + " and " + typeName(exponent));
+
+        if (std::holds_alternative<Double_t>(base) || std::holds_alternative<Double_t>(exponent) || toInt(exponent) < 0)
+            return std::pow(toDouble(base) ,toDouble(exponent));
+
+        // by squaring, the multiplications check for overflow
+        Value result = Int_t(1);
+        Value factor = Int_t(toInt(base));
+        for (Int_t e = toInt(exponent); e > 0; e >>= 1)
+        {
+            if (e & 1)
+                result = applyBinary(TokenType::Multiplication ,result ,factor);
+            if (e > 1)
+                factor = applyBinary(TokenType::Multiplication ,factor ,factor);
+        }
+        return result;
+    }
+    if (name == "sum")
+    {
+        expectArguments(1);
+        const Value& set = arguments[0];
+        if (!std::holds_alternative<SetRef>(set) && !std::holds_alternative<LazyRef>(set))
+            throw std::runtime_error(std::string("sum@Functions expects a set but got ") + typeName(set));
+        if (auto* lazy = std::get_if<LazyRef>(&set); lazy && (*lazy)->isInfinite())
+            throw std::runtime_error("sum@Functions cant add up an infinite set");
+
+        Value total = Int_t(0);
+        for (size_t i = 0; auto element = elementAt(set ,i); i++)
+            total = applyBinary(TokenType::Plus ,total ,*element);
+        return total;
+    }
+    // abs
+    expectArguments(1);
+    if (auto* d = std::get_if<Double_t>(&arguments[0]))
+        return std::fabs(*d);
+    if (!isNumber(arguments[0]))
+        throw std::runtime_error(std::string("abs@Functions cant be used on ") + typeName(arguments[0]));
+    return toInt(arguments[0]) < 0 ? applyBinary(TokenType::Minus ,Int_t(0) ,arguments[0]) : Value(toInt(arguments[0]));
+}
+
+// the names of name@Domain, or empty ones if node isnt of that form
+static std::pair<std::string_view ,std::string_view> domainNames(const AST::Rvalue* node)
+{
+    if (node->getType() != AST::NodeType::Binary)
+        return {};
+    auto* binary = static_cast<const AST::Binary*>(node);
+    if (binary->op != TokenType::At || binary->lhs->getType() != AST::NodeType::Lvalue || binary->rhs->getType() != AST::NodeType::Lvalue)
+        return {};
+    return {nameOf(static_cast<const AST::Lvalue*>(binary->lhs)->identifier) ,nameOf(static_cast<const AST::Lvalue*>(binary->rhs)->identifier)};
+}
+
+bool Evaluator::MemoKey::operator==(const MemoKey& other) const
+{
+    if (node != other.node || arguments.size() != other.arguments.size())
+        return false;
+    for (size_t i = 0; i < arguments.size(); i++)
+        if (!isSame(arguments[i] ,other.arguments[i]))
+            return false;
+    return true;
+}
+
+size_t Evaluator::MemoKeyHash::operator()(const MemoKey& key) const
+{
+    uint64_t hash = hashValue(key.node);
+    for (const auto& argument : key.arguments)
+        hash = hashOf(argument ,hash);
+    return static_cast<size_t>(hash);
+}
+
+bool Evaluator::SpecializationKey::operator==(const SpecializationKey& other) const
+{
+    if (function != other.function || arguments.size() != other.arguments.size())
+        return false;
+    for (size_t i = 0; i < arguments.size(); i++)
+        if (arguments[i].has_value() != other.arguments[i].has_value() || (arguments[i] && !isSame(*arguments[i] ,*other.arguments[i])))
+            return false;
+    return true;
+}
+
+size_t Evaluator::SpecializationKeyHash::operator()(const SpecializationKey& key) const
+{
+    uint64_t hash = hashValue(key.function);
+    for (const auto& argument : key.arguments)
+    {
+        hash = hashValue(argument.has_value() ,hash);
+        if (argument)
+            hash = hashOf(*argument ,hash);
+    }
+    return static_cast<size_t>(hash);
+}
+
+Evaluator::Evaluator(const CompileContext& context ,unsigned threads)
+    : useKernels_ (context.useKernels)
+    ,threads_ (threads == 0 ? 1 : threads)
+{}
+
+Evaluator::Evaluator(const Evaluator* parent ,TaskSteps* taskSteps ,size_t task)
+    : maxSteps_ (std::min(kStepCheck_ ,taskSteps->budget))
+    ,useKernels_ (parent->useKernels_)
+    ,parent_ (parent)
+    ,taskSteps_ (taskSteps)
+    ,task_ (task)
+{}
+
+TaskScheduler& Evaluator::scheduler()
+{
+    if (!scheduler_)
+        scheduler_ = std::make_unique<TaskScheduler>(threads_);
+    return *scheduler_;
+}
+
+void Evaluator::fail(const std::string& msg)
+{
+    throw std::runtime_error(msg);
+}
+
+void Evaluator::countSteps(uint64_t count)
+{
+    stats_.steps += count;
+    if (stats_.steps <= maxSteps_)
+        return;
+
+    if (taskSteps_)
+    {
+        // the tasks before this one only take more steps, so once they and this one
+        // took more than the budget evaluating them in order fails here or earlier
+        taskSteps_->steps[task_] = stats_.steps;
+        uint64_t taken = 0;
+        for (size_t i = 0; i <= task_; i++)
+            taken += taskSteps_->steps[i];
+        if (taken <= taskSteps_->budget)
+        {
+            maxSteps_ = stats_.steps + std::min(kStepCheck_ ,taskSteps_->budget - taken);
+            return;
+        }
+    }
+    fail("evaluation takes more than " + std::to_string(kMaxSteps_) + " steps");
+}
+
+void Evaluator::define(SymbolId name ,Binding binding)
+{
+    if (!globals_.try_emplace(name ,std::move(binding)).second)
+        fail(std::string(nameOf(name)) + " is already defined");
+}
+
+Evaluator::Local* Evaluator::findLocal(SymbolId name)
+{
+    if (frames_.empty())
+        return nullptr;
+
+    auto& locals = frames_.back();
+    for (auto it = locals.rbegin(); it != locals.rend(); ++it) // innermost first
+        if (it->name == name)
+            return &*it;
+    return nullptr;
+}
+
+const Evaluator::Binding* Evaluator::findGlobal(SymbolId name) const
+{
+    if (parent_)
+        return parent_->findGlobal(name);
+    auto it = globals_.find(name);
+    return it == globals_.end() ? nullptr : &it->second;
+}
+
+const Value* Evaluator::memoized(const MemoKey& key) const
+{
+    if (auto it = memo_.find(key); it != memo_.end())
+        return &it->second;
+    return parent_ ? parent_->memoized(key) : nullptr;
+}
+
+Value Evaluator::read(SymbolId name)
+{
+    if (const Local* local = findLocal(name))
+    {
+        if (local->isRuntime)
+            fail(std::string(nameOf(name)) + " is a runtime variable, it has no value at compile time");
+        if (local->isIterator)
+            fail(std::string(nameOf(name)) + " ranges over a set, it can only be used in a set");
+        return local->value;
+    }
+
+    const Binding* binding = findGlobal(name);
+    if (!binding)
+        fail(std::string(nameOf(name)) + " isnt defined");
+    if (binding->isRuntime)
+        fail(std::string(nameOf(name)) + " is a runtime variable, it has no value at compile time");
+    if (binding->function)
+        fail(std::string(nameOf(name)) + " is a function, it has to be called");
+    return binding->value;
+}
+
+std::optional<Int_t> Evaluator::intConstant(SymbolId name ,const std::vector<Local>& locals) const
+{
+    for (auto it = locals.rbegin(); it != locals.rend(); ++it)
+    {
+        if (it->name != name)
+            continue;
+        if (it->isRuntime || it->isIterator || !std::holds_alternative<Int_t>(it->value))
+            return std::nullopt;
+        return std::get<Int_t>(it->value);
+    }
+
+    const Binding* binding = findGlobal(name);
+    if (!binding || binding->isRuntime || binding->function || !std::holds_alternative<Int_t>(binding->value))
+        return std::nullopt;
+    return std::get<Int_t>(binding->value);
+}
+
+void Evaluator::write(const AST::Rvalue* target ,const Value& value)
+{
+    if (target->getType() != AST::NodeType::Lvalue)
+        fail("only variables can be assigned");
+
+    const SymbolId name = static_cast<const AST::Lvalue*>(target)->identifier;
+    if (Local* local = findLocal(name); local && !local->isRuntime && !local->isIterator)
+    {
+        local->value = value;
+        return;
+    }
+    if (findLocal(name) || (findGlobal(name) && findGlobal(name)->isRuntime))
+        fail(std::string(nameOf(name)) + " is a runtime variable, it cant be assigned at compile time");
+    if (findGlobal(name))
+        fail(std::string(nameOf(name)) + " is a define, it cant be assigned");
+    fail(std::string(nameOf(name)) + " isnt defined");
+}
+
+Value Evaluator::evaluate(const AST::Rvalue* node)
+{
+    if (!node)
+        fail("expression has errors");
+    countSteps(1);
+
+    using AST::NodeType;
+    switch (node->getType())
+    {
+        case NodeType::Literal:
+            return toValue(static_cast<const AST::Literal*>(node)->value);
+        case NodeType::Lvalue:
+            return read(static_cast<const AST::Lvalue*>(node)->identifier);
+        case NodeType::Set: {
+            auto* set = static_cast<const AST::Set*>(node);
+            SetBuilder elements;
+            for (const auto& element : set->elements)
+                elements.add(toValue(element));
+            return elements.build();
+        }
+        case NodeType::Block:
+            return evaluateBlock(static_cast<const AST::Block*>(node));
+        case NodeType::Unary:
+            return evaluateUnary(static_cast<const AST::Unary*>(node));
+        case NodeType::Binary:
+            return evaluateBinary(static_cast<const AST::Binary*>(node));
+        case NodeType::Call:
+            return evaluateCall(static_cast<const AST::Call*>(node));
+        case NodeType::Index:
+            return evaluateIndex(static_cast<const AST::Index*>(node));
+        case NodeType::Comprehension:
+            return evaluateComprehension(static_cast<const AST::Comprehension*>(node));
+        case NodeType::Member:
+            fail(formatNode(node) + " ranges over a set, it can only be used in a set");
+        case NodeType::Conditional: {
+            auto* conditional = static_cast<const AST::Conditional*>(node);
+            if (conditional->otherwise) // value | condition ,otherwise
+                return isTruthy(evaluate(conditional->rhs)) ? evaluate(conditional->lhs) : evaluate(conditional->otherwise);
+            // condition | action
+            return isTruthy(evaluate(conditional->lhs)) ? evaluate(conditional->rhs) : Value();
+        }
+        default:
+            fail("this cant be evaluated at compile time");
+    }
+}
+
+Value Evaluator::evaluateUnary(const AST::Unary* unary)
+{
+    switch (unary->op)
+    {
+        case TokenType::Not:
+            return Int_t(!isTruthy(evaluate(unary->operand)));
+        case TokenType::Minus: {
+            const Value value = evaluate(unary->operand);
+            if (auto* d = std::get_if<Double_t>(&value))
+                return -*d;
+            return applyBinary(TokenType::Minus ,Int_t(0) ,value);
+        }
+        case TokenType::DoublePlus:
+        case TokenType::DoubleMinus: {
+            const Value before = evaluate(unary->operand);
+            const Value after = applyBinary(unary->op == TokenType::DoublePlus ? TokenType::Plus : TokenType::Minus ,before ,Int_t(1));
+            write(unary->operand ,after);
+            return unary->isPostfix ? before : after;
+        }
+        default:
+            fail("operator '" + getTokenKey(unary->op) + "' cant be evaluated");
+    }
+}
+
+Value Evaluator::evaluateBinary(const AST::Binary* binary)
+{
+    switch (binary->op)
+    {
+        case TokenType::At: {
+            auto [name ,domain] = domainNames(binary);
+            if (const Value* value = builtinConstant(name ,domain))
+                return *value;
+            if (isBuiltinFunction(name ,domain))
+                fail(std::string(name) + "@" + std::string(domain) + " is a function, it has to be called");
+            fail(std::string(name) + "@" + std::string(domain) + " isnt known at compile time");
+        }
+        case TokenType::And:
+            return Int_t(isTruthy(evaluate(binary->lhs)) && isTruthy(evaluate(binary->rhs)));
+        case TokenType::Or:
+            return Int_t(isTruthy(evaluate(binary->lhs)) || isTruthy(evaluate(binary->rhs)));
+        case TokenType::Xor:
+            return Int_t(isTruthy(evaluate(binary->lhs)) != isTruthy(evaluate(binary->rhs)));
+        case TokenType::Assign: {
+            Value value = evaluate(binary->rhs);
+            write(binary->lhs ,value);
+            return value;
+        }
+        case TokenType::DoubleDot: {
+            const Value first = evaluate(binary->lhs);
+            const Value last = evaluate(binary->rhs);
+            if (!std::holds_alternative<Int_t>(first) || !std::holds_alternative<Int_t>(last))
+                fail(std::string("a range goes from int to int, not from ") + typeName(first) + " to " + typeName(last));
+            return makeRange(std::get<Int_t>(first) ,std::get<Int_t>(last));
+        }
+        default:
+            break;
+    }
+
+    if (const TokenType op = baseOperator(binary->op); op != TokenType::Unknown) // x += y
+    {
+        Value value = applyBinary(op ,evaluate(binary->lhs) ,evaluate(binary->rhs));
+        write(binary->lhs ,value);
+        return value;
+    }
+    return applyBinary(binary->op ,materialize(evaluate(binary->lhs)) ,materialize(evaluate(binary->rhs)));
+}
+
+Value Evaluator::evaluateCall(const AST::Call* call)
+{
+    std::vector<Value> arguments;
+    arguments.reserve(call->arguments.size());
+    for (const auto* argument : call->arguments)
+        arguments.push_back(evaluate(argument));
+
+    if (call->callee->getType() == AST::NodeType::Lvalue)
+    {
+        const SymbolId name = static_cast<const AST::Lvalue*>(call->callee)->identifier;
+        const Binding* binding = findLocal(name) ? nullptr : findGlobal(name);
+        if (!binding || !binding->function)
+            fail(std::string(nameOf(name)) + " isnt a function");
+        if (binding->isRuntime)
+            fail(std::string(nameOf(name)) + " is a runtime function, it cant be called at compile time");
+        return this->call(binding->function ,std::move(arguments));
+    }
+
+    auto [name ,domain] = domainNames(call->callee);
+    if (isBuiltinFunction(name ,domain))
+    {
+        if (name == "sum" && arguments.size() == 1)
+            if (auto total = sumInParallel(arguments[0]))
+                return *total;
+        return callBuiltin(name ,arguments);
+    }
+    fail("only functions can be called");
+}
+
+Value Evaluator::convertArgument(const AST::FunctionDefinition* function ,size_t i ,Value argument) const
+{
+    // x : int
+    const auto* parameter = function->parameters[i];
+    if (!parameter->hasType || !isNumber(argument))
+        return argument;
+
+    const std::string_view type = nameOf(parameter->type);
+    if (type == "int" && std::holds_alternative<Double_t>(argument))
+    {
+        const Double_t d = std::get<Double_t>(argument);
+        if (d != std::trunc(d) || !(std::fabs(d) < 9.2e18))
+            fail(std::string(nameOf(function->name)) + " expects an int for " + std::string(nameOf(parameter->name)) + " but got " + formatValue(argument));
+        return static_cast<Int_t>(d);
+    }
+    if (type == "int")
+        return toInt(argument);
+    if (type == "double")
+        return toDouble(argument);
+    return argument;
+}
+
+Value Evaluator::call(const AST::FunctionDefinition* function ,std::vector<Value> arguments)
+{
+    const std::string_view name = nameOf(function->name);
+    stats_.calls++;
+
+    if (function->relation != TokenType::Assign)
+        fail(std::string(name) + " isnt defined with '=', it cant be evaluated");
+    if (arguments.size() != function->parameters.size())
+        fail(std::string(name) + " takes " + std::to_string(function->parameters.size()) + " arguments but got " + std::to_string(arguments.size()));
+
+    for (size_t i = 0; i < arguments.size(); i++)
+        arguments[i] = convertArgument(function ,i ,std::move(arguments[i]));
+
+    MemoKey key {function ,arguments};
+    if (const Value* known = memoized(key))
+    {
+        stats_.memoHits++;
+        return *known;
+    }
+
+    if (frames_.size() >= kMaxCallDepth_)
+        fail("calls of " + std::string(name) + " nest deeper than " + std::to_string(kMaxCallDepth_));
+
+    frames_.emplace_back();
+    for (size_t i = 0; i < arguments.size(); i++)
+        frames_.back().push_back(Local{function->parameters[i]->name ,std::move(arguments[i]) ,false});
+
+    const Recursion& recursion = recursionOf(function);
+    Value result = recursion.kind == Recursion::Kind::None ? evaluate(function->value) : loop(function ,recursion);
+    frames_.pop_back();
+
+    memo_.emplace(std::move(key) ,result);
+    return result;
+}
+
+const Recursion& Evaluator::recursionOf(const AST::FunctionDefinition* function)
+{
+    auto it = recursions_.find(function);
+    if (it == recursions_.end())
+        it = recursions_.emplace(function ,findRecursion(function)).first;
+    return it->second;
+}
+
+Value Evaluator::loop(const AST::FunctionDefinition* function ,const Recursion& recursion)
+{
+    // each level replaces the parameters of the one above, a step keeps the
+    // operand it evaluated first, or the locals to evaluate it with, until
+    // the levels below it are done
+    struct Pending
+    {
+        Value operand;
+        std::vector<Local> locals;
+    };
+    std::vector<Pending> pending;
+
+    Value result;
+    while (true)
+    {
+        const AST::Rvalue* node = recursion.value;
+        while (recursion.isBranch(node))
+        {
+            auto* conditional = static_cast<const AST::Conditional*>(node);
+            node = isTruthy(evaluate(conditional->rhs)) ? conditional->lhs : conditional->otherwise;
+        }
+
+        const bool isStep = node == recursion.step;
+        const AST::Call* call = isStep ? recursion.stepCall() : recursion.callOf(node);
+        if (!call)
+        {
+            result = evaluate(node);
+            break;
+        }
+
+        Value operand;
+        if (isStep && !recursion.isCallFirst)
+            operand = evaluate(recursion.stepOperand());
+        std::vector<Value> arguments;
+        arguments.reserve(call->arguments.size());
+        for (const auto* argument : call->arguments)
+            arguments.push_back(evaluate(argument));
+
+        // what call() does, the levels below the first arent memoized
+        stats_.calls++;
+        for (size_t i = 0; i < arguments.size(); i++)
+            arguments[i] = convertArgument(function ,i ,std::move(arguments[i]));
+        if (isStep)
+        {
+            if (pending.size() >= kMaxPendingSteps_)
+                fail("calls of " + std::string(nameOf(function->name)) + " nest deeper than " + std::to_string(kMaxPendingSteps_));
+            pending.push_back(Pending{std::move(operand) ,recursion.isCallFirst ? frames_.back() : std::vector<Local>()});
+        }
+        if (const Value* known = memoized(MemoKey{function ,arguments}))
+        {
+            stats_.memoHits++;
+            result = *known;
+            break;
+        }
+
+        frames_.back().clear();
+        for (size_t i = 0; i < arguments.size(); i++)
+            frames_.back().push_back(Local{function->parameters[i]->name ,std::move(arguments[i]) ,false});
+    }
+
+    for (auto it = pending.rbegin(); it != pending.rend(); ++it)
+    {
+        if (recursion.isCallFirst)
+        {
+            frames_.back() = std::move(it->locals);
+            it->operand = evaluate(recursion.stepOperand());
+            result = applyBinary(recursion.step->op ,materialize(result) ,materialize(it->operand));
+        }
+        else
+            result = applyBinary(recursion.step->op ,materialize(it->operand) ,materialize(result));
+    }
+    return result;
+}
+
+Value Evaluator::evaluateBlock(const AST::Block* block)
+{
+    // a block is a value, return gives it
+    const bool isTopLevel = frames_.empty();
+    if (isTopLevel)
+        frames_.emplace_back();
+    const size_t scope = frames_.back().size();
+
+    Value result;
+    for (const auto* statement : block->ASTList)
+    {
+        if (execute(statement))
+        {
+            result = std::move(returnValue_);
+            break;
+        }
+    }
+
+    if (isTopLevel)
+        frames_.pop_back();
+    else
+        frames_.back().resize(scope);
+    return result;
+}
+
+Value Evaluator::evaluateIndex(const AST::Index* index)
+{
+    const Value set = evaluate(index->set);
+    if (!std::holds_alternative<SetRef>(set) && !std::holds_alternative<LazyRef>(set))
+        fail(std::string("only sets can be indexed, not ") + typeName(set));
+
+    auto position = [&](const AST::Rvalue* node)
+    {
+        const Value value = evaluate(node);
+        if (!std::holds_alternative<Int_t>(value))
+            fail(std::string("a set index has to be an int, not ") + typeName(value));
+        return std::get<Int_t>(value);
+    };
+
+    // counting from 1
+    if (index->index->getType() == AST::NodeType::Binary && static_cast<const AST::Binary*>(index->index)->op == TokenType::DoubleDot)
+    {
+        auto* range = static_cast<const AST::Binary*>(index->index);
+        const Int_t first = std::max<Int_t>(position(range->lhs) ,1);
+        const Int_t last = position(range->rhs);
+        if (last < first)
+            return SetValue::empty();
+        return makeSlice(set ,static_cast<size_t>(first - 1) ,static_cast<size_t>(last - 1));
+    }
+
+    const Int_t n = position(index->index);
+    if (n < 1)
+        return Value();
+    auto element = elementAt(set ,static_cast<size_t>(n - 1));
+    return element ? *element : Value();
+}
+
+void Evaluator::collectLocals(const AST::ASTNode* node ,std::vector<Local>& locals)
+{
+    if (!node)
+        return;
+
+    using AST::NodeType;
+    switch (node->getType())
+    {
+        case NodeType::Lvalue: {
+            const SymbolId name = static_cast<const AST::Lvalue*>(node)->identifier;
+            const Local* local = findLocal(name);
+            if (!local)
+                return;
+            for (const auto& known : locals)
+                if (known.name == name)
+                    return;
+            locals.push_back(*local);
+            return;
+        }
+        case NodeType::Unary:
+            collectLocals(static_cast<const AST::Unary*>(node)->operand ,locals);
+            return;
+        case NodeType::Binary: {
+            auto* binary = static_cast<const AST::Binary*>(node);
+            if (binary->op == TokenType::At) // name@Domain isnt a local
+                return;
+            collectLocals(binary->lhs ,locals);
+            collectLocals(binary->rhs ,locals);
+            return;
+        }
+        case NodeType::Conditional: {
+            auto* conditional = static_cast<const AST::Conditional*>(node);
+            collectLocals(conditional->lhs ,locals);
+            collectLocals(conditional->rhs ,locals);
+            collectLocals(conditional->otherwise ,locals);
+            return;
+        }
+        case NodeType::Call: {
+            auto* call = static_cast<const AST::Call*>(node);
+            for (const auto* argument : call->arguments)
+                collectLocals(argument ,locals);
+            return;
+        }
+        case NodeType::Member:
+            collectLocals(static_cast<const AST::Member*>(node)->set ,locals);
+            return;
+        case NodeType::Index:
+            collectLocals(static_cast<const AST::Index*>(node)->set ,locals);
+            collectLocals(static_cast<const AST::Index*>(node)->index ,locals);
+            return;
+        case NodeType::Comprehension: {
+            auto* comprehension = static_cast<const AST::Comprehension*>(node);
+            collectLocals(comprehension->source ,locals);
+            collectLocals(comprehension->predicate ,locals);
+            collectLocals(comprehension->element ,locals);
+            return;
+        }
+        case NodeType::Block:
+            for (const auto* statement : static_cast<const AST::Block*>(node)->ASTList)
+                collectLocals(statement ,locals);
+            return;
+        case NodeType::VarDefinition:
+        case NodeType::VarReference:
+        case NodeType::Return:
+            collectLocals(node->getType() == NodeType::Return ? static_cast<const AST::Return*>(node)->value
+                : static_cast<const AST::VariableBase*>(node)->value ,locals);
+            return;
+        default:
+            return;
+    }
+}
+
+// if threads can read value at the same time, a LazySet that isnt a range
+// remembers what it found or evaluates in the Evaluator that made it
+static bool isShareable(const Value& value)
+{
+    if (auto* lazy = std::get_if<LazyRef>(&value))
+        return (*lazy)->intRange().has_value();
+    bool isShared = true;
+    if (auto* set = std::get_if<SetRef>(&value); set && (*set)->kind() == SetValue::Kind::Mixed)
+        (*set)->forEach([&](const Value& element) { isShared = isShared && isShareable(element); });
+    return isShared;
+}
+
+bool Evaluator::isParallel(const AST::ASTNode* node ,const std::vector<Local>& locals
+    ,std::vector<const AST::FunctionDefinition*>& functions) const
+{
+    if (!node)
+        return true;
+
+    auto all = [&](auto... children) { return (isParallel(children ,locals ,functions) && ...); };
+    using AST::NodeType;
+    switch (node->getType())
+    {
+        case NodeType::Comprehension: {
+            // a lazy one keeps evaluating in the Evaluator that made it
+            auto* comprehension = static_cast<const AST::Comprehension*>(node);
+            return comprehension->mode == TokenType::Unknown
+                && all(comprehension->source ? comprehension->source->set : nullptr ,comprehension->predicate ,comprehension->element);
+        }
+        case NodeType::Lvalue: {
+            const SymbolId name = static_cast<const AST::Lvalue*>(node)->identifier;
+            for (auto it = locals.rbegin(); it != locals.rend(); ++it)
+                if (it->name == name)
+                    return isShareable(it->value);
+            const Binding* binding = findGlobal(name);
+            return !binding || isShareable(binding->value);
+        }
+        case NodeType::Unary:
+            return all(static_cast<const AST::Unary*>(node)->operand);
+        case NodeType::Binary: {
+            auto* binary = static_cast<const AST::Binary*>(node);
+            return binary->op == TokenType::At || all(binary->lhs ,binary->rhs); // name@Domain constants are numbers or ranges
+        }
+        case NodeType::Conditional: {
+            auto* conditional = static_cast<const AST::Conditional*>(node);
+            return all(conditional->lhs ,conditional->rhs ,conditional->otherwise);
+        }
+        case NodeType::Call: {
+            auto* call = static_cast<const AST::Call*>(node);
+            for (const auto* argument : call->arguments)
+                if (!all(argument))
+                    return false;
+            if (call->callee->getType() != NodeType::Lvalue)
+                return true;
+            const Binding* binding = findGlobal(static_cast<const AST::Lvalue*>(call->callee)->identifier);
+            if (!binding || !binding->function || std::find(functions.begin() ,functions.end() ,binding->function) != functions.end())
+                return true;
+            functions.push_back(binding->function); // its parameters and locals only hold what it computes
+            return isParallel(binding->function->value ,{} ,functions);
+        }
+        case NodeType::Member:
+            return all(static_cast<const AST::Member*>(node)->set);
+        case NodeType::Index:
+            return all(static_cast<const AST::Index*>(node)->set ,static_cast<const AST::Index*>(node)->index);
+        case NodeType::Block:
+            for (const auto* statement : static_cast<const AST::Block*>(node)->ASTList)
+                if (!all(statement))
+                    return false;
+            return true;
+        case NodeType::VarDefinition:
+        case NodeType::VarReference:
+            return all(static_cast<const AST::VariableBase*>(node)->value);
+        case NodeType::Return:
+            return all(static_cast<const AST::Return*>(node)->value);
+        default:
+            return true;
+    }
+}
+
+// the last candidate of a window of at most size ones from first
+static Int_t windowEnd(Int_t first ,Int_t last ,size_t size)
+{
+    if (static_cast<uint64_t>(last) - static_cast<uint64_t>(first) < size)
+        return last;
+    return static_cast<Int_t>(static_cast<uint64_t>(first) + size - 1);
+}
+
+Value Evaluator::evaluateComprehension(const AST::Comprehension* comprehension)
+{
+    // the set the variable takes its values from
+    Value source;
+    SymbolId variable;
+    std::vector<Local> captured;
+    collectLocals(comprehension->predicate ,captured);
+    collectLocals(comprehension->element ,captured);
+
+    if (comprehension->source)
+    {
+        source = evaluate(comprehension->source->set);
+        variable = comprehension->source->variable;
+    }
+    else
+    {
+        // { expression } takes it from the name bound with := Set.x
+        auto iterator = std::find_if(captured.begin() ,captured.end() ,[](const Local& local) { return local.isIterator; });
+        if (iterator == captured.end())
+            fail("a set of expressions has to use a name defined with := Set.x");
+        source = iterator->value;
+        variable = iterator->name;
+    }
+    if (!std::holds_alternative<SetRef>(source) && !std::holds_alternative<LazyRef>(source))
+        fail(std::string("only sets have elements, not ") + typeName(source));
+
+    captured.erase(std::remove_if(captured.begin() ,captured.end() ,[variable](const Local& local) { return local.name == variable; }) ,captured.end());
+
+    // over ints only the range the predicate's comparisons allow is tried
+    std::vector<const AST::Rvalue*> filters;
+    if (comprehension->predicate)
+        filters.push_back(comprehension->predicate);
+    if (auto* lazy = std::get_if<LazyRef>(&source); lazy && (*lazy)->intRange() && comprehension->source)
+    {
+        const RangePlan& plan = rangePlan(comprehension ,**lazy);
+        if (comprehension->mode == TokenType::Unknown && (*lazy)->isInfinite() && !plan.hasUpperBound())
+            fail(formatNode(comprehension) + " has no upper bound for " + std::string(nameOf(variable)) + ", declare it continuous or discrete");
+
+        if (!plan.bounds.empty())
+        {
+            IntRange range = *(*lazy)->intRange();
+            frames_.push_back(captured);
+            try
+            {
+                for (const auto& bound : plan.bounds)
+                {
+                    const Value value = evaluate(bound.value);
+                    if (!range.narrow(bound.op ,value))
+                        fail("operator '" + getTokenKey(bound.op) + "' cant be used on int and " + typeName(value));
+                }
+            }
+            catch (...)
+            {
+                frames_.pop_back();
+                throw;
+            }
+            frames_.pop_back();
+
+            if (range.isEmpty())
+                source = SetValue::empty();
+            else if ((*lazy)->isInfinite() && range.last == std::numeric_limits<Int_t>::max())
+                source = countFrom(range.first);
+            else
+                source = makeRange(range.first ,range.last);
+            filters = plan.filters;
+        }
+    }
+
+    // the element the candidate turns into, evaluated by evaluator, nullopt if a filter doesnt hold for it
+    auto produceOn = [comprehension ,variable ,captured ,filters](Evaluator& evaluator ,const Value& candidate ,bool isFiltered) -> std::optional<Value>
+    {
+        if (isFiltered && !comprehension->element)
+            return candidate;
+        auto& frames = evaluator.frames_;
+        frames.push_back(captured);
+        frames.back().push_back(Local{variable ,candidate ,false});
+        std::optional<Value> element;
+        try
+        {
+            bool isKept = true;
+            for (size_t i = 0; i < filters.size() && isKept && !isFiltered; i++)
+                isKept = isTruthy(evaluator.evaluate(filters[i]));
+            if (isKept)
+                element = comprehension->element ? evaluator.evaluate(comprehension->element) : candidate;
+        }
+        catch (...)
+        {
+            frames.pop_back();
+            throw;
+        }
+        frames.pop_back();
+        return element;
+    };
+    auto produce = [this ,produceOn](const Value& candidate ,bool isFiltered = false)
+    {
+        return produceOn(*this ,candidate ,isFiltered);
+    };
+
+    auto* lazySource = std::get_if<LazyRef>(&source);
+    const size_t maxSize = lazySource ? (*lazySource)->maxSize() : std::get<SetRef>(source)->size();
+
+    // over a range of ints the filters run as a FilterKernel, a window of candidates at a time
+    auto compileKernel = [this ,variable ,captured ,filters](Int_t first ,Int_t last)
+    {
+        return FilterKernel::compile(filters ,variable ,IntRange{first ,last} ,[this ,&captured](SymbolId name)
+        {
+            return intConstant(name ,captured);
+        });
+    };
+    std::optional<IntRange> candidates;
+    if (lazySource && (*lazySource)->intRange() && !filters.empty() && useKernels_)
+    {
+        const IntRange& range = *(*lazySource)->intRange();
+        if (!range.isEmpty() && compileKernel(range.first ,windowEnd(range.first ,range.last ,kMinKernelWindow_)))
+            candidates = range;
+    }
+
+    // the candidates of first..last that pass the filters, nullopt if they cant run as a kernel there
+    auto filterWindow = [compileKernel](Evaluator& evaluator ,Int_t first ,Int_t last) -> std::optional<std::vector<Int_t>>
+    {
+        auto kernel = compileKernel(first ,last);
+        if (!kernel)
+            return std::nullopt;
+        evaluator.countSteps(static_cast<uint64_t>(last - first) + 1);
+        std::vector<Int_t> survivors;
+        kernel->run(first ,last ,survivors);
+        return survivors;
+    };
+
+    if (comprehension->mode == TokenType::Unknown)
+    {
+        if (maxSize == LazySet::kInfinite)
+            fail(formatNode(comprehension) + " is over an infinite set, declare it continuous or discrete");
+
+        // in chunks of candidates, a kernel checks a whole window at once
+        const size_t chunk = candidates ? kMaxKernelWindow_ : kParallelChunk_;
+        std::vector<const AST::FunctionDefinition*> functions;
+        bool isInParallel = !parent_ && maxSize > chunk && isShareable(source) && isParallel(comprehension->element ,captured ,functions);
+        for (const auto* filter : filters)
+            isInParallel = isInParallel && isParallel(filter ,captured ,functions);
+        if (isInParallel)
+        {
+            // every chunk is a task with a worker of its own
+            struct Part
+            {
+                SetBuilder elements {};
+                Stats stats {};
+                std::unordered_map<MemoKey ,Value ,MemoKeyHash> memo {};
+                std::unordered_map<const AST::Comprehension* ,RangePlan> plans {};
+                std::vector<std::pair<const AST::Comprehension* ,std::string>> warnings {};
+                std::exception_ptr error {};
+            };
+            std::vector<Part> parts((maxSize - 1) / chunk + 1);
+            std::atomic<size_t> firstError = parts.size(); // the parts after it are never merged
+            TaskSteps taskSteps {std::vector<std::atomic<uint64_t>>(parts.size()) ,kMaxSteps_ - stats_.steps};
+
+            scheduler().run(parts.size() ,[&](size_t task)
+            {
+                if (task > firstError)
+                    return;
+                Evaluator worker(this ,&taskSteps ,task);
+                Part& part = parts[task];
+                const size_t first = task * chunk;
+                const size_t last = std::min(first + chunk ,maxSize) - 1;
+                try
+                {
+                    const Int_t base = candidates ? candidates->first : 0;
+                    const Int_t low = static_cast<Int_t>(static_cast<uint64_t>(base) + first);
+                    const Int_t high = static_cast<Int_t>(static_cast<uint64_t>(base) + last);
+                    if (auto survivors = candidates ? filterWindow(worker ,low ,high) : std::nullopt)
+                    {
+                        for (Int_t survivor : *survivors)
+                            part.elements.add(*produceOn(worker ,survivor ,true));
+                    }
+                    else
+                    {
+                        for (size_t i = first; i <= last; i++)
+                        {
+                            auto candidate = elementAt(source ,i);
+                            if (!candidate)
+                                break;
+                            worker.countSteps(1);
+                            if (auto element = produceOn(worker ,*candidate ,false))
+                                part.elements.add(*element);
+                        }
+                    }
+                }
+                catch (...)
+                {
+                    part.error = std::current_exception();
+                    for (size_t known = firstError; task < known && !firstError.compare_exchange_weak(known ,task);) {}
+                }
+                taskSteps.steps[task] = worker.stats_.steps;
+                part.stats = worker.stats_;
+                part.memo = std::move(worker.memo_);
+                part.plans = std::move(worker.rangePlans_);
+                part.warnings = std::move(worker.warnings_);
+            });
+
+            SetBuilder elements;
+            for (auto& part : parts)
+            {
+                stats_.calls += part.stats.calls;
+                stats_.memoHits += part.stats.memoHits;
+                for (const auto& [node ,warning] : part.warnings)
+                    if (!knownPlan(node))
+                        warn(node ,warning);
+                rangePlans_.merge(part.plans);
+                countSteps(part.stats.steps); // fails where evaluating the parts in order would
+                if (part.error)
+                    std::rethrow_exception(part.error);
+                elements.merge(std::move(part.elements));
+                memo_.merge(part.memo);
+            }
+            return elements.build();
+        }
+
+        SetBuilder elements;
+        if (candidates)
+        {
+            for (Int_t first = candidates->first; ;)
+            {
+                const Int_t last = windowEnd(first ,candidates->last ,kMaxKernelWindow_);
+                if (auto survivors = filterWindow(*this ,first ,last))
+                {
+                    for (Int_t survivor : *survivors)
+                        elements.add(*produce(survivor ,true));
+                }
+                else
+                {
+                    for (Int_t i = first; ; i++)
+                    {
+                        countSteps(1);
+                        if (auto element = produce(i))
+                            elements.add(*element);
+                        if (i == last)
+                            break;
+                    }
+                }
+                if (last == candidates->last)
+                    break;
+                first = last + 1;
+            }
+            return elements.build();
+        }
+
+        for (size_t i = 0; auto candidate = elementAt(source ,i); i++)
+        {
+            countSteps(1);
+            if (auto element = produce(*candidate))
+                elements.add(*element);
+        }
+        return elements.build();
+    }
+
+    MemoKey key {comprehension ,{}};
+    for (const auto& local : captured)
+        key.arguments.push_back(local.value);
+    if (auto it = lazySets_.find(key); it != lazySets_.end())
+        return it->second;
+
+    LazyRef set;
+    const bool isIndexed = !lazySource || (*lazySource)->isIndexed();
+    if (comprehension->mode == TokenType::Discrete && filters.empty() && isIndexed)
+    {
+        // element i only depends on element i of source
+        set = std::make_shared<LazySet>(LazySet::Nth([source ,produce](size_t i) -> std::optional<Value>
+        {
+            auto candidate = elementAt(source ,i);
+            return candidate ? produce(*candidate) : std::nullopt;
+        }) ,maxSize);
+    }
+    else if (candidates)
+    {
+        // windows start small so a set that is only read a little doesnt check many candidates ahead,
+        // a window the kernel cant run on is handed out unchecked
+        struct Scan
+        {
+            Int_t next;
+            bool isDone = false;
+            size_t window = kMinKernelWindow_;
+            std::vector<Int_t> candidates {};
+            size_t used = 0;
+            bool isFiltered = false;
+        };
+        auto scan = std::make_shared<Scan>(Scan{candidates->first});
+        set = std::make_shared<LazySet>(LazySet::Next([this ,scan ,last = candidates->last ,produce ,filterWindow]() -> std::optional<Value>
+        {
+            for (;;)
+            {
+                while (scan->used < scan->candidates.size())
+                {
+                    auto element = produce(scan->candidates[scan->used] ,scan->isFiltered);
+                    ++scan->used;
+                    if (element)
+                        return element;
+                }
+                if (scan->isDone)
+                    return std::nullopt;
+
+                const Int_t windowLast = windowEnd(scan->next ,last ,scan->window);
+                auto survivors = filterWindow(*this ,scan->next ,windowLast);
+                scan->isFiltered = survivors.has_value();
+                if (!survivors)
+                {
+                    survivors.emplace();
+                    for (Int_t i = scan->next; ; i++)
+                    {
+                        survivors->push_back(i);
+                        if (i == windowLast)
+                            break;
+                    }
+                }
+                scan->candidates = std::move(*survivors);
+                scan->used = 0;
+                scan->isDone = windowLast == last;
+                scan->next = scan->isDone ? last : windowLast + 1;
+                scan->window = std::min(scan->window * 2 ,kMaxKernelWindow_);
+            }
+        }) ,maxSize);
+    }
+    else
+    {
+        // the position only moves past candidates that were checked, so an error leaves it where it was
+        auto position = std::make_shared<size_t>(0);
+        set = std::make_shared<LazySet>(LazySet::Next([source ,produce ,position]() -> std::optional<Value>
+        {
+            while (auto candidate = elementAt(source ,*position))
+            {
+                auto element = produce(*candidate);
+                ++*position;
+                if (element)
+                    return element;
+            }
+            return std::nullopt;
+        }) ,maxSize);
+    }
+
+    lazySets_.emplace(std::move(key) ,set);
+    return set;
+}
+
+// nodes whose value cant change between evaluations
+static bool isFixed(const AST::Rvalue* node)
+{
+    if (node->getType() == AST::NodeType::Literal)
+        return true;
+    if (node->getType() != AST::NodeType::Binary)
+        return false;
+    auto* binary = static_cast<const AST::Binary*>(node);
+    return binary->op == TokenType::At || (binary->op == TokenType::DoubleDot && isFixed(binary->lhs) && isFixed(binary->rhs));
+}
+
+const RangePlan* Evaluator::knownPlan(const AST::Comprehension* comprehension) const
+{
+    if (auto it = rangePlans_.find(comprehension); it != rangePlans_.end())
+        return &it->second;
+    return parent_ ? parent_->knownPlan(comprehension) : nullptr;
+}
+
+void Evaluator::warn(const AST::Comprehension* comprehension ,const std::string& msg)
+{
+    if (parent_)
+        warnings_.emplace_back(comprehension ,msg);
+    else
+        log(msg);
+}
+
+const RangePlan& Evaluator::rangePlan(const AST::Comprehension* comprehension ,const LazySet& source)
+{
+    if (parent_)
+        if (const RangePlan* plan = parent_->knownPlan(comprehension))
+            return *plan;
+    auto [it ,isNew] = rangePlans_.try_emplace(comprehension);
+    if (!isNew)
+        return it->second;
+    it->second = planRange(comprehension->predicate ,comprehension->source->variable);
+    const RangePlan& plan = it->second;
+
+    // report a set that is empty whatever the program does, once
+    bool isFixedRange = !plan.bounds.empty() && isFixed(comprehension->source->set);
+    for (const auto& bound : plan.bounds)
+        isFixedRange &= bound.value->getType() == AST::NodeType::Literal;
+    if (isFixedRange)
+    {
+        IntRange range = *source.intRange();
+        for (const auto& bound : plan.bounds)
+            range.narrow(bound.op ,toValue(static_cast<const AST::Literal*>(bound.value)->value));
+        if (range.isEmpty())
+            warn(comprehension ,"WARNING: " + formatNode(comprehension) + " is always empty.");
+    }
+    return plan;
+}
+
+Value Evaluator::materialize(const Value& value)
+{
+    auto* lazy = std::get_if<LazyRef>(&value);
+    if (!lazy)
+        return value;
+    if ((*lazy)->isInfinite())
+        fail("an infinite set cant be compared or calculated with");
+
+    SetBuilder elements;
+    for (size_t i = 0; auto element = (*lazy)->at(i); i++)
+    {
+        countSteps(1);
+        elements.add(*element);
+    }
+    return elements.build();
+}
+
+std::optional<Value> Evaluator::sumInParallel(const Value& value)
+{
+    // only ints, doubles would round differently in another order
+    auto* set = std::get_if<SetRef>(&value);
+    if (parent_ || !set || (*set)->kind() == SetValue::Kind::Mixed || (*set)->size() < 2 * kParallelSumChunk_)
+        return std::nullopt;
+
+    // every task adds up its elements and keeps the lowest and highest sum on the way,
+    // which tell if adding them to the sum before them overflows somewhere
+    struct Part
+    {
+        Int_t total = 0;
+        Int_t lowest = 0;
+        Int_t highest = 0;
+        bool isOverflow = false;
+    };
+    std::vector<Part> parts(((*set)->size() - 1) / kParallelSumChunk_ + 1);
+    scheduler().run(parts.size() ,[&](size_t task)
+    {
+        Part& part = parts[task];
+        const size_t first = task * kParallelSumChunk_;
+        (*set)->forEach(first ,std::min(kParallelSumChunk_ ,(*set)->size() - first) ,[&part](const Value& element)
+        {
+            part.isOverflow |= __builtin_add_overflow(part.total ,std::get<Int_t>(element) ,&part.total);
+            part.lowest = std::min(part.lowest ,part.total);
+            part.highest = std::max(part.highest ,part.total);
+        });
+    });
+
+    Int_t total = 0;
+    for (const auto& part : parts)
+    {
+        Int_t bound;
+        if (part.isOverflow || __builtin_add_overflow(total ,part.lowest ,&bound) || __builtin_add_overflow(total ,part.highest ,&bound))
+            return std::nullopt; // the sum in order reports where
+        total += part.total;
+    }
+    return Value(total);
+}
+
+bool Evaluator::execute(const AST::ASTNode* statement)
+{
+    if (!statement)
+        fail("statement has errors");
+
+    using AST::NodeType;
+    switch (statement->getType())
+    {
+        case NodeType::Empty:
+            return false;
+        case NodeType::VarDeclaration:
+        case NodeType::VarAllocation:
+        case NodeType::VarDefinition:
+        case NodeType::VarReference: {
+            auto* var = static_cast<const AST::VariableBase*>(statement);
+            const auto* member = var->value && var->value->getType() == NodeType::Member ? static_cast<const AST::Member*>(var->value) : nullptr;
+            if (statement->getType() == NodeType::VarReference && member && member->variable == var->name) // x := Set.x
+            {
+                frames_.back().push_back(Local{var->name ,evaluate(member->set) ,false ,true});
+                return false;
+            }
+
+            Value value;
+            if (statement->getType() == NodeType::VarDefinition || statement->getType() == NodeType::VarReference)
+                value = evaluate(var->value);
+            frames_.back().push_back(Local{var->name ,std::move(value) ,false});
+            return false;
+        }
+        case NodeType::FunctionDefinition:
+            fail("functions can only be defined at the top level");
+        case NodeType::Return: {
+            auto* ret = static_cast<const AST::Return*>(statement);
+            returnValue_ = ret->value ? evaluate(ret->value) : Value();
+            return true;
+        }
+        case NodeType::Block: {
+            // a nested block returns from the whole body
+            const size_t scope = frames_.back().size();
+            for (const auto* inner : static_cast<const AST::Block*>(statement)->ASTList)
+            {
+                if (execute(inner))
+                {
+                    frames_.back().resize(scope);
+                    return true;
+                }
+            }
+            frames_.back().resize(scope);
+            return false;
+        }
+        default:
+            if (!AST::isExpression(statement->getType()))
+                fail("this cant be evaluated at compile time");
+            evaluate(static_cast<const AST::Rvalue*>(statement));
+            return false;
+    }
+}
+
+// A deep copy of node in arena that can be folded without changing node, count
+// goes up by the number of nodes copied.
+static AST::ASTNode* copyNode(Arena& arena ,const AST::ASTNode* node ,size_t& count)
+{
+    if (!node)
+        return nullptr;
+    count++;
+
+    auto copy = [&](const AST::Rvalue* value) { return static_cast<AST::Rvalue*>(copyNode(arena ,value ,count)); };
+    using AST::NodeType;
+    switch (node->getType())
+    {
+        case NodeType::Empty:
+            return arena.make<AST::Empty>();
+        case NodeType::Literal:
+            return arena.make<AST::Literal>(static_cast<const AST::Literal*>(node)->value);
+        case NodeType::Lvalue:
+            return arena.make<AST::Lvalue>(static_cast<const AST::Lvalue*>(node)->identifier);
+        case NodeType::Unary: {
+            auto* unary = static_cast<const AST::Unary*>(node);
+            return arena.make<AST::Unary>(unary->op ,unary->isPostfix ,copy(unary->operand));
+        }
+        case NodeType::Binary: {
+            auto* binary = static_cast<const AST::Binary*>(node);
+            return arena.make<AST::Binary>(binary->op ,copy(binary->lhs) ,copy(binary->rhs));
+        }
+        case NodeType::Conditional: {
+            auto* conditional = static_cast<const AST::Conditional*>(node);
+            return arena.make<AST::Conditional>(copy(conditional->lhs) ,copy(conditional->rhs) ,copy(conditional->otherwise));
+        }
+        case NodeType::Call: {
+            auto* call = static_cast<const AST::Call*>(node);
+            auto* result = arena.make<AST::Call>(arena ,copy(call->callee));
+            for (const auto* argument : call->arguments)
+                result->arguments.push_back(copy(argument));
+            return result;
+        }
+        case NodeType::Member: {
+            auto* member = static_cast<const AST::Member*>(node);
+            return arena.make<AST::Member>(copy(member->set) ,member->variable);
+        }
+        case NodeType::Index: {
+            auto* index = static_cast<const AST::Index*>(node);
+            return arena.make<AST::Index>(copy(index->set) ,copy(index->index));
+        }
+        case NodeType::Set: {
+            auto* set = static_cast<const AST::Set*>(node);
+            auto* result = arena.make<AST::Set>(arena);
+            result->elements.assign(set->elements.begin() ,set->elements.end());
+            result->isSetValue = set->isSetValue;
+            return result;
+        }
+        case NodeType::Comprehension: {
+            auto* comprehension = static_cast<const AST::Comprehension*>(node);
+            auto* result = arena.make<AST::Comprehension>(arena ,static_cast<AST::Member*>(copy(comprehension->source))
+                ,copy(comprehension->predicate) ,copy(comprehension->element) ,comprehension->mode);
+            result->isSetValue = comprehension->isSetValue;
+            return result;
+        }
+        case NodeType::Block: {
+            auto* block = static_cast<const AST::Block*>(node);
+            auto* result = arena.make<AST::Block>(arena);
+            for (const auto* statement : block->ASTList)
+                result->ASTList.push_back(copyNode(arena ,statement ,count));
+            return result;
+        }
+        case NodeType::VarDeclaration:
+        case NodeType::VarDefinition:
+        case NodeType::VarAllocation:
+        case NodeType::VarReference: {
+            auto* variable = static_cast<const AST::VariableBase*>(node);
+            AST::VariableBase* result = nullptr;
+            if (node->getType() == NodeType::VarDeclaration)
+                result = arena.make<AST::VarDeclaration>(variable->name ,variable->isRuntime);
+            else if (node->getType() == NodeType::VarDefinition)
+                result = arena.make<AST::VarDefinition>(variable->name ,variable->isRuntime ,variable->isDecleration ,copy(variable->value));
+            else if (node->getType() == NodeType::VarAllocation)
+                result = arena.make<AST::VarAllocation>(variable->name ,variable->isRuntime ,variable->isDecleration ,copy(variable->value));
+            else
+                result = arena.make<AST::VarReference>(variable->name ,variable->isRuntime ,variable->isDecleration ,copy(variable->value));
+            result->hasDomain = variable->hasDomain;
+            result->domain = variable->domain;
+            return result;
+        }
+        case NodeType::Return:
+            return arena.make<AST::Return>(copy(static_cast<const AST::Return*>(node)->value));
+        case NodeType::Domain: {
+            auto* domain = static_cast<const AST::Domain*>(node);
+            return arena.make<AST::Domain>(domain->op ,domain->name);
+        }
+        default: // functions are only at the top level
+            throw std::runtime_error("this cant be copied");
+    }
+}
+
+bool Evaluator::isConstant(const AST::Rvalue* node) const
+{
+    return node && (node->getType() == AST::NodeType::Literal || node->getType() == AST::NodeType::Set);
+}
+
+AST::Rvalue* Evaluator::makeConstant(const Value& value)
+{
+    if (std::holds_alternative<LazyRef>(value)) // may be infinite
+        return nullptr;
+    if (auto* set = std::get_if<SetRef>(&value))
+    {
+        auto* node = arena_.make<AST::Set>(arena_);
+        node->isSetValue = false;
+        for (size_t i = 0; i < (*set)->size(); i++)
+        {
+            const Value element = (*set)->at(i);
+            if (std::holds_alternative<SetRef>(element) || std::holds_alternative<LazyRef>(element)) // nested sets have no literal
+                return nullptr;
+            node->elements.emplace_back(std::visit([](const auto& v) -> AST::Literal_t
+            {
+                if constexpr (std::is_same_v<std::decay_t<decltype(v)> ,SetRef> || std::is_same_v<std::decay_t<decltype(v)> ,LazyRef>)
+                    return {};
+                else
+                    return v;
+            } ,element));
+        }
+        return node;
+    }
+
+    return arena_.make<AST::Literal>(std::visit([](const auto& v) -> AST::Literal_t
+    {
+        if constexpr (std::is_same_v<std::decay_t<decltype(v)> ,SetRef> || std::is_same_v<std::decay_t<decltype(v)> ,LazyRef>)
+            return {};
+        else
+            return v;
+    } ,value));
+}
+
+void Evaluator::checkRuntimeTarget(const AST::Rvalue* target)
+{
+    // the target stays a name, it has to be a runtime one
+    if (target->getType() != AST::NodeType::Lvalue)
+        fail("only variables can be assigned");
+
+    const SymbolId name = static_cast<const AST::Lvalue*>(target)->identifier;
+    const Local* local = findLocal(name);
+    const Binding* binding = local ? nullptr : findGlobal(name);
+    if ((local && !local->isRuntime) || (binding && !binding->isRuntime))
+        fail(std::string(nameOf(name)) + " is a define, it cant be assigned");
+    domainChecker_.use(name);
+}
+
+void Evaluator::foldVariable(AST::VariableBase* variable)
+{
+    // a reference depends on the domains of the names it reads
+    const bool isReference = variable->getType() == AST::NodeType::VarReference;
+    if (isReference)
+        domainChecker_.beginCapture();
+    variable->value = fold(variable->value);
+    domainChecker_.declare(variable ,isReference ? domainChecker_.endCapture() : std::vector<uint32_t>());
+}
+
+AST::Rvalue* Evaluator::specialize(AST::Call* call ,const Binding& binding)
+{
+    const AST::FunctionDefinition* function = binding.function;
+    std::vector<std::optional<Value>> arguments;
+    bool isKnown = false;
+    for (const auto* argument : call->arguments)
+    {
+        arguments.push_back(isConstant(argument) ? std::optional<Value>(evaluate(argument)) : std::nullopt);
+        isKnown |= arguments.back().has_value();
+    }
+
+    // past the budget the arguments stay, a define function still needs a runtime clone,
+    // and so do they in the calls a function makes of itself while its clone is folded,
+    // unrolling it into a clone per level would bake nothing in
+    const bool isOverBudget = specializedNodes_ >= kMaxSpecializedNodes_ || specializing_.size() >= kMaxSpecializationDepth_;
+    const bool isRecursive = std::find(specializing_.begin() ,specializing_.end() ,function) != specializing_.end();
+    if (isOverBudget || isRecursive)
+        std::fill(arguments.begin() ,arguments.end() ,std::nullopt);
+    // a runtime function that runs as a loop would get a clone for each level
+    const bool isCloned = function->relation == TokenType::Assign && arguments.size() == function->parameters.size()
+        && function != foldingFunction_
+        && (!binding.isRuntime || (isKnown && !isOverBudget && !isRecursive && !recursionOf(function).isLoop()));
+
+    AST::FunctionDefinition* clone = isCloned ? specialize(function ,arguments) : nullptr;
+    if (!clone)
+    {
+        if (binding.isRuntime)
+            domainChecker_.use(function->name);
+        return call;
+    }
+
+    // a clone that gives a constant is that constant, if its arguments have no effects
+    size_t kept = 0;
+    bool hasEffects = false;
+    for (size_t i = 0; i < arguments.size(); i++)
+    {
+        if (arguments[i])
+            continue;
+        hasEffects |= call->arguments[i]->getType() != AST::NodeType::Lvalue;
+        call->arguments[kept++] = call->arguments[i];
+    }
+    call->arguments.resize(kept);
+    if (!hasEffects && clone->value && clone->value->getType() == AST::NodeType::Literal)
+        return arena_.make<AST::Literal>(static_cast<const AST::Literal*>(clone->value)->value);
+
+    call->callee = arena_.make<AST::Lvalue>(clone->name);
+    domainChecker_.use(clone->name);
+    return call;
+}
+
+AST::FunctionDefinition* Evaluator::specialize(const AST::FunctionDefinition* function ,const std::vector<std::optional<Value>>& arguments)
+{
+    SpecializationKey key {function ,arguments};
+    try
+    {
+        for (size_t i = 0; i < arguments.size(); i++)
+            if (arguments[i])
+                key.arguments[i] = convertArgument(function ,i ,*arguments[i]);
+    }
+    catch (const std::exception&) // left for the run to fail
+    {
+        return nullptr;
+    }
+    if (auto it = specializations_.find(key); it != specializations_.end())
+        return it->second;
+
+    // named after the known arguments, like power<n=3>, a name no source can use
+    std::string name = std::string(nameOf(function->name)) + "<";
+    for (size_t i = 0 ,count = 0; i < key.arguments.size(); i++)
+        if (key.arguments[i])
+            name += (count++ ? "," : "") + std::string(nameOf(function->parameters[i]->name)) + "=" + formatValue(*key.arguments[i]);
+    name += ">";
+    if (findGlobal(symbols().intern(name))) // values that format the same
+        name += "#" + std::to_string(specializations_.size());
+
+    auto* clone = arena_.make<AST::FunctionDefinition>(arena_ ,symbols().intern(name) ,true ,TokenType::Assign ,nullptr);
+    for (size_t i = 0; i < key.arguments.size(); i++)
+        if (!key.arguments[i])
+            clone->parameters.push_back(function->parameters[i]);
+
+    // folded like a runtime function at the top level, with the known parameters
+    // as defines, the calls it makes of itself find it while it is folded
+    specializations_.emplace(key ,clone);
+    define(clone->name ,Binding{true ,Value() ,clone});
+    const size_t firstClone = newSpecializations_.size();
+    std::vector<std::vector<Local>> frames = std::move(frames_);
+    frames_.assign(1 ,{});
+    domainChecker_.enterTopLevel();
+    specializing_.push_back(function);
+    bool isFolded = false;
+    try
+    {
+        size_t nodes = 0;
+        AST::Rvalue* body = static_cast<AST::Rvalue*>(copyNode(arena_ ,function->value ,nodes));
+        domainChecker_.beginCapture();
+        domainChecker_.enterBlock();
+        for (size_t i = 0; i < key.arguments.size(); i++)
+        {
+            const SymbolId parameter = function->parameters[i]->name;
+            if (key.arguments[i])
+                frames_.back().push_back(Local{parameter ,*key.arguments[i] ,false});
+            else
+            {
+                frames_.back().push_back(Local{parameter ,Value() ,true});
+                domainChecker_.declareParameter(parameter);
+            }
+        }
+        clone->value = fold(body);
+        domainChecker_.exitBlock();
+        domainChecker_.declare(clone ,domainChecker_.endCapture());
+        specializedNodes_ += nodes;
+        isFolded = true;
+    }
+    catch (const std::exception&) // the call stays, if it fails it fails at runtime
+    {
+    }
+    specializing_.pop_back();
+    domainChecker_.exitTopLevel();
+    frames_ = std::move(frames);
+
+    if (!isFolded)
+    {
+        // so are the clones made inside it, they may call it
+        std::vector<const AST::ASTNode*> dropped {clone};
+        dropped.insert(dropped.end() ,newSpecializations_.begin() + firstClone ,newSpecializations_.end());
+        newSpecializations_.resize(firstClone);
+        for (auto it = specializations_.begin(); it != specializations_.end();)
+        {
+            if (std::find(dropped.begin() ,dropped.end() ,it->second) == dropped.end())
+                ++it;
+            else
+            {
+                globals_.erase(it->second->name);
+                it = specializations_.erase(it);
+            }
+        }
+        specializations_.emplace(std::move(key) ,nullptr);
+        return nullptr;
+    }
+
+    // calls of a clone without parameters that gives a constant become the
+    // constant, unless they were folded while it was, in the clones made inside it
+    const bool isConstantClone = clone->parameters.empty() && clone->value && clone->value->getType() == AST::NodeType::Literal
+        && newSpecializations_.size() == firstClone;
+    if (isConstantClone)
+        return clone;
+
+    // logged once the outermost one is folded, a clone made inside it can still go
+    newSpecializations_.push_back(clone);
+    if (specializing_.empty())
+        for (size_t i = firstClone; i < newSpecializations_.size(); i++)
+            log(formatNode(newSpecializations_[i]));
+    return clone;
+}
+
+AST::Rvalue* Evaluator::fold(AST::Rvalue* node)
+{
+    if (!node)
+        return node;
+
+    // evaluates node once its operands are folded, if they all are constants
+    auto reduce = [&](AST::Rvalue* folded ,bool isPure) -> AST::Rvalue*
+    {
+        if (!isPure)
+            return folded;
+        AST::Rvalue* constant = makeConstant(evaluate(folded));
+        return constant ? constant : folded;
+    };
+
+    using AST::NodeType;
+    switch (node->getType())
+    {
+        case NodeType::Lvalue: {
+            const SymbolId name = static_cast<AST::Lvalue*>(node)->identifier;
+            const Local* local = findLocal(name);
+            if (local && !local->isRuntime)
+                return reduce(node ,true);
+
+            const Binding* binding = local ? nullptr : findGlobal(name);
+            if (!local && binding && !binding->isRuntime)
+                return binding->function ? node : reduce(node ,true);
+            domainChecker_.use(name);
+            return node;
+        }
+        case NodeType::Unary: {
+            auto* unary = static_cast<AST::Unary*>(node);
+            if (unary->op == TokenType::DoublePlus || unary->op == TokenType::DoubleMinus)
+            {
+                checkRuntimeTarget(unary->operand);
+                return node;
+            }
+            unary->operand = fold(unary->operand);
+            return reduce(node ,isConstant(unary->operand));
+        }
+        case NodeType::Binary: {
+            auto* binary = static_cast<AST::Binary*>(node);
+            if (binary->op == TokenType::At)
+            {
+                auto [name ,domain] = domainNames(binary);
+                return builtinConstant(name ,domain) ? reduce(node ,true) : node;
+            }
+
+            binary->rhs = fold(binary->rhs);
+            if (isAssignment(binary->op))
+            {
+                checkRuntimeTarget(binary->lhs);
+                return node;
+            }
+
+            binary->lhs = fold(binary->lhs);
+            return reduce(node ,isConstant(binary->lhs) && isConstant(binary->rhs));
+        }
+        case NodeType::Conditional: {
+            // once the condition is known only the side it picks is folded, so
+            // the calls a clone makes on the other side arent specialized
+            auto* conditional = static_cast<AST::Conditional*>(node);
+            if (conditional->otherwise)
+            {
+                conditional->rhs = fold(conditional->rhs);
+                if (isConstant(conditional->rhs))
+                    return fold(isTruthy(evaluate(conditional->rhs)) ? conditional->lhs : conditional->otherwise);
+                conditional->lhs = fold(conditional->lhs);
+                conditional->otherwise = fold(conditional->otherwise);
+                return node;
+            }
+            conditional->lhs = fold(conditional->lhs);
+            if (isConstant(conditional->lhs))
+                return isTruthy(evaluate(conditional->lhs)) ? fold(conditional->rhs) : makeConstant(Value());
+            conditional->rhs = fold(conditional->rhs);
+            return node;
+        }
+        case NodeType::Call: {
+            auto* call = static_cast<AST::Call*>(node);
+            bool isPure = true;
+            for (auto*& argument : call->arguments)
+            {
+                argument = fold(argument);
+                isPure &= isConstant(argument);
+            }
+
+            if (call->callee->getType() == NodeType::Lvalue)
+            {
+                const SymbolId name = static_cast<AST::Lvalue*>(call->callee)->identifier;
+                const Binding* binding = findLocal(name) ? nullptr : findGlobal(name);
+                isPure &= binding && binding->function && !binding->isRuntime;
+                if (!isPure && binding && binding->function)
+                    return specialize(call ,*binding);
+                if (!binding || binding->isRuntime)
+                    domainChecker_.use(name);
+            }
+            else
+            {
+                auto [name ,domain] = domainNames(call->callee);
+                isPure &= isBuiltinFunction(name ,domain);
+            }
+            return reduce(node ,isPure);
+        }
+        case NodeType::Index: {
+            auto* index = static_cast<AST::Index*>(node);
+            index->set = fold(index->set);
+            index->index = fold(index->index);
+            return reduce(node ,isConstant(index->set) && isConstant(index->index));
+        }
+        case NodeType::Block:
+            return static_cast<AST::Rvalue*>(foldStatement(node));
+        default: // Literal, Set, Member, Comprehension
+            return node;
+    }
+}
+
+AST::ASTNode* Evaluator::foldStatement(AST::ASTNode* statement)
+{
+    if (!statement)
+        fail("statement has errors");
+
+    using AST::NodeType;
+    switch (statement->getType())
+    {
+        case NodeType::VarDeclaration:
+        case NodeType::VarAllocation:
+        case NodeType::VarDefinition:
+        case NodeType::VarReference: {
+            auto* var = static_cast<AST::VariableBase*>(statement);
+            if (!var->isRuntime) // evaluated now, runtime code only sees its value
+            {
+                Value value;
+                if (statement->getType() == NodeType::VarDefinition || statement->getType() == NodeType::VarReference)
+                    value = evaluate(var->value);
+                frames_.back().push_back(Local{var->name ,std::move(value) ,false});
+                return nullptr;
+            }
+            foldVariable(var);
+            frames_.back().push_back(Local{var->name ,Value() ,true});
+            return statement;
+        }
+        case NodeType::FunctionDefinition:
+            fail("functions can only be defined at the top level");
+        case NodeType::Return: {
+            auto* ret = static_cast<AST::Return*>(statement);
+            ret->value = fold(ret->value);
+            return statement;
+        }
+        case NodeType::Block: {
+            auto* block = static_cast<AST::Block*>(statement);
+            const bool isTopLevel = frames_.empty();
+            if (isTopLevel)
+                frames_.emplace_back();
+            const size_t scope = frames_.back().size();
+
+            domainChecker_.enterBlock();
+            size_t kept = 0;
+            for (auto* inner : block->ASTList)
+                if (auto* folded = foldStatement(inner))
+                    block->ASTList[kept++] = folded;
+            block->ASTList.resize(kept);
+            domainChecker_.exitBlock();
+
+            if (isTopLevel)
+                frames_.pop_back();
+            else
+                frames_.back().resize(scope);
+            return statement;
+        }
+        case NodeType::Domain: {
+            auto* domain = static_cast<AST::Domain*>(statement);
+            if (domain->op == TokenType::Create)
+                domainChecker_.create(domain->name);
+            else
+                domainChecker_.remove(domain->name);
+            return statement;
+        }
+        case NodeType::Empty:
+            return statement;
+        default:
+            if (!AST::isExpression(statement->getType()))
+                fail("this cant be folded");
+            return fold(static_cast<AST::Rvalue*>(statement));
+    }
+}
+
+std::vector<AST::ASTNode*> Evaluator::takeSpecializations()
+{
+    return std::exchange(newSpecializations_ ,{});
+}
+
+bool Evaluator::run(AST::ASTNode*& statement)
+{
+    if (!statement) // the parser reported it
+        return false;
+
+    try
+    {
+        using AST::NodeType;
+        switch (statement->getType())
+        {
+            case NodeType::VarDeclaration:
+            case NodeType::VarAllocation:
+            case NodeType::VarDefinition:
+            case NodeType::VarReference: {
+                auto* var = static_cast<AST::VariableBase*>(statement);
+                if (var->isRuntime)
+                {
+                    foldVariable(var);
+                    define(var->name ,Binding{true});
+                    log(formatNode(statement));
+                    break;
+                }
+
+                Value value;
+                if (statement->getType() == NodeType::VarDefinition || statement->getType() == NodeType::VarReference)
+                    value = evaluate(var->value);
+                log(std::string(nameOf(var->name)) + " = " + formatValue(value));
+                define(var->name ,Binding{false ,std::move(value)});
+                break;
+            }
+            case NodeType::FunctionDefinition: {
+                auto* function = static_cast<AST::FunctionDefinition*>(statement);
+                if (!function->isRuntime)
+                {
+                    define(function->name ,Binding{false ,Value() ,function});
+                    break;
+                }
+
+                // parameters shadow defines with the same name, calls
+                // depend on the domains of the names the body reads
+                define(function->name ,Binding{true ,Value() ,function});
+                frames_.emplace_back();
+                domainChecker_.beginCapture();
+                domainChecker_.enterBlock();
+                for (const auto* parameter : function->parameters)
+                {
+                    frames_.back().push_back(Local{parameter->name ,Value() ,true});
+                    domainChecker_.declareParameter(parameter->name);
+                }
+                foldingFunction_ = function;
+                function->value = fold(function->value);
+                foldingFunction_ = nullptr;
+                domainChecker_.exitBlock();
+                frames_.pop_back();
+                domainChecker_.declare(function ,domainChecker_.endCapture());
+                log(formatNode(statement));
+                break;
+            }
+            case NodeType::Empty:
+                break;
+            case NodeType::Return:
+                fail("return outside of a function");
+            default: {
+                const std::string source = formatNode(statement);
+                statement = foldStatement(statement);
+                if (statement && AST::isExpression(statement->getType()) && isConstant(static_cast<const AST::Rvalue*>(statement)))
+                    log(source + " = " + formatNode(statement));
+                else
+                    log(formatNode(statement));
+            }
+        }
+        return true;
+    }
+    catch (const std::exception& e)
+    {
+        frames_.clear();
+        domainChecker_.reset();
+        foldingFunction_ = nullptr;
+        errorCount_++;
+        log(std::string("ERROR: ") + e.what() + ".");
+        return false;
+    }
+}
@@ -0,0 +1,351 @@
+#include <algorithm>
+#include <cstring>
+#include <variant>
+
+#include "filterkernel.h"
+
+using namespace Compiler;
+
+namespace {
+
+constexpr size_t kBlock = 256; // candidates per run of the code
+constexpr size_t kMaxRegisters = 64;
+constexpr double kExact = 0x1p53; // every int with a smaller magnitude is a double
+
+// GCC vector extensions, each only as wide as the registers of the function
+// it is inlined into, wider ones get split into scalars for some comparisons.
+typedef double Lanes2 __attribute__((vector_size(16))); // SSE2
+typedef int64_t Masks2 __attribute__((vector_size(16)));
+typedef double Lanes4 __attribute__((vector_size(32))); // AVX2
+typedef int64_t Masks4 __attribute__((vector_size(32)));
+
+constexpr int64_t kOneBits = 0x3FF0000000000000; // 1.0
+constexpr int64_t kSignBit = INT64_MIN;
+
+using Instruction = FilterKernel::Instruction;
+using Op = FilterKernel::Op;
+
+// The helpers are inlined into the function of each target, but they only
+// pass lanes by reference, so a call the compiler keeps, like without
+// optimizations, doesnt depend on the ABI for vectors of that target.
+template <typename Lanes ,typename Masks>
+struct Kernel
+{
+    static constexpr size_t kVectors = kBlock * sizeof(double) / sizeof(Lanes);
+
+    __attribute__((always_inline))
+    static void load(Lanes& lanes ,const double* registers ,size_t index ,size_t v)
+    {
+        std::memcpy(&lanes ,registers + index * kBlock + v * sizeof(Lanes) / sizeof(double) ,sizeof(lanes));
+    }
+
+    __attribute__((always_inline))
+    static void store(double* registers ,size_t index ,size_t v ,const Lanes& lanes)
+    {
+        std::memcpy(registers + index * kBlock + v * sizeof(Lanes) / sizeof(double) ,&lanes ,sizeof(lanes));
+    }
+
+    // 1.0 where mask is set, 0.0 elsewhere, truth values are the ints 1 and 0 like in the evaluator
+    __attribute__((always_inline))
+    static void truth(Lanes& result ,const Masks& mask)
+    {
+        result = reinterpret_cast<Lanes>(mask & kOneBits);
+    }
+
+    // rounds toward zero like int division, without the SSE4.1 round instruction
+    __attribute__((always_inline))
+    static void truncate(Lanes& result ,const Lanes& x)
+    {
+        const Masks bits = reinterpret_cast<Masks>(x);
+        const Lanes magnitude = reinterpret_cast<Lanes>(bits & ~kSignBit);
+        Lanes whole = (magnitude + 0x1p52) - 0x1p52; // the nearest whole number
+        Lanes isAbove;
+        truth(isAbove ,whole > magnitude);
+        whole -= isAbove;
+        const Masks isWhole = magnitude >= 0x1p52; // then it already is one
+        result = reinterpret_cast<Lanes>((isWhole & reinterpret_cast<Masks>(magnitude)) | (~isWhole & reinterpret_cast<Masks>(whole)) | (bits & kSignBit));
+    }
+
+    // result = op(x ,y), Negate and Not ignore y
+    template <Op op>
+    __attribute__((always_inline))
+    static void compute(Lanes& result ,const Lanes& x ,const Lanes& y)
+    {
+        if constexpr (op == Op::Add) result = x + y;
+        else if constexpr (op == Op::Subtract) result = x - y;
+        else if constexpr (op == Op::Multiply) result = x * y;
+        else if constexpr (op == Op::Divide) truncate(result ,x / y);
+        else if constexpr (op == Op::Modulo)
+        {
+            truncate(result ,x / y);
+            result = x - result * y;
+        }
+        else if constexpr (op == Op::Negate) result = -x;
+        else if constexpr (op == Op::Not) truth(result ,x == 0.0);
+        else if constexpr (op == Op::Equal) truth(result ,x == y);
+        else if constexpr (op == Op::NotEqual) truth(result ,~(x == y));
+        else if constexpr (op == Op::Less) truth(result ,x < y);
+        else if constexpr (op == Op::LessEqual) truth(result ,x <= y);
+        else if constexpr (op == Op::Greater) truth(result ,x > y);
+        else if constexpr (op == Op::GreaterEqual) truth(result ,x >= y);
+        else if constexpr (op == Op::And) truth(result ,~(x == 0.0) & ~(y == 0.0));
+        else if constexpr (op == Op::Or) truth(result ,~((x == 0.0) & (y == 0.0)));
+        else truth(result ,(x == 0.0) ^ (y == 0.0));
+    }
+
+    // target = op(lhs ,rhs) for every vector of the block
+    template <Op op>
+    __attribute__((always_inline))
+    static void apply(double* registers ,const Instruction& instruction)
+    {
+        for (size_t v = 0; v < kVectors; v++)
+        {
+            Lanes x ,y ,result;
+            load(x ,registers ,instruction.lhs ,v);
+            load(y ,registers ,instruction.rhs ,v);
+            compute<op>(result ,x ,y);
+            store(registers ,instruction.target ,v ,result);
+        }
+    }
+
+    __attribute__((always_inline))
+    static void execute(const Instruction* code ,size_t size ,double* registers)
+    {
+        for (const Instruction* instruction = code; instruction != code + size; instruction++)
+        {
+            switch (instruction->op)
+            {
+                case Op::Add: apply<Op::Add>(registers ,*instruction); break;
+                case Op::Subtract: apply<Op::Subtract>(registers ,*instruction); break;
+                case Op::Multiply: apply<Op::Multiply>(registers ,*instruction); break;
+                case Op::Divide: apply<Op::Divide>(registers ,*instruction); break;
+                case Op::Modulo: apply<Op::Modulo>(registers ,*instruction); break;
+                case Op::Negate: apply<Op::Negate>(registers ,*instruction); break;
+                case Op::Not: apply<Op::Not>(registers ,*instruction); break;
+                case Op::Equal: apply<Op::Equal>(registers ,*instruction); break;
+                case Op::NotEqual: apply<Op::NotEqual>(registers ,*instruction); break;
+                case Op::Less: apply<Op::Less>(registers ,*instruction); break;
+                case Op::LessEqual: apply<Op::LessEqual>(registers ,*instruction); break;
+                case Op::Greater: apply<Op::Greater>(registers ,*instruction); break;
+                case Op::GreaterEqual: apply<Op::GreaterEqual>(registers ,*instruction); break;
+                case Op::And: apply<Op::And>(registers ,*instruction); break;
+                case Op::Or: apply<Op::Or>(registers ,*instruction); break;
+                case Op::Xor: apply<Op::Xor>(registers ,*instruction); break;
+            }
+        }
+    }
+};
+
+using ExecuteFn = void (*)(const Instruction* ,size_t ,double*);
+
+#if defined(__x86_64__) || defined(__i386__)
+
+__attribute__((target("avx2")))
+void executeAVX2(const Instruction* code ,size_t size ,double* registers)
+{
+    Kernel<Lanes4 ,Masks4>::execute(code ,size ,registers);
+}
+
+#endif
+
+// SSE2 on x86-64, which every such cpu has
+void executeDefault(const Instruction* code ,size_t size ,double* registers)
+{
+    Kernel<Lanes2 ,Masks2>::execute(code ,size ,registers);
+}
+
+ExecuteFn selectExecute()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return executeAVX2;
+#endif
+    return executeDefault;
+}
+
+const ExecuteFn kExecute = selectExecute();
+
+} // namespace
+
+struct FilterKernel::Builder
+{
+    // the values a register can take for the candidates
+    struct Interval
+    {
+        double lo;
+        double hi;
+
+        bool isExact() const { return lo > -kExact && hi < kExact; }
+        bool hasZero() const { return lo <= 0 && hi >= 0; }
+        double magnitude() const { return std::max(-lo ,hi); }
+    };
+
+    struct Operand
+    {
+        uint16_t index;
+        Interval interval;
+    };
+
+    FilterKernel& kernel;
+    SymbolId variable;
+    Interval candidates;
+    const Resolve& resolve;
+
+    std::optional<Operand> constant(Int_t value)
+    {
+        const Interval interval {static_cast<double>(value) ,static_cast<double>(value)};
+        if (!interval.isExact() || kernel.registerCount_ == kMaxRegisters)
+            return std::nullopt;
+        kernel.constants_.push_back({kernel.registerCount_ ,static_cast<double>(value)});
+        return Operand{kernel.registerCount_++ ,interval};
+    }
+
+    std::optional<Operand> instruction(Op op ,Operand lhs ,Operand rhs ,Interval interval)
+    {
+        if (!interval.isExact() || kernel.registerCount_ == kMaxRegisters)
+            return std::nullopt;
+        kernel.code_.push_back({op ,kernel.registerCount_ ,lhs.index ,rhs.index});
+        return Operand{kernel.registerCount_++ ,interval};
+    }
+
+    std::optional<Operand> emit(const AST::Rvalue* node)
+    {
+        using AST::NodeType;
+        switch (node->getType())
+        {
+            case NodeType::Literal: {
+                const Value value = toValue(static_cast<const AST::Literal*>(node)->value);
+                if (auto* i = std::get_if<Int_t>(&value))
+                    return constant(*i);
+                return std::nullopt;
+            }
+            case NodeType::Lvalue: {
+                const SymbolId name = static_cast<const AST::Lvalue*>(node)->identifier;
+                if (name == variable)
+                    return Operand{0 ,candidates};
+                if (auto value = resolve(name))
+                    return constant(*value);
+                return std::nullopt;
+            }
+            case NodeType::Unary:
+                return emitUnary(static_cast<const AST::Unary*>(node));
+            case NodeType::Binary:
+                return emitBinary(static_cast<const AST::Binary*>(node));
+            default:
+                return std::nullopt;
+        }
+    }
+
+    std::optional<Operand> emitUnary(const AST::Unary* unary)
+    {
+        if (unary->op != TokenType::Minus && unary->op != TokenType::Not)
+            return std::nullopt;
+        auto operand = emit(unary->operand);
+        if (!operand)
+            return std::nullopt;
+        if (unary->op == TokenType::Not)
+            return instruction(Op::Not ,*operand ,*operand ,{0 ,1});
+        return instruction(Op::Negate ,*operand ,*operand ,{-operand->interval.hi ,-operand->interval.lo});
+    }
+
+    std::optional<Operand> emitBinary(const AST::Binary* binary)
+    {
+        Op op;
+        switch (binary->op)
+        {
+            case TokenType::Plus: op = Op::Add; break;
+            case TokenType::Minus: op = Op::Subtract; break;
+            case TokenType::Multiplication: op = Op::Multiply; break;
+            case TokenType::Division: op = Op::Divide; break;
+            case TokenType::Modulo: op = Op::Modulo; break;
+            case TokenType::Equals: op = Op::Equal; break;
+            case TokenType::NotEquals: op = Op::NotEqual; break;
+            case TokenType::LessThan: op = Op::Less; break;
+            case TokenType::LessEquals: op = Op::LessEqual; break;
+            case TokenType::GreaterThan: op = Op::Greater; break;
+            case TokenType::GreaterEquals: op = Op::GreaterEqual; break;
+            case TokenType::And: op = Op::And; break;
+            case TokenType::Or: op = Op::Or; break;
+            case TokenType::Xor: op = Op::Xor; break;
+            default: return std::nullopt;
+        }
+
+        auto lhs = emit(binary->lhs);
+        auto rhs = lhs ? emit(binary->rhs) : std::nullopt;
+        if (!rhs)
+            return std::nullopt;
+        const Interval& a = lhs->interval;
+        const Interval& b = rhs->interval;
+
+        // exact as long as the operands are, products are checked against kExact before they are rounded much
+        Interval interval {0 ,1};
+        switch (op)
+        {
+            case Op::Add: interval = {a.lo + b.lo ,a.hi + b.hi}; break;
+            case Op::Subtract: interval = {a.lo - b.hi ,a.hi - b.lo}; break;
+            case Op::Multiply: {
+                const double products[] = {a.lo * b.lo ,a.lo * b.hi ,a.hi * b.lo ,a.hi * b.hi};
+                interval = {*std::min_element(std::begin(products) ,std::end(products)) ,*std::max_element(std::begin(products) ,std::end(products))};
+                break;
+            }
+            case Op::Divide:
+                if (b.hasZero()) // x/0 is undefined
+                    return std::nullopt;
+                interval = {-a.magnitude() ,a.magnitude()};
+                break;
+            case Op::Modulo: {
+                if (b.hasZero())
+                    return std::nullopt;
+                const double magnitude = std::min(a.magnitude() ,b.magnitude() - 1);
+                interval = {-magnitude ,magnitude};
+                break;
+            }
+            default: // comparisons and logic give 0 or 1
+                break;
+        }
+        return instruction(op ,*lhs ,*rhs ,interval);
+    }
+};
+
+std::optional<FilterKernel> FilterKernel::compile(const std::vector<const AST::Rvalue*>& filters ,SymbolId variable
+    ,IntRange range ,const Resolve& resolve)
+{
+    FilterKernel kernel;
+    Builder builder {kernel ,variable ,{static_cast<double>(range.first) ,static_cast<double>(range.last)} ,resolve};
+    if (filters.empty() || range.isEmpty() || !builder.candidates.isExact())
+        return std::nullopt;
+
+    std::optional<Builder::Operand> result;
+    for (const auto* filter : filters)
+    {
+        auto operand = builder.emit(filter);
+        if (!operand)
+            return std::nullopt;
+        result = result ? builder.instruction(Op::And ,*result ,*operand ,{0 ,1}) : operand;
+        if (!result)
+            return std::nullopt;
+    }
+    kernel.result_ = result->index;
+    return kernel;
+}
+
+void FilterKernel::run(Int_t first ,Int_t last ,std::vector<Int_t>& survivors) const
+{
+    std::vector<double> registers(registerCount_ * kBlock);
+    for (const auto& [index ,value] : constants_)
+        std::fill_n(registers.data() + index * kBlock ,kBlock ,value);
+
+    const double* result = registers.data() + result_ * kBlock;
+    for (Int_t base = first; base <= last; base += kBlock)
+    {
+        for (size_t i = 0; i < kBlock; i++)
+            registers[i] = static_cast<double>(base + static_cast<Int_t>(i));
+        kExecute(code_.data() ,code_.size() ,registers.data());
+
+        const size_t count = std::min<uint64_t>(kBlock ,static_cast<uint64_t>(last - base) + 1);
+        for (size_t i = 0; i < count; i++)
+            if (result[i] != 0)
+                survivors.push_back(base + static_cast<Int_t>(i));
+    }
+}
@@ -0,0 +1,204 @@
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "compiler.h"
+#include "flatast.h"
+
+using namespace Compiler;
+using namespace Compiler::AST;
+
+NodeIndex FlatAST::add(const ASTNode* node)
+{
+    NodeIndex root = convert(node);
+    roots.push_back(root);
+    return root;
+}
+
+void FlatAST::clear()
+{
+    kinds.clear();
+    flags.clear();
+    payloads.clear();
+    firstChild.clear();
+    childCount.clear();
+    children.clear();
+    literals.clear();
+    roots.clear();
+}
+
+NodeIndex FlatAST::convert(const ASTNode* node)
+{
+    const NodeIndex index = static_cast<NodeIndex>(kinds.size());
+    const NodeType type = node ? node->getType() : NodeType::Unknown;
+
+    kinds.push_back(type);
+    flags.push_back(0);
+    payloads.push_back(0);
+    firstChild.push_back(0);
+    childCount.push_back(0);
+
+    // children are converted first so their indices follow the node (preorder),
+    // then the list of them is appended in one piece
+    std::vector<NodeIndex> nodeChildren;
+
+    switch (type)
+    {
+        case NodeType::VarDeclaration:
+        case NodeType::VarDefinition:
+        case NodeType::VarAllocation:
+        case NodeType::VarReference:
+        case NodeType::FunctionDefinition: {
+            auto* var = static_cast<const VariableBase*>(node);
+            flags[index] = (var->isRuntime ? Runtime : 0) | (var->isDecleration ? Declaration : 0);
+            payloads[index] = static_cast<uint32_t>(var->name);
+
+            if (type == NodeType::FunctionDefinition)
+            {
+                auto* function = static_cast<const FunctionDefinition*>(node);
+                flags[index] |= function->relation == TokenType::Allocate ? Allocate
+                    : function->relation == TokenType::Reference ? Reference : 0;
+                for (const auto* parameter : function->parameters)
+                    nodeChildren.push_back(convert(parameter));
+            }
+            if (var->value)
+                nodeChildren.push_back(convert(var->value));
+            if (var->hasDomain)
+            {
+                const Domain domain(TokenType::At ,var->domain);
+                nodeChildren.push_back(convert(&domain));
+            }
+            break;
+        }
+        case NodeType::Domain: {
+            auto* domain = static_cast<const Domain*>(node);
+            flags[index] = domain->op == TokenType::Create ? Declaration : 0;
+            payloads[index] = static_cast<uint32_t>(domain->name);
+            break;
+        }
+        case NodeType::Parameter: {
+            auto* parameter = static_cast<const Parameter*>(node);
+            payloads[index] = static_cast<uint32_t>(parameter->name);
+            if (parameter->hasType)
+            {
+                const Lvalue type(parameter->type);
+                nodeChildren.push_back(convert(&type));
+            }
+            break;
+        }
+        case NodeType::Block: {
+            auto* block = static_cast<const Block*>(node);
+            nodeChildren.reserve(block->ASTList.size());
+            for (const auto* stmt : block->ASTList)
+                nodeChildren.push_back(convert(stmt));
+            break;
+        }
+        case NodeType::Set: {
+            auto* set = static_cast<const Set*>(node);
+            flags[index] = set->isSetValue ? SetValue : 0;
+            firstChild[index] = static_cast<uint32_t>(literals.size());
+            childCount[index] = static_cast<uint32_t>(set->elements.size());
+            literals.insert(literals.end() ,set->elements.begin() ,set->elements.end());
+            return index;
+        }
+        case NodeType::Literal: {
+            firstChild[index] = static_cast<uint32_t>(literals.size());
+            childCount[index] = 1;
+            literals.push_back(static_cast<const Literal*>(node)->value);
+            return index;
+        }
+        case NodeType::Lvalue:
+            payloads[index] = static_cast<uint32_t>(static_cast<const Lvalue*>(node)->identifier);
+            break;
+        case NodeType::Return: {
+            auto* ret = static_cast<const Return*>(node);
+            if (ret->value)
+                nodeChildren.push_back(convert(ret->value));
+            break;
+        }
+        case NodeType::Unary: {
+            auto* unary = static_cast<const Unary*>(node);
+            flags[index] = unary->isPostfix ? Postfix : 0;
+            payloads[index] = static_cast<uint32_t>(unary->op);
+            nodeChildren.push_back(convert(unary->operand));
+            break;
+        }
+        case NodeType::Binary: {
+            auto* binary = static_cast<const Binary*>(node);
+            payloads[index] = static_cast<uint32_t>(binary->op);
+            nodeChildren.push_back(convert(binary->lhs));
+            nodeChildren.push_back(convert(binary->rhs));
+            break;
+        }
+        case NodeType::Conditional: {
+            auto* conditional = static_cast<const Conditional*>(node);
+            nodeChildren.push_back(convert(conditional->lhs));
+            nodeChildren.push_back(convert(conditional->rhs));
+            if (conditional->otherwise)
+                nodeChildren.push_back(convert(conditional->otherwise));
+            break;
+        }
+        case NodeType::Call: {
+            auto* call = static_cast<const Call*>(node);
+            nodeChildren.push_back(convert(call->callee));
+            for (const auto* argument : call->arguments)
+                nodeChildren.push_back(convert(argument));
+            break;
+        }
+        case NodeType::Member: {
+            auto* member = static_cast<const Member*>(node);
+            payloads[index] = static_cast<uint32_t>(member->variable);
+            nodeChildren.push_back(convert(member->set));
+            break;
+        }
+        case NodeType::Index: {
+            auto* indexNode = static_cast<const Index*>(node);
+            nodeChildren.push_back(convert(indexNode->set));
+            nodeChildren.push_back(convert(indexNode->index));
+            break;
+        }
+        case NodeType::Comprehension: {
+            auto* comprehension = static_cast<const Comprehension*>(node);
+            flags[index] = (comprehension->source ? Source : 0) | (comprehension->predicate ? Predicate : 0);
+            payloads[index] = static_cast<uint32_t>(comprehension->mode);
+            if (comprehension->source)
+                nodeChildren.push_back(convert(comprehension->source));
+            if (comprehension->predicate)
+                nodeChildren.push_back(convert(comprehension->predicate));
+            if (comprehension->element)
+                nodeChildren.push_back(convert(comprehension->element));
+            break;
+        }
+        default:
+            break;
+    }
+
+    firstChild[index] = static_cast<uint32_t>(children.size());
+    childCount[index] = static_cast<uint32_t>(nodeChildren.size());
+    children.insert(children.end() ,nodeChildren.begin() ,nodeChildren.end());
+    return index;
+}
+
+bool FlatAST::hasSymbol(NodeType type)
+{
+    switch (type)
+    {
+        case NodeType::VarDeclaration:
+        case NodeType::VarDefinition:
+        case NodeType::VarAllocation:
+        case NodeType::VarReference:
+        case NodeType::FunctionDefinition:
+        case NodeType::Parameter:
+        case NodeType::Lvalue:
+        case NodeType::Member:
+        case NodeType::Domain:
+            return true;
+        default:
+            return false;
+    }
+}
+
+void Compiler::printFlatAST(const FlatAST& ast ,NodeIndex node)
+{
+    printFlatTree(ast ,node);
+}
@@ -0,0 +1,262 @@
+#include <algorithm>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "passmanager.h"
+
+using namespace Compiler;
+using namespace Compiler::SSA;
+
+namespace {
+
+using Op = Bytecode::Op;
+
+// an operation on value numbers
+struct Expression
+{
+    Op op;
+    uint32_t lhs;
+    uint32_t rhs;
+    uint32_t constant; // LoadConst's, or AddConst's and SubtractConst's
+
+    bool operator==(const Expression& other) const
+    {
+        return op == other.op && lhs == other.lhs && rhs == other.rhs && constant == other.constant;
+    }
+};
+
+struct ExpressionHash
+{
+    size_t operator()(const Expression& expression) const
+    {
+        uint64_t hash = static_cast<uint64_t>(expression.op);
+        for (uint32_t part : {expression.lhs ,expression.rhs ,expression.constant})
+            hash = (hash ^ part) * 0x100000001B3ull;
+        return static_cast<size_t>(hash);
+    }
+};
+
+// operations that only depend on their operands
+bool isPure(Op op)
+{
+    return op == Op::LoadConst || (op >= Op::Add && op <= Op::Truth);
+}
+
+bool isCommutative(Op op)
+{
+    return op == Op::Add || op == Op::Multiply || op == Op::Equal || op == Op::NotEqual;
+}
+
+// the field of operand k of forEachRead(), nullptr if the instruction also
+// writes it or needs it in that register, like a call's arguments
+uint16_t* operandField(Bytecode::Instruction& code ,size_t k)
+{
+    switch (code.op)
+    {
+        case Op::Move:
+        case Op::LoadCell:
+        case Op::AddConst:
+        case Op::SubtractConst:
+        case Op::Negate:
+        case Op::Not:
+        case Op::Truth:
+        case Op::NewCell:
+            return &code.b;
+        case Op::StoreGlobal:
+        case Op::DefineGlobal:
+        case Op::JumpIfFalse:
+        case Op::JumpIfTrue:
+        case Op::JumpUnlessEqualConst:
+        case Op::JumpUnlessNotEqualConst:
+        case Op::JumpUnlessLessConst:
+        case Op::JumpUnlessLessEqualConst:
+        case Op::JumpUnlessGreaterConst:
+        case Op::JumpUnlessGreaterEqualConst:
+        case Op::Return:
+            return &code.a;
+        case Op::StoreCell:
+        case Op::JumpUnlessEqual:
+        case Op::JumpUnlessNotEqual:
+        case Op::JumpUnlessLess:
+        case Op::JumpUnlessLessEqual:
+        case Op::JumpUnlessGreater:
+        case Op::JumpUnlessGreaterEqual:
+            return k == 0 ? &code.a : &code.b;
+        case Op::Add:
+        case Op::Subtract:
+        case Op::Multiply:
+        case Op::Divide:
+        case Op::Modulo:
+        case Op::Equal:
+        case Op::NotEqual:
+        case Op::Less:
+        case Op::LessEqual:
+        case Op::Greater:
+        case Op::GreaterEqual:
+            return k == 0 ? &code.b : &code.c;
+        default:
+            return nullptr;
+    }
+}
+
+} // namespace
+
+size_t Compiler::numberValues(Module& module ,Function& function)
+{
+    auto& blocks = function.blocks;
+    const uint16_t registerCount = module.program.functions[function.index].registerCount;
+    const uint16_t parameterCount = module.program.functions[function.index].parameterCount;
+
+    std::vector<uint32_t> numbers(function.values.size()); // values with the same number are equal
+    for (uint32_t value = 0; value < numbers.size(); value++)
+        numbers[value] = value;
+
+    std::vector<std::vector<uint32_t>> children(blocks.size());
+    for (uint32_t b = 1; b < blocks.size(); b++)
+        if (!blocks[b].isDead)
+            children[blocks[b].dominator].push_back(b);
+
+    // the expressions the blocks on the way down the dominator tree computed,
+    // the value each register holds and the first value of each number, all
+    // undone when going back up
+    std::unordered_map<Expression ,uint32_t ,ExpressionHash> available;
+    std::vector<std::pair<Expression ,uint32_t>> undoAvailable; // kNone for new entries
+    std::vector<uint32_t> current(registerCount ,kNone);
+    std::vector<uint32_t> first(function.values.size() ,kNone);
+    for (uint16_t reg = 0; reg < parameterCount; reg++)
+        current[reg] = first[reg] = reg;
+    std::vector<std::pair<uint16_t ,uint32_t>> undoCurrent; // registers, or kNoRegister and a number that had no first value
+    auto set = [&](uint16_t reg ,uint32_t value)
+    {
+        undoCurrent.emplace_back(reg ,current[reg]);
+        current[reg] = value;
+        if (value != kNone && first[numbers[value]] == kNone)
+        {
+            undoCurrent.emplace_back(Bytecode::kNoRegister ,numbers[value]);
+            first[numbers[value]] = value;
+        }
+    };
+    // the register with the first value of value's number, if it still holds it
+    auto holder = [&](uint32_t value)
+    {
+        const uint32_t original = first[numbers[value]];
+        if (original == kNone)
+            return Bytecode::kNoRegister;
+        const uint16_t reg = function.values[original].reg;
+        return current[reg] != kNone && numbers[current[reg]] == numbers[value] ? reg : Bytecode::kNoRegister;
+    };
+
+    size_t changes = 0;
+    struct Visit
+    {
+        uint32_t block;
+        size_t undoAvailable; // kNone to enter the block
+        size_t undoCurrent;
+    };
+    std::vector<Visit> stack {Visit{0 ,kNone ,0}};
+    while (!stack.empty())
+    {
+        const Visit visit = stack.back();
+        stack.pop_back();
+        if (visit.undoAvailable != kNone)
+        {
+            for (; undoAvailable.size() > visit.undoAvailable; undoAvailable.pop_back())
+            {
+                const auto& [expression ,value] = undoAvailable.back();
+                if (value == kNone)
+                    available.erase(expression);
+                else
+                    available[expression] = value;
+            }
+            for (; undoCurrent.size() > visit.undoCurrent; undoCurrent.pop_back())
+            {
+                const auto [reg ,value] = undoCurrent.back();
+                if (reg == Bytecode::kNoRegister)
+                    first[value] = kNone;
+                else
+                    current[reg] = value;
+            }
+            continue;
+        }
+
+        Block& block = blocks[visit.block];
+        stack.push_back(Visit{visit.block ,undoAvailable.size() ,undoCurrent.size()});
+
+        for (const Phi& phi : block.phis)
+        {
+            const bool isSame = !phi.incoming.empty() && std::all_of(phi.incoming.begin() ,phi.incoming.end()
+                ,[&](uint32_t value) { return value != kNone && numbers[value] == numbers[phi.incoming[0]]; });
+            if (isSame)
+                numbers[phi.def] = numbers[phi.incoming[0]];
+            set(phi.reg ,phi.def);
+        }
+
+        for (Instruction& instruction : block.instructions)
+        {
+            if (instruction.isDead)
+                continue;
+            Bytecode::Instruction& code = instruction.code;
+
+            // copies are read from the register they were copied from, so the copy can go
+            for (size_t k = 0; k < instruction.uses.size(); k++)
+            {
+                uint16_t* field = operandField(code ,k);
+                const uint32_t value = instruction.uses[k];
+                if (!field || value == kNone)
+                    continue;
+                const uint16_t reg = holder(value);
+                if (reg == Bytecode::kNoRegister || reg == *field)
+                    continue;
+                *field = reg;
+                instruction.uses[k] = current[reg];
+                changes++;
+            }
+            const bool hasOperands = std::none_of(instruction.uses.begin() ,instruction.uses.end() ,[](uint32_t value) { return value == kNone; });
+
+            if (code.op == Op::Move && hasOperands)
+                numbers[instruction.def] = numbers[instruction.uses[0]];
+            else if (isPure(code.op) && hasOperands)
+            {
+                Expression expression {code.op ,kNone ,kNone ,0};
+                if (instruction.uses.size() > 0)
+                    expression.lhs = numbers[instruction.uses[0]];
+                if (instruction.uses.size() > 1)
+                    expression.rhs = numbers[instruction.uses[1]];
+                if (isCommutative(code.op) && expression.lhs > expression.rhs)
+                    std::swap(expression.lhs ,expression.rhs);
+                if (code.op == Op::LoadConst)
+                    expression.constant = code.target;
+                else if (code.op == Op::AddConst || code.op == Op::SubtractConst)
+                    expression.constant = code.c;
+
+                auto found = available.find(expression);
+                const uint32_t leader = found == available.end() ? kNone : found->second;
+                const uint16_t reg = leader == kNone ? Bytecode::kNoRegister : holder(leader);
+                if (reg != Bytecode::kNoRegister)
+                {
+                    // a Move of a register to itself is left out by lower()
+                    numbers[instruction.def] = numbers[leader];
+                    code = Bytecode::Instruction{Op::Move ,code.a ,reg};
+                    instruction.uses = {current[reg]};
+                    changes++;
+                }
+                else
+                {
+                    undoAvailable.emplace_back(expression ,leader);
+                    available[expression] = instruction.def;
+                }
+            }
+
+            if (code.op == Op::Call)
+                for (uint32_t reg = code.a + 1u; reg < registerCount; reg++)
+                    set(static_cast<uint16_t>(reg) ,kNone);
+            if (instruction.def != kNone)
+                set(function.values[instruction.def].reg ,instruction.def);
+        }
+
+        for (auto child = children[visit.block].rbegin(); child != children[visit.block].rend(); ++child)
+            stack.push_back(Visit{*child ,kNone ,0});
+    }
+    return changes;
+}
@@ -0,0 +1,99 @@
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <utility>
+#include <variant>
+
+#include "lazyset.h"
+#include "setvalue.h"
+
+using namespace Compiler;
+
+LazySet::LazySet(Next next ,size_t maxSize)
+    : next_ (std::move(next))
+    ,maxSize_ (maxSize)
+{}
+
+LazySet::LazySet(Nth nth ,size_t maxSize)
+    : nth_ (std::move(nth))
+    ,maxSize_ (maxSize)
+{}
+
+std::optional<Value> LazySet::at(size_t i)
+{
+    if (i >= maxSize_)
+        return std::nullopt;
+    if (nth_)
+        return nth_(i);
+
+    while (memo_.size() <= i && !isExhausted_)
+    {
+        auto element = next_();
+        if (!element)
+        {
+            isExhausted_ = true;
+            break;
+        }
+        memo_.push_back(std::move(*element));
+    }
+
+    if (i < memo_.size())
+        return memo_[i];
+    return std::nullopt;
+}
+
+std::optional<Value> Compiler::elementAt(const Value& set ,size_t i)
+{
+    if (auto* finite = std::get_if<SetRef>(&set))
+    {
+        if (i < (*finite)->size())
+            return (*finite)->at(i);
+        return std::nullopt;
+    }
+    if (auto* lazy = std::get_if<LazyRef>(&set))
+        return (*lazy)->at(i);
+    return std::nullopt;
+}
+
+LazyRef Compiler::makeRange(Int_t first ,Int_t last)
+{
+    // the size in unsigned so first = INT64_MIN ,last = INT64_MAX doesnt overflow
+    const size_t size = last < first ? 0 : static_cast<size_t>(static_cast<uint64_t>(last) - static_cast<uint64_t>(first)) + 1;
+    auto set = std::make_shared<LazySet>(LazySet::Nth([first](size_t i) -> std::optional<Value>
+    {
+        return Value(static_cast<Int_t>(static_cast<uint64_t>(first) + i));
+    }) ,std::min(size ,LazySet::kInfinite - 1));
+    set->intRange_ = IntRange{first ,last};
+    return set;
+}
+
+LazyRef Compiler::countFrom(Int_t first)
+{
+    auto set = std::make_shared<LazySet>(LazySet::Nth([first](size_t i) -> std::optional<Value>
+    {
+        return Value(static_cast<Int_t>(static_cast<uint64_t>(first) + i));
+    }) ,LazySet::kInfinite);
+    set->intRange_ = IntRange{first ,std::numeric_limits<Int_t>::max()};
+    return set;
+}
+
+LazyRef Compiler::naturalNumbers()
+{
+    static const LazyRef kNatural = countFrom(1);
+    return kNatural;
+}
+
+LazyRef Compiler::makeSlice(const Value& set ,size_t first ,size_t last)
+{
+    size_t size = last < first ? 0 : last - first + 1;
+    if (auto* finite = std::get_if<SetRef>(&set))
+        size = first >= (*finite)->size() ? 0 : std::min(size ,(*finite)->size() - first);
+    else if (auto* lazy = std::get_if<LazyRef>(&set); lazy && !(*lazy)->isInfinite())
+        size = first >= (*lazy)->maxSize() ? 0 : std::min(size ,(*lazy)->maxSize() - first);
+
+    return std::make_shared<LazySet>(LazySet::Nth([set ,first](size_t i)
+    {
+        return elementAt(set ,first + i);
+    }) ,size);
+}
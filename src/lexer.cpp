@@ -1,64 +1,75 @@
-#include <algorithm>
-#include <cctype>
 #include <charconv>
 #include <iostream>
+#include <memory>
 #include <optional>
 #include <stdexcept>
 #include <string>
 #include <string_view>
-#include <fstream>
 
+#include "charclass.h"
 #include "compiler.h"
 #include "lexer.h"
 
 using namespace Compiler;
 
-Lexer::Lexer(const CompileContext& context)
+static const std::string& firstSourceFile(const CompileContext& context)
 {
     if (context.sourceFiles.empty())
         throw std::runtime_error("ERROR: No source files provided.");
 
-    ifs.open(context.sourceFiles[0]); //tbd
-    if (!ifs.is_open())
-        throw std::runtime_error("ERROR: Failed to open source file.");
+    return context.sourceFiles[0];
+}
+
+Lexer::Lexer(const CompileContext& context)
+    : Lexer(context ,firstSourceFile(context))
+{}
+
+Lexer::Lexer(const CompileContext& ,const std::string& sourceFile)
+    : source(std::make_unique<SourceBuffer>(sourceFile))
+    ,text(source->view())
+{}
+
+Lexer::Lexer(std::string_view text ,size_t linesBefore)
+    : text(text)
+    ,atLine(linesBefore)
+{}
+
+Token Lexer::makeToken(TokenType type ,uint32_t payload) const
+{
+    return Token{type ,payload ,static_cast<uint32_t>(atLine) ,static_cast<uint32_t>(atColumn)};
 }
 
 Token Lexer::lexIdentifierOrToken(const std::string_view view)
 {
-    auto it = std::find_if_not(view.begin() ,view.end()
-            ,[](char c) {return std::isalnum(c) || c == '_';});
-    size_t count = static_cast<size_t>(it - view.begin());
+    size_t count = countIdentifierChars(view);
 
     atColumn += count;
 
     std::string_view substr = view.substr(0 ,count);
-    auto type = kKeywords.find(substr);
-
-    if (type == kKeywords.end()) // identifier
-        return Token{TokenType::Identifier, std::string(substr), atLine, atColumn};
+    TokenType type = findKeyword(substr);
 
-    return Token{type->second, std::monostate(), atLine, atColumn};
-}
+    if (type == TokenType::Unknown) // identifier
+        return makeToken(TokenType::Identifier ,static_cast<uint32_t>(symbols().intern(substr)));
 
-size_t countDigits(std::string_view view, size_t idx) {
-    auto it = std::find_if_not(view.begin() + idx ,view.end() ,::isdigit);
-    return static_cast<size_t>(it - (view.begin() + idx));
+    return makeToken(type);
 }
 
 Token Lexer::lexNumber(const std::string_view view)
 {
-    size_t whole_length = countDigits(view ,0);
+    size_t whole_length = countDigits(view);
 
-    if (whole_length < view.size() && view[whole_length] == '.') // if double
+    // 1.5 is a double, 1..n is a range starting at the int 1
+    const bool isRange = whole_length + 1 < view.size() && view[whole_length + 1] == '.';
+    if (whole_length < view.size() && view[whole_length] == '.' && !isRange) // if double
     {
-        size_t fraction_length = countDigits(view ,whole_length + 1);
+        size_t fraction_length = countDigits(view.substr(whole_length + 1));
 
         double d;
         if (std::from_chars(view.data(), view.data() + (whole_length + 1 + fraction_length), d).ec != std::errc())
             throw std::runtime_error("FATAL: failed to read double: \'" + std::string(view.data() ,whole_length + 1 + fraction_length) + "\' at line " + std::to_string(atLine) + ".");
 
         atColumn += whole_length + 1 + fraction_length;
-        return Token{TokenType::Double ,d ,atLine, atColumn};
+        return makeToken(TokenType::Double ,symbols().addDouble(d));
     }
     else // if int
     {
@@ -67,7 +78,9 @@ Token Lexer::lexNumber(const std::string_view view)
             throw std::runtime_error("FATAL: failed to read int: \'" + std::string(view.data() ,whole_length) + "\' at line " + std::to_string(atLine) + ".");
 
         atColumn += whole_length;
-        return Token{TokenType::Integer ,i ,atLine, atColumn};
+        if (i < Token::kPooledInt) // small ints dont need the pool
+            return makeToken(TokenType::Integer ,static_cast<uint32_t>(i));
+        return makeToken(TokenType::Integer ,symbols().addInt(i) | Token::kPooledInt);
     }
 }
 
@@ -131,16 +144,23 @@ Token Lexer::lexCharOrString(const std::string_view view)
         throw std::runtime_error("FATAL: string at line " + std::to_string(atLine) + " isnt closed properly.");
 
     if (count == 0) // empty char ('')
-        return Token{TokenType::Char ,'\0' ,atLine ,atColumn};
+        return makeToken(TokenType::Char ,'\0');
 
+    const std::string_view content = view.substr(1 ,count - 2);
 
+    if (content.find('\\') == std::string_view::npos) // nothing to escape
+    {
+        if (content.size() == 1) // if char
+            return makeToken(TokenType::Char ,static_cast<unsigned char>(content[0]));
+        return makeToken(TokenType::String ,static_cast<uint32_t>(symbols().intern(content)));
+    }
 
-    std::string escapedStr = escapeString(view.substr(1 ,count - 2));
+    std::string escapedStr = escapeString(content);
 
     if (escapedStr.size() == 1) // if char
-        return Token{TokenType::Char ,escapedStr[0] ,atLine ,atColumn};
+        return makeToken(TokenType::Char ,static_cast<unsigned char>(escapedStr[0]));
     else // if string
-        return Token{TokenType::String ,escapedStr ,atLine ,atColumn};
+        return makeToken(TokenType::String ,static_cast<uint32_t>(symbols().intern(escapedStr)));
 }
 
 
@@ -162,59 +182,66 @@ Token Lexer::lexString(const std::string_view view)
         throw std::runtime_error("FATAL: string at line " + std::to_string(atLine) + " isnt closed properly.");
 
     if (count == 0) // empty string ("")
-        return Token{TokenType::String ,"" ,atLine ,atColumn};
+        return makeToken(TokenType::String ,static_cast<uint32_t>(symbols().intern("")));
 
+    const std::string_view content = view.substr(1 ,count - 2);
 
+    if (content.find('\\') == std::string_view::npos) // nothing to escape
+        return makeToken(TokenType::String ,static_cast<uint32_t>(symbols().intern(content)));
 
-    std::string escapedStr = escapeString(view.substr(1 ,count - 2));
-    return Token{TokenType::String ,escapedStr ,atLine ,atColumn};
+    std::string escapedStr = escapeString(content);
+    return makeToken(TokenType::String ,static_cast<uint32_t>(symbols().intern(escapedStr)));
 }
 
 Token Lexer::lexOperator(const std::string_view view)
 {
-    auto it = std::find_if_not(view.begin() ,view.end()
-            ,[](char c) {return !std::isspace(c);});
-    size_t count = static_cast<size_t>(it - view.begin());
+    const auto op = matchOperator(view);
 
-    std::string_view substr(view.data(), count);
-    while(count > 0)
-    {
-        auto type = kOperators.find(substr);
+    if (op.key.empty())
+        throw std::runtime_error("FATAL: unintelligible gibberish at line " + std::to_string(atLine) + ".");
 
-        if (type != kOperators.end())
-        {
-            atColumn += count;
-            return Token{type->second, std::monostate(), atLine, atColumn};
-        }
-        count--;
-        substr.remove_suffix(1);
-    }
-    throw std::runtime_error("FATAL: unintelligible gibberish at line " + std::to_string(atLine) + ".");
+    atColumn += op.key.size();
+    return makeToken(op.type);
 }
 
 
-std::optional<Token> Lexer::tokenizeAtPosition()
+bool Lexer::readLine()
 {
-    // skip whitespaces
-    while (atColumn < line.size() && std::isspace(line[atColumn]))
-        atColumn++;
+    if (nextLineOffset >= text.size())
+        return false; // EOF
+
+    size_t end = text.find('\n' ,nextLineOffset);
+    if (end == std::string_view::npos)
+        end = text.size();
 
-    if (atColumn >= line.size())
+    line = text.substr(nextLineOffset ,end - nextLineOffset);
+    nextLineOffset = end + 1;
+    return true;
+}
+
+std::optional<Token> Lexer::tokenizeAtPosition()
+{
+    while (true)
     {
-        if (!std::getline(ifs ,line))
+        // skip whitespaces
+        atColumn += countWhitespace(line.substr(atColumn));
+
+        if (atColumn < line.size())
+            break;
+
+        if (!readLine())
             return std::nullopt; // EOF
         atLine++;
         atColumn = 0;
-        return tokenizeAtPosition();
     }
 
-    const std::string_view view {line.data() + atColumn};
+    const std::string_view view = line.substr(atColumn);
     const char ch = view[0];
 
-    if (std::isalpha(ch) || ch == '_')
+    if (isIdentifierStart(ch))
         return lexIdentifierOrToken(view);
 
-    else if (std::isdigit(ch))
+    else if (isDigit(ch))
         return lexNumber(view);
 
     else if (ch == '\'')
@@ -228,30 +255,65 @@ std::optional<Token> Lexer::tokenizeAtPosition()
 }
 
 
-std::optional<Token> Lexer::getNextToken()
+bool Lexer::fillLookahead(size_t count)
 {
-    if (nextToken)
+    if (lookaheadCount >= count)
+        return true;
+
+    // refill the whole buffer at once instead of one token per request
+    while (lookaheadCount < kLookahead && !isEOF && !lexError)
     {
-        auto token = nextToken;
-        nextToken.reset();
-        return token;
+        std::optional<Token> token;
+        try
+        {
+            token = tokenizeAtPosition();
+        }
+        catch (...)
+        {
+            lexError = std::current_exception();
+            break;
+        }
+
+        if (!token)
+        {
+            isEOF = true;
+            break;
+        }
+
+        lookahead[(lookaheadHead + lookaheadCount) & (kLookahead - 1)] = *token;
+        lookaheadCount++;
     }
 
-    return tokenizeAtPosition();
+    if (lookaheadCount >= count)
+        return true;
+    if (lexError)
+        std::rethrow_exception(lexError);
+    return false;
+}
+
+std::optional<Token> Lexer::getNextToken()
+{
+    if (!fillLookahead(1))
+        return std::nullopt; // EOF
+
+    Token token = lookahead[lookaheadHead];
+    lookaheadHead = (lookaheadHead + 1) & (kLookahead - 1);
+    lookaheadCount--;
+    return token;
 }
+
 std::optional<Token> Lexer::peekNextToken()
 {
-    if (!nextToken)
-    {
-        auto tempLine = line;
-        auto tempAtColumn = atColumn;
-        auto tempAtLine = atLine;
+    return peek(0);
+}
 
-        nextToken = getNextToken();
+std::optional<Token> Lexer::peek(size_t k)
+{
+    if (k >= kLookahead)
+        throw std::out_of_range("ERROR: lookahead of " + std::to_string(k) + " tokens is more than the lexer buffers.");
 
-        line = tempLine;
-        atColumn = tempAtColumn;
-        atLine = tempAtLine;
-    }
-    return nextToken;
+    if (!fillLookahead(k + 1))
+        return std::nullopt; // EOF
+
+    return lookahead[(lookaheadHead + k) & (kLookahead - 1)];
 }
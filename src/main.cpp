@@ -1,13 +1,103 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <exception>
+#include <filesystem>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "astfile.h"
+#include "compilecache.h"
 #include "compiler.h"
+#include "evaluator.h"
+#include "flatast.h"
 #include "lexer.h"
+#include "parallellexer.h"
 #include "parser.h"
+#include "source.h"
+#include "statementcache.h"
+#include "threadpool.h"
+#include "tokenpipeline.h"
+#include "vm.h"
+#include "x86backend.h"
 
-int main(int argc ,const char *argv[])
+// If statement is left for runtime once the Evaluator folded it, defines arent.
+static bool isRuntimeStatement(const Compiler::AST::ASTNode* statement)
 {
-    auto context = Compiler::generateCompilerContext(argc ,argv);
+    using Compiler::AST::NodeType;
+    switch (statement->getType())
+    {
+        case NodeType::VarDeclaration:
+        case NodeType::VarAllocation:
+        case NodeType::VarDefinition:
+        case NodeType::VarReference:
+        case NodeType::FunctionDefinition:
+            return static_cast<const Compiler::AST::VariableBase*>(statement)->isRuntime;
+        default:
+            return true;
+    }
+}
 
-    Compiler::Lexer lexer(context);
+// Parses and prints the tokens of one source file to Compiler::output().
+// With a result the statements are also collected into it, for the cache or --emit-ast.
+// With --eval the statements are evaluated and folded instead of printed, and the
+// folded ones are collected with the functions the Evaluator cloned for them, big
+// comprehensions are evaluated with threads threads.
+// With --run the folded runtime statements are run once the file compiled without errors,
+// with --emit-obj they are compiled to native code.
+// Returns false if the parser, the evaluator, the run or the backend logged errors.
+template <typename LexerT>
+static bool compileTokens(const Compiler::CompileContext& context ,LexerT& lexer ,Compiler::AST::CompiledAST* result ,unsigned threads)
+{
     Compiler::Parser parser(context);
+    Compiler::AST::FlatAST localAST;
+    auto& flatAST = result ? result->ast : localAST;
+    std::unique_ptr<Compiler::Evaluator> evaluator;
+    if (context.evaluate)
+        evaluator = std::make_unique<Compiler::Evaluator>(context ,threads);
+    std::vector<const Compiler::AST::ASTNode*> program; // for --run and --emit-obj
+    const bool isCollecting = context.run != Compiler::RunMode::None || context.emitObject;
+
+    auto emit = [&](Compiler::AST::ASTNode* node)
+    {
+        if (evaluator)
+        {
+            if (parser.hasErrors()) // what is left of a statement that didnt parse isnt evaluated
+                return;
+            // the functions it cloned go first, even if it failed they are whole
+            const bool isRun = evaluator->run(node);
+            for (auto* function : evaluator->takeSpecializations())
+            {
+                if (isCollecting)
+                    program.push_back(function);
+                if (result)
+                    flatAST.add(function);
+            }
+            if (isRun && node && isCollecting && isRuntimeStatement(node))
+                program.push_back(node);
+            if (result && node)
+                flatAST.add(node);
+            return;
+        }
+
+        if (!context.useFlatAST && !result)
+        {
+            Compiler::printASTNode(node);
+            return;
+        }
+
+        const auto root = flatAST.add(node);
+        if (context.useFlatAST)
+            Compiler::printFlatAST(flatAST ,root);
+        else
+            Compiler::printASTNode(node);
+    };
 
     while (auto optToken = lexer.getNextToken())
     {
@@ -17,14 +107,222 @@ int main(int argc ,const char *argv[])
         if (parser.statementReady())
         {
             auto node = parser.parse();
-            Compiler::printASTNode(node);
+            emit(node);
+            if (!evaluator) // functions the evaluator remembers point into the AST
+                parser.releaseAST();
         }
     }
+    if (result)
+        result->completeStatements = static_cast<uint32_t>(flatAST.roots.size());
     Compiler::log("end");
     if (parser.statementNotEmpty())
     {
         auto node = parser.parse();
-        Compiler::printASTNode(node);
+        emit(node);
     }
     // err if parser not empty
+    const bool isClean = parser.errorCount() == 0 && (!evaluator || evaluator->errorCount() == 0);
+    if (isClean && context.run != Compiler::RunMode::None && !Compiler::runProgram(context ,program))
+        return false;
+    if (isClean && context.emitObject)
+        return Compiler::emitObject(context ,program);
+    return isClean;
+}
+
+// With --pipeline the lexer runs on its own thread, ahead of the parser.
+template <typename LexerT ,typename... Args>
+static bool compileWith(const Compiler::CompileContext& context ,Compiler::AST::CompiledAST* result ,unsigned threads ,Args&&... args)
+{
+    if (context.usePipeline)
+    {
+        Compiler::TokenPipeline<LexerT> lexer(std::forward<Args>(args)...);
+        return compileTokens(context ,lexer ,result ,threads);
+    }
+    else
+    {
+        LexerT lexer(std::forward<Args>(args)...);
+        return compileTokens(context ,lexer ,result ,threads);
+    }
+}
+
+// --emit-ast=bin writes foo.src's AST to foo.ast
+static std::string astFilePath(const std::string& sourceFile)
+{
+    std::filesystem::path path(sourceFile);
+    if (path.extension() == ".ast") // dont overwrite the source
+        return sourceFile + ".ast";
+    return path.replace_extension(".ast").string();
+}
+
+// Big files are lexed, and big comprehensions evaluated, with threads threads.
+// With a cache, files compiled before arent lexed or parsed at all, and
+// compiles without errors are stored in it.
+// With --load-ast sourceFile is an AST file that is printed instead.
+// Returns false if the file couldnt be compiled or compileTokens() failed.
+static bool compileFile(const Compiler::CompileContext& context ,const std::string& sourceFile ,unsigned threads ,
+                        Compiler::CompileCache* cache = nullptr)
+{
+    try
+    {
+        std::error_code ec;
+        const auto size = std::filesystem::file_size(sourceFile ,ec);
+
+        if (context.checkLexer)
+            return Compiler::checkParallelLexer(context ,sourceFile ,std::max(threads ,2u));
+
+        if (context.loadAST)
+        {
+            Compiler::printASTFile(Compiler::AST::ASTFile(sourceFile).view());
+            return true;
+        }
+
+        Compiler::Hash128 key = 0;
+        if (cache)
+        {
+            key = cache->key(context ,Compiler::SourceBuffer(sourceFile).view());
+            if (auto cached = cache->load(key))
+            {
+                Compiler::printASTFile(cached->view());
+                if (context.emitAST) // the entry already has the file in it
+                    Compiler::AST::writeASTFile(astFilePath(sourceFile) ,cached->view().bytes());
+                return true;
+            }
+        }
+
+        Compiler::AST::CompiledAST result;
+        auto* collect = cache || context.emitAST ? &result : nullptr;
+
+        bool isClean;
+        if (threads > 1 && !ec && size >= Compiler::ParallelLexer::kMinFileSize)
+            isClean = compileWith<Compiler::ParallelLexer>(context ,collect ,threads ,context ,sourceFile ,threads);
+        else
+            isClean = compileWith<Compiler::Lexer>(context ,collect ,threads ,context ,sourceFile);
+
+        if (context.emitAST)
+            Compiler::AST::writeASTFile(astFilePath(sourceFile) ,Compiler::AST::encodeASTFile(result));
+        if (cache && isClean) // errors arent cached, they have to be reported every time
+            cache->store(key ,result);
+        return isClean;
+    }
+    catch (const std::exception& e)
+    {
+        Compiler::log(e.what());
+        if (context.emitAST && !context.loadAST) // dont leave an older AST file behind
+        {
+            std::error_code ec;
+            std::filesystem::remove(astFilePath(sourceFile) ,ec);
+        }
+        return false;
+    }
+}
+
+// --watch: recompiles a source file every time its modification time changes.
+// Only the edited statements are lexed, parsed and printed again. Never returns.
+[[noreturn]] static void watchFiles(const Compiler::CompileContext& context)
+{
+    struct WatchedFile
+    {
+        std::filesystem::file_time_type modified {};
+        bool isCompiled = false;
+        Compiler::StatementCache cache {};
+    };
+    std::vector<WatchedFile> files(context.sourceFiles.size());
+
+    while (true)
+    {
+        for (size_t i = 0; i < files.size(); i++)
+        {
+            auto& file = files[i];
+
+            std::error_code ec;
+            const auto modified = std::filesystem::last_write_time(context.sourceFiles[i] ,ec);
+            if (ec || (file.isCompiled && modified == file.modified))
+                continue;
+
+            Compiler::compileIncremental(context ,context.sourceFiles[i] ,file.cache);
+            std::cout.flush();
+
+            file.modified = modified;
+            file.isCompiled = true;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+}
+
+// Compiles every source file, with -j the files are compiled in parallel.
+// Returns false if any of them failed.
+static bool compileAll(const Compiler::CompileContext& context ,unsigned jobs ,Compiler::CompileCache* cache)
+{
+    bool isSuccess = true;
+
+    if (jobs == 1 || context.sourceFiles.size() == 1)
+    {
+        for (const auto& sourceFile : context.sourceFiles)
+            isSuccess &= compileFile(context ,sourceFile ,jobs ,cache);
+        return isSuccess;
+    }
+
+    // every file writes into its own buffer, buffers are printed in command line order
+    Compiler::ThreadPool pool(std::min<size_t>(jobs ,context.sourceFiles.size()));
+    std::vector<std::ostringstream> outputs(context.sourceFiles.size());
+    std::vector<std::future<bool>> results;
+
+    for (size_t i = 0; i < context.sourceFiles.size(); i++)
+    {
+        results.push_back(pool.submit([&context ,&outputs ,cache ,i]()
+        {
+            Compiler::OutputRedirect redirect(outputs[i]);
+            return compileFile(context ,context.sourceFiles[i] ,1 ,cache);
+        }));
+    }
+
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        isSuccess &= results[i].get();
+        std::cout << outputs[i].str();
+    }
+    return isSuccess;
+}
+
+int main(int argc ,const char *argv[])
+{
+    auto context = Compiler::generateCompilerContext(argc ,argv);
+
+    std::unique_ptr<Compiler::CompileCache> cache;
+    if (context.useCache || context.showCacheStats)
+    {
+        try
+        {
+            const auto directory = context.cacheDirectory.empty()
+                ? Compiler::CompileCache::defaultDirectory() : std::filesystem::path(context.cacheDirectory);
+            cache = std::make_unique<Compiler::CompileCache>(directory ,context.cacheMaxSize);
+        }
+        catch (const std::exception& e)
+        {
+            Compiler::log(e.what()); // compile without it
+        }
+    }
+
+    if (context.sourceFiles.empty())
+    {
+        if (context.showCacheStats && cache)
+        {
+            Compiler::printCacheStats(*cache);
+            return EXIT_SUCCESS;
+        }
+        Compiler::log("ERROR: No source files provided.");
+        return EXIT_FAILURE;
+    }
+
+    const unsigned jobs = context.jobs ? context.jobs : Compiler::defaultJobCount();
+
+    if (context.isWatching)
+        watchFiles(context);
+
+    // cache entries hold parsed statements, not evaluated ones
+    const bool isSuccess = compileAll(context ,jobs ,context.useCache && !context.evaluate ? cache.get() : nullptr);
+
+    if (context.showCacheStats && cache)
+        Compiler::printCacheStats(*cache);
+    return isSuccess ? EXIT_SUCCESS : EXIT_FAILURE;
 }
@@ -0,0 +1,172 @@
+#include <algorithm>
+#include <cstring>
+#include <exception>
+#include <future>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "compiler.h"
+#include "lexer.h"
+#include "parallellexer.h"
+
+using namespace Compiler;
+
+ParallelLexer::ParallelLexer(const CompileContext& ,const std::string& sourceFile ,unsigned threads)
+    : source_(sourceFile)
+    ,pool_(threads)
+{
+    splitChunks();
+
+    // line numbers: count the newlines of every chunk, then prefix sum
+    std::vector<std::future<size_t>> counts;
+    for (auto text : chunkTexts_)
+        counts.push_back(pool_.submit([text]() { return static_cast<size_t>(std::count(text.begin() ,text.end() ,'\n')); }));
+
+    size_t lines = 0;
+    for (auto& count : counts)
+    {
+        linesBefore_.push_back(lines);
+        lines += count.get();
+    }
+
+    submitChunks();
+}
+
+void ParallelLexer::splitChunks()
+{
+    const std::string_view text = source_.view();
+    size_t begin = 0;
+
+    while (begin < text.size())
+    {
+        size_t end = std::min(begin + kChunkSize ,text.size());
+        if (end < text.size())
+        {
+            size_t newline = text.find('\n' ,end);
+            end = (newline == std::string_view::npos) ? text.size() : newline + 1;
+        }
+        chunkTexts_.push_back(text.substr(begin ,end - begin));
+        begin = end;
+    }
+}
+
+void ParallelLexer::submitChunks()
+{
+    // keep a couple of chunks per thread in flight, so memory stays bounded
+    // when the consumer is slower than the lexers
+    while (nextChunk_ < chunkTexts_.size() && pending_.size() < 2 * pool_.size())
+    {
+        const auto text = chunkTexts_[nextChunk_];
+        const size_t linesBefore = linesBefore_[nextChunk_];
+        pending_.push_back(pool_.submit([text ,linesBefore]() { return lexChunk(text ,linesBefore); }));
+        nextChunk_++;
+    }
+}
+
+ParallelLexer::Chunk ParallelLexer::lexChunk(std::string_view text ,size_t linesBefore)
+{
+    Chunk chunk;
+    chunk.tokens.reserve(text.size() / 4);
+
+    Lexer lexer(text ,linesBefore);
+    try
+    {
+        while (auto token = lexer.getNextToken())
+            chunk.tokens.push_back(*token);
+    }
+    catch (...)
+    {
+        chunk.error = std::current_exception();
+    }
+    return chunk;
+}
+
+std::optional<Token> ParallelLexer::getNextToken()
+{
+    while (currentIndex_ == current_.tokens.size())
+    {
+        if (current_.error)
+        {
+            isDone_ = true; // nothing after an error is handed out
+            std::rethrow_exception(std::exchange(current_.error ,nullptr));
+        }
+
+        if (isDone_ || pending_.empty())
+            return std::nullopt; // EOF
+
+        current_ = pending_.front().get();
+        pending_.pop_front();
+        currentIndex_ = 0;
+        submitChunks();
+    }
+    return current_.tokens[currentIndex_++];
+}
+
+static bool isSameToken(const Token& a ,const Token& b)
+{
+    if (a.type != b.type || a.line != b.line || a.column != b.column)
+        return false;
+
+    switch (a.type)
+    {
+        case TokenType::Integer: // pool indices differ, compare the values
+            return a.intValue() == b.intValue();
+        case TokenType::Double: {
+            const Double_t x = a.doubleValue() ,y = b.doubleValue();
+            return std::memcmp(&x ,&y ,sizeof(Double_t)) == 0;
+        }
+        default:
+            return a.payload == b.payload;
+    }
+}
+
+bool Compiler::checkParallelLexer(const CompileContext& context ,const std::string& sourceFile ,unsigned threads)
+{
+    Lexer sequential(context ,sourceFile);
+    ParallelLexer parallel(context ,sourceFile ,threads);
+    size_t count = 0;
+
+    // an error has to come out of both at the same token
+    auto next = [](auto& lexer ,std::string& error) -> std::optional<Token>
+    {
+        try
+        {
+            return lexer.getNextToken();
+        }
+        catch (const std::exception& e)
+        {
+            error = e.what();
+            return std::nullopt;
+        }
+    };
+
+    while (true)
+    {
+        std::string sequentialError ,parallelError;
+        auto a = next(sequential ,sequentialError);
+        auto b = next(parallel ,parallelError);
+
+        if (!a || !b)
+        {
+            if (a || b || sequentialError != parallelError)
+            {
+                log("ERROR: parallel lexer differs after " + std::to_string(count) + " tokens"
+                        + (sequentialError.empty() ? "" : " (sequential: " + sequentialError + ")")
+                        + (parallelError.empty() ? "" : " (parallel: " + parallelError + ")") + ".");
+                return false;
+            }
+            log("parallel lexer matches on " + std::to_string(count) + " tokens.");
+            return true;
+        }
+
+        if (!isSameToken(*a ,*b))
+        {
+            log("ERROR: parallel lexer differs at token " + std::to_string(count) + ": "
+                    + getTokenKey(a->type) + " at " + getTokenPos(*a) + " vs "
+                    + getTokenKey(b->type) + " at " + getTokenPos(*b) + ".");
+            return false;
+        }
+        count++;
+    }
+}
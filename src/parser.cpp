@@ -1,17 +1,129 @@
 #include "parser.h"
 #include "astnode.h"
 #include "compiler.h"
+#include "hash.h"
 #include "token.h"
 
 #include <iostream>
-#include <memory>
+#include <limits>
 #include <string>
+#include <utility>
 #include <cassert>
 
 using namespace Compiler;
 
-Parser::Parser(const CompileContext& context)
+namespace {
+
+// Binding powers, higher binds tighter.
+enum Power : int
+{
+    kAssignPower = 1, // = += -= *= /= %=, right associative
+    kConditionPower,  // |
+    kOrPower,         // or xor
+    kAndPower,        // and
+    kNotPower,        // prefix not
+    kComparePower,    // == != < > <= >=
+    kRangePower,      // ..
+    kSumPower,        // + -
+    kProductPower,    // * / %
+    kPrefixPower,     // prefix - ++ --
+    kPostfixPower,    // calls, postfix ++ --, Set.x Set.[n]
+    kDomainPower,     // name@Domain
+};
+
+// power of type as an infix or postfix operator, 0 if it isnt one
+int infixPower(TokenType type)
+{
+    switch (type)
+    {
+        case TokenType::Assign:
+        case TokenType::PlusEquals:
+        case TokenType::MinusEquals:
+        case TokenType::MultiplicationEquals:
+        case TokenType::DivisionEquals:
+        case TokenType::ModuloEquals:
+            return kAssignPower;
+        case TokenType::Pipe:
+            return kConditionPower;
+        case TokenType::Or:
+        case TokenType::Xor:
+            return kOrPower;
+        case TokenType::And:
+            return kAndPower;
+        case TokenType::Equals:
+        case TokenType::NotEquals:
+        case TokenType::GreaterThan:
+        case TokenType::LessThan:
+        case TokenType::GreaterEquals:
+        case TokenType::LessEquals:
+            return kComparePower;
+        case TokenType::DoubleDot:
+            return kRangePower;
+        case TokenType::Plus:
+        case TokenType::Minus:
+            return kSumPower;
+        case TokenType::Multiplication:
+        case TokenType::Division:
+        case TokenType::Modulo:
+            return kProductPower;
+        case TokenType::LParen:
+        case TokenType::DoublePlus:
+        case TokenType::DoubleMinus:
+        case TokenType::Dot:
+            return kPostfixPower;
+        case TokenType::At:
+            return kDomainPower;
+        default:
+            return 0;
+    }
+}
+
+bool isLiteral(TokenType type)
+{
+    return type == TokenType::Integer || type == TokenType::Double
+        || type == TokenType::Char || type == TokenType::String;
+}
+
+bool startsExpression(TokenType type)
+{
+    switch (type)
+    {
+        case TokenType::Identifier:
+        case TokenType::Undefined:
+        case TokenType::Nan:
+        case TokenType::Null:
+        case TokenType::LParen:
+        case TokenType::Minus:
+        case TokenType::Not:
+        case TokenType::DoublePlus:
+        case TokenType::DoubleMinus:
+            return true;
+        default:
+            return isLiteral(type);
+    }
+}
+
+// sets a flag until the end of the scope
+class FlagScope
+{
+    public:
+        FlagScope(bool& flag ,bool value)
+            : flag_ (flag)
+            ,saved_ (std::exchange(flag ,value))
+        {}
+        ~FlagScope() { flag_ = saved_; }
+
+    private:
+        bool& flag_;
+        bool saved_;
+};
+
+} // namespace
+
+Parser::Parser(const CompileContext& context ,StatementCache* cache)
     : kMaxNestRange_ (context.maxNestRange)
+    ,cache_ (cache)
+    ,nodeArena_ (cache ? cache->arena() : arena_)
 {}
 
 void Parser::consume(Token token)
@@ -46,6 +158,9 @@ bool Parser::statementNotEmpty()
 
 const Token& Parser::currentToken() const
 {
+    static const Token kEndOfStream {}; // TokenType::Unknown, for statements that end early
+    if (currentIndex_ >= tokenStream_.size())
+        return kEndOfStream;
     return tokenStream_[currentIndex_];
 }
 
@@ -77,12 +192,40 @@ std::string Parser::strCurrentTokenType()
     return Compiler::getTokenKey(currentToken().type);
 }
 
+void Parser::error(const std::string& msg)
+{
+    hasErrors_ = true;
+    errorCount_++;
+    log(msg);
+}
+
+uint64_t Parser::hashStatement() const
+{
+    uint64_t hash = kHashSeed;
+    for (const Token& token : tokenStream_)
+    {
+        hash = hashValue(token.type ,hash);
+        switch (token.type)
+        {
+            case TokenType::Integer: // pool indices differ between compiles, values dont
+                hash = hashValue(token.intValue() ,hash);
+                break;
+            case TokenType::Double:
+                hash = hashValue(token.doubleValue() ,hash);
+                break;
+            default:
+                hash = hashValue(token.payload ,hash);
+        }
+    }
+    return hash;
+}
+
 bool Parser::expect(TokenType type)
 {
     bool isMatch = match(type);
     if (!isMatch)
     {
-        log ("ERROR: Token missmatch at line " + strCurrentTokenPos() + " - expected " + Compiler::getTokenKey(type) + " but got " + strCurrentTokenType() + ".");
+        error("ERROR: Token missmatch at line " + strCurrentTokenPos() + " - expected " + Compiler::getTokenKey(type) + " but got " + strCurrentTokenType() + ".");
     }
     return isMatch;
 }
@@ -91,47 +234,412 @@ bool Parser::expect(TokenType type)
 
 
 
-std::unique_ptr<AST::ASTNode> Parser::parseEmpty()
+AST::ASTNode* Parser::parseEmpty()
 {
     advance(); //skip ';'
-    return std::make_unique<AST::Empty>();
+    return nodeArena_.make<AST::Empty>();
 }
 
 
-std::unique_ptr<AST::Rvalue> Parser::parseRvalue()
+AST::Rvalue* Parser::parseRvalue()
     // { Set }
     // ( Set )
     // Expression
     // Value
 {
-    switch (currentTokenType())
+    // a set, a set value or a block is where an expression can start, so it can be an operand too
+    return parseExpression();
+}
+
+bool Parser::isBlockAhead()
+{
+    // a '{' starts a block if it has a ';' directly inside it
+    int depth = 0;
+    for (size_t i = currentIndex_; i < tokenStream_.size(); i++)
     {
-        case TokenType::LBrace: // Set
-        case TokenType::LParen: // Set value OR Expression
-            return parseSet();
-            break;
-        default:
+        switch (tokenStream_[i].type)
+        {
+            case TokenType::LBrace:
+                depth++;
+                break;
+            case TokenType::RBrace:
+                if (--depth == 0)
+                    return false;
+                break;
+            case TokenType::Semicolon:
+                if (depth == 1)
+                    return true;
+                break;
+            default:
+                break;
+        }
+    }
+    return false;
+}
+
+size_t Parser::elementLength(size_t i) const
+{
+    if (i < tokenStream_.size() && isLiteral(tokenStream_[i].type))
+        return 1;
+    const bool isNumber = i + 1 < tokenStream_.size()
+        && (tokenStream_[i + 1].type == TokenType::Integer || tokenStream_[i + 1].type == TokenType::Double);
+    return isNumber && tokenStream_[i].type == TokenType::Minus ? 2 : 0;
+}
+
+bool Parser::isComprehensionAhead()
+{
+    // a set of literals is {} or starts with one, anything else in braces is a comprehension
+    const size_t i = currentIndex_ + 1;
+    return i < tokenStream_.size() && tokenStream_[i].type != TokenType::RBrace && elementLength(i) == 0;
+}
 
+bool Parser::isSetValueAhead()
+{
+    // ( Literal ,Literal ,... ) is a set value, anything else in parentheses an expression
+    size_t i = currentIndex_ + 1;
+    size_t count = 0;
+    bool hasNegative = false;
+    while (i < tokenStream_.size() && tokenStream_[i].type != TokenType::RParen)
+    {
+        const size_t length = elementLength(i);
+        if (length == 0)
+            return false;
+        hasNegative |= length == 2;
+        count++;
+        i += length;
+        if (i < tokenStream_.size() && tokenStream_[i].type == TokenType::Comma)
+            i++;
+        else if (i >= tokenStream_.size() || tokenStream_[i].type != TokenType::RParen)
+            return false;
     }
+    // (-5) stays the expression -5
+    return i < tokenStream_.size() && (!hasNegative || count > 1);
 }
 
-std::unique_ptr<AST::Rvalue> Parser::parseSet()
+AST::Rvalue* Parser::parseSet()
+    // { Literal ,Literal ,... }
+    // ( Literal ,Literal ,... )
+    // with - before the numbers that are negative
 {
-    auto setNode = std::make_unique<AST::Set>();
+    if (match(TokenType::LBrace) && isBlockAhead())
+        return parseBlock();
+    if (match(TokenType::LBrace) && isComprehensionAhead())
+        return parseComprehension();
+
+    auto setNode = nodeArena_.make<AST::Set>(nodeArena_);
     setNode->isSetValue = currentTokenType() == TokenType::LParen; 
+    const TokenType closing = setNode->isSetValue ? TokenType::RParen : TokenType::RBrace;
 
     advance(); // skip '(' or '{'
 
-    for (auto token : tokenStream_)
-        if (token.type == TokenType::Semicolon)
-            return parseBlock();
+    while (!match(closing))
+    {
+        const bool isNegative = elementLength(currentIndex_) == 2;
+        if (isNegative)
+            advance(); // skip '-'
+        const Token& token = currentToken();
+        switch (token.type)
+        {
+            case TokenType::Integer:
+                setNode->elements.emplace_back(isNegative ? -token.intValue() : token.intValue());
+                break;
+            case TokenType::Double:
+                setNode->elements.emplace_back(isNegative ? -token.doubleValue() : token.doubleValue());
+                break;
+            case TokenType::Char:
+                setNode->elements.emplace_back(token.charValue());
+                break;
+            case TokenType::String:
+                setNode->elements.emplace_back(token.symbol());
+                break;
+            default:
+                error("ERROR: unsupported set element at line " + strCurrentTokenPos() + ": " + strCurrentTokenType() + ".");
+                return nullptr;
+        }
+        advance(); // skip element
+
+        if (match(TokenType::Comma))
+            advance(); // skip ','
+        else if (!expect(closing))
+            return nullptr;
+    }
+    advance(); // skip ')' or '}'
+
+    return setNode;
+}
+
+
+AST::Rvalue* Parser::parsePrefix()
+    // Literal, Identifier, undefined nan null
+    // ( Expression ), Set, Block
+    // - not ++ -- Expression
+{
+    const Token& token = currentToken();
+    switch (token.type)
+    {
+        case TokenType::Integer:
+            advance();
+            return nodeArena_.make<AST::Literal>(AST::Literal_t(token.intValue()));
+        case TokenType::Double:
+            advance();
+            return nodeArena_.make<AST::Literal>(AST::Literal_t(token.doubleValue()));
+        case TokenType::Char:
+            advance();
+            return nodeArena_.make<AST::Literal>(AST::Literal_t(token.charValue()));
+        case TokenType::String:
+            advance();
+            return nodeArena_.make<AST::Literal>(AST::Literal_t(token.symbol()));
+        case TokenType::Undefined:
+        case TokenType::Null:
+            advance();
+            return nodeArena_.make<AST::Literal>(AST::Literal_t());
+        case TokenType::Nan:
+            advance();
+            return nodeArena_.make<AST::Literal>(AST::Literal_t(std::numeric_limits<AST::Double_t>::quiet_NaN()));
+        case TokenType::Identifier:
+            advance();
+            return nodeArena_.make<AST::Lvalue>(token.symbol());
+        case TokenType::LParen: {
+            if (isSetValueAhead())
+                return parseSet();
+
+            FlagScope scope(isInList_ ,false);
+            advance(); // skip '('
+            auto inner = parseExpression();
+            if (!inner || !expect(TokenType::RParen))
+                return nullptr;
+            advance(); // skip ')'
+            return inner;
+        }
+        case TokenType::LBrace: {
+            FlagScope scope(isInList_ ,false);
+            return parseSet();
+        }
+        case TokenType::Minus:
+        case TokenType::Not:
+        case TokenType::DoublePlus:
+        case TokenType::DoubleMinus: {
+            advance(); // skip operator
+            auto operand = parseExpression(token.type == TokenType::Not ? kNotPower : kPrefixPower);
+            if (!operand)
+                return nullptr;
+            return nodeArena_.make<AST::Unary>(token.type ,false ,operand);
+        }
+        default:
+            error("ERROR: expected a value at line " + strCurrentTokenPos() + " but got " + strCurrentTokenType() + ".");
+            return nullptr;
+    }
+}
+
+AST::Rvalue* Parser::parseExpression(int minPower)
+{
+    AST::Rvalue* lhs = parsePrefix();
+
+    while (lhs)
+    {
+        const TokenType op = currentTokenType();
+        const int power = infixPower(op);
+        if (power <= minPower)
+            break;
+
+        switch (op)
+        {
+            case TokenType::LParen:
+                lhs = parseCall(lhs);
+                break;
+            case TokenType::Dot:
+                lhs = parseMember(lhs);
+                break;
+            case TokenType::DoublePlus:
+            case TokenType::DoubleMinus:
+                advance(); // skip operator
+                lhs = nodeArena_.make<AST::Unary>(op ,true ,lhs);
+                break;
+            case TokenType::Pipe: {
+                advance(); // skip '|'
+                auto rhs = parseExpression(kConditionPower);
+                if (!rhs)
+                    return nullptr;
+
+                AST::Rvalue* otherwise = nullptr;
+                if (match(TokenType::Comma) && !isInList_)
+                {
+                    advance(); // skip ','
+                    otherwise = parseExpression(kConditionPower - 1); // a | b ,c | d ,e nests to the right
+                    if (!otherwise)
+                        return nullptr;
+                }
+                lhs = nodeArena_.make<AST::Conditional>(lhs ,rhs ,otherwise);
+                break;
+            }
+            default: {
+                advance(); // skip operator
+                auto rhs = parseExpression(power == kAssignPower ? power - 1 : power);
+                if (!rhs)
+                    return nullptr;
+                lhs = nodeArena_.make<AST::Binary>(op ,lhs ,rhs);
+            }
+        }
+    }
+    return lhs;
+}
+
+AST::Rvalue* Parser::parseMember(AST::Rvalue* set)
+    // set . Identifier
+    // set . [ Expression ]
+{
+    advance(); // skip '.'
+
+    if (match(TokenType::Identifier))
+    {
+        const SymbolId variable = currentToken().symbol();
+        advance(); // skip Identifier
+        return nodeArena_.make<AST::Member>(set ,variable);
+    }
+
+    if (!expect(TokenType::LBracket))
+        return nullptr;
+    advance(); // skip '['
+
+    FlagScope scope(isInList_ ,false);
+    auto index = parseExpression();
+    if (!index || !expect(TokenType::RBracket))
+        return nullptr;
+    advance(); // skip ']'
+
+    return nodeArena_.make<AST::Index>(set ,index);
+}
+
+AST::Rvalue* Parser::parseComprehension()
+    // { Set.x | Expression } continuous/discrete
+    // { Set.x } continuous/discrete
+    // { Expression } continuous/discrete
+{
+    FlagScope scope(isInList_ ,false);
+    advance(); // skip '{'
+
+    auto inner = parseExpression();
+    if (!inner || !expect(TokenType::RBrace))
+        return nullptr;
+    advance(); // skip '}'
+
+    TokenType mode = TokenType::Unknown;
+    if (match(TokenType::Continuous) || match(TokenType::Discrete))
+    {
+        mode = currentTokenType();
+        advance(); // skip mode
+    }
+
+    AST::Member* source = nullptr;
+    AST::Rvalue* predicate = nullptr;
+    AST::Rvalue* element = inner;
+
+    auto* conditional = inner->getType() == AST::NodeType::Conditional ? static_cast<AST::Conditional*>(inner) : nullptr;
+    if (conditional && !conditional->otherwise && conditional->lhs->getType() == AST::NodeType::Member)
+    {
+        source = static_cast<AST::Member*>(conditional->lhs);
+        predicate = conditional->rhs;
+        element = nullptr;
+    }
+    else if (inner->getType() == AST::NodeType::Member)
+    {
+        source = static_cast<AST::Member*>(inner);
+        element = nullptr;
+    }
+
+    return nodeArena_.make<AST::Comprehension>(nodeArena_ ,source ,predicate ,element ,mode);
+}
+
+AST::Rvalue* Parser::parseCall(AST::Rvalue* callee)
+    // callee ( Expression ,Expression ,... )
+{
+    FlagScope scope(isInList_ ,true);
+    auto call = nodeArena_.make<AST::Call>(nodeArena_ ,callee);
+
+    advance(); // skip '('
+    while (!match(TokenType::RParen))
+    {
+        auto argument = parseExpression();
+        if (!argument)
+            return nullptr;
+        call->arguments.emplace_back(argument);
+
+        if (match(TokenType::Comma))
+            advance(); // skip ','
+        else if (!expect(TokenType::RParen))
+            return nullptr;
+    }
+    advance(); // skip ')'
+
+    return call;
+}
 
+AST::ASTNode* Parser::parseExpressionStatement()
+{
+    auto expression = parseExpression();
+    if (!expression || !expect(TokenType::Semicolon))
+        return nullptr;
+    advance(); // skip ';'
+    return expression;
 }
 
+AST::ASTNode* Parser::parseReturn()
+    // return ; or
+    // return Rvalue ;
+{
+    advance(); // skip 'return'
+
+    AST::Rvalue* value = nullptr;
+    if (!match(TokenType::Semicolon))
+    {
+        value = parseRvalue();
+        if (!value)
+            return nullptr;
+    }
+
+    if (!expect(TokenType::Semicolon))
+        return nullptr;
+    advance(); // skip ';'
+    return nodeArena_.make<AST::Return>(value);
+}
+
+bool Parser::parseParameters(AST::FunctionDefinition* function)
+    // ( Identifier ,Identifier : Type ,... )
+{
+    advance(); // skip '('
+    while (!match(TokenType::RParen))
+    {
+        if (!expect(TokenType::Identifier))
+            return false;
+        const SymbolId name = currentToken().symbol();
+        advance(); // skip Identifier
+
+        SymbolId type {};
+        bool hasType = false;
+        if (match(TokenType::Allocate)) // x : int
+        {
+            advance(); // skip ':'
+            if (!expect(TokenType::Identifier))
+                return false;
+            type = currentToken().symbol();
+            hasType = true;
+            advance(); // skip type
+        }
+        function->parameters.emplace_back(nodeArena_.make<AST::Parameter>(name ,type ,hasType));
+
+        if (match(TokenType::Comma))
+            advance(); // skip ','
+        else if (!expect(TokenType::RParen))
+            return false;
+    }
+    advance(); // skip ')'
+    return true;
+}
 
-std::unique_ptr<AST::ASTNode> Parser::parseVariable()
+AST::ASTNode* Parser::parseVariable()
     // Specifier Identifier ; or
     // Specifier Identifier <: = :=> expression or
+    // Specifier Identifier ( Parameters ) <: = :=> expression
 {
     TokenType varType = currentToken().type;
     advance(); // skip Specifier
@@ -140,17 +648,56 @@ std::unique_ptr<AST::ASTNode> Parser::parseVariable()
         return nullptr;
 
 
-    const std::string& name = std::get<std::string>(currentToken().value);
+    const SymbolId name = currentToken().symbol();
     advance(); // skip Identifier
 
-    // TODO domain, strong typing
+    // TODO strong typing
 
     bool isRuntime = (varType == TokenType::New);
 
+    // new x@domain is on domain, new x@ on the global one
+    bool hasDomain = false;
+    SymbolId domain {};
+    if (match(TokenType::At))
+    {
+        if (!isRuntime)
+        {
+            error("ERROR: only new variables can be put on a domain, at line " + strCurrentTokenPos() + ".");
+            return nullptr;
+        }
+        advance(); // skip '@'
+        hasDomain = true;
+        domain = symbols().intern("");
+        if (match(TokenType::Identifier))
+        {
+            domain = currentToken().symbol();
+            advance(); // skip domain
+        }
+    }
+    auto place = [&](AST::VariableBase* variable)
+    {
+        variable->hasDomain = hasDomain;
+        variable->domain = domain;
+        return variable;
+    };
+
     if (match(TokenType::Semicolon)) // empty decleration
     {
         advance(); // skip ';'
-        return std::make_unique<AST::VarDeclaration>(name ,isRuntime);
+        return place(nodeArena_.make<AST::VarDeclaration>(name ,isRuntime));
+    }
+
+    AST::FunctionDefinition* function = nullptr;
+    if (match(TokenType::LParen)) // function
+    {
+        if (hasDomain)
+        {
+            error("ERROR: functions cant be put on a domain, at line " + strCurrentTokenPos() + ".");
+            return nullptr;
+        }
+        function = nodeArena_.make<AST::FunctionDefinition>(nodeArena_ ,name ,isRuntime ,TokenType::Unknown ,nullptr);
+        if (!parseParameters(function))
+            return nullptr;
     }
 
     TokenType valueRelation = currentToken().type;
@@ -165,47 +712,78 @@ std::unique_ptr<AST::ASTNode> Parser::parseVariable()
     expect(TokenType::Semicolon);
     advance(); // skip ';'
 
+    if (function)
+    {
+        if (valueRelation != TokenType::Assign && valueRelation != TokenType::Allocate && valueRelation != TokenType::Reference)
+        {
+            error("ERROR: Invalid token \'" + Compiler::getTokenKey(valueRelation) + "\' at line " + strCurrentTokenPos() + ": use either \'=\' \'=\' or \':=\'.");
+            return nullptr;
+        }
+        function->relation = valueRelation;
+        function->value = value;
+        return function;
+    }
+
     switch (valueRelation)
     {
         case TokenType::Assign: // decleration and assignment
-            return std::make_unique<AST::VarDefinition>(
+            return place(nodeArena_.make<AST::VarDefinition>(
                     name
                     ,isRuntime
                     ,true
-                    ,std::move(value));
+                    ,value));
         case TokenType::Allocate: // decleration and allocation
-            return std::make_unique<AST::VarAllocation> (
+            return place(nodeArena_.make<AST::VarAllocation> (
                     name
                     ,isRuntime
                     ,true
-                    ,std::move(value));
+                    ,value));
         case TokenType::Reference: // decleration and reference
-            return std::make_unique<AST::VarReference> (
+            return place(nodeArena_.make<AST::VarReference> (
                     name
                     ,isRuntime
                     ,true
-                    ,std::move(value));
+                    ,value));
         default: // invalid next token
-            log ("ERROR: Invalid token \'" + Compiler::getTokenKey(valueRelation) + "\' at line " + strCurrentTokenPos() + ": use either \'=\' \'=\' or \':=\'.");
+            error("ERROR: Invalid token \'" + Compiler::getTokenKey(valueRelation) + "\' at line " + strCurrentTokenPos() + ": use either \'=\' \'=\' or \':=\'.");
             return nullptr;
     }
 }
 
-std::unique_ptr<AST::Block> Parser::parseBlock()
+AST::ASTNode* Parser::parseDomain()
+    // create Identifier ;
+    // delete Identifier ;
+{
+    const TokenType op = currentTokenType();
+    advance(); // skip 'create' or 'delete'
+
+    if (!expect(TokenType::Identifier))
+        return nullptr;
+    const SymbolId name = currentToken().symbol();
+    advance(); // skip Identifier
+
+    if (!expect(TokenType::Semicolon))
+        return nullptr;
+    advance(); // skip ';'
+    return nodeArena_.make<AST::Domain>(op ,name);
+}
+
+AST::Block* Parser::parseBlock()
 {
     if (nestLevel_ > kMaxNestRange_)
     {
-        log("ERROR: exceeded max nesting range of " + std::to_string(kMaxNestRange_) + " at line " + strCurrentTokenPos() + ".");
+        error("ERROR: exceeded max nesting range of " + std::to_string(kMaxNestRange_) + " at line " + strCurrentTokenPos() + ".");
         return nullptr;
     }
 
     if (!match(TokenType::LBrace))
     {
-        log("ERROR: expected '{' at line " + strCurrentTokenPos());
+        error("ERROR: expected '{' at line " + strCurrentTokenPos());
         return nullptr;
     }
 
-    auto block = std::make_unique<AST::Block>();
+    FlagScope scope(isInList_ ,false);
+    auto block = nodeArena_.make<AST::Block>(nodeArena_);
     std::string blockStartPos = strCurrentTokenPos();
 
     advance(); // skip '{'
@@ -216,7 +794,7 @@ std::unique_ptr<AST::Block> Parser::parseBlock()
     {
         if (isTokenStreamEmpty())
         {
-            log("ERROR: missing closing '}' for brace at line " + blockStartPos + ".");
+            error("ERROR: missing closing '}' for brace at line " + blockStartPos + ".");
             return nullptr;
         }
 
@@ -230,20 +808,17 @@ std::unique_ptr<AST::Block> Parser::parseBlock()
         auto node = getAST();
         if (!node)
         {
-            log("errors in this block"); // should err in getAST()
+            error("errors in this block"); // should err in getAST()
             return nullptr;
         }
 
-        block->ASTList.emplace_back(std::move(node));
+        block->ASTList.emplace_back(node);
     }
 
-
-    advance(); // consume '}'
-
-    return block;
+    return block; // closing '}' was skipped in the loop
 }
 
-std::unique_ptr<AST::ASTNode> Parser::getAST()
+AST::ASTNode* Parser::getAST()
 {
 
     switch (currentToken().type)
@@ -254,21 +829,54 @@ std::unique_ptr<AST::ASTNode> Parser::getAST()
         case TokenType::New:
             // Variable
             return parseVariable();
+        case TokenType::Create:
+        case TokenType::Delete:
+            return parseDomain();
         case TokenType::LBrace:
             return parseBlock();
+        case TokenType::Return:
+            return parseReturn();
         default:
+            if (startsExpression(currentToken().type))
+                return parseExpressionStatement();
             return nullptr;
     }
 }
 
-std::unique_ptr<AST::ASTNode> Parser::parse()
+AST::ASTNode* Parser::parse()
 {
-    auto node = getAST();
+    AST::ASTNode* node = nullptr;
+
+    wasCached_ = false;
+    hasErrors_ = false;
+
+    if (cache_)
+    {
+        hash_ = hashStatement();
+        node = cache_->find(hash_);
+        wasCached_ = node != nullptr;
+    }
+
+    if (!wasCached_)
+    {
+        const size_t bytesBefore = nodeArena_.bytesUsed();
+        node = getAST();
+
+        if (cache_ && node && !hasErrors_)
+            cache_->insert(hash_ ,node ,nodeArena_.bytesUsed() - bytesBefore);
+    }
 
     tokenStream_.clear();
     isStatementReady_ = false;
     currentIndex_ = 0;
+    nestLevel_ = 0; // parseBlock doesnt unwind it on errors
 
     return node;
 }
 
+void Parser::releaseAST()
+{
+    if (!cache_)
+        arena_.release();
+}
+
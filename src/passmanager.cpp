@@ -0,0 +1,74 @@
+#include <chrono>
+#include <iomanip>
+#include <sstream>
+#include <utility>
+
+#include "compiler.h"
+#include "passmanager.h"
+
+using namespace Compiler;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double millisecondsSince(Clock::time_point start)
+{
+    return std::chrono::duration<double ,std::milli>(Clock::now() - start).count();
+}
+
+void logTiming(const PassManager::Timing& timing)
+{
+    std::ostringstream line;
+    line << "pass " << timing.name << " " << std::fixed << std::setprecision(3) << timing.milliseconds << " ms";
+    if (timing.changes)
+        line << ", " << timing.changes << " changes";
+    log(line.str());
+}
+
+} // namespace
+
+void PassManager::add(std::string name ,Pass pass)
+{
+    passes_.emplace_back(std::move(name) ,pass);
+}
+
+void PassManager::run(SSA::Module& module)
+{
+    for (const auto& [name ,pass] : passes_)
+    {
+        const auto start = Clock::now();
+        size_t changes = 0;
+        for (SSA::Function& function : module.functions)
+            if (function.isSSA)
+                changes += pass(module ,function);
+        timings_.push_back(Timing{name ,millisecondsSince(start) ,changes});
+    }
+}
+
+Bytecode Compiler::optimize(const Bytecode& program ,bool isTimed)
+{
+    auto start = Clock::now();
+    SSA::Module module = SSA::build(program);
+    const PassManager::Timing building {"ssa" ,millisecondsSince(start) ,0};
+
+    PassManager passes;
+    passes.add("sccp" ,propagateConstants);
+    passes.add("gvn" ,numberValues);
+    passes.add("dce" ,eliminateDeadCode);
+    passes.run(module);
+
+    start = Clock::now();
+    const size_t before = program.code.size();
+    Bytecode optimized = SSA::lower(std::move(module));
+    const PassManager::Timing lowering {"lower" ,millisecondsSince(start) ,before - optimized.code.size()};
+
+    if (isTimed)
+    {
+        logTiming(building);
+        for (const auto& timing : passes.timings())
+            logTiming(timing);
+        logTiming(lowering);
+    }
+    return optimized;
+}
@@ -0,0 +1,200 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <variant>
+#include <vector>
+
+#include "rangesolver.h"
+
+using namespace Compiler;
+
+// if node reads variable, or could change anything when evaluated
+static bool dependsOn(const AST::Rvalue* node ,SymbolId variable)
+{
+    if (!node)
+        return false;
+
+    using AST::NodeType;
+    switch (node->getType())
+    {
+        case NodeType::Literal:
+        case NodeType::Set:
+            return false;
+        case NodeType::Lvalue:
+            return static_cast<const AST::Lvalue*>(node)->identifier == variable;
+        case NodeType::Unary: {
+            auto* unary = static_cast<const AST::Unary*>(node);
+            return unary->op == TokenType::DoublePlus || unary->op == TokenType::DoubleMinus || dependsOn(unary->operand ,variable);
+        }
+        case NodeType::Binary: {
+            auto* binary = static_cast<const AST::Binary*>(node);
+            if (binary->op == TokenType::At)
+                return false;
+            const bool isAssignment = binary->op == TokenType::Assign || binary->op == TokenType::PlusEquals
+                || binary->op == TokenType::MinusEquals || binary->op == TokenType::MultiplicationEquals
+                || binary->op == TokenType::DivisionEquals || binary->op == TokenType::ModuloEquals;
+            return isAssignment || dependsOn(binary->lhs ,variable) || dependsOn(binary->rhs ,variable);
+        }
+        case NodeType::Conditional: {
+            auto* conditional = static_cast<const AST::Conditional*>(node);
+            return dependsOn(conditional->lhs ,variable) || dependsOn(conditional->rhs ,variable) || dependsOn(conditional->otherwise ,variable);
+        }
+        case NodeType::Call: {
+            // define functions are pure, only the arguments matter
+            auto* call = static_cast<const AST::Call*>(node);
+            for (const auto* argument : call->arguments)
+                if (dependsOn(argument ,variable))
+                    return true;
+            return false;
+        }
+        case NodeType::Index: {
+            auto* index = static_cast<const AST::Index*>(node);
+            return dependsOn(index->set ,variable) || dependsOn(index->index ,variable);
+        }
+        default: // blocks, nested comprehensions
+            return true;
+    }
+}
+
+static bool isBoundOperator(TokenType op)
+{
+    return op == TokenType::Equals || op == TokenType::GreaterThan || op == TokenType::GreaterEquals
+        || op == TokenType::LessThan || op == TokenType::LessEquals;
+}
+
+// a < x is x > a
+static TokenType mirror(TokenType op)
+{
+    switch (op)
+    {
+        case TokenType::GreaterThan: return TokenType::LessThan;
+        case TokenType::GreaterEquals: return TokenType::LessEquals;
+        case TokenType::LessThan: return TokenType::GreaterThan;
+        case TokenType::LessEquals: return TokenType::GreaterEquals;
+        default: return op;
+    }
+}
+
+static bool isVariable(const AST::Rvalue* node ,SymbolId variable)
+{
+    return node->getType() == AST::NodeType::Lvalue && static_cast<const AST::Lvalue*>(node)->identifier == variable;
+}
+
+static void split(const AST::Rvalue* conjunct ,SymbolId variable ,RangePlan& plan)
+{
+    if (conjunct->getType() == AST::NodeType::Binary)
+    {
+        auto* binary = static_cast<const AST::Binary*>(conjunct);
+        if (binary->op == TokenType::And)
+        {
+            split(binary->lhs ,variable ,plan);
+            split(binary->rhs ,variable ,plan);
+            return;
+        }
+
+        if (isBoundOperator(binary->op))
+        {
+            if (isVariable(binary->lhs ,variable) && !dependsOn(binary->rhs ,variable))
+            {
+                plan.bounds.push_back({binary->op ,binary->rhs});
+                return;
+            }
+            if (isVariable(binary->rhs ,variable) && !dependsOn(binary->lhs ,variable))
+            {
+                plan.bounds.push_back({mirror(binary->op) ,binary->lhs});
+                return;
+            }
+        }
+    }
+    plan.filters.push_back(conjunct);
+}
+
+RangePlan Compiler::planRange(const AST::Rvalue* predicate ,SymbolId variable)
+{
+    RangePlan plan;
+    if (predicate)
+        split(predicate ,variable ,plan);
+    return plan;
+}
+
+bool RangePlan::hasLowerBound() const
+{
+    for (const auto& bound : bounds)
+        if (bound.op == TokenType::Equals || bound.op == TokenType::GreaterThan || bound.op == TokenType::GreaterEquals)
+            return true;
+    return false;
+}
+
+bool RangePlan::hasUpperBound() const
+{
+    for (const auto& bound : bounds)
+        if (bound.op == TokenType::Equals || bound.op == TokenType::LessThan || bound.op == TokenType::LessEquals)
+            return true;
+    return false;
+}
+
+bool IntRange::narrow(TokenType op ,const Value& value)
+{
+    constexpr Int_t kMin = std::numeric_limits<Int_t>::min();
+    constexpr Int_t kMax = std::numeric_limits<Int_t>::max();
+    auto clear = [this]()
+    {
+        first = kMax;
+        last = kMin;
+        return true;
+    };
+
+    if (std::holds_alternative<std::monostate>(value))
+        return clear();
+    if (!isNumber(value))
+        return false;
+
+    // the smallest int >= value and the largest int <= value, clamped to Int_t
+    Int_t ceiling ,floor;
+    bool isWhole = true;
+    if (auto* d = std::get_if<Double_t>(&value))
+    {
+        if (std::isnan(*d)) // compares to nothing
+            return clear();
+        if (op == TokenType::Equals && (*d >= 0x1p63 || *d < -0x1p63)) // no Int_t is equal to it
+            return clear();
+
+        auto clamp = [](Double_t whole) { return whole >= 0x1p63 ? kMax : whole < -0x1p63 ? kMin : static_cast<Int_t>(whole); };
+        isWhole = std::ceil(*d) == std::floor(*d);
+        ceiling = clamp(std::ceil(*d));
+        floor = clamp(std::floor(*d));
+    }
+    else
+    {
+        ceiling = floor = std::holds_alternative<Int_t>(value) ? std::get<Int_t>(value)
+            : static_cast<Int_t>(static_cast<unsigned char>(std::get<Char_t>(value)));
+    }
+
+    switch (op)
+    {
+        case TokenType::Equals:
+            if (!isWhole)
+                return clear();
+            first = std::max(first ,ceiling);
+            last = std::min(last ,floor);
+            return true;
+        case TokenType::GreaterThan:
+            if (isWhole && floor == kMax)
+                return clear();
+            first = std::max(first ,isWhole ? floor + 1 : ceiling);
+            return true;
+        case TokenType::GreaterEquals:
+            first = std::max(first ,ceiling);
+            return true;
+        case TokenType::LessThan:
+            if (isWhole && ceiling == kMin)
+                return clear();
+            last = std::min(last ,isWhole ? ceiling - 1 : floor);
+            return true;
+        case TokenType::LessEquals:
+            last = std::min(last ,floor);
+            return true;
+        default:
+            return false;
+    }
+}
@@ -0,0 +1,224 @@
+#include <algorithm>
+#include <variant>
+#include <vector>
+
+#include "recursion.h"
+
+using namespace Compiler;
+
+namespace {
+
+// if visit holds for node or a node inside it
+template <typename F>
+bool anyNode(const AST::ASTNode* node ,F& visit)
+{
+    if (!node)
+        return false;
+    if (visit(node))
+        return true;
+
+    auto any = [&](const AST::ASTNode* inner) { return anyNode(inner ,visit); };
+    using AST::NodeType;
+    switch (node->getType())
+    {
+        case NodeType::Unary:
+            return any(static_cast<const AST::Unary*>(node)->operand);
+        case NodeType::Binary: {
+            auto* binary = static_cast<const AST::Binary*>(node);
+            return any(binary->lhs) || any(binary->rhs);
+        }
+        case NodeType::Conditional: {
+            auto* conditional = static_cast<const AST::Conditional*>(node);
+            return any(conditional->lhs) || any(conditional->rhs) || any(conditional->otherwise);
+        }
+        case NodeType::Call: {
+            auto* call = static_cast<const AST::Call*>(node);
+            return any(call->callee) || std::any_of(call->arguments.begin() ,call->arguments.end() ,any);
+        }
+        case NodeType::Member:
+            return any(static_cast<const AST::Member*>(node)->set);
+        case NodeType::Index: {
+            auto* index = static_cast<const AST::Index*>(node);
+            return any(index->set) || any(index->index);
+        }
+        case NodeType::Comprehension: {
+            auto* comprehension = static_cast<const AST::Comprehension*>(node);
+            return any(comprehension->source) || any(comprehension->predicate) || any(comprehension->element);
+        }
+        case NodeType::Block: {
+            auto* block = static_cast<const AST::Block*>(node);
+            return std::any_of(block->ASTList.begin() ,block->ASTList.end() ,any);
+        }
+        case NodeType::VarDeclaration:
+        case NodeType::VarDefinition:
+        case NodeType::VarAllocation:
+        case NodeType::VarReference:
+        case NodeType::FunctionDefinition:
+            return any(static_cast<const AST::VariableBase*>(node)->value);
+        case NodeType::Return:
+            return any(static_cast<const AST::Return*>(node)->value);
+        default:
+            return false;
+    }
+}
+
+bool isArithmetic(TokenType op)
+{
+    return op == TokenType::Plus || op == TokenType::Minus || op == TokenType::Multiplication
+        || op == TokenType::Division || op == TokenType::Modulo;
+}
+
+bool isName(const AST::ASTNode* node ,SymbolId name)
+{
+    return node && node->getType() == AST::NodeType::Lvalue && static_cast<const AST::Lvalue*>(node)->identifier == name;
+}
+
+bool isParameter(const AST::ASTNode* node ,const AST::FunctionDefinition* function)
+{
+    return std::any_of(function->parameters.begin() ,function->parameters.end()
+        ,[&](const AST::Parameter* parameter) { return isName(node ,parameter->name); });
+}
+
+// argument is parameter, or an int parameter plus or minus an int literal
+bool isReversibleArgument(const AST::Rvalue* argument ,const AST::Parameter* parameter)
+{
+    if (isName(argument ,parameter->name))
+        return true;
+    if (argument->getType() != AST::NodeType::Binary)
+        return false;
+
+    auto* binary = static_cast<const AST::Binary*>(argument);
+    const bool isInt = parameter->hasType && symbols().lookup(parameter->type) == "int";
+    return isInt && (binary->op == TokenType::Plus || binary->op == TokenType::Minus) && isName(binary->lhs ,parameter->name)
+        && binary->rhs->getType() == AST::NodeType::Literal
+        && std::holds_alternative<AST::Int_t>(static_cast<const AST::Literal*>(binary->rhs)->value);
+}
+
+} // namespace
+
+bool Recursion::isBranch(const AST::Rvalue* node) const
+{
+    return std::find(branches.begin() ,branches.end() ,node) != branches.end();
+}
+
+const AST::Call* Recursion::callOf(const AST::Rvalue* node) const
+{
+    if (!node || node->getType() != AST::NodeType::Call)
+        return nullptr;
+    auto* call = static_cast<const AST::Call*>(node);
+    return isName(call->callee ,name) ? call : nullptr;
+}
+
+Recursion Compiler::findRecursion(const AST::FunctionDefinition* function)
+{
+    Recursion recursion;
+    recursion.name = function->name;
+    if (function->relation != TokenType::Assign || !function->value
+        || std::any_of(function->parameters.begin() ,function->parameters.end() ,[&](const AST::Parameter* parameter) { return parameter->name == function->name; }))
+        return Recursion();
+
+    const AST::Rvalue* value = function->value;
+    if (value->getType() == AST::NodeType::Block)
+    {
+        auto* block = static_cast<const AST::Block*>(value);
+        if (block->ASTList.size() != 1 || block->ASTList[0]->getType() != AST::NodeType::Return)
+            return Recursion();
+        value = static_cast<const AST::Return*>(block->ASTList[0])->value;
+        if (!value)
+            return Recursion();
+    }
+    recursion.value = value;
+
+    auto isCall = [&](const AST::ASTNode* node) { return AST::isExpression(node->getType()) && recursion.callOf(static_cast<const AST::Rvalue*>(node)); };
+    auto callsItself = [&](const AST::ASTNode* node) { return anyNode(node ,isCall); };
+    auto isLeafCall = [&](const AST::Call* call)
+    {
+        return call && call->arguments.size() == function->parameters.size()
+            && std::none_of(call->arguments.begin() ,call->arguments.end() ,callsItself);
+    };
+
+    size_t tails = 0;
+    size_t bases = 0;
+    std::vector<const AST::Rvalue*> work {value};
+    while (!work.empty())
+    {
+        const AST::Rvalue* node = work.back();
+        work.pop_back();
+
+        if (const AST::Call* call = recursion.callOf(node))
+        {
+            if (!isLeafCall(call))
+                return Recursion();
+            tails++;
+            continue;
+        }
+        if (node->getType() == AST::NodeType::Conditional && static_cast<const AST::Conditional*>(node)->otherwise && callsItself(node))
+        {
+            auto* conditional = static_cast<const AST::Conditional*>(node);
+            if (callsItself(conditional->rhs))
+                return Recursion();
+            recursion.branches.push_back(conditional);
+            work.push_back(conditional->otherwise);
+            work.push_back(conditional->lhs);
+            continue;
+        }
+        if (node->getType() == AST::NodeType::Binary && isArithmetic(static_cast<const AST::Binary*>(node)->op) && !recursion.step)
+        {
+            auto* binary = static_cast<const AST::Binary*>(node);
+            const bool isCallFirst = recursion.callOf(binary->lhs) != nullptr;
+            const AST::Call* call = recursion.callOf(isCallFirst ? binary->lhs : binary->rhs);
+            if (isLeafCall(call) && !callsItself(isCallFirst ? binary->rhs : binary->lhs))
+            {
+                recursion.step = binary;
+                recursion.isCallFirst = isCallFirst;
+                continue;
+            }
+        }
+        if (callsItself(node))
+            return Recursion();
+        bases++;
+    }
+
+    // without a leaf that stops it the function never returns, its calls fail
+    // once they nest too deep
+    if (bases == 0)
+        return Recursion();
+    if (tails > 0 && !recursion.step)
+        recursion.kind = Recursion::Kind::Tail;
+    else if (tails == 0 && recursion.step)
+        recursion.kind = Recursion::Kind::Linear;
+    else
+        return Recursion();
+
+    if (recursion.kind == Recursion::Kind::Linear)
+    {
+        const AST::Call* call = recursion.stepCall();
+        bool isReversible = recursion.isCallFirst || isParameter(recursion.stepOperand() ,function)
+            || recursion.stepOperand()->getType() == AST::NodeType::Literal;
+        for (size_t i = 0; i < call->arguments.size(); i++)
+            isReversible &= isReversibleArgument(call->arguments[i] ,function->parameters[i]);
+
+        // a reference could assign one too
+        auto isAssignment = [&](const AST::ASTNode* node)
+        {
+            if (node->getType() == AST::NodeType::VarReference)
+                return true;
+            if (node->getType() == AST::NodeType::Unary)
+            {
+                auto* unary = static_cast<const AST::Unary*>(node);
+                return (unary->op == TokenType::DoublePlus || unary->op == TokenType::DoubleMinus) && isParameter(unary->operand ,function);
+            }
+            if (node->getType() == AST::NodeType::Binary)
+            {
+                auto* binary = static_cast<const AST::Binary*>(node);
+                const bool isAssign = binary->op == TokenType::Assign || binary->op == TokenType::PlusEquals
+                    || binary->op == TokenType::MinusEquals || binary->op == TokenType::MultiplicationEquals
+                    || binary->op == TokenType::DivisionEquals || binary->op == TokenType::ModuloEquals;
+                return isAssign && isParameter(binary->lhs ,function);
+            }
+            return false;
+        };
+        recursion.isReversible = isReversible && !anyNode(value ,isAssignment);
+    }
+    return recursion;
+}
@@ -0,0 +1,395 @@
+#include <algorithm>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "evaluator.h"
+#include "passmanager.h"
+
+using namespace Compiler;
+using namespace Compiler::SSA;
+
+namespace {
+
+using Op = Bytecode::Op;
+
+// what a value is known to be: nothing yet (it may never be written), one
+// constant, or not a constant
+struct Cell
+{
+    enum class State : uint8_t { Unknown ,Constant ,Varying };
+
+    State state = State::Unknown;
+    Value value {};
+};
+
+TokenType tokenOf(Op op)
+{
+    switch (op)
+    {
+        case Op::Add: case Op::AddConst: case Op::Increment: return TokenType::Plus;
+        case Op::Subtract: case Op::SubtractConst: case Op::Decrement: return TokenType::Minus;
+        case Op::Multiply: return TokenType::Multiplication;
+        case Op::Divide: return TokenType::Division;
+        case Op::Modulo: return TokenType::Modulo;
+        case Op::Equal: case Op::JumpUnlessEqual: case Op::JumpUnlessEqualConst: return TokenType::Equals;
+        case Op::NotEqual: case Op::JumpUnlessNotEqual: case Op::JumpUnlessNotEqualConst: return TokenType::NotEquals;
+        case Op::Less: case Op::JumpUnlessLess: case Op::JumpUnlessLessConst: return TokenType::LessThan;
+        case Op::LessEqual: case Op::JumpUnlessLessEqual: case Op::JumpUnlessLessEqualConst: return TokenType::LessEquals;
+        case Op::Greater: case Op::JumpUnlessGreater: case Op::JumpUnlessGreaterConst: return TokenType::GreaterThan;
+        case Op::GreaterEqual: case Op::JumpUnlessGreaterEqual: case Op::JumpUnlessGreaterEqualConst: return TokenType::GreaterEquals;
+        default: return TokenType::Unknown;
+    }
+}
+
+// the instructions fold() can compute
+bool isFoldable(Op op)
+{
+    return op == Op::Move || op == Op::LoadConst || (op >= Op::Add && op <= Op::Decrement) || op == Op::CallBuiltin;
+}
+
+bool isDefined(const Value& value)
+{
+    return !std::holds_alternative<std::monostate>(value);
+}
+
+// what the VM computes for the instruction on operands, nothing if it could
+// fail, or if it or its operands are undefined where native code has 0
+std::optional<Value> fold(const Bytecode& program ,const Bytecode::Instruction& code ,const std::vector<Value>& operands)
+{
+    auto constant = [&](uint32_t index) { return toValue(program.constants[index]); };
+    try
+    {
+        Value result;
+        switch (code.op)
+        {
+            case Op::Move: result = operands[0]; break;
+            case Op::LoadConst: result = constant(code.target); break;
+            case Op::Add:
+            case Op::Subtract:
+            case Op::Multiply:
+            case Op::Divide:
+            case Op::Modulo:
+            case Op::Equal:
+            case Op::NotEqual:
+            case Op::Less:
+            case Op::LessEqual:
+            case Op::Greater:
+            case Op::GreaterEqual:
+                result = applyBinary(tokenOf(code.op) ,operands[0] ,operands[1]);
+                break;
+            case Op::AddConst:
+            case Op::SubtractConst:
+                if (!isDefined(constant(code.c)))
+                    return std::nullopt;
+                result = applyBinary(tokenOf(code.op) ,operands[0] ,constant(code.c));
+                break;
+            case Op::Increment:
+            case Op::Decrement:
+                result = applyBinary(tokenOf(code.op) ,operands[0] ,Int_t(1));
+                break;
+            case Op::Negate:
+                if (auto* d = std::get_if<Double_t>(&operands[0]))
+                    result = -*d;
+                else
+                    result = applyBinary(TokenType::Minus ,Int_t(0) ,operands[0]);
+                break;
+            case Op::Not: result = Int_t(!isTruthy(operands[0])); break;
+            case Op::Truth: result = Int_t(isTruthy(operands[0])); break;
+            case Op::CallBuiltin:
+            {
+                const bool isPow = static_cast<Bytecode::Builtin>(code.target) == Bytecode::Builtin::Pow;
+                result = callBuiltin(isPow ? "pow" : "abs" ,operands);
+                // native code fails for a negative exponent instead
+                const bool isIntPow = isPow && std::all_of(operands.begin() ,operands.end()
+                    ,[](const Value& operand) { return !std::holds_alternative<Double_t>(operand); });
+                if (isIntPow && std::holds_alternative<Double_t>(result))
+                    return std::nullopt;
+                break;
+            }
+            default:
+                return std::nullopt;
+        }
+        if (!isDefined(result))
+            return std::nullopt;
+        toRuntimeValue(result); // fails for sets
+        return result;
+    }
+    catch (const std::exception&)
+    {
+        return std::nullopt;
+    }
+}
+
+// if a conditional jump is taken on operands, nothing if that cant be known
+std::optional<bool> isTaken(const Bytecode& program ,const Bytecode::Instruction& code ,const std::vector<Value>& operands)
+{
+    switch (code.op)
+    {
+        case Op::JumpIfFalse: return !isTruthy(operands[0]);
+        case Op::JumpIfTrue: return isTruthy(operands[0]);
+        default: break;
+    }
+
+    const bool isConstant = code.op >= Op::JumpUnlessEqualConst;
+    const Value rhs = isConstant ? toValue(program.constants[code.b]) : operands[1];
+    if (!isDefined(rhs))
+        return std::nullopt;
+    try
+    {
+        return !isTruthy(applyBinary(tokenOf(code.op) ,operands[0] ,rhs));
+    }
+    catch (const std::exception&)
+    {
+        return std::nullopt;
+    }
+}
+
+struct Propagation
+{
+    const Bytecode& program;
+    Function& function;
+    std::vector<Cell> cells;
+    std::vector<std::vector<std::pair<uint32_t ,uint32_t>>> users {}; // the blocks and instructions that read each value, kNone for its phis
+    std::vector<bool> isExecutable;
+    std::vector<std::pair<bool ,bool>> edges; // the ones to next and target that can be taken
+    std::vector<uint32_t> blockWork {};
+    std::vector<uint32_t> valueWork {};
+
+    Propagation(const Bytecode& program ,Function& function)
+        : program (program)
+        ,function (function)
+        ,cells (function.values.size())
+        ,users (function.values.size())
+        ,isExecutable (function.blocks.size())
+        ,edges (function.blocks.size())
+    {
+        const auto& blocks = function.blocks;
+        for (uint32_t b = 0; b < blocks.size(); b++)
+        {
+            if (blocks[b].isDead)
+                continue;
+            for (const Phi& phi : blocks[b].phis)
+                for (uint32_t value : phi.incoming)
+                    if (value != kNone)
+                        users[value].emplace_back(b ,kNone);
+            for (uint32_t i = 0; i < blocks[b].instructions.size(); i++)
+                for (uint32_t value : blocks[b].instructions[i].uses)
+                    if (value != kNone)
+                        users[value].emplace_back(b ,i);
+        }
+        const uint16_t parameterCount = program.functions[function.index].parameterCount;
+        for (uint32_t value = 0; value < parameterCount; value++)
+            cells[value].state = Cell::State::Varying;
+    }
+
+    const Cell& cellOf(uint32_t value) const
+    {
+        static const Cell kVarying {Cell::State::Varying ,Value()};
+        return value == kNone ? kVarying : cells[value];
+    }
+
+    void lower(uint32_t value ,const Cell& cell)
+    {
+        Cell& old = cells[value];
+        if (cell.state == Cell::State::Unknown || old.state == Cell::State::Varying)
+            return;
+        if (old.state == Cell::State::Constant && cell.state == Cell::State::Constant && isSame(old.value ,cell.value))
+            return;
+        old.state = old.state == Cell::State::Unknown ? cell.state : Cell::State::Varying; // two constants meet
+        if (old.state == Cell::State::Constant)
+            old.value = cell.value;
+        valueWork.push_back(value);
+    }
+
+    void takeEdge(uint32_t from ,bool isTarget)
+    {
+        bool& isTaken = isTarget ? edges[from].second : edges[from].first;
+        if (isTaken)
+            return;
+        isTaken = true;
+        const uint32_t to = isTarget ? function.blocks[from].target : function.blocks[from].next;
+        if (!isExecutable[to])
+        {
+            isExecutable[to] = true;
+            blockWork.push_back(to);
+            return;
+        }
+        for (const Phi& phi : function.blocks[to].phis)
+            visitPhi(to ,phi);
+    }
+
+    bool isEdgeTaken(uint32_t from ,uint32_t to) const
+    {
+        const Block& block = function.blocks[from];
+        return (block.next == to && edges[from].first) || (block.target == to && edges[from].second);
+    }
+
+    void visitPhi(uint32_t b ,const Phi& phi)
+    {
+        const Block& block = function.blocks[b];
+        Cell cell;
+        for (size_t k = 0; k < block.predecessors.size(); k++)
+        {
+            if (!isEdgeTaken(block.predecessors[k] ,b))
+                continue;
+            const Cell& incoming = cellOf(phi.incoming[k]);
+            if (incoming.state == Cell::State::Unknown)
+                continue;
+            if (cell.state == Cell::State::Unknown)
+                cell = incoming;
+            else if (incoming.state == Cell::State::Varying || !isSame(cell.value ,incoming.value))
+                cell.state = Cell::State::Varying;
+            if (cell.state == Cell::State::Varying)
+                break;
+        }
+        lower(phi.def ,cell);
+    }
+
+    // the operands if they are all constants, Unknown or Varying if one is
+    Cell::State operandsOf(const Instruction& instruction ,std::vector<Value>& operands) const
+    {
+        Cell::State state = Cell::State::Constant;
+        for (uint32_t value : instruction.uses)
+        {
+            const Cell& cell = cellOf(value);
+            if (cell.state == Cell::State::Varying)
+                return Cell::State::Varying;
+            if (cell.state == Cell::State::Unknown)
+                state = Cell::State::Unknown;
+            else
+                operands.push_back(cell.value);
+        }
+        return state;
+    }
+
+    void visitInstruction(uint32_t b ,uint32_t i)
+    {
+        const Block& block = function.blocks[b];
+        const Instruction& instruction = block.instructions[i];
+        std::vector<Value> operands;
+        const Cell::State state = operandsOf(instruction ,operands);
+
+        if (instruction.def != kNone)
+        {
+            Cell cell {isFoldable(instruction.code.op) ? state : Cell::State::Varying};
+            if (cell.state == Cell::State::Constant)
+            {
+                auto value = fold(program ,instruction.code ,operands);
+                cell = value ? Cell{Cell::State::Constant ,std::move(*value)} : Cell{Cell::State::Varying};
+            }
+            lower(instruction.def ,cell);
+        }
+
+        if (i + 1 < block.instructions.size())
+            return;
+        const Op op = instruction.code.op;
+        if (op == Op::Jump)
+            takeEdge(b ,true);
+        else if (Bytecode::isJump(op))
+        {
+            if (state == Cell::State::Unknown)
+                return;
+            const auto taken = state == Cell::State::Constant ? isTaken(program ,instruction.code ,operands) : std::nullopt;
+            if (!taken || *taken)
+                takeEdge(b ,true);
+            if (!taken || !*taken)
+                takeEdge(b ,false);
+        }
+        else if (block.next != kNone)
+            takeEdge(b ,false);
+    }
+
+    void run()
+    {
+        isExecutable[0] = true;
+        blockWork.push_back(0);
+        while (!blockWork.empty() || !valueWork.empty())
+        {
+            while (!blockWork.empty())
+            {
+                const uint32_t b = blockWork.back();
+                blockWork.pop_back();
+                for (const Phi& phi : function.blocks[b].phis)
+                    visitPhi(b ,phi);
+                for (uint32_t i = 0; i < function.blocks[b].instructions.size(); i++)
+                    visitInstruction(b ,i);
+            }
+            if (valueWork.empty())
+                continue;
+            const uint32_t value = valueWork.back();
+            valueWork.pop_back();
+            for (const auto& [b ,i] : users[value])
+            {
+                if (!isExecutable[b])
+                    continue;
+                if (i != kNone)
+                {
+                    visitInstruction(b ,i);
+                    continue;
+                }
+                for (const Phi& phi : function.blocks[b].phis)
+                    if (std::find(phi.incoming.begin() ,phi.incoming.end() ,value) != phi.incoming.end())
+                        visitPhi(b ,phi);
+            }
+        }
+    }
+};
+
+} // namespace
+
+size_t Compiler::propagateConstants(Module& module ,Function& function)
+{
+    Propagation propagation(module.program ,function);
+    propagation.run();
+
+    size_t changes = 0;
+    auto& blocks = function.blocks;
+    for (uint32_t b = 0; b < blocks.size(); b++)
+    {
+        Block& block = blocks[b];
+        if (block.isDead)
+            continue;
+        if (!propagation.isExecutable[b])
+        {
+            block.isDead = true;
+            changes++;
+            continue;
+        }
+
+        for (Instruction& instruction : block.instructions)
+        {
+            if (instruction.isDead || instruction.def == kNone || instruction.code.op == Op::LoadConst)
+                continue;
+            const Cell& cell = propagation.cells[instruction.def];
+            if (cell.state != Cell::State::Constant)
+                continue;
+            const uint32_t constant = module.constant(toRuntimeValue(cell.value));
+            instruction.code = Bytecode::Instruction{Op::LoadConst ,function.values[instruction.def].reg ,0 ,0 ,constant};
+            instruction.uses.clear();
+            changes++;
+        }
+
+        Instruction& last = block.instructions.back();
+        const auto [isNextTaken ,isTargetTaken] = propagation.edges[b];
+        if (last.isDead || !Bytecode::isJump(last.code.op) || last.code.op == Op::Jump || isNextTaken == isTargetTaken)
+            continue;
+        if (isNextTaken)
+        {
+            last.isDead = true;
+            block.target = kNone;
+        }
+        else
+        {
+            last.code = Bytecode::Instruction{Op::Jump ,0 ,0 ,0 ,block.target};
+            last.uses.clear();
+            block.next = kNone;
+        }
+        changes++;
+    }
+
+    if (changes)
+        update(function);
+    return changes;
+}
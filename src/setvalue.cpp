@@ -0,0 +1,460 @@
+#include <algorithm>
+#include <iterator>
+#include <memory>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "setvalue.h"
+
+using namespace Compiler;
+
+// Bits pays off once at least one int in 32 of its span is in the set,
+// then it needs under 6 bits per element against 64 for Ints.
+static bool isDense(size_t size ,uint64_t wordCount)
+{
+    return wordCount * 2 <= size;
+}
+
+static uint64_t wordsSpanned(Int_t first ,Int_t last)
+{
+    return (static_cast<uint64_t>(last) - static_cast<uint64_t>(first)) / 64 + 1;
+}
+
+SetRef SetValue::make(std::vector<Value> elements)
+{
+    if (std::all_of(elements.begin() ,elements.end() ,[](const Value& v) { return std::holds_alternative<Int_t>(v); }))
+    {
+        std::vector<Int_t> ints;
+        ints.reserve(elements.size());
+        for (const auto& element : elements)
+            ints.push_back(std::get<Int_t>(element));
+        return fromInts(std::move(ints));
+    }
+
+    std::stable_sort(elements.begin() ,elements.end() ,valueLess);
+    elements.erase(std::unique(elements.begin() ,elements.end() ,isSame) ,elements.end());
+    return fromSortedValues(std::move(elements));
+}
+
+SetRef SetValue::fromInts(std::vector<Int_t> ints)
+{
+    std::sort(ints.begin() ,ints.end());
+    ints.erase(std::unique(ints.begin() ,ints.end()) ,ints.end());
+    return fromSortedInts(std::move(ints));
+}
+
+const SetRef& SetValue::empty()
+{
+    static const SetRef kEmpty = fromSortedInts({});
+    return kEmpty;
+}
+
+SetRef SetValue::fromSortedInts(std::vector<Int_t> ints)
+{
+    auto set = std::shared_ptr<SetValue>(new SetValue());
+    set->size_ = ints.size();
+    if (ints.empty() || !isDense(ints.size() ,wordsSpanned(ints.front() ,ints.back())))
+    {
+        set->kind_ = Kind::Ints;
+        set->ints_ = std::move(ints);
+        return set;
+    }
+
+    set->kind_ = Kind::Bits;
+    set->base_ = ints.front();
+    set->words_.assign(wordsSpanned(ints.front() ,ints.back()) ,0);
+    for (Int_t i : ints)
+    {
+        const uint64_t bit = static_cast<uint64_t>(i) - static_cast<uint64_t>(set->base_);
+        set->words_[bit / 64] |= uint64_t(1) << (bit % 64);
+    }
+    set->ranks_.reserve(set->words_.size());
+    uint32_t rank = 0;
+    for (uint64_t word : set->words_)
+    {
+        set->ranks_.push_back(rank);
+        rank += __builtin_popcountll(word);
+    }
+    return set;
+}
+
+SetRef SetValue::fromBits(Int_t base ,std::vector<uint64_t> words)
+{
+    // trim to the smallest and largest element so the representation only depends on the contents
+    while (!words.empty() && words.back() == 0)
+        words.pop_back();
+    auto first = std::find_if(words.begin() ,words.end() ,[](uint64_t word) { return word != 0; });
+    if (first == words.end())
+        return empty();
+    base = static_cast<Int_t>(static_cast<uint64_t>(base) + 64 * static_cast<uint64_t>(first - words.begin()));
+    words.erase(words.begin() ,first);
+
+    if (const int shift = __builtin_ctzll(words.front()))
+    {
+        for (size_t i = 0; i < words.size(); i++)
+            words[i] = (words[i] >> shift) | (i + 1 < words.size() ? words[i + 1] << (64 - shift) : 0);
+        if (words.back() == 0)
+            words.pop_back();
+        base = static_cast<Int_t>(static_cast<uint64_t>(base) + shift);
+    }
+
+    size_t size = 0;
+    for (uint64_t word : words)
+        size += __builtin_popcountll(word);
+
+    if (!isDense(size ,words.size()))
+    {
+        std::vector<Int_t> ints;
+        ints.reserve(size);
+        for (size_t w = 0; w < words.size(); w++)
+            for (uint64_t word = words[w]; word; word &= word - 1)
+                ints.push_back(static_cast<Int_t>(static_cast<uint64_t>(base) + w * 64 + __builtin_ctzll(word)));
+        return fromSortedInts(std::move(ints));
+    }
+
+    auto set = std::shared_ptr<SetValue>(new SetValue());
+    set->kind_ = Kind::Bits;
+    set->size_ = size;
+    set->base_ = base;
+    set->words_ = std::move(words);
+    set->ranks_.reserve(set->words_.size());
+    uint32_t rank = 0;
+    for (uint64_t word : set->words_)
+    {
+        set->ranks_.push_back(rank);
+        rank += __builtin_popcountll(word);
+    }
+    return set;
+}
+
+SetRef SetValue::fromSortedValues(std::vector<Value> values)
+{
+    if (std::all_of(values.begin() ,values.end() ,[](const Value& v) { return std::holds_alternative<Int_t>(v); }))
+    {
+        std::vector<Int_t> ints;
+        ints.reserve(values.size());
+        for (const auto& value : values)
+            ints.push_back(std::get<Int_t>(value));
+        return fromSortedInts(std::move(ints));
+    }
+
+    auto set = std::shared_ptr<SetValue>(new SetValue());
+    set->kind_ = Kind::Mixed;
+    set->size_ = values.size();
+    set->values_ = std::move(values);
+    size_t capacity = 1;
+    while (capacity < set->values_.size() * 2)
+        capacity *= 2;
+    set->slots_.assign(capacity ,0);
+    for (size_t i = 0; i < set->values_.size(); i++)
+        set->slots_[set->find(set->values_[i])] = static_cast<uint32_t>(i + 1);
+    return set;
+}
+
+Value SetValue::at(size_t i) const
+{
+    switch (kind_)
+    {
+        case Kind::Bits: {
+            // the last word with fewer set bits before it than i, then the bit in it
+            const size_t w = std::upper_bound(ranks_.begin() ,ranks_.end() ,i) - ranks_.begin() - 1;
+            uint64_t word = words_[w];
+            for (size_t skip = i - ranks_[w]; skip; skip--)
+                word &= word - 1;
+            return static_cast<Int_t>(static_cast<uint64_t>(base_) + w * 64 + __builtin_ctzll(word));
+        }
+        case Kind::Ints:
+            return ints_[i];
+        default:
+            return values_[i];
+    }
+}
+
+size_t SetValue::find(const Value& value) const
+{
+    const size_t mask = slots_.size() - 1;
+    for (size_t slot = hashOf(value ,0) & mask; ; slot = (slot + 1) & mask)
+        if (slots_[slot] == 0 || isSame(values_[slots_[slot] - 1] ,value))
+            return slot;
+}
+
+bool SetValue::contains(const Value& value) const
+{
+    switch (kind_)
+    {
+        case Kind::Bits: {
+            auto* i = std::get_if<Int_t>(&value);
+            if (!i)
+                return false;
+            const uint64_t bit = static_cast<uint64_t>(*i) - static_cast<uint64_t>(base_);
+            return bit / 64 < words_.size() && (words_[bit / 64] >> (bit % 64) & 1);
+        }
+        case Kind::Ints: {
+            auto* i = std::get_if<Int_t>(&value);
+            return i && std::binary_search(ints_.begin() ,ints_.end() ,*i);
+        }
+        default:
+            return !slots_.empty() && slots_[find(value)] != 0;
+    }
+}
+
+Int_t SetValue::last() const
+{
+    const uint64_t top = 63 - __builtin_clzll(words_.back());
+    return static_cast<Int_t>(static_cast<uint64_t>(base_) + (words_.size() - 1) * 64 + top);
+}
+
+std::vector<Int_t> SetValue::ints() const
+{
+    if (kind_ == Kind::Ints)
+        return ints_;
+
+    std::vector<Int_t> ints;
+    ints.reserve(size_);
+    forEach([&ints](const Value& value) { ints.push_back(std::get<Int_t>(value)); });
+    return ints;
+}
+
+// The words of a Bits set moved into a frame of count words whose bit 0 is base,
+// the bits that fall outside of it are dropped.
+static std::vector<uint64_t> alignWords(const std::vector<uint64_t>& words ,Int_t wordsBase ,Int_t base ,size_t count)
+{
+    std::vector<uint64_t> aligned(count ,0);
+    const int64_t delta = static_cast<int64_t>(static_cast<uint64_t>(wordsBase) - static_cast<uint64_t>(base));
+    const int64_t shift = delta & 63;
+    for (size_t i = 0; i < words.size(); i++)
+    {
+        const int64_t target = static_cast<int64_t>(i) + (delta >> 6); // floors for negative deltas
+        if (target >= 0 && target < static_cast<int64_t>(count))
+            aligned[target] |= words[i] << shift;
+        if (shift && target + 1 >= 0 && target + 1 < static_cast<int64_t>(count))
+            aligned[target + 1] |= words[i] >> (64 - shift);
+    }
+    return aligned;
+}
+
+// Mixed sets go through values in valueLess order
+static std::vector<Value> valuesOf(const SetValue& set)
+{
+    std::vector<Value> values;
+    values.reserve(set.size());
+    set.forEach([&values](const Value& value) { values.push_back(value); });
+    return values;
+}
+
+SetRef Compiler::setUnion(const SetRef& lhs ,const SetRef& rhs)
+{
+    using Kind = SetValue::Kind;
+    const SetValue& a = *lhs;
+    const SetValue& b = *rhs;
+    if (b.size_ == 0 || lhs == rhs)
+        return lhs;
+    if (a.size_ == 0)
+        return rhs;
+
+    if (a.kind_ == Kind::Bits && b.kind_ == Kind::Bits)
+    {
+        const Int_t first = std::min(a.base_ ,b.base_);
+        const uint64_t count = wordsSpanned(first ,std::max(a.last() ,b.last()));
+        if (count <= a.words_.size() + b.words_.size() + 1) // otherwise the gap between them costs more than it saves
+        {
+            auto words = alignWords(a.words_ ,a.base_ ,first ,count);
+            const auto other = alignWords(b.words_ ,b.base_ ,first ,count);
+            for (size_t i = 0; i < count; i++)
+                words[i] |= other[i];
+            return SetValue::fromBits(first ,std::move(words));
+        }
+    }
+
+    if (a.kind_ != Kind::Mixed && b.kind_ != Kind::Mixed)
+    {
+        const auto x = a.ints();
+        const auto y = b.ints();
+        std::vector<Int_t> ints;
+        ints.reserve(x.size() + y.size());
+        std::set_union(x.begin() ,x.end() ,y.begin() ,y.end() ,std::back_inserter(ints));
+        return SetValue::fromSortedInts(std::move(ints));
+    }
+
+    const auto x = valuesOf(a);
+    const auto y = valuesOf(b);
+    std::vector<Value> values;
+    values.reserve(x.size() + y.size());
+    std::set_union(x.begin() ,x.end() ,y.begin() ,y.end() ,std::back_inserter(values) ,valueLess);
+    return SetValue::fromSortedValues(std::move(values));
+}
+
+SetRef Compiler::setIntersection(const SetRef& lhs ,const SetRef& rhs)
+{
+    using Kind = SetValue::Kind;
+    const SetValue& a = *lhs;
+    const SetValue& b = *rhs;
+    if (a.size_ == 0 || b.size_ == 0)
+        return SetValue::empty();
+    if (lhs == rhs)
+        return lhs;
+
+    if (a.kind_ == Kind::Bits && b.kind_ == Kind::Bits)
+    {
+        if (a.last() < b.base_ || b.last() < a.base_)
+            return SetValue::empty();
+        // in the frame of a, the bits of b outside of it cant be in the result
+        auto words = alignWords(b.words_ ,b.base_ ,a.base_ ,a.words_.size());
+        for (size_t i = 0; i < words.size(); i++)
+            words[i] &= a.words_[i];
+        return SetValue::fromBits(a.base_ ,std::move(words));
+    }
+
+    if (a.kind_ == Kind::Ints && b.kind_ == Kind::Ints)
+    {
+        std::vector<Int_t> ints;
+        std::set_intersection(a.ints_.begin() ,a.ints_.end() ,b.ints_.begin() ,b.ints_.end() ,std::back_inserter(ints));
+        return SetValue::fromSortedInts(std::move(ints));
+    }
+
+    // look the elements of the smaller one up in the other, Bits and Mixed do that in constant time
+    const SetValue& small = a.size_ <= b.size_ ? a : b;
+    const SetValue& large = a.size_ <= b.size_ ? b : a;
+    if (small.kind_ != Kind::Mixed)
+    {
+        std::vector<Int_t> ints;
+        small.forEach([&](const Value& value)
+        {
+            if (large.contains(value))
+                ints.push_back(std::get<Int_t>(value));
+        });
+        return SetValue::fromSortedInts(std::move(ints));
+    }
+
+    std::vector<Value> values;
+    small.forEach([&](const Value& value)
+    {
+        if (large.contains(value))
+            values.push_back(value);
+    });
+    return SetValue::fromSortedValues(std::move(values));
+}
+
+SetRef Compiler::setDifference(const SetRef& lhs ,const SetRef& rhs)
+{
+    using Kind = SetValue::Kind;
+    const SetValue& a = *lhs;
+    const SetValue& b = *rhs;
+    if (a.size_ == 0 || b.size_ == 0)
+        return lhs;
+    if (lhs == rhs)
+        return SetValue::empty();
+
+    if (a.kind_ == Kind::Bits && b.kind_ == Kind::Bits)
+    {
+        if (a.last() < b.base_ || b.last() < a.base_)
+            return lhs;
+        auto words = a.words_;
+        const auto other = alignWords(b.words_ ,b.base_ ,a.base_ ,words.size());
+        for (size_t i = 0; i < words.size(); i++)
+            words[i] &= ~other[i];
+        return SetValue::fromBits(a.base_ ,std::move(words));
+    }
+
+    if (a.kind_ == Kind::Bits && b.kind_ == Kind::Ints)
+    {
+        auto words = a.words_;
+        for (Int_t i : b.ints_)
+        {
+            const uint64_t bit = static_cast<uint64_t>(i) - static_cast<uint64_t>(a.base_);
+            if (bit / 64 < words.size())
+                words[bit / 64] &= ~(uint64_t(1) << (bit % 64));
+        }
+        return SetValue::fromBits(a.base_ ,std::move(words));
+    }
+
+    if (a.kind_ == Kind::Ints && b.kind_ == Kind::Ints)
+    {
+        std::vector<Int_t> ints;
+        std::set_difference(a.ints_.begin() ,a.ints_.end() ,b.ints_.begin() ,b.ints_.end() ,std::back_inserter(ints));
+        return SetValue::fromSortedInts(std::move(ints));
+    }
+
+    if (a.kind_ != Kind::Mixed)
+    {
+        std::vector<Int_t> ints;
+        a.forEach([&](const Value& value)
+        {
+            if (!b.contains(value))
+                ints.push_back(std::get<Int_t>(value));
+        });
+        return SetValue::fromSortedInts(std::move(ints));
+    }
+
+    std::vector<Value> values;
+    for (const auto& value : a.values_)
+        if (!b.contains(value))
+            values.push_back(value);
+    return SetValue::fromSortedValues(std::move(values));
+}
+
+bool Compiler::setsEqual(const SetValue& a ,const SetValue& b)
+{
+    // equal contents always get the same representation
+    if (&a == &b)
+        return true;
+    if (a.kind_ != b.kind_ || a.size_ != b.size_)
+        return false;
+
+    switch (a.kind_)
+    {
+        case SetValue::Kind::Bits:
+            return a.base_ == b.base_ && a.words_ == b.words_;
+        case SetValue::Kind::Ints:
+            return a.ints_ == b.ints_;
+        default:
+            return std::equal(a.values_.begin() ,a.values_.end() ,b.values_.begin() ,isSame);
+    }
+}
+
+void SetBuilder::add(const Value& value)
+{
+    if (!isMixed_)
+    {
+        if (auto* i = std::get_if<Int_t>(&value))
+        {
+            ints_.push_back(*i);
+            return;
+        }
+
+        isMixed_ = true;
+        values_.reserve(ints_.size() + 1);
+        for (Int_t i : ints_)
+            values_.push_back(i);
+        ints_ = {};
+    }
+    values_.push_back(value);
+}
+
+void SetBuilder::merge(SetBuilder&& other)
+{
+    if (!isMixed_ && !other.isMixed_)
+    {
+        if (ints_.empty())
+            ints_ = std::move(other.ints_);
+        else
+            ints_.insert(ints_.end() ,other.ints_.begin() ,other.ints_.end());
+    }
+    else if (other.isMixed_)
+    {
+        for (const auto& value : other.values_)
+            add(value);
+    }
+    else
+    {
+        for (Int_t i : other.ints_)
+            add(i);
+    }
+    other = SetBuilder();
+}
+
+SetRef SetBuilder::build()
+{
+    return isMixed_ ? SetValue::make(std::move(values_)) : SetValue::fromInts(std::move(ints_));
+}
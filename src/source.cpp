@@ -0,0 +1,58 @@
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "source.h"
+
+using namespace Compiler;
+
+SourceBuffer::SourceBuffer(const std::string& path)
+{
+    int fd = ::open(path.c_str() ,O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error("ERROR: Failed to open source file.");
+
+    struct stat st {};
+    if (::fstat(fd ,&st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+    {
+        void* addr = ::mmap(nullptr ,st.st_size ,PROT_READ ,MAP_PRIVATE ,fd ,0);
+        if (addr != MAP_FAILED)
+        {
+            ::madvise(addr ,st.st_size ,MADV_SEQUENTIAL);
+            data_ = static_cast<const char*>(addr);
+            size_ = static_cast<size_t>(st.st_size);
+            isMapped_ = true;
+        }
+    }
+    ::close(fd);
+
+    if (isMapped_)
+        return;
+
+    // fallback: read the whole stream
+    std::ifstream ifs(path ,std::ios::binary);
+    if (!ifs.is_open())
+        throw std::runtime_error("ERROR: Failed to open source file.");
+
+    contents_.assign(std::istreambuf_iterator<char>(ifs) ,std::istreambuf_iterator<char>());
+    data_ = contents_.data();
+    size_ = contents_.size();
+}
+
+SourceBuffer::~SourceBuffer()
+{
+    if (isMapped_)
+        ::munmap(const_cast<char*>(data_) ,size_);
+}
+
+std::string_view SourceBuffer::view() const
+{
+    return std::string_view(data_ ,size_);
+}
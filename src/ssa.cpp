@@ -0,0 +1,357 @@
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "ssa.h"
+
+using namespace Compiler;
+using namespace Compiler::SSA;
+
+namespace {
+
+using Op = Bytecode::Op;
+
+// if control never goes on to the next instruction
+bool isTerminator(Op op)
+{
+    return op == Op::Jump || op == Op::Return || op == Op::Fail || op == Op::Halt;
+}
+
+// splits the code from begin to end into blocks, a jump's target becomes the block it goes to
+void findBlocks(Function& function ,const std::vector<Bytecode::Instruction>& code ,size_t begin ,size_t end)
+{
+    std::vector<bool> isLeader(end - begin + 1);
+    isLeader[0] = true;
+    for (size_t i = begin; i < end; i++)
+    {
+        const Bytecode::Instruction& instruction = code[i];
+        if (isTerminator(instruction.op) || Bytecode::isJump(instruction.op))
+            isLeader[i + 1 - begin] = true;
+        if (!Bytecode::isJump(instruction.op))
+            continue;
+        if (instruction.target < begin || instruction.target >= end)
+            throw std::runtime_error("a jump leaves its function");
+        isLeader[instruction.target - begin] = true;
+        if (instruction.target <= i)
+            function.isSSA = false;
+    }
+
+    std::vector<uint32_t> blockOf(end - begin);
+    for (size_t i = begin; i < end; i++)
+    {
+        if (isLeader[i - begin])
+            function.blocks.emplace_back();
+        blockOf[i - begin] = static_cast<uint32_t>(function.blocks.size() - 1);
+        function.blocks.back().instructions.push_back(Instruction{code[i]});
+    }
+
+    auto& blocks = function.blocks;
+    for (uint32_t b = 0; b < blocks.size(); b++)
+    {
+        Instruction& last = blocks[b].instructions.back();
+        if (!isTerminator(last.code.op) && b + 1 < blocks.size())
+            blocks[b].next = b + 1;
+        if (Bytecode::isJump(last.code.op))
+        {
+            blocks[b].target = blockOf[last.code.target - begin];
+            last.code.target = blocks[b].target;
+        }
+    }
+    if (blocks.empty())
+        function.isSSA = false;
+}
+
+// the nearest block that dominates both, blocks are in an order where dominators come first
+uint32_t commonDominator(const std::vector<Block>& blocks ,uint32_t a ,uint32_t b)
+{
+    while (a != b)
+    {
+        if (a > b)
+            a = blocks[a].dominator;
+        else
+            b = blocks[b].dominator;
+    }
+    return a;
+}
+
+// Puts the phis and gives every read its value, minimal SSA by the dominance
+// frontiers, with phis only for the registers read in another block than the
+// one that writes them (semi pruned), or written in more than one block: a
+// pass that reuses the value a register held needs to see where it changed.
+// A call gives the callee the registers from its first argument on, the ones
+// after the result have no value after it.
+void construct(Function& function ,uint16_t parameterCount ,uint16_t registerCount)
+{
+    auto& blocks = function.blocks;
+
+    std::vector<std::vector<uint32_t>> frontiers(blocks.size());
+    std::vector<std::vector<uint32_t>> children(blocks.size());
+    for (uint32_t b = 0; b < blocks.size(); b++)
+    {
+        if (blocks[b].isDead)
+            continue;
+        if (b > 0)
+            children[blocks[b].dominator].push_back(b);
+        if (blocks[b].predecessors.size() < 2)
+            continue;
+        for (uint32_t predecessor : blocks[b].predecessors)
+            for (uint32_t runner = predecessor; runner != blocks[b].dominator; runner = blocks[runner].dominator)
+                frontiers[runner].push_back(b);
+    }
+
+    std::vector<std::vector<uint32_t>> writers(registerCount); // the blocks that write each register
+    std::vector<bool> isGlobal(registerCount);
+    for (uint16_t reg = 0; reg < parameterCount; reg++)
+        writers[reg].push_back(0);
+    for (uint32_t b = 0; b < blocks.size(); b++)
+    {
+        if (blocks[b].isDead)
+            continue;
+        std::vector<bool> isWritten(registerCount);
+        auto write = [&](uint16_t reg)
+        {
+            isWritten[reg] = true;
+            if (writers[reg].empty() || writers[reg].back() != b)
+                writers[reg].push_back(b);
+        };
+        for (const Instruction& instruction : blocks[b].instructions)
+        {
+            Bytecode::forEachRead(instruction.code ,[&](uint16_t reg) { isGlobal[reg] = isGlobal[reg] || !isWritten[reg]; });
+            if (instruction.code.op == Op::Call)
+                for (uint32_t reg = instruction.code.a + 1u; reg < registerCount; reg++)
+                    write(static_cast<uint16_t>(reg));
+            if (const uint16_t reg = Bytecode::written(instruction.code); reg != Bytecode::kNoRegister)
+                write(reg);
+        }
+    }
+
+    for (uint16_t reg = 0; reg < registerCount; reg++)
+    {
+        if (!isGlobal[reg] && writers[reg].size() < 2)
+            continue;
+        std::vector<uint32_t> work = writers[reg];
+        std::vector<bool> hasPhi(blocks.size());
+        while (!work.empty())
+        {
+            const uint32_t b = work.back();
+            work.pop_back();
+            for (uint32_t frontier : frontiers[b])
+            {
+                if (hasPhi[frontier])
+                    continue;
+                hasPhi[frontier] = true;
+                blocks[frontier].phis.push_back(Phi{reg ,kNone ,std::vector<uint32_t>(blocks[frontier].predecessors.size() ,kNone)});
+                work.push_back(frontier);
+            }
+        }
+    }
+
+    // renaming, down the dominator tree
+    std::vector<uint32_t> current(registerCount ,kNone);
+    for (uint16_t reg = 0; reg < parameterCount; reg++)
+    {
+        function.values.push_back(Definition{0 ,kNone ,false ,reg});
+        current[reg] = reg;
+    }
+    std::vector<std::pair<uint16_t ,uint32_t>> undo; // the registers to set back, with their values
+    auto set = [&](uint16_t reg ,uint32_t value)
+    {
+        undo.emplace_back(reg ,current[reg]);
+        current[reg] = value;
+    };
+    auto define = [&](uint32_t b ,uint32_t index ,bool isPhi ,uint16_t reg)
+    {
+        function.values.push_back(Definition{b ,index ,isPhi ,reg});
+        const auto value = static_cast<uint32_t>(function.values.size() - 1);
+        set(reg ,value);
+        return value;
+    };
+
+    struct Visit
+    {
+        uint32_t block;
+        size_t undo; // kNone to enter the block, where to undo to when leaving it
+    };
+    std::vector<Visit> stack {Visit{0 ,kNone}};
+    while (!stack.empty())
+    {
+        const Visit visit = stack.back();
+        stack.pop_back();
+        if (visit.undo != kNone)
+        {
+            for (; undo.size() > visit.undo; undo.pop_back())
+                current[undo.back().first] = undo.back().second;
+            continue;
+        }
+
+        const uint32_t b = visit.block;
+        stack.push_back(Visit{b ,undo.size()});
+        Block& block = blocks[b];
+        for (uint32_t i = 0; i < block.phis.size(); i++)
+            block.phis[i].def = define(b ,i ,true ,block.phis[i].reg);
+        for (uint32_t i = 0; i < block.instructions.size(); i++)
+        {
+            Instruction& instruction = block.instructions[i];
+            Bytecode::forEachRead(instruction.code ,[&](uint16_t reg) { instruction.uses.push_back(current[reg]); });
+            if (instruction.code.op == Op::Call)
+                for (uint32_t reg = instruction.code.a + 1u; reg < registerCount; reg++)
+                    set(static_cast<uint16_t>(reg) ,kNone);
+            if (const uint16_t reg = Bytecode::written(instruction.code); reg != Bytecode::kNoRegister)
+                instruction.def = define(b ,i ,false ,reg);
+        }
+
+        for (uint32_t successor : {block.next ,block.target})
+        {
+            if (successor == kNone)
+                continue;
+            auto& predecessors = blocks[successor].predecessors;
+            const auto k = std::find(predecessors.begin() ,predecessors.end() ,b) - predecessors.begin();
+            for (Phi& phi : blocks[successor].phis)
+                phi.incoming[k] = current[phi.reg];
+        }
+        for (auto child = children[b].rbegin(); child != children[b].rend(); ++child)
+            stack.push_back(Visit{*child ,kNone});
+    }
+}
+
+} // namespace
+
+const Instruction* Function::definition(uint32_t value) const
+{
+    const Definition& definition = values[value];
+    if (definition.isPhi || definition.index == kNone)
+        return nullptr;
+    return &blocks[definition.block].instructions[definition.index];
+}
+
+uint32_t Module::constant(const RuntimeValue& value)
+{
+    auto key = [](const RuntimeValue& constant)
+    {
+        uint64_t bits = 0;
+        if (constant.type != RuntimeValue::Type::Undefined)
+            std::memcpy(&bits ,&constant.i ,sizeof(bits));
+        return std::make_pair(constant.type ,bits);
+    };
+    for (; indexed_ < program.constants.size(); indexed_++)
+        constants_.emplace(key(program.constants[indexed_]) ,static_cast<uint32_t>(indexed_));
+
+    auto [it ,isNew] = constants_.emplace(key(value) ,static_cast<uint32_t>(program.constants.size()));
+    if (isNew)
+    {
+        program.constants.push_back(value);
+        indexed_++;
+    }
+    return it->second;
+}
+
+void SSA::update(Function& function)
+{
+    auto& blocks = function.blocks;
+
+    // jumps go forward, so the predecessors of a block are known when it is reached
+    std::vector<std::vector<uint32_t>> predecessors(blocks.size());
+    for (uint32_t b = 0; b < blocks.size(); b++)
+    {
+        Block& block = blocks[b];
+        if (b > 0 && predecessors[b].empty())
+            block.isDead = true;
+        if (block.isDead)
+            continue;
+        for (uint32_t successor : {block.next ,block.target})
+            if (successor != kNone && (predecessors[successor].empty() || predecessors[successor].back() != b))
+                predecessors[successor].push_back(b);
+    }
+
+    for (uint32_t b = 0; b < blocks.size(); b++)
+    {
+        Block& block = blocks[b];
+        if (block.isDead)
+            continue;
+        for (Phi& phi : block.phis)
+        {
+            std::vector<uint32_t> incoming;
+            for (uint32_t predecessor : predecessors[b])
+            {
+                const auto k = std::find(block.predecessors.begin() ,block.predecessors.end() ,predecessor) - block.predecessors.begin();
+                incoming.push_back(phi.incoming.at(k));
+            }
+            phi.incoming = std::move(incoming);
+        }
+        block.predecessors = std::move(predecessors[b]);
+
+        block.dominator = kNone;
+        for (uint32_t predecessor : block.predecessors)
+            block.dominator = block.dominator == kNone ? predecessor : commonDominator(blocks ,block.dominator ,predecessor);
+    }
+}
+
+Module SSA::build(const Bytecode& program)
+{
+    Module module;
+    module.program = program;
+
+    // each function is the code from its entry to the next one's
+    std::vector<uint32_t> entries;
+    for (const auto& function : program.functions)
+        entries.push_back(function.entry);
+    std::sort(entries.begin() ,entries.end());
+
+    for (uint32_t i = 0; i < program.functions.size(); i++)
+    {
+        const Bytecode::Function& info = program.functions[i];
+        auto next = std::upper_bound(entries.begin() ,entries.end() ,info.entry);
+        Function function {i};
+        findBlocks(function ,program.code ,info.entry ,next == entries.end() ? program.code.size() : *next);
+        if (function.isSSA)
+        {
+            update(function);
+            construct(function ,info.parameterCount ,info.registerCount);
+        }
+        module.functions.push_back(std::move(function));
+    }
+    return module;
+}
+
+Bytecode SSA::lower(Module module)
+{
+    Bytecode& program = module.program;
+    program.code.clear();
+
+    for (Function& function : module.functions)
+    {
+        auto& blocks = function.blocks;
+
+        // what each block keeps, from the last one on, so a jump over blocks that
+        // became empty to the next one that isnt can be left out
+        std::vector<std::vector<Bytecode::Instruction>> kept(blocks.size());
+        for (size_t b = blocks.size(); b-- > 0;)
+        {
+            if (blocks[b].isDead)
+                continue;
+            for (const Instruction& instruction : blocks[b].instructions)
+                if (!instruction.isDead && !(instruction.code.op == Op::Move && instruction.code.a == instruction.code.b))
+                    kept[b].push_back(instruction.code);
+            if (kept[b].empty() || kept[b].back().op != Op::Jump)
+                continue;
+            const uint32_t target = kept[b].back().target;
+            if (target > b && std::all_of(kept.begin() + b + 1 ,kept.begin() + target ,[](const auto& code) { return code.empty(); }))
+                kept[b].pop_back();
+        }
+
+        const auto entry = static_cast<uint32_t>(program.code.size());
+        program.functions[function.index].entry = entry;
+        std::vector<uint32_t> starts(blocks.size());
+        for (size_t b = 0; b < blocks.size(); b++)
+        {
+            starts[b] = static_cast<uint32_t>(program.code.size());
+            program.code.insert(program.code.end() ,kept[b].begin() ,kept[b].end());
+        }
+        for (size_t i = entry; i < program.code.size(); i++)
+            if (Bytecode::isJump(program.code[i].op))
+                program.code[i].target = starts[program.code[i].target];
+    }
+    return std::move(program);
+}
@@ -0,0 +1,263 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "compiler.h"
+#include "flatast.h"
+#include "lexer.h"
+#include "parser.h"
+#include "statementcache.h"
+
+using namespace Compiler;
+
+AST::ASTNode* StatementCache::find(uint64_t hash) const
+{
+    auto it = entries_.find(hash);
+    return it == entries_.end() ? nullptr : it->second.node;
+}
+
+void StatementCache::insert(uint64_t hash ,AST::ASTNode* node ,size_t bytes)
+{
+    if (entries_.try_emplace(hash ,Entry{node ,bytes ,0}).second)
+        liveBytes_ += bytes;
+}
+
+void StatementCache::addUse(uint64_t hash)
+{
+    auto it = entries_.find(hash);
+    if (it != entries_.end())
+        it->second.uses++;
+}
+
+void StatementCache::removeUse(uint64_t hash)
+{
+    auto it = entries_.find(hash);
+    if (it == entries_.end() || --it->second.uses > 0)
+        return;
+
+    liveBytes_ -= it->second.bytes;
+    entries_.erase(it);
+}
+
+void StatementCache::beginCompile()
+{
+    compileCount_++;
+}
+
+void StatementCache::endCompile(std::string text ,std::vector<CachedStatement> statements)
+{
+    spareText_ = std::move(text_);
+    text_ = std::move(text);
+    statements_ = std::move(statements);
+
+    // the arena cant free single statements, start over when its mostly garbage
+    const size_t used = arena_.bytesUsed();
+    if (used - liveBytes_ > kMaxDeadBytes_ && used > 2 * liveBytes_)
+        clear();
+}
+
+void StatementCache::clear()
+{
+    entries_.clear();
+    arena_.release();
+    liveBytes_ = 0;
+    text_.clear();
+    statements_.clear();
+}
+
+
+// Index of the complete statement of the last compile that ended at end, or statements.size().
+static size_t findStatementEnd(const std::vector<CachedStatement>& statements ,size_t end)
+{
+    auto it = std::lower_bound(statements.begin() ,statements.end() ,end ,
+        [](const CachedStatement& statement ,size_t offset) { return statement.end < offset; });
+
+    if (it == statements.end() || it->end != end || !it->isComplete)
+        return statements.size();
+    return it - statements.begin();
+}
+
+// Reads the whole file into text, reusing its memory.
+static void readFile(const std::string& path ,std::string& text)
+{
+    std::ifstream file(path ,std::ios::binary);
+    if (!file)
+        throw std::runtime_error("ERROR: Failed to open source file.");
+
+    file.seekg(0 ,std::ios::end);
+    text.resize(static_cast<size_t>(file.tellg()));
+    file.seekg(0);
+    file.read(text.data() ,text.size());
+}
+
+// Length of the common prefix (or suffix) of a and b, compared a block at a time.
+static size_t commonPrefix(std::string_view a ,std::string_view b)
+{
+    constexpr size_t kBlock = 4096;
+    const size_t size = std::min(a.size() ,b.size());
+
+    size_t i = 0;
+    while (i + kBlock <= size && std::memcmp(a.data() + i ,b.data() + i ,kBlock) == 0)
+        i += kBlock;
+    while (i < size && a[i] == b[i])
+        i++;
+    return i;
+}
+
+static size_t commonSuffix(std::string_view a ,std::string_view b)
+{
+    constexpr size_t kBlock = 4096;
+    const size_t size = std::min(a.size() ,b.size());
+
+    size_t i = 0;
+    while (i + kBlock <= size && std::memcmp(a.end() - i - kBlock ,b.end() - i - kBlock ,kBlock) == 0)
+        i += kBlock;
+    while (i < size && a[a.size() - i - 1] == b[b.size() - i - 1])
+        i++;
+    return i;
+}
+
+bool Compiler::compileIncremental(const CompileContext& context ,const std::string& sourceFile ,StatementCache& cache)
+{
+    const auto start = std::chrono::steady_clock::now();
+
+    std::string text = cache.takeSpareText(); // the file may change under a mapping, so copy it
+    try
+    {
+        readFile(sourceFile ,text);
+    }
+    catch (const std::exception& e)
+    {
+        log(e.what());
+        return false;
+    }
+
+    const std::string& oldText = cache.text();
+    std::vector<CachedStatement> statements = cache.takeStatements(); // edited in place
+
+    // the edit lies between an unchanged prefix and suffix
+    const size_t prefix = commonPrefix(text ,oldText);
+    const size_t suffix = std::min(commonSuffix(text ,oldText) ,std::min(text.size() ,oldText.size()) - prefix);
+
+    // keep the statements that end before the edit, lexing resumes at the start
+    // of the line the last of them ends on and skips its tokens up to the ';'
+    size_t kept = std::upper_bound(statements.begin() ,statements.end() ,prefix ,
+        [](size_t offset ,const CachedStatement& statement) { return offset < statement.end; }) - statements.begin();
+    if (kept > 0 && !statements[kept - 1].isComplete)
+        kept--;
+
+    size_t lineStart = 0;
+    uint32_t line = 1;
+    uint32_t skipColumn = 0;
+    if (kept > 0)
+    {
+        line = statements[kept - 1].line;
+        skipColumn = statements[kept - 1].column;
+        lineStart = statements[kept - 1].end - skipColumn;
+    }
+    const uint32_t skipLine = kept > 0 ? line : 0;
+
+    // token line and column -> offset in text
+    auto offsetOf = [&](const Token& token)
+    {
+        for (; line < token.line; line++)
+            lineStart = text.find('\n' ,lineStart) + 1;
+        return lineStart + token.column;
+    };
+
+    cache.beginCompile();
+
+    Parser parser(context ,&cache);
+    AST::FlatAST flatAST;
+    std::vector<CachedStatement> parsed; // replaces statements [kept ,resumed)
+    size_t resumed = statements.size();
+    size_t reparsed = 0;
+
+    auto parseStatement = [&](size_t end ,const Token& last ,bool isComplete)
+    {
+        auto node = parser.parse();
+
+        reparsed += !parser.wasCached();
+        if (!cache.isWarm() || !parser.wasCached())
+        {
+            if (context.useFlatAST)
+                printFlatAST(flatAST ,flatAST.add(node));
+            else
+                printASTNode(node);
+        }
+        parsed.push_back(CachedStatement{end ,last.line ,last.column ,parser.statementHash() ,node ,isComplete});
+        cache.addUse(parser.statementHash());
+    };
+
+    try
+    {
+        Lexer lexer(std::string_view(text).substr(lineStart) ,line - 1);
+        Token last {};
+
+        while (auto optToken = lexer.getNextToken())
+        {
+            last = *optToken;
+            if (last.line == skipLine && last.column <= skipColumn)
+                continue; // belongs to a kept statement
+
+            parser.consume(last);
+            if (!parser.statementReady())
+                continue;
+
+            const size_t end = offsetOf(last);
+            parseStatement(end ,last ,true);
+
+            // past the edit, the rest is the same once a statement ends where one did before
+            if (end < text.size() - suffix)
+                continue;
+
+            const size_t aligned = findStatementEnd(statements ,end - text.size() + oldText.size());
+            if (aligned == statements.size())
+                continue;
+
+            // shift what follows to the new positions
+            const CachedStatement& oldEnd = statements[aligned];
+            for (size_t i = aligned + 1; i < statements.size(); i++)
+            {
+                auto& statement = statements[i];
+                if (statement.line == oldEnd.line) // on the edited line
+                    statement.column = statement.column - oldEnd.column + last.column;
+                statement.line = statement.line - oldEnd.line + last.line;
+                statement.end = statement.end - oldText.size() + text.size();
+            }
+            resumed = aligned + 1;
+            break;
+        }
+
+        log("end");
+        if (resumed == statements.size() && parser.statementNotEmpty())
+            parseStatement(text.size() ,last ,false);
+    }
+    catch (const std::exception& e)
+    {
+        log(e.what());
+        cache.clear();
+        return false;
+    }
+
+    for (size_t i = kept; i < resumed; i++)
+        cache.removeUse(statements[i].hash);
+
+    statements.erase(statements.begin() + kept ,statements.begin() + resumed);
+    statements.insert(statements.begin() + kept ,parsed.begin() ,parsed.end());
+
+    const size_t total = statements.size();
+    cache.endCompile(std::move(text) ,std::move(statements));
+
+    const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+    log(sourceFile + ": reparsed " + std::to_string(reparsed) + " of " + std::to_string(total)
+        + " statements in " + std::to_string(elapsed.count() / 1000.0) + " ms");
+    return true;
+}
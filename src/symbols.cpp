@@ -0,0 +1,111 @@
+#include <atomic>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <utility>
+
+#include "symbols.h"
+
+using namespace Compiler;
+
+SymbolTable& Compiler::symbols()
+{
+    static SymbolTable table;
+    return table;
+}
+
+std::string_view SymbolTable::Shard::store(std::string_view str)
+{
+    if (str.empty()) // there may be no block yet
+        return {};
+
+    if (str.size() > kBlockSize_ / 4) // big strings get their own block
+    {
+        auto block = std::make_unique<char[]>(str.size());
+        char* data = block.get();
+        blocks.insert(blocks.begin() ,std::move(block)); // keep the current block at the back
+        std::memcpy(data ,str.data() ,str.size());
+        return std::string_view(data ,str.size());
+    }
+
+    if (blockUsed + str.size() > kBlockSize_)
+    {
+        blocks.push_back(std::make_unique<char[]>(kBlockSize_));
+        blockUsed = 0;
+    }
+
+    char* data = blocks.back().get() + blockUsed;
+    std::memcpy(data ,str.data() ,str.size());
+    blockUsed += str.size();
+    return std::string_view(data ,str.size());
+}
+
+uint32_t SymbolTable::makeIndex(uint32_t shard ,size_t local)
+{
+    return static_cast<uint32_t>(local << kShardBits_) | shard;
+}
+
+SymbolTable::Shard& SymbolTable::threadShard()
+{
+    static std::atomic<uint32_t> nextShard {0};
+    thread_local const uint32_t shard = nextShard++ & (kShardCount_ - 1);
+    return shards_[shard];
+}
+
+SymbolId SymbolTable::intern(std::string_view str)
+{
+    const uint32_t shardIndex = std::hash<std::string_view>{}(str) & (kShardCount_ - 1);
+    Shard& shard = shards_[shardIndex];
+    std::lock_guard lock(shard.mutex);
+
+    auto it = shard.ids.find(str);
+    if (it != shard.ids.end())
+        return it->second;
+
+    std::string_view stored = shard.store(str);
+    SymbolId id = static_cast<SymbolId>(makeIndex(shardIndex ,shard.strings.size()));
+
+    shard.strings.push_back(stored);
+    shard.ids.emplace(stored ,id);
+    return id;
+}
+
+std::string_view SymbolTable::lookup(SymbolId id) const
+{
+    const auto index = static_cast<uint32_t>(id);
+    const Shard& shard = shardOf(index);
+    std::lock_guard lock(shard.mutex);
+    return shard.strings[localOf(index)];
+}
+
+uint32_t SymbolTable::addInt(Int_t value)
+{
+    Shard& shard = threadShard();
+    std::lock_guard lock(shard.mutex);
+    shard.ints.push_back(value);
+    return makeIndex(static_cast<uint32_t>(&shard - shards_) ,shard.ints.size() - 1);
+}
+
+Int_t SymbolTable::getInt(uint32_t index) const
+{
+    const Shard& shard = shardOf(index);
+    std::lock_guard lock(shard.mutex);
+    return shard.ints[localOf(index)];
+}
+
+uint32_t SymbolTable::addDouble(Double_t value)
+{
+    Shard& shard = threadShard();
+    std::lock_guard lock(shard.mutex);
+    shard.doubles.push_back(value);
+    return makeIndex(static_cast<uint32_t>(&shard - shards_) ,shard.doubles.size() - 1);
+}
+
+Double_t SymbolTable::getDouble(uint32_t index) const
+{
+    const Shard& shard = shardOf(index);
+    std::lock_guard lock(shard.mutex);
+    return shard.doubles[localOf(index)];
+}
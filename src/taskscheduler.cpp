@@ -0,0 +1,136 @@
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "taskscheduler.h"
+
+using namespace Compiler;
+
+TaskScheduler::TaskScheduler(unsigned threads)
+{
+    if (threads == 0)
+        threads = 1;
+
+    for (unsigned i = 0; i < threads; i++)
+        shares_.push_back(std::make_unique<Share>());
+    workers_.reserve(threads - 1);
+    for (unsigned i = 0; i + 1 < threads; i++)
+        workers_.emplace_back(&TaskScheduler::work ,this ,i);
+}
+
+TaskScheduler::~TaskScheduler()
+{
+    {
+        std::lock_guard lock(mutex_);
+        isStopping_ = true;
+    }
+    wakeup_.notify_all();
+
+    for (auto& worker : workers_)
+        worker.join();
+}
+
+void TaskScheduler::run(size_t count ,const std::function<void(size_t)>& task)
+{
+    // neighbouring tasks mostly run on the same thread
+    const size_t threads = shares_.size();
+    for (size_t i = 0; i < threads; i++)
+    {
+        std::lock_guard lock(shares_[i]->mutex);
+        shares_[i]->next = count * i / threads;
+        shares_[i]->end = count * (i + 1) / threads;
+    }
+
+    if (!workers_.empty())
+    {
+        {
+            std::lock_guard lock(mutex_);
+            task_ = &task;
+            busy_ = workers_.size();
+            round_++;
+        }
+        wakeup_.notify_all();
+    }
+
+    drain(threads - 1 ,task);
+
+    std::unique_lock lock(mutex_);
+    finished_.wait(lock ,[this] { return busy_ == 0; });
+}
+
+void TaskScheduler::work(size_t self)
+{
+    uint64_t round = 0;
+    while (true)
+    {
+        const std::function<void(size_t)>* task;
+        {
+            std::unique_lock lock(mutex_);
+            wakeup_.wait(lock ,[&] { return isStopping_ || round_ != round; });
+            if (isStopping_)
+                return;
+            round = round_;
+            task = task_;
+        }
+
+        drain(self ,*task);
+
+        {
+            std::lock_guard lock(mutex_);
+            busy_--;
+        }
+        finished_.notify_one();
+    }
+}
+
+void TaskScheduler::drain(size_t self ,const std::function<void(size_t)>& task)
+{
+    // a thread only stops once it found every share empty, the ones it
+    // didnt see empty run their tasks before they stop too
+    while (true)
+    {
+        size_t next;
+        if (take(self ,next))
+            task(next);
+        else if (!steal(self))
+            return;
+    }
+}
+
+bool TaskScheduler::take(size_t self ,size_t& task)
+{
+    Share& share = *shares_[self];
+    std::lock_guard lock(share.mutex);
+    if (share.next == share.end)
+        return false;
+    task = share.next++;
+    return true;
+}
+
+bool TaskScheduler::steal(size_t self)
+{
+    // victims are tried from the next thread on, so thieves spread out
+    for (size_t i = 1; i < shares_.size(); i++)
+    {
+        Share& victim = *shares_[(self + i) % shares_.size()];
+        size_t first;
+        size_t end;
+        {
+            std::lock_guard lock(victim.mutex);
+            const size_t left = victim.end - victim.next;
+            if (left == 0)
+                continue;
+            first = victim.end - (left + 1) / 2;
+            end = victim.end;
+            victim.end = first;
+        }
+
+        Share& share = *shares_[self];
+        std::lock_guard lock(share.mutex);
+        share.next = first;
+        share.end = end;
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,64 @@
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+#include "threadpool.h"
+
+using namespace Compiler;
+
+unsigned Compiler::defaultJobCount()
+{
+#if defined(__linux__)
+    // the cpus this process may run on, containers often get fewer than the machine has
+    cpu_set_t cpus;
+    if (sched_getaffinity(0 ,sizeof(cpus) ,&cpus) == 0 && CPU_COUNT(&cpus) > 0)
+        return static_cast<unsigned>(CPU_COUNT(&cpus));
+#endif
+    unsigned count = std::thread::hardware_concurrency();
+    return count == 0 ? 1 : count;
+}
+
+ThreadPool::ThreadPool(unsigned threads)
+{
+    if (threads == 0)
+        threads = 1;
+
+    workers_.reserve(threads);
+    for (unsigned i = 0; i < threads; i++)
+        workers_.emplace_back(&ThreadPool::work ,this);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard lock(mutex_);
+        isStopping_ = true;
+    }
+    wakeup_.notify_all();
+
+    for (auto& worker : workers_)
+        worker.join();
+}
+
+void ThreadPool::work()
+{
+    while (true)
+    {
+        std::function<void()> job;
+        {
+            std::unique_lock lock(mutex_);
+            wakeup_.wait(lock ,[this] { return isStopping_ || !jobs_.empty(); });
+
+            if (jobs_.empty())
+                return; // stopping and nothing left
+
+            job = std::move(jobs_.front());
+            jobs_.pop();
+        }
+        job();
+    }
+}
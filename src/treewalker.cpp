@@ -0,0 +1,511 @@
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "compiler.h"
+#include "evaluator.h"
+#include "treewalker.h"
+
+using namespace Compiler;
+
+static std::string nameOf(SymbolId id)
+{
+    return std::string(symbols().lookup(id));
+}
+
+// x += y is x = x + y
+static TokenType baseOperator(TokenType op)
+{
+    switch (op)
+    {
+        case TokenType::PlusEquals: return TokenType::Plus;
+        case TokenType::MinusEquals: return TokenType::Minus;
+        case TokenType::MultiplicationEquals: return TokenType::Multiplication;
+        case TokenType::DivisionEquals: return TokenType::Division;
+        case TokenType::ModuloEquals: return TokenType::Modulo;
+        default: return TokenType::Unknown;
+    }
+}
+
+static bool isVariable(const AST::ASTNode* node)
+{
+    const auto type = node->getType();
+    return type == AST::NodeType::VarDeclaration || type == AST::NodeType::VarAllocation
+        || type == AST::NodeType::VarDefinition || type == AST::NodeType::VarReference;
+}
+
+// a reference to a name is another name for its value
+static bool isAlias(const AST::VariableBase* variable)
+{
+    return variable->getType() == AST::NodeType::VarReference && variable->value && variable->value->getType() == AST::NodeType::Lvalue;
+}
+
+void TreeWalker::fail(const std::string& msg)
+{
+    throw std::runtime_error(msg);
+}
+
+void TreeWalker::run(const std::vector<const AST::ASTNode*>& statements)
+{
+    // functions can call and read the names declared after them
+    frames_.emplace_back();
+    for (const auto* statement : statements)
+    {
+        if (statement->getType() == AST::NodeType::FunctionDefinition)
+            functions_[static_cast<const AST::FunctionDefinition*>(statement)->name] = static_cast<const AST::FunctionDefinition*>(statement);
+        else if (isVariable(statement) && !isAlias(static_cast<const AST::VariableBase*>(statement)))
+        {
+            const SymbolId name = static_cast<const AST::VariableBase*>(statement)->name;
+            globals_[name] = Local{name ,std::make_shared<Value>() ,kNoDomain_ ,0};
+        }
+    }
+
+    for (const auto* statement : statements)
+    {
+        if (statement->getType() == AST::NodeType::FunctionDefinition)
+            continue;
+        if (statement->getType() == AST::NodeType::Return)
+            fail("return outside of a function");
+        if (statement->getType() == AST::NodeType::Block) // return leaves it
+            evaluateBlock(static_cast<const AST::Block*>(statement));
+        else
+            execute(statement);
+    }
+}
+
+std::vector<std::pair<SymbolId ,Value>> TreeWalker::results() const
+{
+    std::vector<std::pair<SymbolId ,Value>> results;
+    for (const auto& result : results_)
+        if (result.domain == kNoDomain_ || isDomainAlive_[result.domain])
+            results.emplace_back(result.name ,*result.slot);
+    return results;
+}
+
+TreeWalker::Local* TreeWalker::find(SymbolId name)
+{
+    auto& locals = frames_.back().locals;
+    for (auto it = locals.rbegin(); it != locals.rend(); ++it)
+        if (it->name == name)
+            return &*it;
+    auto it = globals_.find(name);
+    return it != globals_.end() ? &it->second : nullptr;
+}
+
+TreeWalker::Local& TreeWalker::named(const AST::Rvalue* node)
+{
+    if (node->getType() != AST::NodeType::Lvalue)
+        fail("only variables can be assigned");
+
+    const SymbolId name = static_cast<const AST::Lvalue*>(node)->identifier;
+    if (Local* local = find(name))
+        return *local;
+    if (functions_.count(name))
+        fail(nameOf(name) + " is a function, it has to be called");
+    fail(nameOf(name) + " isnt defined");
+}
+
+const TreeWalker::Domain& TreeWalker::findDomain(SymbolId name) const
+{
+    const auto& domains = frames_.back().domains;
+    for (auto it = domains.rbegin(); it != domains.rend(); ++it)
+        if (it->name == name)
+            return *it;
+    for (const auto& domain : frames_.front().domains) // functions see the top level ones
+        if (domain.depth == 0 && domain.name == name)
+            return domain;
+    fail("there is no domain " + nameOf(name));
+}
+
+Value TreeWalker::evaluate(const AST::Rvalue* node)
+{
+    if (!node)
+        fail("expression has errors");
+
+    using AST::NodeType;
+    switch (node->getType())
+    {
+        case NodeType::Literal:
+            return toValue(static_cast<const AST::Literal*>(node)->value);
+        case NodeType::Lvalue:
+            return *named(node).slot;
+        case NodeType::Block:
+            return evaluateBlock(static_cast<const AST::Block*>(node));
+        case NodeType::Unary:
+            return evaluateUnary(static_cast<const AST::Unary*>(node));
+        case NodeType::Binary:
+            return evaluateBinary(static_cast<const AST::Binary*>(node));
+        case NodeType::Call:
+            return evaluateCall(static_cast<const AST::Call*>(node));
+        case NodeType::Conditional: {
+            auto* conditional = static_cast<const AST::Conditional*>(node);
+            if (conditional->otherwise) // value | condition ,otherwise
+                return isTruthy(evaluate(conditional->rhs)) ? evaluate(conditional->lhs) : evaluate(conditional->otherwise);
+            // condition | action
+            return isTruthy(evaluate(conditional->lhs)) && !AST::isEmptySet(conditional->rhs) ? evaluate(conditional->rhs) : Value();
+        }
+        case NodeType::Set:
+        case NodeType::Comprehension:
+        case NodeType::Member:
+        case NodeType::Index:
+            fail(formatNode(node) + " uses sets, runtime code cant use sets yet");
+        default:
+            fail(formatNode(node) + " cant be run");
+    }
+}
+
+Value TreeWalker::evaluateUnary(const AST::Unary* unary)
+{
+    switch (unary->op)
+    {
+        case TokenType::Not:
+            return Int_t(!isTruthy(evaluate(unary->operand)));
+        case TokenType::Minus: {
+            const Value value = evaluate(unary->operand);
+            if (auto* d = std::get_if<Double_t>(&value))
+                return -*d;
+            return applyBinary(TokenType::Minus ,Int_t(0) ,value);
+        }
+        case TokenType::DoublePlus:
+        case TokenType::DoubleMinus: {
+            Local& target = named(unary->operand);
+            const Value before = *target.slot;
+            *target.slot = applyBinary(unary->op == TokenType::DoublePlus ? TokenType::Plus : TokenType::Minus ,before ,Int_t(1));
+            return unary->isPostfix ? before : *target.slot;
+        }
+        default:
+            fail("operator '" + getTokenKey(unary->op) + "' cant be run");
+    }
+}
+
+Value TreeWalker::evaluateBinary(const AST::Binary* binary)
+{
+    switch (binary->op)
+    {
+        case TokenType::At:
+            fail(formatNode(binary) + " cant be used by runtime code yet");
+        case TokenType::And:
+            return Int_t(isTruthy(evaluate(binary->lhs)) && isTruthy(evaluate(binary->rhs)));
+        case TokenType::Or:
+            return Int_t(isTruthy(evaluate(binary->lhs)) || isTruthy(evaluate(binary->rhs)));
+        case TokenType::Xor: {
+            const bool lhs = isTruthy(evaluate(binary->lhs));
+            return Int_t(lhs != isTruthy(evaluate(binary->rhs)));
+        }
+        case TokenType::Assign: {
+            Value value = evaluate(binary->rhs);
+            *named(binary->lhs).slot = value;
+            return value;
+        }
+        case TokenType::DoubleDot:
+            fail(formatNode(binary) + " is a set, runtime code cant use sets yet");
+        default:
+            break;
+    }
+
+    if (const TokenType op = baseOperator(binary->op); op != TokenType::Unknown) // x += y
+    {
+        const Value current = *named(binary->lhs).slot;
+        Value value = applyBinary(op ,current ,evaluate(binary->rhs));
+        *named(binary->lhs).slot = value;
+        return value;
+    }
+    const Value lhs = evaluate(binary->lhs);
+    return applyBinary(binary->op ,lhs ,evaluate(binary->rhs));
+}
+
+Value TreeWalker::evaluateCall(const AST::Call* call)
+{
+    std::vector<Value> arguments;
+    arguments.reserve(call->arguments.size());
+    for (const auto* argument : call->arguments)
+        arguments.push_back(evaluate(argument));
+
+    if (call->callee->getType() == AST::NodeType::Lvalue)
+    {
+        const SymbolId name = static_cast<const AST::Lvalue*>(call->callee)->identifier;
+        auto it = functions_.find(name);
+        if (it == functions_.end())
+            fail(nameOf(name) + (find(name) ? " isnt a function" : " isnt defined"));
+        return this->call(it->second ,std::move(arguments));
+    }
+
+    if (call->callee->getType() == AST::NodeType::Binary)
+    {
+        auto* at = static_cast<const AST::Binary*>(call->callee);
+        if (at->op == TokenType::At && at->lhs->getType() == AST::NodeType::Lvalue && at->rhs->getType() == AST::NodeType::Lvalue)
+        {
+            const std::string name = nameOf(static_cast<const AST::Lvalue*>(at->lhs)->identifier);
+            const std::string domain = nameOf(static_cast<const AST::Lvalue*>(at->rhs)->identifier);
+            if (domain == "Functions" && (name == "pow" || name == "abs"))
+                return callBuiltin(name ,arguments);
+            if (domain == "Functions" && name == "sum")
+                fail("sum@Functions adds up a set, runtime code cant use sets yet");
+        }
+    }
+    fail("only functions can be called");
+}
+
+void TreeWalker::convertArguments(const AST::FunctionDefinition* function ,std::vector<Value>& arguments)
+{
+    for (size_t i = 0; i < arguments.size(); i++) // x : int
+    {
+        const auto* parameter = function->parameters[i];
+        if (!parameter->hasType || !isNumber(arguments[i]))
+            continue;
+
+        const std::string type = nameOf(parameter->type);
+        if (auto* c = std::get_if<Char_t>(&arguments[i]); c && (type == "int" || type == "double"))
+            arguments[i] = Int_t(static_cast<unsigned char>(*c));
+        if (type == "int" && std::holds_alternative<Double_t>(arguments[i]))
+        {
+            const Double_t d = std::get<Double_t>(arguments[i]);
+            if (d != std::trunc(d) || !(std::fabs(d) < 9.2e18))
+                fail(nameOf(function->name) + " expects an int for " + nameOf(parameter->name) + " but got " + formatValue(arguments[i]));
+            arguments[i] = static_cast<Int_t>(d);
+        }
+        else if (type == "double" && std::holds_alternative<Int_t>(arguments[i]))
+            arguments[i] = static_cast<Double_t>(std::get<Int_t>(arguments[i]));
+    }
+}
+
+Value TreeWalker::call(const AST::FunctionDefinition* function ,std::vector<Value> arguments)
+{
+    const std::string name = nameOf(function->name);
+    if (arguments.size() != function->parameters.size())
+        fail(name + " takes " + std::to_string(function->parameters.size()) + " arguments but got " + std::to_string(arguments.size()));
+
+    convertArguments(function ,arguments);
+    if (function->relation != TokenType::Assign)
+        fail(name + " isnt defined with '=', it cant be run");
+    if (frames_.size() > kMaxCallDepth_)
+        fail("calls of " + name + " nest deeper than " + std::to_string(kMaxCallDepth_));
+
+    frames_.emplace_back();
+    for (size_t i = 0; i < arguments.size(); i++)
+        frames_.back().locals.push_back(Local{function->parameters[i]->name ,std::make_shared<Value>(std::move(arguments[i])) ,kNoDomain_ ,0});
+
+    // the loops the Bytecode compiler makes, so both go as deep
+    auto it = recursions_.find(function);
+    if (it == recursions_.end())
+        it = recursions_.emplace(function ,findRecursion(function)).first;
+    Value result = it->second.isLoop() ? loop(function ,it->second) : evaluate(function->value);
+    frames_.pop_back();
+    return result;
+}
+
+Value TreeWalker::loop(const AST::FunctionDefinition* function ,const Recursion& recursion)
+{
+    // each level replaces the parameters of the one above, a step keeps the
+    // operand it evaluated first, or the locals to evaluate it with, until
+    // the levels below it are done
+    struct Pending
+    {
+        Value operand;
+        std::vector<Local> locals;
+    };
+    std::vector<Pending> pending;
+
+    const bool isBlock = function->value->getType() == AST::NodeType::Block; // { return value; }
+    if (isBlock)
+        enterBlock();
+    Value result;
+    while (true)
+    {
+        const AST::Rvalue* node = recursion.value;
+        while (recursion.isBranch(node))
+        {
+            auto* conditional = static_cast<const AST::Conditional*>(node);
+            node = isTruthy(evaluate(conditional->rhs)) ? conditional->lhs : conditional->otherwise;
+        }
+
+        const bool isStep = node == recursion.step;
+        const AST::Call* call = isStep ? recursion.stepCall() : recursion.callOf(node);
+        if (!call)
+        {
+            result = evaluate(node);
+            break;
+        }
+
+        Value operand;
+        if (isStep && !recursion.isCallFirst)
+            operand = evaluate(recursion.stepOperand());
+        std::vector<Value> arguments;
+        arguments.reserve(call->arguments.size());
+        for (const auto* argument : call->arguments)
+            arguments.push_back(evaluate(argument));
+        convertArguments(function ,arguments);
+        if (isStep)
+            pending.push_back(Pending{std::move(operand) ,recursion.isCallFirst ? frames_.back().locals : std::vector<Local>()});
+
+        auto& locals = frames_.back().locals;
+        locals.clear();
+        for (size_t i = 0; i < arguments.size(); i++)
+            locals.push_back(Local{function->parameters[i]->name ,std::make_shared<Value>(std::move(arguments[i])) ,kNoDomain_ ,0});
+    }
+
+    for (auto it = pending.rbegin(); it != pending.rend(); ++it)
+    {
+        if (recursion.isCallFirst)
+        {
+            frames_.back().locals = std::move(it->locals);
+            result = applyBinary(recursion.step->op ,result ,evaluate(recursion.stepOperand()));
+        }
+        else
+            result = applyBinary(recursion.step->op ,it->operand ,result);
+    }
+    if (isBlock)
+        exitBlock();
+    return result;
+}
+
+void TreeWalker::enterBlock()
+{
+    frames_.back().depth++;
+}
+
+void TreeWalker::exitBlock()
+{
+    Frame& frame = frames_.back();
+    while (!frame.domains.empty() && frame.domains.back().depth == frame.depth)
+    {
+        isDomainAlive_[frame.domains.back().id] = false;
+        frame.domains.pop_back();
+    }
+    frame.locals.erase(std::remove_if(frame.locals.begin() ,frame.locals.end() ,[&](const Local& local) { return local.depth >= frame.depth; })
+        ,frame.locals.end());
+    frame.depth--;
+}
+
+Value TreeWalker::evaluateBlock(const AST::Block* block)
+{
+    // a block is a value, return gives it
+    Value result;
+    enterBlock();
+    for (const auto* statement : block->ASTList)
+    {
+        if (execute(statement))
+        {
+            result = std::move(returnValue_);
+            break;
+        }
+    }
+    exitBlock();
+    return result;
+}
+
+void TreeWalker::declare(const AST::VariableBase* variable)
+{
+    const bool isTopLevel = frames_.size() == 1 && frames_.back().depth == 0;
+    const bool isMain = frames_.size() == 1;
+
+    if (isAlias(variable))
+    {
+        Local local = named(variable->value);
+        local.name = variable->name;
+        local.depth = frames_.back().depth;
+        if (isTopLevel)
+        {
+            globals_[variable->name] = local;
+            results_.push_back(local);
+        }
+        else
+            frames_.back().locals.push_back(local);
+        return;
+    }
+
+    Value value;
+    if (variable->getType() == AST::NodeType::VarDefinition || variable->getType() == AST::NodeType::VarReference)
+        value = evaluate(variable->value);
+
+    Frame& frame = frames_.back(); // evaluating the value can call functions
+    const bool isNamedDomain = variable->hasDomain && !symbols().lookup(variable->domain).empty();
+    const Domain* domain = isNamedDomain ? &findDomain(variable->domain) : nullptr;
+    const bool isTopLevelDomain = domain && domain->depth == 0; // function bodies are blocks, their domains are deeper
+
+    // on a block's domain, or the domain of its block
+    if ((domain && !isTopLevelDomain) || (!variable->hasDomain && !isTopLevel))
+    {
+        frame.locals.push_back(Local{variable->name ,std::make_shared<Value>(std::move(value)) ,domain ? domain->id : kNoDomain_
+            ,domain ? domain->depth : frame.depth});
+        return;
+    }
+
+    // on the global domain or a top level one, top level names were made by run()
+    Local& global = globals_[variable->name];
+    if (isTopLevel)
+        *global.slot = std::move(value);
+    else
+        global.slot = std::make_shared<Value>(std::move(value));
+    global.name = variable->name;
+    global.domain = domain ? domain->id : kNoDomain_;
+    global.depth = 0;
+    if (isMain)
+        results_.push_back(global);
+}
+
+bool TreeWalker::execute(const AST::ASTNode* statement)
+{
+    if (!statement)
+        fail("statement has errors");
+
+    using AST::NodeType;
+    switch (statement->getType())
+    {
+        case NodeType::Empty:
+            return false;
+        case NodeType::VarDeclaration:
+        case NodeType::VarAllocation:
+        case NodeType::VarDefinition:
+        case NodeType::VarReference:
+            declare(static_cast<const AST::VariableBase*>(statement));
+            return false;
+        case NodeType::FunctionDefinition:
+            fail("functions can only be defined at the top level");
+        case NodeType::Return: {
+            auto* ret = static_cast<const AST::Return*>(statement);
+            returnValue_ = ret->value ? evaluate(ret->value) : Value();
+            return true;
+        }
+        case NodeType::Block: {
+            // a nested block returns from whatever encloses it
+            enterBlock();
+            for (const auto* inner : static_cast<const AST::Block*>(statement)->ASTList)
+            {
+                if (execute(inner))
+                {
+                    exitBlock();
+                    return true;
+                }
+            }
+            exitBlock();
+            return false;
+        }
+        case NodeType::Domain: {
+            auto* domain = static_cast<const AST::Domain*>(statement);
+            Frame& frame = frames_.back();
+            if (domain->op == TokenType::Create)
+            {
+                frame.domains.push_back(Domain{domain->name ,frame.depth ,isDomainAlive_.size()});
+                isDomainAlive_.push_back(true);
+                return false;
+            }
+            auto it = std::find_if(frame.domains.rbegin() ,frame.domains.rend() ,[&](const Domain& d) { return d.name == domain->name; });
+            if (it == frame.domains.rend())
+                fail("there is no domain " + nameOf(domain->name));
+            isDomainAlive_[it->id] = false;
+            frame.domains.erase(std::next(it).base());
+            return false;
+        }
+        default:
+            if (AST::isEmptySet(statement))
+                return false;
+            if (!AST::isExpression(statement->getType()))
+                fail(formatNode(statement) + " cant be run");
+            evaluate(static_cast<const AST::Rvalue*>(statement));
+            return false;
+    }
+}
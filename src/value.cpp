@@ -0,0 +1,199 @@
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <variant>
+#include <vector>
+
+#include "hash.h"
+#include "lazyset.h"
+#include "setvalue.h"
+#include "value.h"
+
+using namespace Compiler;
+
+Value Compiler::toValue(const AST::Literal_t& literal)
+{
+    return std::visit([](const auto& value) -> Value { return value; } ,literal);
+}
+
+bool Compiler::isNumber(const Value& value)
+{
+    return std::holds_alternative<Int_t>(value) || std::holds_alternative<Double_t>(value)
+        || std::holds_alternative<Char_t>(value);
+}
+
+static Double_t toDouble(const Value& value)
+{
+    if (auto* d = std::get_if<Double_t>(&value))
+        return *d;
+    if (auto* c = std::get_if<Char_t>(&value))
+        return static_cast<unsigned char>(*c);
+    return static_cast<Double_t>(std::get<Int_t>(value));
+}
+
+bool Compiler::isTruthy(const Value& value)
+{
+    if (auto* i = std::get_if<Int_t>(&value))
+        return *i != 0;
+    if (auto* d = std::get_if<Double_t>(&value))
+        return *d != 0 && !std::isnan(*d);
+    if (auto* c = std::get_if<Char_t>(&value))
+        return *c != '\0';
+    if (auto* s = std::get_if<SymbolId>(&value))
+        return !symbols().lookup(*s).empty();
+    if (auto* set = std::get_if<SetRef>(&value))
+        return (*set)->size() != 0;
+    if (auto* lazy = std::get_if<LazyRef>(&value))
+        return (*lazy)->at(0).has_value();
+    return false; // undefined
+}
+
+bool Compiler::valuesEqual(const Value& a ,const Value& b)
+{
+    if (isNumber(a) && isNumber(b))
+    {
+        if (std::holds_alternative<Double_t>(a) || std::holds_alternative<Double_t>(b))
+            return toDouble(a) == toDouble(b);
+        // Int_t and Char_t
+        auto toInt = [](const Value& v) { return std::holds_alternative<Int_t>(v) ? std::get<Int_t>(v) : Int_t(static_cast<unsigned char>(std::get<Char_t>(v))); };
+        return toInt(a) == toInt(b);
+    }
+    return isSame(a ,b);
+}
+
+bool Compiler::isSame(const Value& a ,const Value& b)
+{
+    if (a.index() != b.index())
+        return false;
+
+    if (auto* d = std::get_if<Double_t>(&a))
+    {
+        const Double_t other = std::get<Double_t>(b);
+        return std::memcmp(d ,&other ,sizeof(other)) == 0 || (std::isnan(*d) && std::isnan(other));
+    }
+    if (auto* set = std::get_if<SetRef>(&a))
+        return setsEqual(**set ,*std::get<SetRef>(b));
+    return a == b;
+}
+
+bool Compiler::valueLess(const Value& a ,const Value& b)
+{
+    if (a.index() != b.index())
+        return a.index() < b.index();
+
+    switch (a.index())
+    {
+        case 1: return std::get<Int_t>(a) < std::get<Int_t>(b);
+        case 2: {
+            const Double_t x = std::get<Double_t>(a);
+            const Double_t y = std::get<Double_t>(b);
+            if (std::isnan(x) || std::isnan(y))
+                return !std::isnan(x); // NaN sorts last
+            return x < y;
+        }
+        case 3: return std::get<Char_t>(a) < std::get<Char_t>(b);
+        case 4: return symbols().lookup(std::get<SymbolId>(a)) < symbols().lookup(std::get<SymbolId>(b));
+        case 5: {
+            const SetValue& lhs = *std::get<SetRef>(a);
+            const SetValue& rhs = *std::get<SetRef>(b);
+            if (lhs.size() != rhs.size())
+                return lhs.size() < rhs.size();
+            for (size_t i = 0; i < lhs.size(); i++)
+            {
+                const Value x = lhs.at(i);
+                const Value y = rhs.at(i);
+                if (valueLess(x ,y))
+                    return true;
+                if (valueLess(y ,x))
+                    return false;
+            }
+            return false;
+        }
+        case 6: return std::less<const LazySet*>()(std::get<LazyRef>(a).get() ,std::get<LazyRef>(b).get());
+        default: return false; // undefined
+    }
+}
+
+uint64_t Compiler::hashOf(const Value& value ,uint64_t hash)
+{
+    hash = hashValue(value.index() ,hash);
+    switch (value.index())
+    {
+        case 1: return hashValue(std::get<Int_t>(value) ,hash);
+        case 2: {
+            const Double_t d = std::get<Double_t>(value);
+            return std::isnan(d) ? hash : hashValue(d ,hash);
+        }
+        case 3: return hashValue(std::get<Char_t>(value) ,hash);
+        case 4: return hashValue(std::get<SymbolId>(value) ,hash);
+        case 5:
+            std::get<SetRef>(value)->forEach([&hash](const Value& element) { hash = hashOf(element ,hash); });
+            return hash;
+        case 6: return hashValue(std::get<LazyRef>(value).get() ,hash);
+        default: return hash;
+    }
+}
+
+std::string Compiler::formatValue(const Value& value)
+{
+    switch (value.index())
+    {
+        case 1: return std::to_string(std::get<Int_t>(value));
+        case 2: {
+            const Double_t d = std::get<Double_t>(value);
+            if (std::isnan(d))
+                return "nan";
+            char buffer[32];
+            auto result = std::to_chars(buffer ,buffer + sizeof(buffer) ,d);
+            std::string text(buffer ,result.ptr);
+            if (text.find_first_of(".en") == std::string::npos) // keep it a double when read back
+                text += ".0";
+            return text;
+        }
+        case 3: return std::string("'") + std::get<Char_t>(value) + "'";
+        case 4: return "\"" + std::string(symbols().lookup(std::get<SymbolId>(value))) + "\"";
+        case 5: {
+            std::string text = "{";
+            std::get<SetRef>(value)->forEach([&text](const Value& element)
+            {
+                text += (text.size() > 1 ? ", " : "") + formatValue(element);
+            });
+            return text + "}";
+        }
+        case 6: {
+            // the first few elements, a generated set only shows what it found so far
+            constexpr size_t kShown = 16;
+            LazySet& set = *std::get<LazyRef>(value);
+            std::vector<Value> elements;
+            bool isCut;
+            if (set.isIndexed())
+            {
+                for (size_t i = 0; i < kShown; i++)
+                {
+                    auto element = set.at(i);
+                    if (!element)
+                        break;
+                    elements.push_back(std::move(*element));
+                }
+                isCut = elements.size() == kShown && set.at(kShown);
+            }
+            else
+            {
+                const auto& known = set.known();
+                elements.assign(known.begin() ,known.begin() + std::min(known.size() ,kShown));
+                isCut = known.size() > kShown || !set.isComplete();
+            }
+
+            std::string text = "{";
+            for (const auto& element : elements)
+                text += (text.size() > 1 ? ", " : "") + formatValue(element);
+            if (isCut)
+                text += text.size() > 1 ? ", ..." : "...";
+            return text + "}";
+        }
+        default: return "undefined";
+    }
+}
@@ -0,0 +1,450 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <limits>
+#include <new>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "domain.h"
+#include "evaluator.h"
+#include "passmanager.h"
+#include "treewalker.h"
+#include "vm.h"
+
+using namespace Compiler;
+
+using Type = RuntimeValue::Type;
+
+namespace {
+
+// the slow paths, kept out of the loop
+[[gnu::noinline]] RuntimeValue slowBinary(TokenType op ,const RuntimeValue& lhs ,const RuntimeValue& rhs)
+{
+    return toRuntimeValue(applyBinary(op ,toValue(lhs) ,toValue(rhs)));
+}
+
+[[gnu::noinline]] bool slowTruthy(const RuntimeValue& value)
+{
+    return isTruthy(toValue(value));
+}
+
+inline bool truthy(const RuntimeValue& value)
+{
+    return value.type == Type::Int ? value.i != 0 : slowTruthy(value);
+}
+
+[[noreturn, gnu::noinline]] void fail(const std::string& msg)
+{
+    throw std::runtime_error(msg);
+}
+
+[[gnu::noinline]] RuntimeValue runBuiltin(Bytecode::Builtin builtin ,const RuntimeValue* arguments ,uint16_t count)
+{
+    std::vector<Value> values;
+    for (uint16_t i = 0; i < count; i++)
+        values.push_back(toValue(arguments[i]));
+    return toRuntimeValue(callBuiltin(builtin == Bytecode::Builtin::Pow ? "pow" : "abs" ,values));
+}
+
+// a parameter declared as an int (toDouble false) or a double, like Evaluator::call()
+[[gnu::noinline]] void convert(RuntimeValue& value ,bool toDouble ,const std::string& msg)
+{
+    if (value.type == Type::Char)
+        value = RuntimeValue::ofInt(static_cast<unsigned char>(value.c));
+
+    if (toDouble && value.type == Type::Int)
+    {
+        const auto d = static_cast<Double_t>(value.i);
+        value.type = Type::Double;
+        value.d = d;
+    }
+    else if (!toDouble && value.type == Type::Double)
+    {
+        const Double_t d = value.d;
+        if (d != std::trunc(d) || !(std::fabs(d) < 9.2e18))
+            fail(msg + formatValue(d));
+        value = RuntimeValue::ofInt(static_cast<Int_t>(d));
+    }
+}
+
+} // namespace
+
+VM::VM(const Bytecode& program)
+    : program_ (program)
+    ,registers_ (std::max<size_t>(1024 ,program.functions[0].registerCount))
+    ,globals_ (program.globalCount)
+    ,isDeclared_ (program.globalCount)
+{}
+
+VM::~VM()
+{
+    for (::Domain* domain : domains_)
+        domainDelete(domain);
+}
+
+#if defined(__GNUC__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic" // computed goto
+#endif
+
+void VM::run()
+{
+    using Op = Bytecode::Op;
+
+    const Bytecode::Instruction* const code = program_.code.data();
+    const RuntimeValue* const constants = program_.constants.data();
+    RuntimeValue* const globals = globals_.data();
+    RuntimeValue* stack = registers_.data();
+    RuntimeValue* r = stack; // the current frame
+    const Bytecode::Instruction* pc = code + program_.functions[0].entry;
+
+#if defined(__GNUC__)
+    // in the order of Bytecode::Op
+    static const void* const kHandlers[] = {
+        &&Move, &&LoadConst, &&LoadGlobal, &&StoreGlobal, &&DefineGlobal, &&LoadCell, &&StoreCell,
+        &&Add, &&Subtract, &&Multiply, &&Divide, &&Modulo, &&AddConst, &&SubtractConst,
+        &&Equal, &&NotEqual, &&Less, &&LessEqual, &&Greater, &&GreaterEqual,
+        &&Negate, &&Not, &&Truth, &&Increment, &&Decrement,
+        &&Jump, &&JumpIfFalse, &&JumpIfTrue,
+        &&JumpUnlessEqual, &&JumpUnlessNotEqual, &&JumpUnlessLess, &&JumpUnlessLessEqual, &&JumpUnlessGreater, &&JumpUnlessGreaterEqual,
+        &&JumpUnlessEqualConst, &&JumpUnlessNotEqualConst, &&JumpUnlessLessConst, &&JumpUnlessLessEqualConst,
+        &&JumpUnlessGreaterConst, &&JumpUnlessGreaterEqualConst,
+        &&Call, &&CallBuiltin, &&Convert, &&Return,
+        &&CreateDomain, &&DeleteDomain, &&NewCell, &&Fail, &&Halt,
+    };
+    static_assert(sizeof(kHandlers) / sizeof(kHandlers[0]) == static_cast<size_t>(Op::Halt) + 1);
+#define VM_DISPATCH() goto *kHandlers[static_cast<size_t>(pc->op)]
+#define VM_CASE(name) name:
+    VM_DISPATCH();
+#else
+#define VM_DISPATCH() goto dispatch
+#define VM_CASE(name) case Op::name:
+dispatch:
+    switch (pc->op)
+    {
+#endif
+#define VM_NEXT() do { pc++; VM_DISPATCH(); } while (false)
+
+    // ints inline, with the overflow check applyBinary() does
+#define VM_ARITHMETIC(name ,token ,builtin ,rhs) \
+    VM_CASE(name) { \
+        const RuntimeValue& x = r[pc->b]; \
+        const RuntimeValue& y = rhs; \
+        Int_t value; \
+        if (x.type == Type::Int && y.type == Type::Int && !builtin(x.i ,y.i ,&value)) \
+            r[pc->a] = RuntimeValue::ofInt(value); \
+        else \
+            r[pc->a] = slowBinary(token ,x ,y); \
+        VM_NEXT(); \
+    }
+
+    // a / 0 is undefined and MIN / -1 overflows, both in applyBinary()
+#define VM_DIVISION(name ,token ,op) \
+    VM_CASE(name) { \
+        const RuntimeValue& x = r[pc->b]; \
+        const RuntimeValue& y = r[pc->c]; \
+        if (x.type == Type::Int && y.type == Type::Int && y.i != 0 && !(y.i == -1 && x.i == std::numeric_limits<Int_t>::min())) \
+            r[pc->a] = RuntimeValue::ofInt(x.i op y.i); \
+        else \
+            r[pc->a] = slowBinary(token ,x ,y); \
+        VM_NEXT(); \
+    }
+
+    // comparisons of two ints or two doubles inline, NaN compares false like in applyBinary()
+#define VM_COMPARE(x ,y ,op ,token) \
+    ((x).type == Type::Int && (y).type == Type::Int ? (x).i op (y).i \
+        : (x).type == Type::Double && (y).type == Type::Double ? (x).d op (y).d \
+        : truthy(slowBinary(token ,x ,y)))
+
+#define VM_COMPARISON(name ,op ,token) \
+    VM_CASE(name) { \
+        const RuntimeValue& x = r[pc->b]; \
+        const RuntimeValue& y = r[pc->c]; \
+        if (x.type == Type::Int && y.type == Type::Int) \
+            r[pc->a] = RuntimeValue::ofInt(x.i op y.i); \
+        else if (x.type == Type::Double && y.type == Type::Double) \
+            r[pc->a] = RuntimeValue::ofInt(x.d op y.d); \
+        else \
+            r[pc->a] = slowBinary(token ,x ,y); /* undefined stays undefined */ \
+        VM_NEXT(); \
+    }
+
+#define VM_BRANCH(name ,op ,token ,rhs) \
+    VM_CASE(name) { \
+        if (VM_COMPARE(r[pc->a] ,rhs ,op ,token)) \
+            pc++; \
+        else \
+            pc = code + pc->target; \
+        VM_DISPATCH(); \
+    }
+
+    VM_CASE(Move) { r[pc->a] = r[pc->b]; VM_NEXT(); }
+    VM_CASE(LoadConst) { r[pc->a] = constants[pc->target]; VM_NEXT(); }
+    VM_CASE(LoadGlobal) { r[pc->a] = globals[pc->target]; VM_NEXT(); }
+    VM_CASE(StoreGlobal) { globals[pc->target] = r[pc->a]; VM_NEXT(); }
+    VM_CASE(DefineGlobal) {
+        globals[pc->target] = r[pc->a];
+        isDeclared_[pc->target] = true;
+        VM_NEXT();
+    }
+    VM_CASE(LoadCell) {
+        // a global cell a function reads before the top level code declares it is undefined
+        r[pc->a] = r[pc->b].type == Type::Cell ? *r[pc->b].cell : RuntimeValue();
+        VM_NEXT();
+    }
+    VM_CASE(StoreCell) {
+        if (r[pc->a].type != Type::Cell)
+            fail("a variable on a domain is assigned before it is declared");
+        *r[pc->a].cell = r[pc->b];
+        VM_NEXT();
+    }
+
+    VM_ARITHMETIC(Add ,TokenType::Plus ,__builtin_add_overflow ,r[pc->c])
+    VM_ARITHMETIC(Subtract ,TokenType::Minus ,__builtin_sub_overflow ,r[pc->c])
+    VM_ARITHMETIC(Multiply ,TokenType::Multiplication ,__builtin_mul_overflow ,r[pc->c])
+    VM_DIVISION(Divide ,TokenType::Division ,/)
+    VM_DIVISION(Modulo ,TokenType::Modulo ,%)
+    VM_ARITHMETIC(AddConst ,TokenType::Plus ,__builtin_add_overflow ,constants[pc->c])
+    VM_ARITHMETIC(SubtractConst ,TokenType::Minus ,__builtin_sub_overflow ,constants[pc->c])
+
+    VM_COMPARISON(Equal ,== ,TokenType::Equals)
+    VM_COMPARISON(NotEqual ,!= ,TokenType::NotEquals)
+    VM_COMPARISON(Less ,< ,TokenType::LessThan)
+    VM_COMPARISON(LessEqual ,<= ,TokenType::LessEquals)
+    VM_COMPARISON(Greater ,> ,TokenType::GreaterThan)
+    VM_COMPARISON(GreaterEqual ,>= ,TokenType::GreaterEquals)
+
+    VM_CASE(Negate) {
+        const RuntimeValue& x = r[pc->b];
+        if (x.type == Type::Double)
+        {
+            const Double_t d = -x.d;
+            r[pc->a].type = Type::Double;
+            r[pc->a].d = d;
+        }
+        else
+            r[pc->a] = slowBinary(TokenType::Minus ,RuntimeValue::ofInt(0) ,x);
+        VM_NEXT();
+    }
+    VM_CASE(Not) { r[pc->a] = RuntimeValue::ofInt(!truthy(r[pc->b])); VM_NEXT(); }
+    VM_CASE(Truth) { r[pc->a] = RuntimeValue::ofInt(truthy(r[pc->b])); VM_NEXT(); }
+    VM_CASE(Increment) {
+        RuntimeValue& x = r[pc->a];
+        Int_t value;
+        if (x.type == Type::Int && !__builtin_add_overflow(x.i ,1 ,&value))
+            x.i = value;
+        else
+            x = slowBinary(TokenType::Plus ,x ,RuntimeValue::ofInt(1));
+        VM_NEXT();
+    }
+    VM_CASE(Decrement) {
+        RuntimeValue& x = r[pc->a];
+        Int_t value;
+        if (x.type == Type::Int && !__builtin_sub_overflow(x.i ,1 ,&value))
+            x.i = value;
+        else
+            x = slowBinary(TokenType::Minus ,x ,RuntimeValue::ofInt(1));
+        VM_NEXT();
+    }
+
+    VM_CASE(Jump) { pc = code + pc->target; VM_DISPATCH(); }
+    VM_CASE(JumpIfFalse) {
+        pc = truthy(r[pc->a]) ? pc + 1 : code + pc->target;
+        VM_DISPATCH();
+    }
+    VM_CASE(JumpIfTrue) {
+        pc = truthy(r[pc->a]) ? code + pc->target : pc + 1;
+        VM_DISPATCH();
+    }
+    VM_BRANCH(JumpUnlessEqual ,== ,TokenType::Equals ,r[pc->b])
+    VM_BRANCH(JumpUnlessNotEqual ,!= ,TokenType::NotEquals ,r[pc->b])
+    VM_BRANCH(JumpUnlessLess ,< ,TokenType::LessThan ,r[pc->b])
+    VM_BRANCH(JumpUnlessLessEqual ,<= ,TokenType::LessEquals ,r[pc->b])
+    VM_BRANCH(JumpUnlessGreater ,> ,TokenType::GreaterThan ,r[pc->b])
+    VM_BRANCH(JumpUnlessGreaterEqual ,>= ,TokenType::GreaterEquals ,r[pc->b])
+    VM_BRANCH(JumpUnlessEqualConst ,== ,TokenType::Equals ,constants[pc->b])
+    VM_BRANCH(JumpUnlessNotEqualConst ,!= ,TokenType::NotEquals ,constants[pc->b])
+    VM_BRANCH(JumpUnlessLessConst ,< ,TokenType::LessThan ,constants[pc->b])
+    VM_BRANCH(JumpUnlessLessEqualConst ,<= ,TokenType::LessEquals ,constants[pc->b])
+    VM_BRANCH(JumpUnlessGreaterConst ,> ,TokenType::GreaterThan ,constants[pc->b])
+    VM_BRANCH(JumpUnlessGreaterEqualConst ,>= ,TokenType::GreaterEquals ,constants[pc->b])
+
+    VM_CASE(Call) {
+        const Bytecode::Function& callee = program_.functions[pc->target];
+        if (frames_.size() >= kMaxCallDepth_)
+            fail("calls of " + std::string(symbols().lookup(callee.name)) + " nest deeper than " + std::to_string(kMaxCallDepth_));
+
+        const size_t caller = static_cast<size_t>(r - stack);
+        const size_t base = caller + pc->a;
+        if (base + callee.registerCount > registers_.size())
+        {
+            registers_.resize(std::max(registers_.size() * 2 ,base + callee.registerCount));
+            stack = registers_.data();
+        }
+        frames_.push_back(Frame{pc + 1 ,caller});
+        r = stack + base;
+        pc = code + callee.entry;
+        VM_DISPATCH();
+    }
+    VM_CASE(CallBuiltin) {
+        r[pc->a] = runBuiltin(static_cast<Bytecode::Builtin>(pc->target) ,r + pc->a ,pc->b);
+        VM_NEXT();
+    }
+    VM_CASE(Convert) {
+        const Type type = r[pc->a].type;
+        if ((pc->b && type != Type::Double) || (!pc->b && type != Type::Int))
+            convert(r[pc->a] ,pc->b ,program_.messages[pc->target]);
+        VM_NEXT();
+    }
+    VM_CASE(Return) {
+        r[0] = r[pc->a];
+        const Frame frame = frames_.back();
+        frames_.pop_back();
+        r = stack + frame.base;
+        pc = frame.returnTo;
+        VM_DISPATCH();
+    }
+
+    VM_CASE(CreateDomain) {
+        domains_.push_back(domainCreate());
+        r[pc->a].type = Type::Domain;
+        r[pc->a].domain = domains_.back();
+        VM_NEXT();
+    }
+    VM_CASE(DeleteDomain) {
+        // usually the newest one
+        if (r[pc->a].type == Type::Domain)
+        {
+            domains_.erase(std::find(domains_.rbegin() ,domains_.rend() ,r[pc->a].domain).base() - 1);
+            domainDelete(r[pc->a].domain);
+        }
+        r[pc->a] = RuntimeValue();
+        VM_NEXT();
+    }
+    VM_CASE(NewCell) {
+        if (r[pc->b].type != Type::Domain)
+            fail("a variable is put on a domain that was deleted");
+        void* memory = domainAllocate(r[pc->b].domain ,sizeof(RuntimeValue) ,alignof(RuntimeValue));
+        r[pc->a].cell = new (memory) RuntimeValue();
+        r[pc->a].type = Type::Cell;
+        VM_NEXT();
+    }
+    VM_CASE(Fail) { fail(program_.messages[pc->target]); }
+    VM_CASE(Halt) { return; }
+
+#if !defined(__GNUC__)
+    }
+#endif
+#undef VM_BRANCH
+#undef VM_COMPARISON
+#undef VM_COMPARE
+#undef VM_DIVISION
+#undef VM_ARITHMETIC
+#undef VM_NEXT
+#undef VM_CASE
+#undef VM_DISPATCH
+}
+
+#if defined(__GNUC__)
+#pragma GCC diagnostic pop
+#endif
+
+std::vector<std::pair<SymbolId ,Value>> VM::results() const
+{
+    std::vector<std::pair<SymbolId ,Value>> results;
+    for (const auto& result : program_.results)
+    {
+        if (!isDeclared_[result.global])
+            continue;
+        RuntimeValue value = globals_[result.global];
+        if (result.isCell)
+            value = value.type == Type::Cell ? *value.cell : RuntimeValue();
+        results.emplace_back(result.name ,toValue(value));
+    }
+    return results;
+}
+
+static void logResults(const std::vector<std::pair<SymbolId ,Value>>& results)
+{
+    for (const auto& [name ,value] : results)
+        log(std::string(symbols().lookup(name)) + " = " + formatValue(value));
+}
+
+// the fastest of a few runs, in milliseconds
+template <typename Run>
+static double bestTime(Run run)
+{
+    constexpr int kRuns = 5;
+    double best = 0;
+    for (int i = 0; i < kRuns; i++)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        run();
+        const std::chrono::duration<double ,std::milli> time = std::chrono::steady_clock::now() - start;
+        best = i == 0 ? time.count() : std::min(best ,time.count());
+    }
+    return best;
+}
+
+bool Compiler::runProgram(const CompileContext& context ,const std::vector<const AST::ASTNode*>& statements)
+{
+    log("run");
+    try
+    {
+        if (context.run == RunMode::Tree)
+        {
+            TreeWalker walker;
+            walker.run(statements);
+            logResults(walker.results());
+            return true;
+        }
+
+        Bytecode program = Bytecode::compile(statements);
+        if (context.optimize)
+            program = optimize(program ,context.timePasses);
+        if (context.run == RunMode::VM)
+        {
+            VM vm(program);
+            vm.run();
+            logResults(vm.results());
+            return true;
+        }
+
+        // both from scratch each time, and they have to agree
+        std::vector<std::pair<SymbolId ,Value>> vmResults ,treeResults;
+        const double vmTime = bestTime([&]
+        {
+            VM vm(program);
+            vm.run();
+            vmResults = vm.results();
+        });
+        const double treeTime = bestTime([&]
+        {
+            TreeWalker walker;
+            walker.run(statements);
+            treeResults = walker.results();
+        });
+
+        const bool isAgreed = std::equal(vmResults.begin() ,vmResults.end() ,treeResults.begin() ,treeResults.end()
+            ,[](const auto& a ,const auto& b) { return a.first == b.first && isSame(a.second ,b.second); });
+        if (!isAgreed)
+            throw std::runtime_error("the VM and the tree walker got different results");
+
+        logResults(vmResults);
+        std::ostringstream times;
+        times << std::fixed << std::setprecision(2) << "vm " << vmTime << " ms, tree " << treeTime << " ms, "
+            << treeTime / std::max(vmTime ,1e-6) << "x faster";
+        log(times.str());
+        return true;
+    }
+    catch (const std::exception& e)
+    {
+        log(std::string("ERROR: ") + e.what() + ".");
+        return false;
+    }
+}
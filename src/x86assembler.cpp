@@ -0,0 +1,263 @@
+#include <cstring>
+#include <stdexcept>
+
+#include "x86assembler.h"
+
+using namespace Compiler;
+
+namespace {
+
+bool fitsInt8(int64_t value) { return value >= INT8_MIN && value <= INT8_MAX; }
+bool fitsInt32(int64_t value) { return value >= INT32_MIN && value <= INT32_MAX; }
+
+} // namespace
+
+bool X86Assembler::Operand::operator==(const Operand& other) const
+{
+    if (kind != other.kind)
+        return false;
+    switch (kind)
+    {
+        case Kind::Register: return reg == other.reg;
+        case Kind::Memory: return reg == other.reg && offset == other.offset;
+        default: return symbol == other.symbol && offset == other.offset;
+    }
+}
+
+X86Assembler::Label X86Assembler::newLabel()
+{
+    labels_.push_back(kUnbound);
+    return static_cast<Label>(labels_.size() - 1);
+}
+
+void X86Assembler::bind(Label label)
+{
+    labels_[label] = static_cast<uint32_t>(size());
+}
+
+void X86Assembler::int32(int32_t value)
+{
+    uint8_t bytes[4];
+    std::memcpy(bytes ,&value ,sizeof(bytes));
+    object_.text.insert(object_.text.end() ,bytes ,bytes + sizeof(bytes));
+}
+
+void X86Assembler::int64(int64_t value)
+{
+    uint8_t bytes[8];
+    std::memcpy(bytes ,&value ,sizeof(bytes));
+    object_.text.insert(object_.text.end() ,bytes ,bytes + sizeof(bytes));
+}
+
+void X86Assembler::rel32(Label label)
+{
+    fixups_.push_back(Fixup{size() ,label});
+    int32(0);
+}
+
+void X86Assembler::emit(bool isWide ,std::initializer_list<uint8_t> opcode ,uint8_t reg ,const Operand& rm ,size_t trailing ,bool hasByteRegister)
+{
+    uint8_t rex = (isWide ? 0x8 : 0) | ((reg >> 3) & 1) << 2;
+    if (rm.kind != Operand::Kind::Symbol)
+        rex |= (rm.reg >> 3) & 1;
+    if (rex || hasByteRegister) // with any REX prefix the byte registers 4 to 7 are spl to dil
+        byte(0x40 | rex);
+    for (uint8_t op : opcode)
+        byte(op);
+
+    const uint8_t field = (reg & 7) << 3;
+    switch (rm.kind)
+    {
+        case Operand::Kind::Register:
+            byte(0xC0 | field | (rm.reg & 7));
+            break;
+        case Operand::Kind::Memory:
+        {
+            // rsp and r12 as a base need a SIB byte, rbp and r13 always have an offset
+            const uint8_t base = rm.reg & 7;
+            const uint8_t mod = rm.offset == 0 && base != rbp ? 0 : fitsInt8(rm.offset) ? 1 : 2;
+            byte(mod << 6 | field | base);
+            if (base == rsp)
+                byte(0x24);
+            if (mod == 1)
+                byte(static_cast<uint8_t>(rm.offset));
+            else if (mod == 2)
+                int32(rm.offset);
+            break;
+        }
+        case Operand::Kind::Symbol:
+            byte(field | 5);
+            object_.addRelocation(size() ,rm.symbol ,ElfObject::kPC32 ,int64_t(rm.offset) - 4 - int64_t(trailing));
+            int32(0);
+            break;
+    }
+}
+
+void X86Assembler::mov(Reg dst ,const Operand& src)
+{
+    emit(true ,{0x8B} ,dst ,src);
+}
+
+void X86Assembler::mov(const Operand& dst ,Reg src)
+{
+    emit(true ,{0x89} ,src ,dst);
+}
+
+void X86Assembler::mov(const Operand& dst ,int64_t value)
+{
+    if (!dst.isRegister())
+    {
+        if (fitsInt32(value))
+        {
+            emit(true ,{0xC7} ,0 ,dst ,4);
+            int32(static_cast<int32_t>(value));
+            return;
+        }
+        mov(Operand::of(r11) ,value);
+        mov(dst ,r11);
+        return;
+    }
+
+    const Reg reg = dst.reg;
+    if (value >= 0 && value <= UINT32_MAX) // a 32 bit mov clears the upper half
+    {
+        if (reg >= r8)
+            byte(0x41);
+        byte(0xB8 | (reg & 7));
+        int32(static_cast<int32_t>(static_cast<uint32_t>(value)));
+    }
+    else if (fitsInt32(value))
+    {
+        emit(true ,{0xC7} ,0 ,dst ,4);
+        int32(static_cast<int32_t>(value));
+    }
+    else
+    {
+        byte(0x48 | (reg >> 3));
+        byte(0xB8 | (reg & 7));
+        int64(value);
+    }
+}
+
+void X86Assembler::lea(Reg dst ,const Operand& src)
+{
+    emit(true ,{0x8D} ,dst ,src);
+}
+
+void X86Assembler::alu(Alu op ,Reg dst ,const Operand& src)
+{
+    emit(true ,{static_cast<uint8_t>(static_cast<uint8_t>(op) << 3 | 3)} ,dst ,src);
+}
+
+void X86Assembler::alu(Alu op ,const Operand& dst ,int32_t value)
+{
+    if (fitsInt8(value))
+    {
+        emit(true ,{0x83} ,static_cast<uint8_t>(op) ,dst ,1);
+        byte(static_cast<uint8_t>(value));
+    }
+    else
+    {
+        emit(true ,{0x81} ,static_cast<uint8_t>(op) ,dst ,4);
+        int32(value);
+    }
+}
+
+void X86Assembler::imul(Reg dst ,const Operand& src)
+{
+    emit(true ,{0x0F ,0xAF} ,dst ,src);
+}
+
+void X86Assembler::test(Reg a ,Reg b)
+{
+    emit(true ,{0x85} ,b ,Operand::of(a));
+}
+
+void X86Assembler::neg(const Operand& operand)
+{
+    emit(true ,{0xF7} ,3 ,operand);
+}
+
+void X86Assembler::cqo()
+{
+    byte(0x48);
+    byte(0x99);
+}
+
+void X86Assembler::idiv(const Operand& divisor)
+{
+    emit(true ,{0xF7} ,7 ,divisor);
+}
+
+void X86Assembler::set(Condition condition ,Reg dst)
+{
+    emit(false ,{0x0F ,static_cast<uint8_t>(0x90 | static_cast<uint8_t>(condition))} ,0 ,Operand::of(dst) ,0 ,true);
+    emit(true ,{0x0F ,0xB6} ,dst ,Operand::of(dst)); // movzx
+}
+
+void X86Assembler::push(const Operand& operand)
+{
+    if (!operand.isRegister())
+    {
+        emit(false ,{0xFF} ,6 ,operand);
+        return;
+    }
+    if (operand.reg >= r8)
+        byte(0x41);
+    byte(0x50 | (operand.reg & 7));
+}
+
+void X86Assembler::pop(const Operand& operand)
+{
+    if (!operand.isRegister())
+    {
+        emit(false ,{0x8F} ,0 ,operand);
+        return;
+    }
+    if (operand.reg >= r8)
+        byte(0x41);
+    byte(0x58 | (operand.reg & 7));
+}
+
+void X86Assembler::jump(Label label)
+{
+    byte(0xE9);
+    rel32(label);
+}
+
+void X86Assembler::jump(Condition condition ,Label label)
+{
+    byte(0x0F);
+    byte(0x80 | static_cast<uint8_t>(condition));
+    rel32(label);
+}
+
+void X86Assembler::call(Label label)
+{
+    byte(0xE8);
+    rel32(label);
+}
+
+void X86Assembler::callExternal(uint32_t symbol)
+{
+    byte(0xE8);
+    object_.addRelocation(size() ,symbol ,ElfObject::kPLT32 ,-4);
+    int32(0);
+}
+
+void X86Assembler::ret()
+{
+    byte(0xC3);
+}
+
+void X86Assembler::finish()
+{
+    for (const Fixup& fixup : fixups_)
+    {
+        if (labels_[fixup.label] == kUnbound)
+            throw std::runtime_error("a jump goes to a label that isnt bound");
+        const auto distance = static_cast<int32_t>(int64_t(labels_[fixup.label]) - int64_t(fixup.at + 4));
+        std::memcpy(object_.text.data() + fixup.at ,&distance ,sizeof(distance));
+    }
+    fixups_.clear();
+}
@@ -0,0 +1,990 @@
+#include <algorithm>
+#include <cctype>
+#include <climits>
+#include <filesystem>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "passmanager.h"
+#include "x86assembler.h"
+#include "x86backend.h"
+
+using namespace Compiler;
+
+namespace {
+
+using Op = Bytecode::Op;
+using Reg = X86Assembler::Reg;
+using Operand = X86Assembler::Operand;
+using Condition = X86Assembler::Condition;
+using Alu = X86Assembler::Alu;
+using Label = X86Assembler::Label;
+
+// rax, rcx, rdx and r11 are the scratch registers of the instructions, rsp and rbp hold the frame
+constexpr Reg kCallerSaved[] = {X86Assembler::rsi ,X86Assembler::rdi ,X86Assembler::r8 ,X86Assembler::r9 ,X86Assembler::r10};
+constexpr Reg kCalleeSaved[] = {X86Assembler::rbx ,X86Assembler::r12 ,X86Assembler::r13 ,X86Assembler::r14 ,X86Assembler::r15};
+constexpr Reg kArguments[] = {X86Assembler::rdi ,X86Assembler::rsi ,X86Assembler::rdx ,X86Assembler::rcx ,X86Assembler::r8 ,X86Assembler::r9};
+constexpr size_t kArgumentRegisters = sizeof(kArguments) / sizeof(kArguments[0]);
+
+bool fitsInt32(int64_t value) { return value >= INT32_MIN && value <= INT32_MAX; }
+
+std::string nameOf(SymbolId id)
+{
+    return std::string(symbols().lookup(id));
+}
+
+// name as a C identifier
+std::string identifier(std::string name)
+{
+    for (char& c : name)
+        if (!std::isalnum(static_cast<unsigned char>(c)))
+            c = '_';
+    if (name.empty() || std::isdigit(static_cast<unsigned char>(name[0])))
+        name.insert(name.begin() ,'_');
+    return name;
+}
+
+bool isCalleeSaved(Reg reg)
+{
+    return std::find(std::begin(kCalleeSaved) ,std::end(kCalleeSaved) ,reg) != std::end(kCalleeSaved);
+}
+
+// if the instruction calls a function, which may change the caller saved registers
+bool isCall(const Bytecode::Instruction& instruction)
+{
+    switch (instruction.op)
+    {
+        case Op::Call:
+        case Op::CreateDomain:
+        case Op::DeleteDomain:
+        case Op::NewCell:
+            return true;
+        case Op::CallBuiltin:
+            return static_cast<Bytecode::Builtin>(instruction.target) == Bytecode::Builtin::Pow;
+        default:
+            return false;
+    }
+}
+
+// visit with each register the instruction reads or writes
+template <typename F>
+void forEachRegister(const Bytecode::Instruction& instruction ,F&& visit)
+{
+    Bytecode::forEachRead(instruction ,visit);
+    if (const uint16_t reg = Bytecode::written(instruction); reg != Bytecode::kNoRegister)
+        visit(reg);
+}
+
+// where the registers of a function are, by linear scan over their live intervals
+struct Allocation
+{
+    std::vector<Operand> locations {};
+    std::vector<bool> isUsed {};
+    std::vector<Reg> saved {}; // the callee saved registers it uses
+    size_t spillCount = 0;
+};
+
+Allocation allocateRegisters(const Bytecode& program ,size_t function ,size_t begin ,size_t end)
+{
+    struct Interval
+    {
+        int64_t start = INT64_MAX;
+        int64_t end = -1;
+        bool crossesCall = false;
+        int64_t slot = -1; // if it is spilled
+        Reg reg = X86Assembler::rax;
+    };
+
+    const Bytecode::Function& info = program.functions[function];
+    std::vector<Interval> intervals(info.registerCount);
+    std::vector<int64_t> calls;
+    bool jumpsBack = false;
+
+    for (uint16_t i = 0; i < info.parameterCount; i++) // set on entry
+        intervals[i].start = -1;
+    for (size_t k = begin; k < end; k++)
+    {
+        const Bytecode::Instruction& instruction = program.code[k];
+        const auto position = static_cast<int64_t>(k - begin);
+        forEachRegister(instruction ,[&](uint16_t reg)
+        {
+            intervals[reg].start = std::min(intervals[reg].start ,position);
+            intervals[reg].end = std::max(intervals[reg].end ,position);
+        });
+        if (isCall(instruction))
+            calls.push_back(position);
+        if (Bytecode::isJump(instruction.op) && instruction.target <= k)
+            jumpsBack = true;
+    }
+
+    // a value is live from its first write to its last read when jumps only go forward,
+    // a loop would keep it alive in all of the function
+    for (Interval& interval : intervals)
+    {
+        if (interval.end < 0)
+            continue;
+        if (jumpsBack)
+        {
+            interval.start = -1;
+            interval.end = static_cast<int64_t>(end - begin);
+        }
+        auto call = std::upper_bound(calls.begin() ,calls.end() ,interval.start);
+        interval.crossesCall = call != calls.end() && *call < interval.end;
+    }
+
+    std::vector<uint16_t> order;
+    for (uint16_t i = 0; i < intervals.size(); i++)
+        if (intervals[i].end >= 0)
+            order.push_back(i);
+    std::stable_sort(order.begin() ,order.end() ,[&](uint16_t a ,uint16_t b) { return intervals[a].start < intervals[b].start; });
+
+    std::vector<Reg> freeCallerSaved(std::rbegin(kCallerSaved) ,std::rend(kCallerSaved));
+    std::vector<Reg> freeCalleeSaved(std::rbegin(kCalleeSaved) ,std::rend(kCalleeSaved));
+    std::vector<uint16_t> active;
+    std::vector<bool> isSaved(16);
+    Allocation allocation;
+
+    auto take = [](std::vector<Reg>& registers)
+    {
+        const Reg reg = registers.back();
+        registers.pop_back();
+        return reg;
+    };
+
+    for (uint16_t current : order)
+    {
+        Interval& interval = intervals[current];
+
+        // the ones that ended before it starts give their registers back, the
+        // ones that end where it starts are still read by that instruction
+        for (size_t i = 0; i < active.size();)
+        {
+            const Interval& other = intervals[active[i]];
+            if (other.end >= interval.start)
+            {
+                i++;
+                continue;
+            }
+            (isCalleeSaved(other.reg) ? freeCalleeSaved : freeCallerSaved).push_back(other.reg);
+            active.erase(active.begin() + static_cast<std::ptrdiff_t>(i));
+        }
+
+        if (!interval.crossesCall && !freeCallerSaved.empty())
+            interval.reg = take(freeCallerSaved);
+        else if (!freeCalleeSaved.empty())
+            interval.reg = take(freeCalleeSaved);
+        else
+        {
+            // spill the one that lives the longest, it or one it can take the register of
+            auto longest = active.end();
+            for (auto it = active.begin(); it != active.end(); ++it)
+                if ((!interval.crossesCall || isCalleeSaved(intervals[*it].reg))
+                    && (longest == active.end() || intervals[*it].end > intervals[*longest].end))
+                    longest = it;
+
+            if (longest == active.end() || intervals[*longest].end <= interval.end)
+            {
+                interval.slot = static_cast<int64_t>(allocation.spillCount++);
+                continue;
+            }
+            Interval& spilled = intervals[*longest];
+            interval.reg = spilled.reg;
+            spilled.slot = static_cast<int64_t>(allocation.spillCount++);
+            active.erase(longest);
+        }
+        isSaved[interval.reg] = isSaved[interval.reg] || isCalleeSaved(interval.reg);
+        active.push_back(current);
+    }
+
+    for (Reg reg : kCalleeSaved)
+        if (isSaved[reg])
+            allocation.saved.push_back(reg);
+
+    // the spill slots are below the saved registers
+    allocation.locations.resize(intervals.size());
+    allocation.isUsed.resize(intervals.size());
+    for (size_t i = 0; i < intervals.size(); i++)
+    {
+        const Interval& interval = intervals[i];
+        allocation.isUsed[i] = interval.end >= 0;
+        allocation.locations[i] = interval.slot < 0 ? Operand::of(interval.reg)
+            : Operand::memory(X86Assembler::rbp ,static_cast<int32_t>(-8 * (int64_t(allocation.saved.size()) + 1 + interval.slot)));
+    }
+    return allocation;
+}
+
+// the code of each function, from its entry to the next one's
+std::vector<std::pair<size_t ,size_t>> functionRanges(const Bytecode& program)
+{
+    std::vector<size_t> entries;
+    for (const auto& function : program.functions)
+        entries.push_back(function.entry);
+    std::sort(entries.begin() ,entries.end());
+    std::vector<std::pair<size_t ,size_t>> ranges;
+    for (const auto& function : program.functions)
+    {
+        auto next = std::upper_bound(entries.begin() ,entries.end() ,size_t(function.entry));
+        ranges.push_back({function.entry ,next == entries.end() ? program.code.size() : *next});
+    }
+    return ranges;
+}
+
+// The state before each instruction of [begin ,end) the code from begin on reaches, by
+// transfer(k ,state) for what instruction k does and merge(into ,state) where paths join,
+// which returns if into changed.
+template <typename State ,typename Transfer ,typename Merge>
+std::vector<std::optional<State>> flow(const Bytecode& program ,size_t begin ,size_t end ,State entry ,Transfer&& transfer ,Merge&& merge)
+{
+    std::vector<std::optional<State>> states(end - begin);
+    std::vector<size_t> work;
+    auto reach = [&](size_t k ,const State& state)
+    {
+        if (k >= end)
+            return;
+        std::optional<State>& into = states[k - begin];
+        if (!into)
+            into = state;
+        else if (!merge(*into ,state))
+            return;
+        work.push_back(k);
+    };
+
+    reach(begin ,entry);
+    while (!work.empty())
+    {
+        const size_t k = work.back();
+        work.pop_back();
+        const Bytecode::Instruction& instruction = program.code[k];
+        State state = *states[k - begin];
+        transfer(k ,state);
+        if (Bytecode::isJump(instruction.op))
+            reach(instruction.target ,state);
+        if (instruction.op != Op::Jump && instruction.op != Op::Return && instruction.op != Op::Fail && instruction.op != Op::Halt)
+            reach(k + 1 ,state);
+    }
+    return states;
+}
+
+// Native code has no undefined, what the VM gets as undefined is 0 here. That computes the
+// same while only moves, returns and truth tests (where both are false) read it, so this
+// rejects programs where anything else could, and finds the divisions that cant be by 0.
+struct UndefinedCheck
+{
+    const Bytecode& program;
+    std::vector<std::pair<size_t ,size_t>> ranges {};
+    std::vector<bool> returnsUndefined {}; // of each function
+    std::vector<bool> isNonZeroDivisor {}; // of each instruction, a division by a constant other than 0
+
+    // of a register
+    static constexpr uint8_t kUndefined = 1; // it can be undefined
+    static constexpr uint8_t kNonZero = 2; // it is a constant other than 0
+
+    explicit UndefinedCheck(const Bytecode& program)
+        : program (program)
+        ,ranges (functionRanges(program))
+        ,returnsUndefined (program.functions.size())
+        ,isNonZeroDivisor (program.code.size())
+    {
+        // what a function returns depends on the functions it calls, until nothing changes
+        bool isChanged = true;
+        while (isChanged)
+        {
+            isChanged = false;
+            for (size_t i = 0; i < program.functions.size(); i++)
+                isChanged |= check(i ,false);
+        }
+        for (size_t i = 0; i < program.functions.size(); i++)
+            check(i ,true);
+        checkGlobals();
+    }
+
+    std::string nameOf(size_t function) const
+    {
+        return function == 0 ? "the top level code" : ::nameOf(program.functions[function].name);
+    }
+
+    // Returns if it found that the function can return undefined.
+    bool check(size_t function ,bool isFailing)
+    {
+        const auto [begin ,end] = ranges[function];
+        auto transfer = [&](size_t k ,std::vector<uint8_t>& registers)
+        {
+            const Bytecode::Instruction& instruction = program.code[k];
+            uint8_t flags = 0;
+            switch (instruction.op)
+            {
+                case Op::Move:
+                    flags = registers[instruction.b];
+                    break;
+                case Op::LoadConst:
+                {
+                    const RuntimeValue& value = program.constants[instruction.target];
+                    flags = value.type == RuntimeValue::Type::Undefined ? kUndefined
+                        : value.type == RuntimeValue::Type::Int && value.i != 0 ? kNonZero : 0;
+                    break;
+                }
+                case Op::Divide:
+                case Op::Modulo:
+                    flags = registers[instruction.c] & kNonZero ? 0 : kUndefined;
+                    break;
+                case Op::Call:
+                    flags = returnsUndefined[instruction.target] ? kUndefined : 0;
+                    break;
+                default:
+                    break;
+            }
+            if (const uint16_t reg = Bytecode::written(instruction); reg != Bytecode::kNoRegister)
+                registers[reg] = flags;
+        };
+        auto merge = [](std::vector<uint8_t>& into ,const std::vector<uint8_t>& registers)
+        {
+            bool isChanged = false;
+            for (size_t i = 0; i < into.size(); i++)
+            {
+                const uint8_t flags = ((into[i] | registers[i]) & kUndefined) | (into[i] & registers[i] & kNonZero);
+                isChanged |= flags != into[i];
+                into[i] = flags;
+            }
+            return isChanged;
+        };
+        const auto states = flow(program ,begin ,end ,std::vector<uint8_t>(program.functions[function].registerCount) ,transfer ,merge);
+
+        bool isReturningUndefined = false;
+        for (size_t k = begin; k < end; k++)
+        {
+            if (!states[k - begin])
+                continue;
+            const std::vector<uint8_t>& registers = *states[k - begin];
+            const Bytecode::Instruction& instruction = program.code[k];
+            switch (instruction.op)
+            {
+                case Op::Move:
+                case Op::Not:
+                case Op::Truth:
+                case Op::JumpIfFalse:
+                case Op::JumpIfTrue:
+                    break;
+                case Op::Return:
+                    isReturningUndefined |= (registers[instruction.a] & kUndefined) != 0;
+                    break;
+                default:
+                    if (isFailing)
+                        Bytecode::forEachRead(instruction ,[&](uint16_t reg)
+                        {
+                            if (registers[reg] & kUndefined)
+                                throw std::runtime_error(nameOf(function) + " uses a value that can be undefined, native code has no undefined");
+                        });
+                    if (instruction.op == Op::Divide || instruction.op == Op::Modulo)
+                        isNonZeroDivisor[k] = (registers[instruction.c] & kNonZero) != 0;
+                    break;
+            }
+        }
+        const bool isChanged = isReturningUndefined && !returnsUndefined[function];
+        returnsUndefined[function] = returnsUndefined[function] || isReturningUndefined;
+        return isChanged;
+    }
+
+    // A global is undefined until something gives it a value, so the top level code has
+    // to before it reads it or calls a function that reads it.
+    void checkGlobals() const
+    {
+        // the globals each function reads, with the functions it calls
+        std::vector<std::vector<bool>> reads(program.functions.size() ,std::vector<bool>(program.globalCount));
+        std::vector<std::vector<uint32_t>> calls(program.functions.size());
+        for (size_t i = 0; i < program.functions.size(); i++)
+            for (size_t k = ranges[i].first; k < ranges[i].second; k++)
+            {
+                const Bytecode::Instruction& instruction = program.code[k];
+                if (instruction.op == Op::LoadGlobal)
+                    reads[i][instruction.target] = true;
+                else if (instruction.op == Op::Call)
+                    calls[i].push_back(instruction.target);
+            }
+        bool isChanged = true;
+        while (isChanged)
+        {
+            isChanged = false;
+            for (size_t i = 0; i < program.functions.size(); i++)
+                for (uint32_t callee : calls[i])
+                    for (size_t global = 0; global < program.globalCount; global++)
+                        if (reads[callee][global] && !reads[i][global])
+                        {
+                            reads[i][global] = true;
+                            isChanged = true;
+                        }
+        }
+
+        // the globals that have a value on every path to an instruction
+        auto transfer = [&](size_t k ,std::vector<bool>& written)
+        {
+            const Bytecode::Instruction& instruction = program.code[k];
+            if (instruction.op == Op::StoreGlobal || instruction.op == Op::DefineGlobal)
+                written[instruction.target] = true;
+        };
+        auto merge = [](std::vector<bool>& into ,const std::vector<bool>& written)
+        {
+            bool isChanged = false;
+            for (size_t i = 0; i < into.size(); i++)
+                if (into[i] && !written[i])
+                {
+                    into[i] = false;
+                    isChanged = true;
+                }
+            return isChanged;
+        };
+        const auto [begin ,end] = ranges[0];
+        const auto states = flow(program ,begin ,end ,std::vector<bool>(program.globalCount) ,transfer ,merge);
+        for (size_t k = begin; k < end; k++)
+        {
+            const Bytecode::Instruction& instruction = program.code[k];
+            if (!states[k - begin])
+                continue;
+            const std::vector<bool>& written = *states[k - begin];
+            if (instruction.op == Op::LoadGlobal && !written[instruction.target])
+                throw std::runtime_error(nameOf(0) + " reads a variable before it has a value, native code has no undefined");
+            if (instruction.op == Op::Call)
+                for (size_t global = 0; global < program.globalCount; global++)
+                    if (reads[instruction.target][global] && !written[global])
+                        throw std::runtime_error(nameOf(0) + " calls " + nameOf(instruction.target)
+                            + " before a variable it reads has a value, native code has no undefined");
+        }
+    }
+};
+
+// lowers the functions of a program one after another
+struct Lowering
+{
+    const Bytecode& program;
+    ElfObject& object;
+    X86Assembler assembler;
+    std::vector<Label> functions {};
+    std::vector<Label> instructions {}; // one for each of program.code
+    std::unordered_map<std::string ,Label> failures {}; // calls of nativeFail() by message
+    std::vector<std::pair<Label ,uint32_t>> messages {}; // the failures and where their messages are
+    uint32_t globals = 0; // the symbol of .bss
+    std::unordered_map<std::string ,uint32_t> externals {};
+    std::vector<bool> isNonZeroDivisor {}; // see UndefinedCheck
+
+    // of the function being lowered
+    std::string name {};
+    Allocation allocation {};
+    Label epilogue = 0;
+    size_t position = 0; // of the instruction being lowered in program.code
+    bool isLast = false; // it is the function's last one
+
+    Lowering(const Bytecode& program ,ElfObject& object)
+        : program (program)
+        ,object (object)
+        ,assembler (object)
+        ,globals (object.sectionSymbol(ElfObject::Section::Bss))
+    {}
+
+    [[noreturn]] static void fail(const std::string& msg) { throw std::runtime_error(msg); }
+
+    uint32_t external(const std::string& function)
+    {
+        auto [it ,isNew] = externals.try_emplace(function ,0);
+        if (isNew)
+            it->second = object.addExternal(function);
+        return it->second;
+    }
+
+    // a jump there fails with msg
+    Label failure(const std::string& msg)
+    {
+        auto [it ,isNew] = failures.try_emplace(msg ,0);
+        if (isNew)
+        {
+            it->second = assembler.newLabel();
+            messages.push_back({it->second ,static_cast<uint32_t>(object.readOnly.size())});
+            object.readOnly.insert(object.readOnly.end() ,msg.begin() ,msg.end());
+            object.readOnly.push_back('\0');
+        }
+        return it->second;
+    }
+
+    Label overflow(const char* op) { return failure(std::string("integer overflow in ") + op); }
+
+    int64_t constant(uint32_t index) const
+    {
+        const RuntimeValue& value = program.constants[index];
+        switch (value.type)
+        {
+            case RuntimeValue::Type::Int: return value.i;
+            case RuntimeValue::Type::Undefined: return 0;
+            default: fail(name + " uses " + formatValue(toValue(value)) + ", native code only has ints yet");
+        }
+    }
+
+    const Operand& at(uint16_t reg) const { return allocation.locations[reg]; }
+
+    // reg in a register, scratch if it isnt in one
+    Reg load(uint16_t reg ,Reg scratch)
+    {
+        if (at(reg).isRegister())
+            return at(reg).reg;
+        assembler.mov(scratch ,at(reg));
+        return scratch;
+    }
+
+    void store(uint16_t reg ,Reg value)
+    {
+        if (at(reg) != Operand::of(value))
+            assembler.mov(at(reg) ,value);
+    }
+
+    // where an instruction computes the value of reg, avoiding is read after that
+    Reg target(uint16_t reg ,uint16_t avoiding)
+    {
+        return at(reg).isRegister() && at(reg) != at(avoiding) ? at(reg).reg : X86Assembler::rax;
+    }
+
+    // targets[i] = sources[i] for all of them at once, through the stack if a
+    // move would overwrite a source that is still to be read
+    void moveAll(const std::vector<Operand>& targets ,const std::vector<Operand>& sources)
+    {
+        bool isOrdered = true;
+        for (size_t i = 0; i < targets.size(); i++)
+            for (size_t j = i + 1; j < sources.size(); j++)
+                isOrdered = isOrdered && targets[i] != sources[j];
+
+        if (!isOrdered)
+        {
+            for (const Operand& source : sources)
+                assembler.push(source);
+            for (size_t i = targets.size(); i-- > 0;)
+                assembler.pop(targets[i]);
+            return;
+        }
+        for (size_t i = 0; i < targets.size(); i++)
+        {
+            if (targets[i] == sources[i])
+                continue;
+            if (targets[i].isRegister())
+                assembler.mov(targets[i].reg ,sources[i]);
+            else if (sources[i].isRegister())
+                assembler.mov(targets[i] ,sources[i].reg);
+            else
+            {
+                assembler.mov(X86Assembler::rax ,sources[i]);
+                assembler.mov(targets[i] ,X86Assembler::rax);
+            }
+        }
+    }
+
+    // the count values from first on in the argument registers and on the stack,
+    // returns the bytes to pop after the call
+    int32_t passArguments(uint16_t first ,uint16_t count)
+    {
+        const size_t onStack = count > kArgumentRegisters ? count - kArgumentRegisters : 0;
+        const int32_t padding = onStack % 2 ? 8 : 0; // the stack is 16 byte aligned at calls
+        if (padding)
+            assembler.alu(Alu::Sub ,Operand::of(X86Assembler::rsp) ,padding);
+        for (size_t i = count; i-- > kArgumentRegisters;)
+            assembler.push(at(static_cast<uint16_t>(first + i)));
+
+        std::vector<Operand> targets ,sources;
+        for (size_t i = 0; i < std::min<size_t>(count ,kArgumentRegisters); i++)
+        {
+            targets.push_back(Operand::of(kArguments[i]));
+            sources.push_back(at(static_cast<uint16_t>(first + i)));
+        }
+        moveAll(targets ,sources);
+        return static_cast<int32_t>(onStack * 8) + padding;
+    }
+
+    void dropArguments(int32_t bytes)
+    {
+        if (bytes)
+            assembler.alu(Alu::Add ,Operand::of(X86Assembler::rsp) ,bytes);
+    }
+
+    void prologue(const Bytecode::Function& function)
+    {
+        assembler.push(Operand::of(X86Assembler::rbp));
+        assembler.mov(X86Assembler::rbp ,Operand::of(X86Assembler::rsp));
+        for (Reg reg : allocation.saved)
+            assembler.push(Operand::of(reg));
+        int64_t frame = int64_t(allocation.spillCount) * 8;
+        if ((allocation.saved.size() + allocation.spillCount) % 2)
+            frame += 8;
+        if (frame > INT32_MAX)
+            fail(name + " has too many values for its stack frame");
+        if (frame)
+            assembler.alu(Alu::Sub ,Operand::of(X86Assembler::rsp) ,static_cast<int32_t>(frame));
+
+        // the parameters to where they were allocated
+        const size_t inRegisters = std::min<size_t>(function.parameterCount ,kArgumentRegisters);
+        std::vector<Operand> targets ,sources;
+        for (size_t i = 0; i < inRegisters; i++)
+        {
+            if (!allocation.isUsed[i])
+                continue;
+            targets.push_back(at(static_cast<uint16_t>(i)));
+            sources.push_back(Operand::of(kArguments[i]));
+        }
+        moveAll(targets ,sources);
+        for (size_t i = inRegisters; i < function.parameterCount; i++)
+        {
+            if (!allocation.isUsed[i])
+                continue;
+            const auto reg = static_cast<uint16_t>(i);
+            const Operand caller = Operand::memory(X86Assembler::rbp ,static_cast<int32_t>(16 + 8 * (i - kArgumentRegisters)));
+            const Reg value = at(reg).isRegister() ? at(reg).reg : X86Assembler::rax;
+            assembler.mov(value ,caller);
+            store(reg ,value);
+        }
+    }
+
+    void function(size_t index ,size_t begin ,size_t end ,const std::string& symbol)
+    {
+        const Bytecode::Function& function = program.functions[index];
+        name = index == 0 ? "the top level code" : symbol;
+        allocation = allocateRegisters(program ,index ,begin ,end);
+        epilogue = assembler.newLabel();
+
+        const size_t start = assembler.size();
+        assembler.bind(functions[index]);
+        prologue(function);
+        for (size_t k = begin; k < end; k++)
+        {
+            assembler.bind(instructions[k]);
+            position = k;
+            isLast = k + 1 == end; // the epilogue is right after it
+            if (!isLast || program.code[k].op != Op::Halt)
+                instruction(program.code[k]);
+        }
+
+        assembler.bind(epilogue);
+        assembler.lea(X86Assembler::rsp ,Operand::memory(X86Assembler::rbp ,-8 * static_cast<int32_t>(allocation.saved.size())));
+        for (auto it = allocation.saved.rbegin(); it != allocation.saved.rend(); ++it)
+            assembler.pop(Operand::of(*it));
+        assembler.pop(Operand::of(X86Assembler::rbp));
+        assembler.ret();
+
+        // a specialized clone (f<n=1>) has no name C could call it by, only this object calls it
+        object.addSymbol(symbol ,ElfObject::Section::Text ,start ,assembler.size() - start ,true ,symbol == identifier(symbol));
+    }
+
+    void arithmetic(const Bytecode::Instruction& instruction ,const char* op)
+    {
+        const Reg value = target(instruction.a ,instruction.c);
+        if (at(instruction.b) != Operand::of(value))
+            assembler.mov(value ,at(instruction.b));
+        switch (instruction.op)
+        {
+            case Op::Add: assembler.alu(Alu::Add ,value ,at(instruction.c)); break;
+            case Op::Subtract: assembler.alu(Alu::Sub ,value ,at(instruction.c)); break;
+            default: assembler.imul(value ,at(instruction.c)); break;
+        }
+        assembler.jump(Condition::Overflow ,overflow(op));
+        store(instruction.a ,value);
+    }
+
+    // a / 0 is undefined, so 0 (see UndefinedCheck), and MIN / -1 overflows
+    void division(const Bytecode::Instruction& instruction ,bool isNonZero)
+    {
+        const bool isModulo = instruction.op == Op::Modulo;
+        const Label divide = assembler.newLabel();
+        const Label zero = assembler.newLabel();
+        const Label done = assembler.newLabel();
+
+        assembler.mov(X86Assembler::rcx ,at(instruction.c));
+        if (!isNonZero)
+        {
+            assembler.test(X86Assembler::rcx ,X86Assembler::rcx);
+            assembler.jump(Condition::Equal ,zero);
+        }
+        assembler.mov(X86Assembler::rax ,at(instruction.b));
+        assembler.alu(Alu::Cmp ,Operand::of(X86Assembler::rcx) ,-1);
+        assembler.jump(Condition::NotEqual ,divide);
+        assembler.neg(Operand::of(X86Assembler::rax));
+        assembler.jump(Condition::Overflow ,overflow(isModulo ? "%" : "/"));
+        if (!isModulo)
+            assembler.jump(done);
+        assembler.bind(zero); // x % -1 too
+        assembler.mov(Operand::of(X86Assembler::rax) ,0);
+        assembler.jump(done);
+
+        assembler.bind(divide);
+        assembler.cqo();
+        assembler.idiv(Operand::of(X86Assembler::rcx));
+        if (isModulo)
+            assembler.mov(X86Assembler::rax ,Operand::of(X86Assembler::rdx));
+        assembler.bind(done);
+        store(instruction.a ,X86Assembler::rax);
+    }
+
+    void comparison(const Bytecode::Instruction& instruction ,Condition condition)
+    {
+        const Reg lhs = load(instruction.b ,X86Assembler::rax);
+        assembler.alu(Alu::Cmp ,lhs ,at(instruction.c));
+        assembler.set(condition ,X86Assembler::rax);
+        store(instruction.a ,X86Assembler::rax);
+    }
+
+    // jumps to target unless a compares to b (or the constant b) with condition
+    void branchUnless(const Bytecode::Instruction& instruction ,Condition condition ,bool isConstant)
+    {
+        if (!isConstant)
+            assembler.alu(Alu::Cmp ,load(instruction.a ,X86Assembler::rax) ,at(instruction.b));
+        else if (const int64_t value = constant(instruction.b); fitsInt32(value))
+            assembler.alu(Alu::Cmp ,at(instruction.a) ,static_cast<int32_t>(value));
+        else
+        {
+            assembler.mov(Operand::of(X86Assembler::rcx) ,value);
+            assembler.alu(Alu::Cmp ,load(instruction.a ,X86Assembler::rax) ,Operand::of(X86Assembler::rcx));
+        }
+        // the opposite condition is the one with the lowest bit flipped
+        assembler.jump(static_cast<Condition>(static_cast<uint8_t>(condition) ^ 1) ,instructions[instruction.target]);
+    }
+
+    void builtin(const Bytecode::Instruction& instruction)
+    {
+        const bool isPow = static_cast<Bytecode::Builtin>(instruction.target) == Bytecode::Builtin::Pow;
+        const uint16_t count = isPow ? 2 : 1;
+        if (instruction.b != count)
+        {
+            assembler.jump(failure(std::string(isPow ? "pow" : "abs") + "@Functions takes " + std::to_string(count)
+                + " arguments but got " + std::to_string(instruction.b)));
+            return;
+        }
+
+        if (isPow)
+        {
+            const int32_t bytes = passArguments(instruction.a ,2);
+            assembler.callExternal(external("nativePow"));
+            dropArguments(bytes);
+            store(instruction.a ,X86Assembler::rax);
+            return;
+        }
+
+        const Label positive = assembler.newLabel();
+        assembler.mov(X86Assembler::rax ,at(instruction.a));
+        assembler.test(X86Assembler::rax ,X86Assembler::rax);
+        assembler.jump(Condition::NotSign ,positive);
+        assembler.neg(Operand::of(X86Assembler::rax));
+        assembler.jump(Condition::Overflow ,overflow("-"));
+        assembler.bind(positive);
+        store(instruction.a ,X86Assembler::rax);
+    }
+
+    void instruction(const Bytecode::Instruction& instruction)
+    {
+        const uint16_t a = instruction.a;
+        const uint16_t b = instruction.b;
+        auto global = [&] { return Operand::at(globals ,static_cast<int32_t>(instruction.target * 8)); };
+
+        switch (instruction.op)
+        {
+            case Op::Move:
+                if (at(a) != at(b))
+                    store(a ,load(b ,X86Assembler::rax));
+                return;
+            case Op::LoadConst:
+                assembler.mov(at(a) ,constant(instruction.target));
+                return;
+            case Op::LoadGlobal:
+            {
+                const Reg value = at(a).isRegister() ? at(a).reg : X86Assembler::rax;
+                assembler.mov(value ,global());
+                store(a ,value);
+                return;
+            }
+            case Op::StoreGlobal:
+            case Op::DefineGlobal:
+                assembler.mov(global() ,load(a ,X86Assembler::rax));
+                return;
+            case Op::LoadCell: // the global of a cell has it once it is read (see UndefinedCheck::checkGlobals())
+                assembler.mov(X86Assembler::rax ,at(b));
+                assembler.mov(X86Assembler::rax ,Operand::memory(X86Assembler::rax ,0));
+                store(a ,X86Assembler::rax);
+                return;
+            case Op::StoreCell:
+                assembler.mov(X86Assembler::rax ,at(a));
+                assembler.test(X86Assembler::rax ,X86Assembler::rax);
+                assembler.jump(Condition::Equal ,failure("a variable on a domain is assigned before it is declared"));
+                assembler.mov(Operand::memory(X86Assembler::rax ,0) ,load(b ,X86Assembler::rcx));
+                return;
+            case Op::Add: arithmetic(instruction ,"+"); return;
+            case Op::Subtract: arithmetic(instruction ,"-"); return;
+            case Op::Multiply: arithmetic(instruction ,"*"); return;
+            case Op::Divide:
+            case Op::Modulo:
+                division(instruction ,isNonZeroDivisor[position]);
+                return;
+            case Op::AddConst:
+            case Op::SubtractConst:
+            {
+                const bool isAdd = instruction.op == Op::AddConst;
+                const int64_t value = constant(instruction.c);
+                const Reg result = at(a).isRegister() ? at(a).reg : X86Assembler::rax;
+                if (at(b) != Operand::of(result))
+                    assembler.mov(result ,at(b));
+                if (fitsInt32(value))
+                    assembler.alu(isAdd ? Alu::Add : Alu::Sub ,Operand::of(result) ,static_cast<int32_t>(value));
+                else
+                {
+                    assembler.mov(Operand::of(X86Assembler::rcx) ,value);
+                    assembler.alu(isAdd ? Alu::Add : Alu::Sub ,result ,Operand::of(X86Assembler::rcx));
+                }
+                assembler.jump(Condition::Overflow ,overflow(isAdd ? "+" : "-"));
+                store(a ,result);
+                return;
+            }
+            case Op::Equal: comparison(instruction ,Condition::Equal); return;
+            case Op::NotEqual: comparison(instruction ,Condition::NotEqual); return;
+            case Op::Less: comparison(instruction ,Condition::Less); return;
+            case Op::LessEqual: comparison(instruction ,Condition::LessEqual); return;
+            case Op::Greater: comparison(instruction ,Condition::Greater); return;
+            case Op::GreaterEqual: comparison(instruction ,Condition::GreaterEqual); return;
+            case Op::Negate:
+            {
+                const Reg result = at(a).isRegister() ? at(a).reg : X86Assembler::rax;
+                if (at(b) != Operand::of(result))
+                    assembler.mov(result ,at(b));
+                assembler.neg(Operand::of(result));
+                assembler.jump(Condition::Overflow ,overflow("-"));
+                store(a ,result);
+                return;
+            }
+            case Op::Not:
+            case Op::Truth:
+                assembler.alu(Alu::Cmp ,at(b) ,0);
+                assembler.set(instruction.op == Op::Not ? Condition::Equal : Condition::NotEqual ,X86Assembler::rax);
+                store(a ,X86Assembler::rax);
+                return;
+            case Op::Increment:
+            case Op::Decrement:
+                assembler.alu(instruction.op == Op::Increment ? Alu::Add : Alu::Sub ,at(a) ,1);
+                assembler.jump(Condition::Overflow ,overflow(instruction.op == Op::Increment ? "+" : "-"));
+                return;
+            case Op::Jump:
+                assembler.jump(instructions[instruction.target]);
+                return;
+            case Op::JumpIfFalse:
+            case Op::JumpIfTrue:
+                assembler.alu(Alu::Cmp ,at(a) ,0);
+                assembler.jump(instruction.op == Op::JumpIfFalse ? Condition::Equal : Condition::NotEqual ,instructions[instruction.target]);
+                return;
+            case Op::JumpUnlessEqual: branchUnless(instruction ,Condition::Equal ,false); return;
+            case Op::JumpUnlessNotEqual: branchUnless(instruction ,Condition::NotEqual ,false); return;
+            case Op::JumpUnlessLess: branchUnless(instruction ,Condition::Less ,false); return;
+            case Op::JumpUnlessLessEqual: branchUnless(instruction ,Condition::LessEqual ,false); return;
+            case Op::JumpUnlessGreater: branchUnless(instruction ,Condition::Greater ,false); return;
+            case Op::JumpUnlessGreaterEqual: branchUnless(instruction ,Condition::GreaterEqual ,false); return;
+            case Op::JumpUnlessEqualConst: branchUnless(instruction ,Condition::Equal ,true); return;
+            case Op::JumpUnlessNotEqualConst: branchUnless(instruction ,Condition::NotEqual ,true); return;
+            case Op::JumpUnlessLessConst: branchUnless(instruction ,Condition::Less ,true); return;
+            case Op::JumpUnlessLessEqualConst: branchUnless(instruction ,Condition::LessEqual ,true); return;
+            case Op::JumpUnlessGreaterConst: branchUnless(instruction ,Condition::Greater ,true); return;
+            case Op::JumpUnlessGreaterEqualConst: branchUnless(instruction ,Condition::GreaterEqual ,true); return;
+            case Op::Call:
+            {
+                const int32_t bytes = passArguments(a ,b);
+                assembler.call(functions[instruction.target]);
+                dropArguments(bytes);
+                store(a ,X86Assembler::rax);
+                return;
+            }
+            case Op::CallBuiltin:
+                builtin(instruction);
+                return;
+            case Op::Convert: // to an int, which it already is
+                if (b)
+                    fail(name + " has a double parameter, native code only has ints yet");
+                return;
+            case Op::Return:
+                assembler.mov(X86Assembler::rax ,at(a));
+                if (!isLast)
+                    assembler.jump(epilogue);
+                return;
+            case Op::CreateDomain:
+                assembler.callExternal(external("domainCreate"));
+                store(a ,X86Assembler::rax);
+                return;
+            case Op::DeleteDomain:
+            {
+                const Label done = assembler.newLabel();
+                assembler.mov(X86Assembler::rdi ,at(a));
+                assembler.test(X86Assembler::rdi ,X86Assembler::rdi);
+                assembler.jump(Condition::Equal ,done);
+                assembler.callExternal(external("domainDelete"));
+                assembler.bind(done);
+                assembler.mov(at(a) ,0);
+                return;
+            }
+            case Op::NewCell:
+                assembler.mov(X86Assembler::rdi ,at(b));
+                assembler.callExternal(external("nativeNewCell"));
+                store(a ,X86Assembler::rax);
+                return;
+            case Op::Fail:
+                assembler.jump(failure(program.messages[instruction.target]));
+                return;
+            case Op::Halt:
+                assembler.jump(epilogue);
+                return;
+        }
+    }
+
+    void lower(const std::string& init)
+    {
+        for (size_t i = 0; i < program.functions.size(); i++)
+            functions.push_back(assembler.newLabel());
+        for (size_t i = 0; i < program.code.size(); i++)
+            instructions.push_back(assembler.newLabel());
+
+        const UndefinedCheck check(program);
+        isNonZeroDivisor = check.isNonZeroDivisor;
+        for (size_t i = 0; i < program.functions.size(); i++)
+            function(i ,check.ranges[i].first ,check.ranges[i].second ,i == 0 ? init : nameOf(program.functions[i].name));
+
+        // the failures, out of the way of the code that doesnt fail
+        for (const auto& [label ,offset] : messages)
+        {
+            assembler.bind(label);
+            assembler.lea(X86Assembler::rdi ,Operand::at(object.sectionSymbol(ElfObject::Section::ReadOnly) ,static_cast<int32_t>(offset)));
+            assembler.callExternal(external("nativeFail"));
+        }
+        assembler.finish();
+
+        object.bssSize = uint64_t(program.globalCount) * 8;
+        for (const Bytecode::Result& result : program.results)
+            object.addSymbol(nameOf(result.name) ,ElfObject::Section::Bss ,uint64_t(result.global) * 8 ,8 ,false ,true);
+    }
+};
+
+} // namespace
+
+ElfObject Compiler::compileNative(const Bytecode& program ,const std::string& name)
+{
+    ElfObject object;
+    Lowering lowering(program ,object);
+    lowering.lower(identifier(name) + "_init");
+    return object;
+}
+
+bool Compiler::emitObject(const CompileContext& context ,const std::vector<const AST::ASTNode*>& statements)
+{
+    try
+    {
+        std::filesystem::path path = context.outputName;
+        if (path.extension() != ".o")
+            path += ".o";
+        Bytecode program = Bytecode::compile(statements);
+        if (context.optimize)
+            program = optimize(program ,context.timePasses);
+        compileNative(program ,path.stem().string()).write(path.string());
+        log("object " + path.string());
+        return true;
+    }
+    catch (const std::exception& e)
+    {
+        log(std::string("ERROR: ") + e.what() + ".");
+        return false;
+    }
+}
@@ -0,0 +1,15 @@
+# cmake -DCOMPILER=<Compiler> -DBLOCK=<file> -DSOURCE=<file to write> -P comparelexers.cmake
+# repeats BLOCK into SOURCE until it is big enough for the parallel lexer
+# (ParallelLexer::kMinFileSize), so chunk boundaries fall next to the strings
+# and chars on its lines, and fails if the parallel lexer gives other tokens
+# than the sequential one
+file(READ ${BLOCK} block)
+string(LENGTH "${block}" length)
+math(EXPR count "(9 * 1024 * 1024) / ${length} + 1")
+string(REPEAT "${block}" ${count} text)
+file(WRITE ${SOURCE} "${text}")
+execute_process(COMMAND ${COMPILER} --check-lex -j4 ${SOURCE} RESULT_VARIABLE result OUTPUT_VARIABLE output ERROR_VARIABLE output)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "--check-lex failed\n${output}")
+endif()
+message(STATUS "${output}")
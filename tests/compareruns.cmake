@@ -0,0 +1,8 @@
+# cmake -DCOMPILER=<Compiler> -DPROGRAM=<file> -P compareruns.cmake
+# fails if running PROGRAM with the optimization passes prints something else
+# than running it without them
+execute_process(COMMAND ${COMPILER} --run ${PROGRAM} OUTPUT_VARIABLE optimized ERROR_VARIABLE optimized)
+execute_process(COMMAND ${COMPILER} --run -O0 ${PROGRAM} OUTPUT_VARIABLE unoptimized ERROR_VARIABLE unoptimized)
+if(NOT optimized STREQUAL unoptimized)
+    message(FATAL_ERROR "--run printed\n${optimized}\nbut --run -O0 printed\n${unoptimized}")
+endif()